@@ -36,14 +36,6 @@ const ModemCdmaInterface = {
 };
 const ModemCdmaProxy = DBus.makeProxyClass(ModemCdmaInterface);
 
-let _providersTable;
-function _getProvidersTable() {
-    if (_providersTable)
-        return _providersTable;
-    let [providers, countryCodes] = Cinnamon.mobile_providers_parse();
-    return _providersTable = providers;
-}
-
 function ModemGsm() {
     this._init.apply(this, arguments);
 }
@@ -110,41 +102,12 @@ ModemGsm.prototype = {
     },
 
     _findProviderForMCCMNC: function(needle) {
-        let table = _getProvidersTable();
         let needlemcc = needle.substring(0, 3);
         let needlemnc = needle.substring(3, needle.length);
 
-        let name2, name3;
-        for (let iter in table) {
-            let providers = table[iter];
-
-            // Search through each country's providers
-            for (let i = 0; i < providers.length; i++) {
-                let provider = providers[i];
-
-                // Search through MCC/MNC list
-                let list = provider.get_gsm_mcc_mnc();
-                for (let j = 0; j < list.length; j++) {
-                    let mccmnc = list[j];
-
-                    // Match both 2-digit and 3-digit MNC; prefer a
-                    // 3-digit match if found, otherwise a 2-digit one.
-                    if (mccmnc.mcc != needlemcc)
-                        continue;  // MCC was wrong
-
-                    if (!name3 && needle.length == 6 && needlemnc == mccmnc.mnc)
-                        name3 = provider.name;
-
-                    if (!name2 && needlemnc.substring(0, 2) == mccmnc.mnc.substring(0, 2))
-                        name2 = provider.name;
-
-                    if (name2 && name3)
-                        break;
-                }
-            }
-        }
-
-        return name3 || name2 || null;
+        // Matches both 2-digit and 3-digit MNC; prefers a 3-digit
+        // match if found, otherwise a 2-digit one.
+        return Cinnamon.mobile_providers_find_for_mcc_mnc(needlemcc, needlemnc);
     }
 }
 Signals.addSignalMethods(ModemGsm.prototype);
@@ -200,26 +163,7 @@ ModemCdma.prototype = {
         if (sid == 0)
             return null;
 
-        let table = _getProvidersTable();
-
-        // Search through each country
-        for (let iter in table) {
-            let providers = table[iter];
-
-            // Search through each country's providers
-            for (let i = 0; i < providers.length; i++) {
-                let provider = providers[i];
-                let cdma_sid = provider.get_cdma_sid();
-
-                // Search through CDMA SID list
-                for (let j = 0; j < cdma_sid.length; j++) {
-                    if (cdma_sid[j] == sid)
-                        return provider.name;
-                }
-            }
-        }
-
-        return null;
+        return Cinnamon.mobile_providers_find_for_sid(sid);
     }
 };
 Signals.addSignalMethods(ModemCdma.prototype);
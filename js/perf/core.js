@@ -50,6 +50,18 @@ let METRICS = {
       units: "us" },
     applicationsShowTimeSubsequent:
     { description: "Time to switch to applications view, second time",
+      units: "us"},
+    applicationUsageLoadTime:
+    { description: "Time to load the application usage data at startup",
+      units: "us"},
+    applicationsTreeLoadTime:
+    { description: "Time to load the applications menu tree at startup",
+      units: "us"},
+    applicationsIndexTime:
+    { description: "Time to set up and index the applications at startup",
+      units: "us"},
+    iconLoadTimeStartup:
+    { description: "Time from the first image load until the images requested at startup were loaded",
       units: "us"}
 };
 
@@ -171,6 +183,22 @@ function malloc_usedSize(time, bytes) {
     mallocUsedSize = bytes;
 }
 
+function applicationUsage_loadTime(time, loadTime) {
+    METRICS.applicationUsageLoadTime.value = loadTime;
+}
+
+function applications_treeLoadTime(time, loadTime) {
+    METRICS.applicationsTreeLoadTime.value = loadTime;
+}
+
+function applications_indexTime(time, indexTime) {
+    METRICS.applicationsIndexTime.value = indexTime;
+}
+
+function iconCache_startupLoadTime(time, loadTime) {
+    METRICS.iconLoadTimeStartup.value = loadTime;
+}
+
 function _frameDone(time) {
     if (showingOverview) {
         if (overviewFrames == 0)
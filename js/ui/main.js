@@ -289,6 +289,13 @@ function start() {
     _log('info', 'loaded at ' + _startDate);
     log('Cinnamon started at ' + _startDate);
 
+    // Everything shown at startup exists by the first idle; the icons
+    // requested until then count towards the startup load time
+    Meta.later_add(Meta.LaterType.IDLE, function() {
+        St.TextureCache.get_default().mark_startup_complete();
+        return false;
+    });
+
     let perfModuleName = GLib.getenv("CINNAMON_PERF_MODULE");
     if (perfModuleName) {
         let perfOutput = GLib.getenv("CINNAMON_PERF_OUTPUT");
@@ -0,0 +1,24 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+#ifndef __CINNAMON_APP_CACHE_PRIVATE_H__
+#define __CINNAMON_APP_CACHE_PRIVATE_H__
+
+#include "cinnamon-app.h"
+
+G_BEGIN_DECLS
+
+typedef struct _CinnamonAppCache CinnamonAppCache;
+
+CinnamonAppCache *_cinnamon_app_cache_new     (const char       *name);
+void              _cinnamon_app_cache_free    (CinnamonAppCache *cache);
+
+gboolean          _cinnamon_app_cache_restore (CinnamonAppCache *cache,
+                                               CinnamonApp      *app,
+                                               char            **vendor_prefix);
+void              _cinnamon_app_cache_store   (CinnamonAppCache *cache,
+                                               CinnamonApp      *app,
+                                               const char       *vendor_prefix);
+void              _cinnamon_app_cache_commit  (CinnamonAppCache *cache);
+
+G_END_DECLS
+
+#endif /* __CINNAMON_APP_CACHE_PRIVATE_H__ */
@@ -0,0 +1,318 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* A cache of what CinnamonAppSystem derives from each entry of a menu tree,
+ * which would otherwise be recomputed for every application at startup: the
+ * vendor prefix of its desktop file id, the casefolded strings searches
+ * match against, and the collation key of its name.
+ *
+ * The cache is a GVariant mapped from CACHE_DIR/<name>.cache. An entry is
+ * only used while its desktop file has the modification time it had when
+ * the entry was stored, and the whole cache only in the locale it was
+ * written in, since names are translated and collation keys depend on it.
+ *
+ * After a tree is loaded, each application is looked up with
+ * _cinnamon_app_cache_restore(), then stored back with
+ * _cinnamon_app_cache_store(); _cinnamon_app_cache_commit() then writes the
+ * new contents from an idle if anything changed.
+ *
+ * This costs a stat() per application and still leaves the parsing of
+ * the desktop files to the tree: only what comes after is saved, as the
+ * applications.indexTime statistic shows next to applications.treeLoadTime.
+ * The settings tree is too small for it to be worth it.
+ */
+
+#include "config.h"
+
+#include <locale.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "cinnamon-app-cache-private.h"
+#include "cinnamon-app-private.h"
+
+#define CACHE_VERSION 1
+
+/* version, locale, and desktop file id => (path, mtime, vendor prefix,
+ * name, executable, description, name collation key) */
+#define CACHE_TYPE "(usa{s(sxmsmsmsmsay)})"
+#define ENTRY_TYPE "{s(sxmsmsmsmsay)}"
+#define ENTRY_FORMAT "{s(sxmsmsmsms^ay)}"
+
+struct _CinnamonAppCache {
+  char             *path;
+  char             *locale;
+
+  GVariant         *data;
+  GHashTable       *entries;      /* desktop file id => GVariant */
+
+  GVariantBuilder  *builder;      /* entries of the current pass */
+  guint             n_stored;
+  guint             n_restored;
+
+  GVariant         *pending;      /* written by the idle */
+  guint             save_id;
+};
+
+static char *
+get_locale (void)
+{
+  const char *collate = setlocale (LC_COLLATE, NULL);
+
+  return g_strdup_printf ("%s/%s",
+                          g_get_language_names ()[0],
+                          collate ? collate : "");
+}
+
+static void
+set_data (CinnamonAppCache *cache,
+          GVariant         *data)
+{
+  GVariant *entries;
+  guint32 version;
+  const char *locale;
+  gsize i, n_entries;
+
+  g_hash_table_remove_all (cache->entries);
+  if (cache->data)
+    g_variant_unref (cache->data);
+  cache->data = data;
+
+  g_variant_get_child (data, 0, "u", &version);
+  g_variant_get_child (data, 1, "&s", &locale);
+  if (version != CACHE_VERSION || strcmp (locale, cache->locale) != 0)
+    return;
+
+  /* Keys point into the data, which stays around as long as they do */
+  entries = g_variant_get_child_value (data, 2);
+  n_entries = g_variant_n_children (entries);
+  for (i = 0; i < n_entries; i++)
+    {
+      GVariant *entry = g_variant_get_child_value (entries, i);
+      const char *id;
+
+      g_variant_get_child (entry, 0, "&s", &id);
+      g_hash_table_replace (cache->entries, (char *)id,
+                            g_variant_get_child_value (entry, 1));
+      g_variant_unref (entry);
+    }
+  g_variant_unref (entries);
+}
+
+/**
+ * _cinnamon_app_cache_new:
+ * @name: the name of the cache file
+ *
+ * Return value: the cache @name, loaded from disk if it exists
+ */
+CinnamonAppCache *
+_cinnamon_app_cache_new (const char *name)
+{
+  CinnamonAppCache *cache;
+  GMappedFile *mapped;
+  char *filename;
+
+  cache = g_slice_new0 (CinnamonAppCache);
+
+  filename = g_strconcat (name, ".cache", NULL);
+  cache->path = g_build_filename (g_get_user_cache_dir (), "cinnamon", filename, NULL);
+  g_free (filename);
+
+  cache->locale = get_locale ();
+  cache->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          NULL, (GDestroyNotify) g_variant_unref);
+
+  mapped = g_mapped_file_new (cache->path, FALSE, NULL);
+  if (mapped != NULL)
+    {
+      /* GVariant copes with any contents, at worst it reads defaults */
+      set_data (cache,
+                g_variant_ref_sink (g_variant_new_from_data (G_VARIANT_TYPE (CACHE_TYPE),
+                                                             g_mapped_file_get_contents (mapped),
+                                                             g_mapped_file_get_length (mapped),
+                                                             FALSE,
+                                                             (GDestroyNotify) g_mapped_file_unref,
+                                                             mapped)));
+    }
+
+  return cache;
+}
+
+void
+_cinnamon_app_cache_free (CinnamonAppCache *cache)
+{
+  if (cache->save_id != 0)
+    g_source_remove (cache->save_id);
+  if (cache->pending)
+    g_variant_unref (cache->pending);
+  if (cache->builder)
+    g_variant_builder_unref (cache->builder);
+
+  g_hash_table_destroy (cache->entries);
+  if (cache->data)
+    g_variant_unref (cache->data);
+
+  g_free (cache->locale);
+  g_free (cache->path);
+  g_slice_free (CinnamonAppCache, cache);
+}
+
+static gboolean
+get_desktop_file_mtime (const char *path,
+                        gint64     *mtime)
+{
+  struct stat buf;
+
+  if (path == NULL || g_stat (path, &buf) < 0)
+    return FALSE;
+
+  *mtime = buf.st_mtime;
+  return TRUE;
+}
+
+/**
+ * _cinnamon_app_cache_restore:
+ * @cache: a #CinnamonAppCache
+ * @app: an application with a tree entry
+ * @vendor_prefix: (out): location for the vendor prefix of @app, if found
+ *
+ * Sets the search strings and collation key of @app from the cache, if
+ * its entry is still valid.
+ *
+ * Return value: %TRUE if @app was found
+ */
+gboolean
+_cinnamon_app_cache_restore (CinnamonAppCache  *cache,
+                             CinnamonApp       *app,
+                             char             **vendor_prefix)
+{
+  GMenuTreeEntry *entry = cinnamon_app_get_tree_entry (app);
+  GVariant *value;
+  const char *path, *prefix, *name, *exec, *description, *collation_key;
+  gint64 mtime, current_mtime;
+
+  value = g_hash_table_lookup (cache->entries, gmenu_tree_entry_get_desktop_file_id (entry));
+  if (value == NULL)
+    return FALSE;
+
+  g_variant_get (value, "(&sxm&sm&sm&sm&s^&ay)",
+                 &path, &mtime, &prefix, &name, &exec, &description, &collation_key);
+
+  if (g_strcmp0 (path, gmenu_tree_entry_get_desktop_file_path (entry)) != 0 ||
+      !get_desktop_file_mtime (path, &current_mtime) ||
+      current_mtime != mtime)
+    return FALSE;
+
+  _cinnamon_app_set_search_data (app, name, exec, description, collation_key);
+  *vendor_prefix = g_strdup (prefix);
+
+  cache->n_restored++;
+
+  return TRUE;
+}
+
+/**
+ * _cinnamon_app_cache_store:
+ * @cache: a #CinnamonAppCache
+ * @app: an application with a tree entry
+ * @vendor_prefix: (allow-none): the vendor prefix of @app
+ *
+ * Adds @app to the contents of the cache after the next
+ * _cinnamon_app_cache_commit().
+ */
+void
+_cinnamon_app_cache_store (CinnamonAppCache *cache,
+                           CinnamonApp      *app,
+                           const char       *vendor_prefix)
+{
+  GMenuTreeEntry *entry = cinnamon_app_get_tree_entry (app);
+  const char *path, *name, *exec, *description;
+  gint64 mtime;
+
+  path = gmenu_tree_entry_get_desktop_file_path (entry);
+  if (!get_desktop_file_mtime (path, &mtime))
+    return;
+
+  if (cache->builder == NULL)
+    cache->builder = g_variant_builder_new (G_VARIANT_TYPE ("a" ENTRY_TYPE));
+
+  _cinnamon_app_get_search_strings (app, &name, &exec, &description);
+
+  g_variant_builder_add (cache->builder, ENTRY_FORMAT,
+                         gmenu_tree_entry_get_desktop_file_id (entry),
+                         path, mtime, vendor_prefix, name, exec, description,
+                         _cinnamon_app_get_name_collation_key (app));
+
+  cache->n_stored++;
+}
+
+static gboolean
+idle_save_cache (gpointer data)
+{
+  CinnamonAppCache *cache = data;
+  char *dir;
+  GError *error = NULL;
+
+  cache->save_id = 0;
+
+  dir = g_path_get_dirname (cache->path);
+  g_mkdir_with_parents (dir, 0700);
+  g_free (dir);
+
+  if (!g_file_set_contents (cache->path,
+                            g_variant_get_data (cache->pending),
+                            g_variant_get_size (cache->pending),
+                            &error))
+    {
+      g_debug ("Could not save the application cache: %s", error->message);
+      g_error_free (error);
+    }
+
+  g_variant_unref (cache->pending);
+  cache->pending = NULL;
+
+  return FALSE;
+}
+
+/**
+ * _cinnamon_app_cache_commit:
+ * @cache: a #CinnamonAppCache
+ *
+ * Makes the applications stored since the last commit the contents of
+ * the cache, and saves them if they differ from what was restored.
+ */
+void
+_cinnamon_app_cache_commit (CinnamonAppCache *cache)
+{
+  GVariant *data;
+  gboolean changed;
+
+  changed = cache->n_restored != cache->n_stored ||
+            cache->n_stored != g_hash_table_size (cache->entries);
+
+  if (cache->builder == NULL)
+    cache->builder = g_variant_builder_new (G_VARIANT_TYPE ("a" ENTRY_TYPE));
+
+  data = g_variant_new ("(us@a" ENTRY_TYPE ")",
+                        CACHE_VERSION, cache->locale,
+                        g_variant_builder_end (cache->builder));
+  g_variant_builder_unref (cache->builder);
+  cache->builder = NULL;
+  cache->n_stored = 0;
+  cache->n_restored = 0;
+
+  if (!changed)
+    {
+      g_variant_unref (g_variant_ref_sink (data));
+      return;
+    }
+
+  set_data (cache, g_variant_ref_sink (data));
+
+  if (cache->pending)
+    g_variant_unref (cache->pending);
+  cache->pending = g_variant_ref (cache->data);
+
+  if (cache->save_id == 0)
+    cache->save_id = g_idle_add_full (G_PRIORITY_LOW, idle_save_cache, cache, NULL);
+}
@@ -22,6 +22,19 @@ void _cinnamon_app_add_window (CinnamonApp *app, MetaWindow *window);
 
 void _cinnamon_app_remove_window (CinnamonApp *app, MetaWindow *window);
 
+void _cinnamon_app_get_search_strings (CinnamonApp  *app,
+                                       const char  **name,
+                                       const char  **exec,
+                                       const char  **description);
+
+void _cinnamon_app_set_search_data (CinnamonApp *app,
+                                    const char  *name,
+                                    const char  *exec,
+                                    const char  *description,
+                                    const char  *name_collation_key);
+
+const char *_cinnamon_app_get_name_collation_key (CinnamonApp *app);
+
 void _cinnamon_app_do_match (CinnamonApp         *app,
                           GSList           *terms,
                           GSList          **prefix_results,
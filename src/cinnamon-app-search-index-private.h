@@ -0,0 +1,22 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+#ifndef __CINNAMON_APP_SEARCH_INDEX_PRIVATE_H__
+#define __CINNAMON_APP_SEARCH_INDEX_PRIVATE_H__
+
+#include "cinnamon-app.h"
+
+G_BEGIN_DECLS
+
+typedef struct _CinnamonAppSearchIndex CinnamonAppSearchIndex;
+
+CinnamonAppSearchIndex *_cinnamon_app_search_index_new       (GHashTable             *apps);
+void                    _cinnamon_app_search_index_free      (CinnamonAppSearchIndex *index);
+
+GSList                 *_cinnamon_app_search_index_search    (CinnamonAppSearchIndex *index,
+                                                              GSList                 *terms);
+GSList                 *_cinnamon_app_search_index_subsearch (CinnamonAppSearchIndex *index,
+                                                              GSList                 *previous_results,
+                                                              GSList                 *terms);
+
+G_END_DECLS
+
+#endif /* __CINNAMON_APP_SEARCH_INDEX_PRIVATE_H__ */
@@ -0,0 +1,354 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* An inverted index over the strings applications are searched by, so
+ * that a search only looks at the applications that can match instead of
+ * all of them.
+ *
+ * The casefolded name, executable and description of each application go
+ * into a CinnamonNgramIndex, which gives the few applications that can
+ * match the terms of a search. Those are then matched with
+ * _cinnamon_app_do_match() as before.
+ *
+ * When nothing matches exactly, the names and executables of all the
+ * applications are scored with the typo-tolerant matching of
+ * cinnamon-fuzzy-match.c instead, so that "termnial" still finds the
+ * terminal. Those results come sorted by score, then by usage.
+ *
+ * Results are sorted by usage. Rather than asking CinnamonAppUsage on each
+ * comparison, the index keeps the rank of each application in the usage
+ * ordering, refreshed when it gets older than USAGE_SNAPSHOT_LIFETIME.
+ */
+
+#include "config.h"
+
+#include "cinnamon-app-search-index-private.h"
+#include "cinnamon-app-private.h"
+#include "cinnamon-app-usage.h"
+#include "cinnamon-fuzzy-match-private.h"
+#include "cinnamon-ngram-index-private.h"
+
+/* Usage changes slowly, the ranks are only refreshed once a minute */
+#define USAGE_SNAPSHOT_LIFETIME (60 * G_USEC_PER_SEC)
+
+typedef struct {
+  CinnamonApp *app;
+  guint        usage_rank;
+} IndexedApp;
+
+typedef struct {
+  guint32      doc;
+  guint        usage_rank;
+  CinnamonApp *app;
+  guint        score;
+} SearchResult;
+
+struct _CinnamonAppSearchIndex {
+  GArray             *apps;         /* IndexedApp, by document number */
+  GHashTable         *app_to_doc;   /* CinnamonApp => document number + 1 */
+  CinnamonNgramIndex *ngrams;
+  gint64              usage_snapshot_time;
+};
+
+/**
+ * _cinnamon_app_search_index_new:
+ * @apps: (element-type utf8 CinnamonApp): the applications to search
+ *
+ * Return value: a new index over the searchable applications of @apps
+ */
+CinnamonAppSearchIndex *
+_cinnamon_app_search_index_new (GHashTable *apps)
+{
+  CinnamonAppSearchIndex *index;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  index = g_slice_new0 (CinnamonAppSearchIndex);
+  index->apps = g_array_new (FALSE, FALSE, sizeof (IndexedApp));
+  index->app_to_doc = g_hash_table_new (NULL, NULL);
+  index->ngrams = _cinnamon_ngram_index_new ();
+
+  g_hash_table_iter_init (&iter, apps);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      CinnamonApp *app = value;
+      GAppInfo *appinfo;
+      IndexedApp indexed;
+      const char *name, *exec, *description;
+      guint32 doc;
+
+      /* The same applications _cinnamon_app_do_match() skips */
+      appinfo = (GAppInfo*)cinnamon_app_get_app_info (app);
+      if (appinfo == NULL || !g_app_info_should_show (appinfo))
+        continue;
+
+      doc = index->apps->len;
+      indexed.app = g_object_ref (app);
+      indexed.usage_rank = G_MAXUINT;
+      g_array_append_val (index->apps, indexed);
+      g_hash_table_insert (index->app_to_doc, app, GUINT_TO_POINTER (doc + 1));
+
+      _cinnamon_app_get_search_strings (app, &name, &exec, &description);
+      _cinnamon_ngram_index_add_string (index->ngrams, name, doc);
+      _cinnamon_ngram_index_add_string (index->ngrams, exec, doc);
+      _cinnamon_ngram_index_add_string (index->ngrams, description, doc);
+    }
+
+  return index;
+}
+
+void
+_cinnamon_app_search_index_free (CinnamonAppSearchIndex *index)
+{
+  guint i;
+
+  for (i = 0; i < index->apps->len; i++)
+    g_object_unref (g_array_index (index->apps, IndexedApp, i).app);
+
+  g_array_free (index->apps, TRUE);
+  g_hash_table_destroy (index->app_to_doc);
+  _cinnamon_ngram_index_free (index->ngrams);
+  g_slice_free (CinnamonAppSearchIndex, index);
+}
+
+static void
+update_usage_snapshot (CinnamonAppSearchIndex *index)
+{
+  GSList *most_used, *l;
+  gint64 now;
+  guint rank;
+  guint i;
+
+  now = g_get_monotonic_time ();
+  if (index->usage_snapshot_time != 0 &&
+      now - index->usage_snapshot_time < USAGE_SNAPSHOT_LIFETIME)
+    return;
+
+  index->usage_snapshot_time = now;
+
+  for (i = 0; i < index->apps->len; i++)
+    g_array_index (index->apps, IndexedApp, i).usage_rank = G_MAXUINT;
+
+  most_used = cinnamon_app_usage_get_most_used (cinnamon_app_usage_get_default (), "", -1);
+  for (l = most_used, rank = 0; l; l = l->next, rank++)
+    {
+      guint doc = GPOINTER_TO_UINT (g_hash_table_lookup (index->app_to_doc, l->data));
+
+      if (doc != 0)
+        g_array_index (index->apps, IndexedApp, doc - 1).usage_rank = rank;
+    }
+
+  g_slist_foreach (most_used, (GFunc)g_object_unref, NULL);
+  g_slist_free (most_used);
+}
+
+static gint
+compare_results (gconstpointer a,
+                 gconstpointer b)
+{
+  const SearchResult *result_a = a;
+  const SearchResult *result_b = b;
+
+  if (result_a->score != result_b->score)
+    return result_a->score > result_b->score ? -1 : 1;
+
+  if (result_a->usage_rank != result_b->usage_rank)
+    return result_a->usage_rank < result_b->usage_rank ? -1 : 1;
+
+  return result_a->doc < result_b->doc ? -1 : (result_a->doc > result_b->doc);
+}
+
+/* Sorts the applications of @apps, which are all indexed, by usage */
+static GSList *
+sort_by_usage (CinnamonAppSearchIndex *index,
+               GSList                 *apps)
+{
+  GArray *results;
+  GSList *l;
+  gint i;
+
+  results = g_array_new (FALSE, FALSE, sizeof (SearchResult));
+
+  for (l = apps; l; l = l->next)
+    {
+      SearchResult result;
+
+      result.app = l->data;
+      result.doc = GPOINTER_TO_UINT (g_hash_table_lookup (index->app_to_doc, result.app)) - 1;
+      result.usage_rank = g_array_index (index->apps, IndexedApp, result.doc).usage_rank;
+      result.score = 0;
+      g_array_append_val (results, result);
+    }
+
+  g_slist_free (apps);
+
+  g_array_sort (results, compare_results);
+
+  apps = NULL;
+  for (i = results->len - 1; i >= 0; i--)
+    apps = g_slist_prepend (apps, g_array_index (results, SearchResult, i).app);
+
+  g_array_free (results, TRUE);
+
+  return apps;
+}
+
+/* Every term has to match the name or the executable of an application,
+ * whose score is the sum of the best score of each term */
+static GSList *
+fuzzy_search (CinnamonAppSearchIndex *index,
+              GSList                 *terms)
+{
+  GPtrArray *patterns;
+  GArray *results;
+  GSList *apps = NULL;
+  GSList *l;
+  gint i;
+  guint j;
+
+  patterns = g_ptr_array_new ();
+  for (l = terms; l; l = l->next)
+    g_ptr_array_add (patterns, _cinnamon_fuzzy_pattern_new (l->data));
+
+  results = g_array_new (FALSE, FALSE, sizeof (SearchResult));
+
+  for (i = 0; i < (gint)index->apps->len; i++)
+    {
+      IndexedApp *indexed = &g_array_index (index->apps, IndexedApp, i);
+      const char *name, *exec, *description;
+      SearchResult result;
+
+      _cinnamon_app_get_search_strings (indexed->app, &name, &exec, &description);
+
+      result.score = 0;
+      for (j = 0; j < patterns->len; j++)
+        {
+          CinnamonFuzzyPattern *pattern = g_ptr_array_index (patterns, j);
+          guint score;
+
+          score = MAX (_cinnamon_fuzzy_pattern_score (pattern, name),
+                       _cinnamon_fuzzy_pattern_score (pattern, exec));
+          if (score == 0)
+            break;
+
+          result.score += score;
+        }
+
+      if (j < patterns->len)
+        continue;
+
+      result.doc = i;
+      result.app = indexed->app;
+      result.usage_rank = indexed->usage_rank;
+      g_array_append_val (results, result);
+    }
+
+  g_array_sort (results, compare_results);
+
+  for (i = results->len - 1; i >= 0; i--)
+    apps = g_slist_prepend (apps, g_array_index (results, SearchResult, i).app);
+
+  g_array_free (results, TRUE);
+  g_ptr_array_foreach (patterns, (GFunc)_cinnamon_fuzzy_pattern_free, NULL);
+  g_ptr_array_free (patterns, TRUE);
+
+  return apps;
+}
+
+static GSList *
+search (CinnamonAppSearchIndex *index,
+        GSList                 *terms,
+        GArray                 *restrict_to)
+{
+  GSList *prefix_results = NULL;
+  GSList *substring_results = NULL;
+  GArray *candidates;
+  guint i;
+
+  candidates = _cinnamon_ngram_index_find_candidates (index->ngrams, terms, restrict_to,
+                                                      index->apps->len);
+  if (candidates != NULL)
+    {
+      for (i = 0; i < candidates->len; i++)
+        {
+          guint32 doc = g_array_index (candidates, guint32, i);
+
+          _cinnamon_app_do_match (g_array_index (index->apps, IndexedApp, doc).app,
+                                  terms,
+                                  &prefix_results,
+                                  &substring_results);
+        }
+
+      g_array_free (candidates, TRUE);
+    }
+
+  update_usage_snapshot (index);
+
+  /* Longer terms tolerate more typos, so a fuzzy search can find
+   * applications that weren't in the previous results: always look at
+   * all of them */
+  if (prefix_results == NULL && substring_results == NULL)
+    return fuzzy_search (index, terms);
+
+  return g_slist_concat (sort_by_usage (index, prefix_results),
+                         sort_by_usage (index, substring_results));
+}
+
+/**
+ * _cinnamon_app_search_index_search:
+ * @index: a #CinnamonAppSearchIndex
+ * @terms: (element-type utf8): normalized and casefolded terms, logical AND
+ *
+ * Return value: (transfer container) (element-type CinnamonApp): the
+ *   matching applications, prefix matches first, then by usage; if there
+ *   are none, the closest approximate matches
+ */
+GSList *
+_cinnamon_app_search_index_search (CinnamonAppSearchIndex *index,
+                                   GSList                 *terms)
+{
+  return search (index, terms, NULL);
+}
+
+/**
+ * _cinnamon_app_search_index_subsearch:
+ * @index: a #CinnamonAppSearchIndex
+ * @previous_results: (element-type CinnamonApp): results of a previous
+ *   search with a prefix of @terms
+ * @terms: (element-type utf8): normalized and casefolded terms, logical AND
+ *
+ * Like _cinnamon_app_search_index_search(), but only considers
+ * @previous_results.
+ *
+ * Return value: (transfer container) (element-type CinnamonApp): the
+ *   matching applications
+ */
+GSList *
+_cinnamon_app_search_index_subsearch (CinnamonAppSearchIndex *index,
+                                      GSList                 *previous_results,
+                                      GSList                 *terms)
+{
+  GArray *previous_docs;
+  GSList *results;
+  GSList *l;
+
+  previous_docs = g_array_new (FALSE, FALSE, sizeof (guint32));
+  for (l = previous_results; l; l = l->next)
+    {
+      guint doc = GPOINTER_TO_UINT (g_hash_table_lookup (index->app_to_doc, l->data));
+
+      /* Applications removed since don't match anymore */
+      if (doc != 0)
+        {
+          guint32 value = doc - 1;
+          g_array_append_val (previous_docs, value);
+        }
+    }
+
+  _cinnamon_ngram_docs_sort_unique (previous_docs);
+
+  results = search (index, terms, previous_docs);
+
+  g_array_free (previous_docs, TRUE);
+
+  return results;
+}
@@ -13,10 +13,13 @@
 #include <glib/gi18n.h>
 #include <meta/display.h>
 
+#include "cinnamon-app-cache-private.h"
 #include "cinnamon-app-private.h"
+#include "cinnamon-app-search-index-private.h"
 #include "cinnamon-window-tracker-private.h"
 #include "cinnamon-app-system-private.h"
 #include "cinnamon-global.h"
+#include "cinnamon-perf-log.h"
 #include "cinnamon-util.h"
 #include "st.h"
 
@@ -46,11 +49,15 @@ struct _CinnamonAppSystemPrivate {
 
   GHashTable *running_apps;
   GHashTable *id_to_app;
+  CinnamonAppSearchIndex *apps_index;
+  CinnamonAppCache *apps_cache;
+  gboolean apps_loaded;
 
   GSList *known_vendor_prefixes;
 
   GMenuTree *settings_tree;
   GHashTable *setting_id_to_app;
+  CinnamonAppSearchIndex *settings_index;
 };
 
 static void cinnamon_app_system_finalize (GObject *object);
@@ -106,6 +113,8 @@ cinnamon_app_system_init (CinnamonAppSystem *self)
    * handle NODISPLAY semantics at a higher level or investigate them
    * case by case.
    */
+  priv->apps_cache = _cinnamon_app_cache_new ("applications");
+
   priv->apps_tree = gmenu_tree_new ("cinnamon-applications.menu", GMENU_TREE_FLAGS_INCLUDE_NODISPLAY);
   g_signal_connect (priv->apps_tree, "changed", G_CALLBACK (on_apps_tree_changed_cb), self);
 
@@ -128,6 +137,11 @@ cinnamon_app_system_finalize (GObject *object)
   g_hash_table_destroy (priv->running_apps);
   g_hash_table_destroy (priv->id_to_app);
   g_hash_table_destroy (priv->setting_id_to_app);
+  if (priv->apps_index)
+    _cinnamon_app_search_index_free (priv->apps_index);
+  if (priv->settings_index)
+    _cinnamon_app_search_index_free (priv->settings_index);
+  _cinnamon_app_cache_free (priv->apps_cache);
 
   g_slist_foreach (priv->known_vendor_prefixes, (GFunc)g_free, NULL);
   g_slist_free (priv->known_vendor_prefixes);
@@ -312,6 +326,7 @@ on_apps_tree_changed_cb (GMenuTree *tree,
   gpointer key, value;
   GSList *removed_apps = NULL;
   GSList *removed_node;
+  gint64 start, load_time;
 
   g_assert (tree == self->priv->apps_tree);
 
@@ -319,11 +334,14 @@ on_apps_tree_changed_cb (GMenuTree *tree,
   g_slist_free (self->priv->known_vendor_prefixes);
   self->priv->known_vendor_prefixes = NULL;
 
+  start = g_get_monotonic_time ();
   if (!gmenu_tree_load_sync (self->priv->apps_tree, &error))
     {
       g_warning ("Failed to load apps: %s", error->message);
       return;
     }
+  load_time = g_get_monotonic_time () - start;
+  start += load_time;
 
   new_apps = get_flattened_entries_from_tree (self->priv->apps_tree);
   g_hash_table_iter_init (&iter, new_apps);
@@ -334,17 +352,7 @@ on_apps_tree_changed_cb (GMenuTree *tree,
       GMenuTreeEntry *old_entry;
       char *prefix;
       CinnamonApp *app;
-      
-      prefix = get_prefix_for_entry (entry);
-      
-      if (prefix != NULL
-          && !g_slist_find_custom (self->priv->known_vendor_prefixes, prefix,
-                                   (GCompareFunc)g_strcmp0))
-        self->priv->known_vendor_prefixes = g_slist_append (self->priv->known_vendor_prefixes,
-                                                            prefix);
-      else
-        g_free (prefix);
-      
+
       app = g_hash_table_lookup (self->priv->id_to_app, id);
       if (app != NULL)
         {
@@ -372,7 +380,20 @@ on_apps_tree_changed_cb (GMenuTree *tree,
 
       if (old_entry)
         gmenu_tree_item_unref (old_entry);
+
+      if (!_cinnamon_app_cache_restore (self->priv->apps_cache, app, &prefix))
+        prefix = get_prefix_for_entry (entry);
+      _cinnamon_app_cache_store (self->priv->apps_cache, app, prefix);
+
+      if (prefix != NULL
+          && !g_slist_find_custom (self->priv->known_vendor_prefixes, prefix,
+                                   (GCompareFunc)g_strcmp0))
+        self->priv->known_vendor_prefixes = g_slist_append (self->priv->known_vendor_prefixes,
+                                                            prefix);
+      else
+        g_free (prefix);
     }
+  _cinnamon_app_cache_commit (self->priv->apps_cache);
   /* Now iterate over the apps again; we need to unreference any apps
    * which have been removed.  The JS code may still be holding a
    * reference; that's fine.
@@ -394,6 +415,25 @@ on_apps_tree_changed_cb (GMenuTree *tree,
       
   g_hash_table_destroy (new_apps);
 
+  if (self->priv->apps_index)
+    _cinnamon_app_search_index_free (self->priv->apps_index);
+  self->priv->apps_index = _cinnamon_app_search_index_new (self->priv->id_to_app);
+
+  /* The cache only speeds up the second part, parsing the desktop files
+   * is still all in the first */
+  if (!self->priv->apps_loaded)
+    {
+      CinnamonPerfLog *perf_log = cinnamon_perf_log_get_default ();
+
+      cinnamon_perf_log_update_statistic_x (perf_log,
+                                            "applications.treeLoadTime",
+                                            load_time);
+      cinnamon_perf_log_update_statistic_x (perf_log,
+                                            "applications.indexTime",
+                                            g_get_monotonic_time () - start);
+      self->priv->apps_loaded = TRUE;
+    }
+
   g_signal_emit (self, signals[INSTALLED_CHANGED], 0);
 }
 
@@ -410,6 +450,12 @@ on_settings_tree_changed_cb (GMenuTree *tree,
   g_assert (tree == self->priv->settings_tree);
 
   g_hash_table_remove_all (self->priv->setting_id_to_app);
+  if (self->priv->settings_index)
+    {
+      _cinnamon_app_search_index_free (self->priv->settings_index);
+      self->priv->settings_index = NULL;
+    }
+
   if (!gmenu_tree_load_sync (self->priv->settings_tree, &error))
     {
       g_warning ("Failed to load settings: %s", error->message);
@@ -429,6 +475,8 @@ on_settings_tree_changed_cb (GMenuTree *tree,
       g_hash_table_replace (self->priv->setting_id_to_app, (char*)id, app);
     }
   g_hash_table_destroy (new_settings);
+
+  self->priv->settings_index = _cinnamon_app_search_index_new (self->priv->setting_id_to_app);
 }
 
 /**
@@ -703,33 +751,6 @@ cinnamon_app_system_get_running (CinnamonAppSystem *self)
 }
 
 
-static gint
-compare_apps_by_usage (gconstpointer a,
-                       gconstpointer b,
-                       gpointer      data)
-{
-  CinnamonAppUsage *usage = cinnamon_app_usage_get_default ();
-
-  CinnamonApp *app_a = (CinnamonApp*)a;
-  CinnamonApp *app_b = (CinnamonApp*)b;
-
-  return cinnamon_app_usage_compare (usage, "", app_a, app_b);
-}
-
-static GSList *
-sort_and_concat_results (CinnamonAppSystem *system,
-                         GSList         *prefix_matches,
-                         GSList         *substring_matches)
-{
-  prefix_matches = g_slist_sort_with_data (prefix_matches,
-                                           compare_apps_by_usage,
-                                           system);
-  substring_matches = g_slist_sort_with_data (substring_matches,
-                                              compare_apps_by_usage,
-                                              system);
-  return g_slist_concat (prefix_matches, substring_matches);
-}
-
 /**
  * normalize_terms:
  * @terms: (element-type utf8): Input search terms
@@ -750,33 +771,25 @@ normalize_terms (GSList *terms)
 }
 
 static GSList *
-search_tree (CinnamonAppSystem *self,
-             GSList         *terms,
-             GHashTable     *apps)
+search_tree (CinnamonAppSystem      *self,
+             GSList                 *terms,
+             CinnamonAppSearchIndex *index)
 {
-  GSList *prefix_results = NULL;
-  GSList *substring_results = NULL;
+  GSList *results;
   GSList *normalized_terms;
-  GHashTableIter iter;
-  gpointer key, value;
+
+  /* Loading the tree failed */
+  if (index == NULL)
+    return NULL;
 
   normalized_terms = normalize_terms (terms);
 
-  g_hash_table_iter_init (&iter, apps);
-  while (g_hash_table_iter_next (&iter, &key, &value))
-    {
-      const char *id = key;
-      CinnamonApp *app = value;
-      (void)id;
-      _cinnamon_app_do_match (app, normalized_terms,
-                           &prefix_results,
-                           &substring_results);
-    }
+  results = _cinnamon_app_search_index_search (index, normalized_terms);
+
   g_slist_foreach (normalized_terms, (GFunc)g_free, NULL);
   g_slist_free (normalized_terms);
 
-  return sort_and_concat_results (self, prefix_results, substring_results);
-
+  return results;
 }
 
 /**
@@ -792,7 +805,7 @@ GSList *
 cinnamon_app_system_initial_search (CinnamonAppSystem  *self,
                                  GSList          *terms)
 {
-  return search_tree (self, terms, self->priv->id_to_app);
+  return search_tree (self, terms, self->priv->apps_index);
 }
 
 /**
@@ -813,26 +826,25 @@ cinnamon_app_system_subsearch (CinnamonAppSystem   *system,
                             GSList           *previous_results,
                             GSList           *terms)
 {
-  GSList *iter;
-  GSList *prefix_results = NULL;
-  GSList *substring_results = NULL;
-  GSList *normalized_terms = normalize_terms (terms);
+  GSList *results;
+  GSList *normalized_terms;
 
-  for (iter = previous_results; iter; iter = iter->next)
-    {
-      CinnamonApp *app = iter->data;
-      
-      _cinnamon_app_do_match (app, normalized_terms,
-                           &prefix_results,
-                           &substring_results);
-    }
-  g_slist_foreach (normalized_terms, (GFunc)g_free, NULL);
-  g_slist_free (normalized_terms);
+  if (system->priv->apps_index == NULL)
+    return NULL;
+
+  normalized_terms = normalize_terms (terms);
 
   /* Note that a shorter term might have matched as a prefix, but
      when extended only as a substring, so we have to redo the
      sort rather than reusing the existing ordering */
-  return sort_and_concat_results (system, prefix_results, substring_results);
+  results = _cinnamon_app_search_index_subsearch (system->priv->apps_index,
+                                                  previous_results,
+                                                  normalized_terms);
+
+  g_slist_foreach (normalized_terms, (GFunc)g_free, NULL);
+  g_slist_free (normalized_terms);
+
+  return results;
 }
 
 /**
@@ -848,5 +860,5 @@ GSList *
 cinnamon_app_system_search_settings (CinnamonAppSystem  *self,
                                   GSList          *terms)
 {
-  return search_tree (self, terms, self->priv->setting_id_to_app);
+  return search_tree (self, terms, self->priv->settings_index);
 }
@@ -2,8 +2,14 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
@@ -19,6 +25,7 @@
 #include "cinnamon-window-tracker.h"
 #include "cinnamon-global.h"
 #include "cinnamon-marshal.h"
+#include "cinnamon-perf-log.h"
 
 /* This file includes modified code from
  * desktop-data-engine/engine-dbus/hippo-application-monitor.c
@@ -46,8 +53,12 @@
 
 #define USAGE_CLEAN_DAYS 7 /* If after 7 days we haven't seen an app, purge it */
 
-/* Data is saved to file CINNAMON_CONFIG_DIR/DATA_FILENAME */
-#define DATA_FILENAME "application_state"
+/* Data is saved to file CINNAMON_CONFIG_DIR/STORE_FILENAME. Older versions
+ * saved it as XML to CINNAMON_CONFIG_DIR/LEGACY_FILENAME, which is migrated
+ * when there is no store yet.
+ */
+#define STORE_FILENAME "application_state.bin"
+#define LEGACY_FILENAME "application_state"
 
 #define IDLE_TIME_TRANSITION_SECONDS 30 /* If we transition to idle, only count
                                          * this many seconds of usage */
@@ -56,6 +67,11 @@
  * divide all scores by 2. Scores are raised by 1 unit every SAVE_APPS_TIMEOUT
  * seconds. This mechanism allows the list to update relatively fast when
  * a new app is used intensively.
+ * Dividing all scores only starts a new epoch; each score is divided by 2 for
+ * every epoch it missed the next time it is looked at, see get_score(). Since
+ * that keeps the order of the scores, the sorted list of the most used apps
+ * of each context is cached until a score is raised or an app is added or
+ * removed.
  * To keep the list clean, and avoid being Big Brother, apps that have not been
  * seen for a week and whose score is below SCORE_MIN are removed.
  */
@@ -74,13 +90,65 @@
 /* http://www.gnome.org/~mccann/gnome-session/docs/gnome-session.html#org.gnome.SessionManager.Presence */
 #define GNOME_SESSION_STATUS_IDLE 3
 
+/* The store is memory-mapped, and laid out as a StoreHeader, an array of
+ * record_capacity StoreRecords, then strings_capacity bytes of
+ * nul-terminated strings. Saving only writes the records that changed, in
+ * place.
+ *
+ * Records and strings past those counted by the current commit are unused;
+ * new records are written there first, then made part of the store by
+ * writing a new commit into the other slot of the header. On load, the
+ * valid commit with the highest generation wins, so a save interrupted at
+ * any point leaves the previous commit in effect. When the store is full,
+ * or after forgetting applications, it is rewritten to a new file that
+ * replaces the old one.
+ */
+#define STORE_MAGIC 0x53555043 /* "CPUS" */
+#define STORE_VERSION 1
+
+#define STORE_MIN_RECORDS 64
+#define STORE_MIN_STRINGS_SIZE 4096
+
+/* Set on the records of applications that aren't installed anymore, which
+ * are not loaded */
+#define RECORD_FLAG_UNINSTALLED (1 << 0)
+
+typedef struct {
+  guint64 generation;
+  guint32 n_records;
+  guint32 strings_size;
+  guint32 checksum;
+  guint32 padding;
+} StoreCommit;
+
+typedef struct {
+  guint32     magic;
+  guint32     version;
+  guint32     record_capacity;
+  guint32     strings_capacity;
+  StoreCommit commits[2];
+} StoreHeader;
+
+typedef struct {
+  gdouble score;
+  gint64  last_seen;
+  guint32 n_windows;
+  guint32 flags;
+  guint32 context;   /* offsets of the strings */
+  guint32 id;
+} StoreRecord;
+
 typedef struct UsageData UsageData;
 
 struct _CinnamonAppUsage
 {
   GObject parent;
 
-  GFile *configfile;
+  GFile *legacy_file;
+  char *store_path;
+  guint8 *store;
+  gsize store_size;
+  guint current_commit;
   GDBusProxy *session_proxy;
   GdkDisplay *display;
   gulong last_idle;
@@ -97,6 +165,11 @@ struct _CinnamonAppUsage
 
   /* <char *context, GHashTable<char *appid, UsageData *usage>> */
   GHashTable *app_usages_for_context;
+
+  /* <char *context, GPtrArray<char *appid>>, by decreasing score */
+  GHashTable *most_used_for_context;
+
+  guint epoch;
 };
 
 G_DEFINE_TYPE (CinnamonAppUsage, cinnamon_app_usage, G_TYPE_OBJECT);
@@ -111,6 +184,10 @@ struct UsageData
 
   gdouble score; /* Based on the number of times we'e seen the app and normalized */
   long last_seen; /* Used to clear old apps we've only seen a few times */
+
+  guint record; /* index of the record in the store + 1, 0 if none */
+
+  guint epoch; /* the epoch score was last divided for */
 };
 
 static void cinnamon_app_usage_finalize (GObject *object);
@@ -124,7 +201,7 @@ static UsageData * get_app_usage_for_context_and_id (CinnamonAppUsage  *self,
 
 static gboolean idle_save_application_usage (gpointer data);
 
-static void restore_from_file (CinnamonAppUsage *self);
+static void restore_usage (CinnamonAppUsage *self);
 
 static void update_enable_monitoring (CinnamonAppUsage *self);
 
@@ -179,8 +256,11 @@ get_app_usage_for_context_and_id (CinnamonAppUsage *self,
     return usage;
 
   usage = g_new0 (UsageData, 1);
+  usage->epoch = self->epoch;
   g_hash_table_insert (context_usages, g_strdup (appid), usage);
 
+  g_hash_table_remove (self->most_used_for_context, context);
+
   return usage;
 }
 
@@ -257,21 +337,25 @@ usage_iterator_remove (CinnamonAppUsage *self,
   g_hash_table_iter_remove (&(iter->usage_iter));
 }
 
+static gdouble
+get_score (CinnamonAppUsage *self,
+           UsageData        *usage)
+{
+  if (usage->epoch != self->epoch)
+    {
+      /* Past a thousand halvings, the score is 0 anyway */
+      usage->score = ldexp (usage->score, - (int) MIN (self->epoch - usage->epoch, 1100));
+      usage->epoch = self->epoch;
+    }
+
+  return usage->score;
+}
+
 /* Limit the score to a certain level so that most used apps can change */
 static void
 normalize_usage (CinnamonAppUsage *self)
 {
-  UsageIterator iter;
-  const char *context;
-  const char *id;
-  UsageData *usage;
-
-  usage_iterator_init (self, &iter);
-
-  while (usage_iterator_next (self, &iter, &context, &id, &usage))
-    {
-      usage->score /= 2;
-    }
+  self->epoch++;
 }
 
 static void
@@ -291,9 +375,11 @@ increment_usage_for_app_at_time (CinnamonAppUsage *self,
   usage_count = elapsed / FOCUS_TIME_MIN_SECONDS;
   if (usage_count > 0)
     {
-      usage->score += usage_count;
+      usage->score = get_score (self, usage) + usage_count;
       if (usage->score > SCORE_MAX)
         normalize_usage (self);
+      g_hash_table_remove (self->most_used_for_context,
+                           _cinnamon_window_tracker_get_app_context (cinnamon_window_tracker_get_default (), app));
       ensure_queued_save (self);
     }
 }
@@ -396,6 +482,7 @@ cinnamon_app_usage_init (CinnamonAppUsage *self)
   global = cinnamon_global_get ();
 
   self->app_usages_for_context = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_hash_table_destroy);
+  self->most_used_for_context = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_ptr_array_unref);
 
   tracker = cinnamon_window_tracker_get_default ();
   g_signal_connect (tracker, "notify::focus-app", G_CALLBACK (on_focus_app_changed), self);
@@ -420,11 +507,12 @@ cinnamon_app_usage_init (CinnamonAppUsage *self)
   self->enable_monitoring = FALSE;
 
   g_object_get (cinnamon_global_get(), "userdatadir", &cinnamon_userdata_dir, NULL),
-  path = g_build_filename (cinnamon_userdata_dir, DATA_FILENAME, NULL);
-  g_free (cinnamon_userdata_dir);
-  self->configfile = g_file_new_for_path (path);
+  path = g_build_filename (cinnamon_userdata_dir, LEGACY_FILENAME, NULL);
+  self->legacy_file = g_file_new_for_path (path);
   g_free (path);
-  restore_from_file (self);
+  self->store_path = g_build_filename (cinnamon_userdata_dir, STORE_FILENAME, NULL);
+  g_free (cinnamon_userdata_dir);
+  restore_usage (self);
 
 
   self->settings_notify = g_signal_connect (cinnamon_global_get_settings (global),
@@ -447,42 +535,90 @@ cinnamon_app_usage_finalize (GObject *object)
   g_signal_handler_disconnect (cinnamon_global_get_settings (global),
                                self->settings_notify);
 
-  g_object_unref (self->configfile);
+  if (self->store != NULL)
+    munmap (self->store, self->store_size);
+  g_free (self->store_path);
+  g_object_unref (self->legacy_file);
 
   g_object_unref (self->session_proxy);
 
   G_OBJECT_CLASS (cinnamon_app_usage_parent_class)->finalize(object);
 }
 
-typedef struct {
-  CinnamonAppUsage *usage;
-  GHashTable *context_usages;
-} SortAppsByUsageData;
+static int
+compare_scores (gdouble score_a,
+                gdouble score_b)
+{
+  if (score_a > score_b)
+    return -1;
+  else if (score_a < score_b)
+    return 1;
+  else
+    return 0;
+}
 
 static int
-sort_apps_by_usage (gconstpointer a,
-                    gconstpointer b,
-                    gpointer      datap)
+sort_ids_by_usage (gconstpointer a,
+                   gconstpointer b,
+                   gpointer      data)
 {
-  SortAppsByUsageData *data = datap;
-  CinnamonApp *app_a, *app_b;
+  GHashTable *context_usages = data;
+  const char *id_a = *(const char **)a;
+  const char *id_b = *(const char **)b;
   UsageData *usage_a, *usage_b;
+  int result;
 
-  app_a = (CinnamonApp*)a;
-  app_b = (CinnamonApp*)b;
+  usage_a = g_hash_table_lookup (context_usages, id_a);
+  usage_b = g_hash_table_lookup (context_usages, id_b);
 
-  usage_a = g_hash_table_lookup (data->context_usages, cinnamon_app_get_id (app_a));
-  usage_b = g_hash_table_lookup (data->context_usages, cinnamon_app_get_id (app_b));
+  /* All the scores are up to date, see get_most_used_ids() */
+  result = compare_scores (usage_a->score, usage_b->score);
+  if (result != 0)
+    return result;
 
-  return usage_b->score - usage_a->score;
+  return strcmp (id_a, id_b);
+}
+
+/* Returns the ids of the apps of @context, by decreasing score */
+static GPtrArray *
+get_most_used_ids (CinnamonAppUsage *self,
+                   const char       *context)
+{
+  GPtrArray *ids;
+  GHashTable *usages;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  ids = g_hash_table_lookup (self->most_used_for_context, context);
+  if (ids != NULL)
+    return ids;
+
+  usages = get_usages_for_context (self, context);
+  ids = g_ptr_array_sized_new (g_hash_table_size (usages));
+
+  /* The keys of the usage table, which invalidates this one before
+   * removing any */
+  g_hash_table_iter_init (&iter, usages);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      get_score (self, value);
+      g_ptr_array_add (ids, key);
+    }
+
+  g_ptr_array_sort_with_data (ids, sort_ids_by_usage, usages);
+
+  g_hash_table_insert (self->most_used_for_context, g_strdup (context), ids);
+
+  return ids;
 }
 
 /**
  * cinnamon_app_usage_get_most_used:
  * @usage: the usage instance to request
  * @context: Activity identifier
- * @max_count: how many applications are requested. Note that the actual
- *     list size may be less, or NULL if not enough applications are registered.
+ * @max_count: how many applications are requested, or -1 for all of
+ *     them. Note that the actual list size may be less, or NULL if not
+ *     enough applications are registered.
  *
  * Get a list of most popular applications for a given context.
  *
@@ -494,38 +630,32 @@ cinnamon_app_usage_get_most_used (CinnamonAppUsage   *self,
                                gint             max_count)
 {
   GSList *apps;
-  GList *appids, *iter;
-  GHashTable *usages;
+  GPtrArray *ids;
   CinnamonAppSystem *appsys;
-  SortAppsByUsageData data;
+  guint i;
+  gint n_apps;
 
-  usages = g_hash_table_lookup (self->app_usages_for_context, context);
-  if (usages == NULL)
+  if (g_hash_table_lookup (self->app_usages_for_context, context) == NULL)
     return NULL;
 
   appsys = cinnamon_app_system_get_default ();
+  ids = get_most_used_ids (self, context);
 
-  appids = g_hash_table_get_keys (usages);
   apps = NULL;
-  for (iter = appids; iter; iter = iter->next)
+  n_apps = 0;
+  for (i = 0; i < ids->len && (max_count < 0 || n_apps < max_count); i++)
     {
-      const char *appid = iter->data;
       CinnamonApp *app;
 
-      app = cinnamon_app_system_lookup_app (appsys, appid);
+      app = cinnamon_app_system_lookup_app (appsys, g_ptr_array_index (ids, i));
       if (!app)
         continue;
 
       apps = g_slist_prepend (apps, g_object_ref (app));
+      n_apps++;
     }
 
-  g_list_free (appids);
-
-  data.usage = self;
-  data.context_usages = usages;
-  apps = g_slist_sort_with_data (apps, sort_apps_by_usage, &data);
-
-  return apps;
+  return g_slist_reverse (apps);
 }
 
 
@@ -564,7 +694,7 @@ cinnamon_app_usage_compare (CinnamonAppUsage *self,
   else if (usage_b == NULL)
     return -1;
 
-  return usage_b->score - usage_a->score;
+  return compare_scores (get_score (self, usage_a), get_score (self, usage_b));
 }
 
 static void
@@ -578,7 +708,8 @@ ensure_queued_save (CinnamonAppUsage *self)
 /* Clean up apps we see rarely.
  * The logic behind this is that if an app was seen less than SCORE_MIN times
  * and not seen for a week, it can probably be forgotten about.
- * This should much reduce the size of the list and avoid 'pollution'. */
+ * This should much reduce the size of the list and avoid 'pollution'.
+ * Returns %TRUE if any app was removed. */
 static gboolean
 idle_clean_usage (CinnamonAppUsage *self)
 {
@@ -588,6 +719,7 @@ idle_clean_usage (CinnamonAppUsage *self)
   UsageData *usage;
   long current_time;
   long week_ago;
+  gboolean removed = FALSE;
 
   current_time = get_time ();
   week_ago = current_time - (7 * 24 * 60 * 60);
@@ -596,80 +728,301 @@ idle_clean_usage (CinnamonAppUsage *self)
 
   while (usage_iterator_next (self, &iter, &context, &id, &usage))
     {
-      if ((usage->score < SCORE_MIN) &&
+      if ((get_score (self, usage) < SCORE_MIN) &&
           (usage->last_seen < week_ago))
-        usage_iterator_remove (self, &iter);
+        {
+          usage_iterator_remove (self, &iter);
+          removed = TRUE;
+        }
     }
 
-  return FALSE;
+  if (removed)
+    g_hash_table_remove_all (self->most_used_for_context);
+
+  return removed;
+}
+
+static guint32
+store_commit_checksum (const StoreCommit *commit)
+{
+  const guint8 *p = (const guint8 *)commit;
+  guint32 hash = 2166136261u;
+  gsize i;
+
+  /* FNV-1a over the fields before the checksum */
+  for (i = 0; i < G_STRUCT_OFFSET (StoreCommit, checksum); i++)
+    hash = (hash ^ p[i]) * 16777619u;
+
+  return hash;
+}
+
+static StoreHeader *
+store_get_header (CinnamonAppUsage *self)
+{
+  return (StoreHeader *)self->store;
+}
+
+static StoreRecord *
+store_get_records (CinnamonAppUsage *self)
+{
+  return (StoreRecord *)(self->store + sizeof (StoreHeader));
+}
+
+static char *
+store_get_strings (CinnamonAppUsage *self)
+{
+  return (char *)(store_get_records (self) + store_get_header (self)->record_capacity);
+}
+
+static gsize
+store_size_for_capacity (guint32 record_capacity,
+                         guint32 strings_capacity)
+{
+  return sizeof (StoreHeader) + (gsize)record_capacity * sizeof (StoreRecord) + strings_capacity;
+}
+
+static void
+store_unmap (CinnamonAppUsage *self)
+{
+  if (self->store == NULL)
+    return;
+
+  munmap (self->store, self->store_size);
+  self->store = NULL;
+  self->store_size = 0;
 }
 
 static gboolean
-write_escaped (GDataOutputStream   *stream,
-               const char          *str,
-               GError             **error)
+store_commit_is_valid (const StoreHeader *header,
+                       const StoreCommit *commit)
 {
-  gboolean ret;
-  char *quoted = g_markup_escape_text (str, -1);
-  ret = g_data_output_stream_put_string (stream, quoted, NULL, error);
-  g_free (quoted);
-  return ret;
+  return commit->checksum == store_commit_checksum (commit) &&
+         commit->n_records <= header->record_capacity &&
+         commit->strings_size <= header->strings_capacity;
 }
 
+/* Maps the store read-write and finds its current commit */
 static gboolean
-write_attribute_string (GDataOutputStream *stream,
-                        const char        *elt_name,
-                        const char        *str,
-                        GError           **error)
+store_map (CinnamonAppUsage  *self,
+           GError           **error)
 {
-  gboolean ret = FALSE;
-  char *elt;
+  StoreHeader *header;
+  struct stat buf;
+  gboolean valid[2];
+  int fd;
 
-  elt = g_strdup_printf (" %s=\"", elt_name);
-  ret = g_data_output_stream_put_string (stream, elt, NULL, error);
-  g_free (elt);
-  if (!ret)
-    goto out;
+  fd = open (self->store_path, O_RDWR);
+  if (fd < 0 || fstat (fd, &buf) < 0)
+    {
+      int errsv = errno;
 
-  ret = write_escaped (stream, str, error);
-  if (!ret)
-    goto out;
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                   "%s", g_strerror (errsv));
+      if (fd >= 0)
+        close (fd);
+      return FALSE;
+    }
 
-  ret = g_data_output_stream_put_string (stream, "\"", NULL, error);
+  if ((gsize)buf.st_size < sizeof (StoreHeader))
+    goto invalid;
 
-out:
-  return ret;
+  self->store = mmap (NULL, buf.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (self->store == MAP_FAILED)
+    {
+      int errsv = errno;
+
+      self->store = NULL;
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                   "%s", g_strerror (errsv));
+      close (fd);
+      return FALSE;
+    }
+  self->store_size = buf.st_size;
+  close (fd);
+  fd = -1;
+
+  header = store_get_header (self);
+  if (header->magic != STORE_MAGIC ||
+      header->version != STORE_VERSION ||
+      store_size_for_capacity (header->record_capacity, header->strings_capacity) != self->store_size)
+    goto invalid;
+
+  valid[0] = store_commit_is_valid (header, &header->commits[0]);
+  valid[1] = store_commit_is_valid (header, &header->commits[1]);
+
+  if (valid[0] && valid[1])
+    self->current_commit = header->commits[1].generation > header->commits[0].generation;
+  else if (valid[0] || valid[1])
+    self->current_commit = valid[1];
+  else
+    goto invalid;
+
+  return TRUE;
+
+invalid:
+  if (fd >= 0)
+    close (fd);
+  store_unmap (self);
+  g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+               "%s is not a valid applications usage store", self->store_path);
+  return FALSE;
 }
 
-static gboolean
-write_attribute_uint (GDataOutputStream *stream,
-                      const char        *elt_name,
-                      guint              value,
-                      GError           **error)
+/* Makes @n_records records and @strings_size bytes of strings the current
+ * contents of the store, by writing them to the other commit slot */
+static void
+store_write_commit (CinnamonAppUsage *self,
+                    guint32           n_records,
+                    guint32           strings_size)
 {
-  gboolean ret;
-  char *buf;
+  StoreHeader *header = store_get_header (self);
+  StoreCommit *current = &header->commits[self->current_commit];
+  StoreCommit *next = &header->commits[!self->current_commit];
+
+  next->generation = current->generation + 1;
+  next->n_records = n_records;
+  next->strings_size = strings_size;
+  next->padding = 0;
+  next->checksum = store_commit_checksum (next);
 
-  buf = g_strdup_printf ("%u", value);
-  ret = write_attribute_string (stream, elt_name, buf, error);
-  g_free (buf);
+  self->current_commit = !self->current_commit;
+}
 
-  return ret;
+static void
+fill_record (CinnamonAppUsage *self,
+             StoreRecord      *record,
+             UsageData        *usage,
+             CinnamonApp      *app)
+{
+  record->score = get_score (self, usage);
+  record->last_seen = usage->last_seen;
+  record->n_windows = app ? cinnamon_app_get_n_windows (app) : 0;
+  record->flags = app ? 0 : RECORD_FLAG_UNINSTALLED;
 }
 
 static gboolean
-write_attribute_double (GDataOutputStream *stream,
-                        const char        *elt_name,
-                        double             value,
-                        GError           **error)
+record_equal (const StoreRecord *a,
+              const StoreRecord *b)
+{
+  return a->score == b->score &&
+         a->last_seen == b->last_seen &&
+         a->n_windows == b->n_windows &&
+         a->flags == b->flags;
+}
+
+/* Writes all the usage data to a new store, which replaces the old one */
+static void
+store_rewrite (CinnamonAppUsage *self)
 {
-  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
-  gboolean ret;
+  UsageIterator iter;
+  const char *context;
+  const char *id;
+  UsageData *usage;
+  GHashTable *context_offsets;
+  CinnamonAppSystem *app_system;
+  StoreHeader *header;
+  StoreRecord *records;
+  char *strings;
+  guint8 *contents;
+  guint32 n_records, strings_size, record_capacity, strings_capacity;
+  gsize size;
+  GError *error = NULL;
+
+  store_unmap (self);
+
+  app_system = cinnamon_app_system_get_default ();
+  context_offsets = g_hash_table_new (g_str_hash, g_str_equal);
+  n_records = 0;
+  strings_size = 0;
+
+  /* Applications that aren't installed anymore are dropped */
+  usage_iterator_init (self, &iter);
+  while (usage_iterator_next (self, &iter, &context, &id, &usage))
+    {
+      usage->record = 0;
+
+      if (!cinnamon_app_system_lookup_app (app_system, id))
+        continue;
+
+      n_records++;
+      if (!g_hash_table_lookup_extended (context_offsets, context, NULL, NULL))
+        {
+          g_hash_table_insert (context_offsets, (char *)context, NULL);
+          strings_size += strlen (context) + 1;
+        }
+      strings_size += strlen (id) + 1;
+    }
+
+  /* Leave room to add records in place for a while */
+  record_capacity = MAX (STORE_MIN_RECORDS, 2 * n_records);
+  strings_capacity = MAX (STORE_MIN_STRINGS_SIZE, 2 * strings_size);
+  size = store_size_for_capacity (record_capacity, strings_capacity);
+  contents = g_malloc0 (size);
+
+  header = (StoreHeader *)contents;
+  header->magic = STORE_MAGIC;
+  header->version = STORE_VERSION;
+  header->record_capacity = record_capacity;
+  header->strings_capacity = strings_capacity;
+
+  records = (StoreRecord *)(contents + sizeof (StoreHeader));
+  strings = (char *)(records + record_capacity);
 
-  g_ascii_dtostr (buf, sizeof (buf), value);
-  ret = write_attribute_string (stream, elt_name, buf, error);
+  g_hash_table_remove_all (context_offsets);
+  n_records = 0;
+  strings_size = 0;
 
-  return ret;
+  usage_iterator_init (self, &iter);
+  while (usage_iterator_next (self, &iter, &context, &id, &usage))
+    {
+      CinnamonApp *app;
+      StoreRecord *record;
+      gpointer offset;
+
+      app = cinnamon_app_system_lookup_app (app_system, id);
+      if (!app)
+        continue;
+
+      record = &records[n_records];
+      fill_record (self, record, usage, app);
+
+      if (!g_hash_table_lookup_extended (context_offsets, context, NULL, &offset))
+        {
+          offset = GUINT_TO_POINTER (strings_size);
+          g_hash_table_insert (context_offsets, (char *)context, offset);
+          strcpy (strings + strings_size, context);
+          strings_size += strlen (context) + 1;
+        }
+      record->context = GPOINTER_TO_UINT (offset);
+
+      record->id = strings_size;
+      strcpy (strings + strings_size, id);
+      strings_size += strlen (id) + 1;
+
+      usage->record = ++n_records;
+    }
+
+  header->commits[0].generation = 1;
+  header->commits[0].n_records = n_records;
+  header->commits[0].strings_size = strings_size;
+  header->commits[0].checksum = store_commit_checksum (&header->commits[0]);
+
+  g_hash_table_destroy (context_offsets);
+
+  /* Parent directory is already created by cinnamon-global */
+  if (!g_file_set_contents (self->store_path, (char *)contents, size, &error) ||
+      !store_map (self, &error))
+    {
+      g_debug ("Could not save applications usage data: %s", error->message);
+      g_error_free (error);
+
+      /* Everything will be written again next time */
+      usage_iterator_init (self, &iter);
+      while (usage_iterator_next (self, &iter, &context, &id, &usage))
+        usage->record = 0;
+    }
+
+  g_free (contents);
 }
 
 /* Save app data lists to file */
@@ -678,92 +1031,130 @@ idle_save_application_usage (gpointer data)
 {
   CinnamonAppUsage *self = CINNAMON_APP_USAGE (data);
   UsageIterator iter;
-  const char *current_context;
   const char *context;
   const char *id;
   UsageData *usage;
-  GFileOutputStream *output;
-  GOutputStream *buffered_output;
-  GDataOutputStream *data_output;
-  GError *error = NULL;
+  StoreHeader *header;
+  StoreRecord *records;
+  char *strings;
+  guint32 n_records, strings_size;
+  gboolean appended = FALSE;
 
   self->save_id = 0;
 
-  /* Parent directory is already created by cinnamon-global */
-  output = g_file_replace (self->configfile, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error);
-  if (!output)
+  if (self->store == NULL)
     {
-      g_debug ("Could not save applications usage data: %s", error->message);
-      g_error_free (error);
+      store_rewrite (self);
       return FALSE;
     }
-  buffered_output = g_buffered_output_stream_new (G_OUTPUT_STREAM (output));
-  g_object_unref (output);
-  data_output = g_data_output_stream_new (G_OUTPUT_STREAM (buffered_output));
-  g_object_unref (buffered_output);
 
-  if (!g_data_output_stream_put_string (data_output, "<?xml version=\"1.0\"?>\n<application-state>\n", NULL, &error))
-    goto out;
+  header = store_get_header (self);
+  records = store_get_records (self);
+  strings = store_get_strings (self);
+  n_records = header->commits[self->current_commit].n_records;
+  strings_size = header->commits[self->current_commit].strings_size;
 
   usage_iterator_init (self, &iter);
-
-  current_context = NULL;
   while (usage_iterator_next (self, &iter, &context, &id, &usage))
     {
       CinnamonApp *app;
+      StoreRecord record;
+      gsize context_size, id_size;
 
       app = cinnamon_app_system_lookup_app (cinnamon_app_system_get_default(), id);
+      fill_record (self, &record, usage, app);
+
+      if (usage->record != 0)
+        {
+          StoreRecord *stored = &records[usage->record - 1];
+
+          if (!record_equal (stored, &record))
+            {
+              stored->score = record.score;
+              stored->last_seen = record.last_seen;
+              stored->n_windows = record.n_windows;
+              stored->flags = record.flags;
+            }
+          continue;
+        }
 
       if (!app)
         continue;
 
-      if (context != current_context)
+      context_size = strlen (context) + 1;
+      id_size = strlen (id) + 1;
+      if (n_records == header->record_capacity ||
+          strings_size + context_size + id_size > header->strings_capacity)
         {
-          if (current_context != NULL)
-            {
-              if (!g_data_output_stream_put_string (data_output, "  </context>", NULL, &error))
-                goto out;
-            }
-          current_context = context;
-          if (!g_data_output_stream_put_string (data_output, "  <context", NULL, &error))
-            goto out;
-          if (!write_attribute_string (data_output, "id", context, &error))
-            goto out;
-          if (!g_data_output_stream_put_string (data_output, ">\n", NULL, &error))
-            goto out;
+          store_rewrite (self);
+          return FALSE;
         }
-      if (!g_data_output_stream_put_string (data_output, "    <application", NULL, &error))
-        goto out;
-      if (!write_attribute_string (data_output, "id", id, &error))
-        goto out;
-      if (!write_attribute_uint (data_output, "open-window-count", cinnamon_app_get_n_windows (app), &error))
-        goto out;
 
-      if (!write_attribute_double (data_output, "score", usage->score, &error))
-        goto out;
-      if (!write_attribute_uint (data_output, "last-seen", usage->last_seen, &error))
-        goto out;
-      if (!g_data_output_stream_put_string (data_output, "/>\n", NULL, &error))
-        goto out;
+      /* Appended past the current commit, so not visible until the next */
+      record.context = strings_size;
+      memcpy (strings + strings_size, context, context_size);
+      strings_size += context_size;
+
+      record.id = strings_size;
+      memcpy (strings + strings_size, id, id_size);
+      strings_size += id_size;
+
+      records[n_records] = record;
+      usage->record = ++n_records;
+      appended = TRUE;
     }
-  if (current_context != NULL)
+
+  if (appended)
     {
-      if (!g_data_output_stream_put_string (data_output, "  </context>\n", NULL, &error))
-        goto out;
+      /* The new records must be on disk before the commit refers to them */
+      msync (self->store, self->store_size, MS_SYNC);
+      store_write_commit (self, n_records, strings_size);
     }
-  if (!g_data_output_stream_put_string (data_output, "</application-state>\n", NULL, &error))
-    goto out;
 
-out:
-  if (!error)
-    g_output_stream_close_async (G_OUTPUT_STREAM (data_output), 0, NULL, NULL, NULL);
-  g_object_unref (data_output);
-  if (error)
+  msync (self->store, self->store_size, MS_ASYNC);
+
+  return FALSE;
+}
+
+/* Load data about apps usage from the store */
+static void
+load_from_store (CinnamonAppUsage *self)
+{
+  StoreHeader *header = store_get_header (self);
+  StoreRecord *records = store_get_records (self);
+  const char *strings = store_get_strings (self);
+  guint32 n_records = header->commits[self->current_commit].n_records;
+  guint32 strings_size = header->commits[self->current_commit].strings_size;
+  guint32 i;
+
+  for (i = 0; i < n_records; i++)
     {
-      g_debug ("Could not save applications usage data: %s", error->message);
-      g_error_free (error);
+      StoreRecord *record = &records[i];
+      UsageData *usage;
+      const char *context, *id;
+
+      if (record->flags & RECORD_FLAG_UNINSTALLED)
+        continue;
+
+      if (record->context >= strings_size ||
+          record->id >= strings_size ||
+          memchr (strings + record->context, '\0', strings_size - record->context) == NULL ||
+          memchr (strings + record->id, '\0', strings_size - record->id) == NULL)
+        continue;
+
+      context = strings + record->context;
+      id = strings + record->id;
+
+      usage = g_new0 (UsageData, 1);
+      usage->score = record->score;
+      usage->last_seen = record->last_seen;
+      usage->record = i + 1;
+      g_hash_table_replace (get_usages_for_context (self, context), g_strdup (id), usage);
+
+      if (record->n_windows > 0)
+        self->previously_running = g_slist_prepend (self->previously_running,
+                                                    g_strdup (id));
     }
-  return FALSE;
 }
 
 typedef struct {
@@ -898,9 +1289,9 @@ static GMarkupParser app_state_parse_funcs =
   NULL
 };
 
-/* Load data about apps usage from file */
+/* Load data about apps usage from the XML file older versions saved */
 static void
-restore_from_file (CinnamonAppUsage *self)
+restore_from_legacy_file (CinnamonAppUsage *self)
 {
   GFileInputStream *input;
   ParseData parse_data;
@@ -908,7 +1299,7 @@ restore_from_file (CinnamonAppUsage *self)
   GError *error = NULL;
   char buf[1024];
 
-  input = g_file_read (self->configfile, NULL, &error);
+  input = g_file_read (self->legacy_file, NULL, &error);
   if (error)
     {
       if (error->code != G_IO_ERROR_NOT_FOUND)
@@ -938,8 +1329,6 @@ out:
   g_input_stream_close ((GInputStream*)input, NULL, NULL);
   g_object_unref (input);
 
-  idle_clean_usage (self);
-
   if (error)
     {
       g_warning ("Could not load applications usage data: %s", error->message);
@@ -947,6 +1336,42 @@ out:
     }
 }
 
+static void
+restore_usage (CinnamonAppUsage *self)
+{
+  gboolean needs_rewrite = FALSE;
+  GError *error = NULL;
+  gint64 start;
+
+  start = g_get_monotonic_time ();
+
+  if (store_map (self, &error))
+    {
+      load_from_store (self);
+    }
+  else
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        g_warning ("Could not load applications usage data: %s", error->message);
+      g_clear_error (&error);
+
+      /* The XML file stays behind for older versions, but is only read
+       * until there is a store */
+      restore_from_legacy_file (self);
+      needs_rewrite = TRUE;
+    }
+
+  if (idle_clean_usage (self))
+    needs_rewrite = TRUE;
+
+  if (needs_rewrite)
+    store_rewrite (self);
+
+  cinnamon_perf_log_update_statistic_x (cinnamon_perf_log_get_default (),
+                                        "applicationUsage.loadTime",
+                                        g_get_monotonic_time () - start);
+}
+
 /* Enable or disable the timers, depending on the value of ENABLE_MONITORING_KEY
  * and taking care of the previous state.  If selfing is disabled, we still
  * report apps usage based on (possibly) saved data, but don't collect data.
@@ -13,6 +13,7 @@
 #include "cinnamon-global.h"
 #include "cinnamon-util.h"
 #include "cinnamon-app-system-private.h"
+#include "cinnamon-image-ops-private.h"
 #include "cinnamon-window-tracker-private.h"
 #include "st.h"
 
@@ -207,9 +208,6 @@ cinnamon_app_create_faded_icon_cpu (StTextureCache *cache,
   gint width, height, rowstride;
   guint8 n_channels;
   gboolean have_alpha;
-  gint fade_start;
-  gint fade_range;
-  guint i, j;
   guint pixbuf_byte_size;
   guint8 *orig_pixels;
   guint8 *pixels;
@@ -257,24 +255,11 @@ cinnamon_app_create_faded_icon_cpu (StTextureCache *cache,
   pixbuf_byte_size = (height - 1) * rowstride +
     + width * ((n_channels * gdk_pixbuf_get_bits_per_sample (pixbuf) + 7) / 8);
 
+  /* The pixbuf may be shared with other users of the icon theme */
   pixels = g_malloc0 (rowstride * height);
   memcpy (pixels, orig_pixels, pixbuf_byte_size);
 
-  fade_start = width / 2;
-  fade_range = width - fade_start;
-  for (i = fade_start; i < width; i++)
-    {
-      for (j = 0; j < height; j++)
-        {
-          guchar *pixel = &pixels[j * rowstride + i * n_channels];
-          float fade = 1.0 - ((float) i - fade_start) / fade_range;
-          pixel[0] = 0.5 + pixel[0] * fade;
-          pixel[1] = 0.5 + pixel[1] * fade;
-          pixel[2] = 0.5 + pixel[2] * fade;
-          if (have_alpha)
-            pixel[3] = 0.5 + pixel[3] * fade;
-        }
-    }
+  _cinnamon_image_fade_horizontal (pixels, width, height, rowstride, n_channels, width / 2);
 
   texture = cogl_texture_new_from_data (width,
                                         height,
@@ -832,10 +817,16 @@ _cinnamon_app_set_entry (CinnamonApp       *app,
   if (app->entry != NULL)
     gmenu_tree_item_unref (app->entry);
   app->entry = gmenu_tree_item_ref (entry);
-  
-  if (app->name_collation_key != NULL)
-    g_free (app->name_collation_key);
-  app->name_collation_key = g_utf8_collate_key (cinnamon_app_get_name (app), -1);
+
+  /* Computed again when needed, unless set from the cache */
+  g_free (app->name_collation_key);
+  app->name_collation_key = NULL;
+  g_free (app->casefolded_name);
+  app->casefolded_name = NULL;
+  g_free (app->casefolded_description);
+  app->casefolded_description = NULL;
+  g_free (app->casefolded_exec);
+  app->casefolded_exec = NULL;
 }
 
 static void
@@ -1232,7 +1223,74 @@ cinnamon_app_init_search_data (CinnamonApp *app)
 int
 cinnamon_app_compare_by_name (CinnamonApp *app, CinnamonApp *other)
 {
-  return strcmp (app->name_collation_key, other->name_collation_key);
+  return strcmp (_cinnamon_app_get_name_collation_key (app),
+                 _cinnamon_app_get_name_collation_key (other));
+}
+
+/**
+ * _cinnamon_app_get_name_collation_key:
+ * @app: a #CinnamonApp
+ *
+ * Return value: the collation key of the name of @app
+ */
+const char *
+_cinnamon_app_get_name_collation_key (CinnamonApp *app)
+{
+  if (G_UNLIKELY (!app->name_collation_key))
+    app->name_collation_key = g_utf8_collate_key (cinnamon_app_get_name (app), -1);
+
+  return app->name_collation_key;
+}
+
+/**
+ * _cinnamon_app_set_search_data:
+ * @app: a #CinnamonApp
+ * @name: the casefolded name
+ * @exec: (allow-none): the casefolded executable name
+ * @description: (allow-none): the casefolded description
+ * @name_collation_key: the collation key of the name
+ *
+ * Sets what would otherwise be computed from the entry of @app, when it is
+ * already known.
+ */
+void
+_cinnamon_app_set_search_data (CinnamonApp *app,
+                               const char  *name,
+                               const char  *exec,
+                               const char  *description,
+                               const char  *name_collation_key)
+{
+  g_free (app->casefolded_name);
+  app->casefolded_name = g_strdup (name);
+  g_free (app->casefolded_exec);
+  app->casefolded_exec = g_strdup (exec);
+  g_free (app->casefolded_description);
+  app->casefolded_description = g_strdup (description);
+  g_free (app->name_collation_key);
+  app->name_collation_key = g_strdup (name_collation_key);
+}
+
+/**
+ * _cinnamon_app_get_search_strings:
+ * @app: a #CinnamonApp
+ * @name: (out): the casefolded name
+ * @exec: (out): the casefolded executable name, or %NULL
+ * @description: (out): the casefolded description, or %NULL
+ *
+ * Gets the strings search terms are matched against, for indexing.
+ */
+void
+_cinnamon_app_get_search_strings (CinnamonApp  *app,
+                                  const char  **name,
+                                  const char  **exec,
+                                  const char  **description)
+{
+  if (G_UNLIKELY (!app->casefolded_name))
+    cinnamon_app_init_search_data (app);
+
+  *name = app->casefolded_name;
+  *exec = app->casefolded_exec;
+  *description = app->casefolded_description;
 }
 
 static CinnamonAppSearchMatch
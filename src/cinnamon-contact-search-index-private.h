@@ -0,0 +1,36 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+#ifndef __CINNAMON_CONTACT_SEARCH_INDEX_PRIVATE_H__
+#define __CINNAMON_CONTACT_SEARCH_INDEX_PRIVATE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define CINNAMON_CONTACT_NAME_PREFIX_WEIGHT     100
+#define CINNAMON_CONTACT_NAME_SUBSTRING_WEIGHT  90
+#define CINNAMON_CONTACT_NAME_FUZZY_WEIGHT      50
+#define CINNAMON_CONTACT_ADDR_PREFIX_WEIGHT     10
+#define CINNAMON_CONTACT_ADDR_SUBSTRING_WEIGHT  5
+
+typedef struct _CinnamonContactSearchIndex CinnamonContactSearchIndex;
+
+CinnamonContactSearchIndex *_cinnamon_contact_search_index_new       (void);
+void                        _cinnamon_contact_search_index_free      (CinnamonContactSearchIndex *index);
+
+void                        _cinnamon_contact_search_index_add       (CinnamonContactSearchIndex *index,
+                                                                      const char                 *id,
+                                                                      const char * const         *names,
+                                                                      const char * const         *addresses);
+void                        _cinnamon_contact_search_index_remove    (CinnamonContactSearchIndex *index,
+                                                                      const char                 *id);
+guint                       _cinnamon_contact_search_index_get_size  (CinnamonContactSearchIndex *index);
+
+GSList                     *_cinnamon_contact_search_index_search    (CinnamonContactSearchIndex *index,
+                                                                      GSList                     *terms);
+GSList                     *_cinnamon_contact_search_index_subsearch (CinnamonContactSearchIndex *index,
+                                                                      GSList                     *previous_results,
+                                                                      GSList                     *terms);
+
+G_END_DECLS
+
+#endif /* __CINNAMON_CONTACT_SEARCH_INDEX_PRIVATE_H__ */
@@ -0,0 +1,433 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* An inverted index over the names and addresses of contacts, kept up to
+ * date as contacts come and go, so that searching tens of thousands of
+ * them doesn't mean normalizing and scanning all their strings on every
+ * keystroke.
+ *
+ * Like the application index, the normalized and casefolded strings of
+ * each contact go into a CinnamonNgramIndex, which gives the only
+ * candidates for an exact match.
+ *
+ * Contacts are numbered in the order they are added, as the n-gram index
+ * wants. A contact that changes is removed and added again; removed
+ * contacts only leave a hole, skipped by searches, until holes are the
+ * majority and the index is rebuilt without them.
+ *
+ * When nothing matches exactly, the names of all the contacts are scored
+ * with the typo-tolerant matching of cinnamon-fuzzy-match.c instead.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "cinnamon-contact-search-index-private.h"
+#include "cinnamon-fuzzy-match-private.h"
+#include "cinnamon-ngram-index-private.h"
+
+/* Below this many holes, rebuilding isn't worth it */
+#define MIN_HOLES_TO_COMPACT 64
+
+typedef struct {
+  char  *id;          /* NULL once removed */
+  char **names;       /* alias, full name, nickname */
+  char **addresses;   /* IM and email addresses */
+} IndexedContact;
+
+typedef struct {
+  guint32 doc;
+  guint   weight;
+} SearchResult;
+
+struct _CinnamonContactSearchIndex {
+  GArray             *contacts;    /* IndexedContact, by document number */
+  GHashTable         *id_to_doc;   /* id => document number + 1 */
+  CinnamonNgramIndex *ngrams;
+  guint               n_removed;
+};
+
+static void
+index_strings (CinnamonContactSearchIndex *index,
+               char                      **strings,
+               guint32                     doc)
+{
+  char **s;
+
+  for (s = strings; *s; s++)
+    _cinnamon_ngram_index_add_string (index->ngrams, *s, doc);
+}
+
+/* Appends @contact, whose strings the index takes over */
+static void
+append_contact (CinnamonContactSearchIndex *index,
+                IndexedContact             *contact)
+{
+  guint32 doc = index->contacts->len;
+
+  g_array_append_val (index->contacts, *contact);
+  g_hash_table_insert (index->id_to_doc, contact->id, GUINT_TO_POINTER (doc + 1));
+
+  index_strings (index, contact->names, doc);
+  index_strings (index, contact->addresses, doc);
+}
+
+/* Renumbers the remaining contacts, in the same order */
+static void
+compact (CinnamonContactSearchIndex *index)
+{
+  GArray *contacts = index->contacts;
+  guint i;
+
+  index->contacts = g_array_sized_new (FALSE, FALSE, sizeof (IndexedContact),
+                                       contacts->len - index->n_removed);
+  index->n_removed = 0;
+  g_hash_table_remove_all (index->id_to_doc);
+  _cinnamon_ngram_index_clear (index->ngrams);
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      IndexedContact *contact = &g_array_index (contacts, IndexedContact, i);
+
+      if (contact->id != NULL)
+        append_contact (index, contact);
+    }
+
+  g_array_free (contacts, TRUE);
+}
+
+CinnamonContactSearchIndex *
+_cinnamon_contact_search_index_new (void)
+{
+  CinnamonContactSearchIndex *index;
+
+  index = g_slice_new0 (CinnamonContactSearchIndex);
+  index->contacts = g_array_new (FALSE, FALSE, sizeof (IndexedContact));
+  index->id_to_doc = g_hash_table_new (g_str_hash, g_str_equal);
+  index->ngrams = _cinnamon_ngram_index_new ();
+
+  return index;
+}
+
+void
+_cinnamon_contact_search_index_free (CinnamonContactSearchIndex *index)
+{
+  guint i;
+
+  for (i = 0; i < index->contacts->len; i++)
+    {
+      IndexedContact *contact = &g_array_index (index->contacts, IndexedContact, i);
+
+      g_free (contact->id);
+      g_strfreev (contact->names);
+      g_strfreev (contact->addresses);
+    }
+
+  g_array_free (index->contacts, TRUE);
+  g_hash_table_destroy (index->id_to_doc);
+  _cinnamon_ngram_index_free (index->ngrams);
+  g_slice_free (CinnamonContactSearchIndex, index);
+}
+
+/**
+ * _cinnamon_contact_search_index_add:
+ * @index: a #CinnamonContactSearchIndex
+ * @id: the identifier of the contact
+ * @names: (array zero-terminated=1): normalized and casefolded names
+ * @addresses: (array zero-terminated=1): normalized and casefolded IM
+ *   and email addresses
+ *
+ * Adds a contact to the index, replacing the one with the same @id, if
+ * any.
+ */
+void
+_cinnamon_contact_search_index_add (CinnamonContactSearchIndex *index,
+                                    const char                 *id,
+                                    const char * const         *names,
+                                    const char * const         *addresses)
+{
+  IndexedContact contact;
+
+  _cinnamon_contact_search_index_remove (index, id);
+
+  contact.id = g_strdup (id);
+  contact.names = g_strdupv ((char **) names);
+  contact.addresses = g_strdupv ((char **) addresses);
+
+  append_contact (index, &contact);
+}
+
+/**
+ * _cinnamon_contact_search_index_remove:
+ * @index: a #CinnamonContactSearchIndex
+ * @id: the identifier of a contact
+ *
+ * Removes the contact @id from the index, if it is there.
+ */
+void
+_cinnamon_contact_search_index_remove (CinnamonContactSearchIndex *index,
+                                       const char                 *id)
+{
+  IndexedContact *contact;
+  guint doc;
+
+  doc = GPOINTER_TO_UINT (g_hash_table_lookup (index->id_to_doc, id));
+  if (doc == 0)
+    return;
+
+  contact = &g_array_index (index->contacts, IndexedContact, doc - 1);
+
+  g_hash_table_remove (index->id_to_doc, contact->id);
+  g_free (contact->id);
+  g_strfreev (contact->names);
+  g_strfreev (contact->addresses);
+  contact->id = NULL;
+  contact->names = NULL;
+  contact->addresses = NULL;
+
+  index->n_removed++;
+  if (index->n_removed >= MIN_HOLES_TO_COMPACT &&
+      index->n_removed > index->contacts->len / 2)
+    compact (index);
+}
+
+/**
+ * _cinnamon_contact_search_index_get_size:
+ * @index: a #CinnamonContactSearchIndex
+ *
+ * Return value: the number of contacts in the index
+ */
+guint
+_cinnamon_contact_search_index_get_size (CinnamonContactSearchIndex *index)
+{
+  return index->contacts->len - index->n_removed;
+}
+
+/* Matches every term against the names and addresses of @contact; when
+ * @patterns is given, terms that don't match exactly may match names
+ * approximately */
+static guint
+match_contact (IndexedContact *contact,
+               GSList         *terms,
+               GPtrArray      *patterns)
+{
+  GSList *l;
+  char **s;
+  guint i;
+  guint weight = 0;
+
+  gboolean have_name_prefix = FALSE;
+  gboolean have_name_substring = FALSE;
+  gboolean have_name_fuzzy = FALSE;
+
+  gboolean have_addr_prefix = FALSE;
+  gboolean have_addr_substring = FALSE;
+
+  for (l = terms, i = 0; l; l = l->next, i++)
+    {
+      const char *term = l->data;
+      const char *p;
+      gboolean matched = FALSE;
+
+      for (s = contact->names; *s; s++)
+        {
+          p = strstr (*s, term);
+          if (p == *s)
+            have_name_prefix = matched = TRUE;
+          else if (p != NULL)
+            have_name_substring = matched = TRUE;
+        }
+
+      for (s = contact->addresses; *s; s++)
+        {
+          p = strstr (*s, term);
+          if (p == *s)
+            have_addr_prefix = matched = TRUE;
+          else if (p != NULL)
+            have_addr_substring = matched = TRUE;
+        }
+
+      /* Tolerate typos in names, but not in addresses */
+      if (!matched && patterns != NULL)
+        for (s = contact->names; *s && !matched; s++)
+          if (_cinnamon_fuzzy_pattern_score (g_ptr_array_index (patterns, i), *s) != 0)
+            have_name_fuzzy = matched = TRUE;
+
+      if (!matched)
+        return 0;
+    }
+
+  if (have_name_prefix)
+    weight += CINNAMON_CONTACT_NAME_PREFIX_WEIGHT;
+  else if (have_name_substring)
+    weight += CINNAMON_CONTACT_NAME_SUBSTRING_WEIGHT;
+  else if (have_name_fuzzy)
+    weight += CINNAMON_CONTACT_NAME_FUZZY_WEIGHT;
+
+  if (have_addr_prefix)
+    weight += CINNAMON_CONTACT_ADDR_PREFIX_WEIGHT;
+  else if (have_addr_substring)
+    weight += CINNAMON_CONTACT_ADDR_SUBSTRING_WEIGHT;
+
+  return weight;
+}
+
+static void
+add_result (GArray  *results,
+            guint32  doc,
+            guint    weight)
+{
+  SearchResult result;
+
+  result.doc = doc;
+  result.weight = weight;
+  g_array_append_val (results, result);
+}
+
+static gint
+compare_results (gconstpointer a,
+                 gconstpointer b)
+{
+  const SearchResult *result_a = a;
+  const SearchResult *result_b = b;
+
+  if (result_a->weight != result_b->weight)
+    return result_a->weight > result_b->weight ? -1 : 1;
+
+  return result_a->doc < result_b->doc ? -1 : (result_a->doc > result_b->doc);
+}
+
+static GSList *
+search (CinnamonContactSearchIndex *index,
+        GSList                     *terms,
+        GArray                     *restrict_to)
+{
+  GArray *results;
+  GArray *candidates;
+  GSList *ids = NULL;
+  guint32 doc;
+  guint weight;
+  gint i;
+
+  results = g_array_new (FALSE, FALSE, sizeof (SearchResult));
+
+  candidates = _cinnamon_ngram_index_find_candidates (index->ngrams, terms, restrict_to,
+                                                      index->contacts->len);
+  if (candidates != NULL)
+    {
+      for (i = 0; i < (gint)candidates->len; i++)
+        {
+          IndexedContact *contact;
+
+          doc = g_array_index (candidates, guint32, i);
+          contact = &g_array_index (index->contacts, IndexedContact, doc);
+          if (contact->id == NULL)
+            continue;
+
+          weight = match_contact (contact, terms, NULL);
+          if (weight != 0)
+            add_result (results, doc, weight);
+        }
+
+      g_array_free (candidates, TRUE);
+    }
+
+  /* Typos can make a contact match that wasn't in the previous results,
+   * so look at all of them */
+  if (results->len == 0 && terms != NULL)
+    {
+      GPtrArray *patterns = g_ptr_array_new ();
+      GSList *l;
+
+      for (l = terms; l; l = l->next)
+        g_ptr_array_add (patterns, _cinnamon_fuzzy_pattern_new (l->data));
+
+      for (doc = 0; doc < index->contacts->len; doc++)
+        {
+          IndexedContact *contact = &g_array_index (index->contacts, IndexedContact, doc);
+
+          if (contact->id == NULL)
+            continue;
+
+          weight = match_contact (contact, terms, patterns);
+          if (weight != 0)
+            add_result (results, doc, weight);
+        }
+
+      g_ptr_array_foreach (patterns, (GFunc)_cinnamon_fuzzy_pattern_free, NULL);
+      g_ptr_array_free (patterns, TRUE);
+    }
+
+  g_array_sort (results, compare_results);
+
+  for (i = results->len - 1; i >= 0; i--)
+    {
+      doc = g_array_index (results, SearchResult, i).doc;
+      ids = g_slist_prepend (ids, g_array_index (index->contacts, IndexedContact, doc).id);
+    }
+
+  g_array_free (results, TRUE);
+
+  return ids;
+}
+
+/**
+ * _cinnamon_contact_search_index_search:
+ * @index: a #CinnamonContactSearchIndex
+ * @terms: (element-type utf8): normalized and casefolded terms, logical AND
+ *
+ * Return value: (transfer container) (element-type utf8): the identifiers
+ *   of the matching contacts, best matches first; if there are none, the
+ *   closest approximate matches. The strings belong to the index and are
+ *   only valid until it is next modified.
+ */
+GSList *
+_cinnamon_contact_search_index_search (CinnamonContactSearchIndex *index,
+                                       GSList                     *terms)
+{
+  return search (index, terms, NULL);
+}
+
+/**
+ * _cinnamon_contact_search_index_subsearch:
+ * @index: a #CinnamonContactSearchIndex
+ * @previous_results: (element-type utf8): identifiers found by a previous
+ *   search with a prefix of @terms
+ * @terms: (element-type utf8): normalized and casefolded terms, logical AND
+ *
+ * Like _cinnamon_contact_search_index_search(), but only considers
+ * @previous_results for exact matches.
+ *
+ * Return value: (transfer container) (element-type utf8): the identifiers
+ *   of the matching contacts
+ */
+GSList *
+_cinnamon_contact_search_index_subsearch (CinnamonContactSearchIndex *index,
+                                          GSList                     *previous_results,
+                                          GSList                     *terms)
+{
+  GArray *previous_docs;
+  GSList *results;
+  GSList *l;
+
+  previous_docs = g_array_new (FALSE, FALSE, sizeof (guint32));
+  for (l = previous_results; l; l = l->next)
+    {
+      guint doc = GPOINTER_TO_UINT (g_hash_table_lookup (index->id_to_doc, l->data));
+
+      /* Contacts removed since don't match anymore */
+      if (doc != 0)
+        {
+          guint32 value = doc - 1;
+          g_array_append_val (previous_docs, value);
+        }
+    }
+
+  _cinnamon_ngram_docs_sort_unique (previous_docs);
+
+  results = search (index, terms, previous_docs);
+
+  g_array_free (previous_docs, TRUE);
+
+  return results;
+}
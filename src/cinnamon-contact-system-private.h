@@ -0,0 +1,20 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+#ifndef __CINNAMON_CONTACT_SYSTEM_PRIVATE_H__
+#define __CINNAMON_CONTACT_SYSTEM_PRIVATE_H__
+
+#include <gee.h>
+
+#include "cinnamon-contact-search-index-private.h"
+
+G_BEGIN_DECLS
+
+void _cinnamon_contact_system_individuals_changed (CinnamonContactSearchIndex *index,
+                                                   GeeSet                     *added,
+                                                   GeeSet                     *removed);
+void _cinnamon_contact_system_individual_notify   (GObject                    *individual,
+                                                   GParamSpec                 *pspec,
+                                                   CinnamonContactSearchIndex *index);
+
+G_END_DECLS
+
+#endif /* __CINNAMON_CONTACT_SYSTEM_PRIVATE_H__ */
@@ -5,23 +5,21 @@
 
 #include "cinnamon-contact-system.h"
 
+#include <string.h>
+
 #include <glib.h>
 #include <glib/gprintf.h>
 #include <gee.h>
 #include <clutter/clutter.h>
 #include <folks/folks.h>
 
+#include "cinnamon-contact-system-private.h"
 #include "cinnamon-global.h"
 #include "cinnamon-util.h"
 #include "st.h"
 
 G_DEFINE_TYPE (CinnamonContactSystem, cinnamon_contact_system, G_TYPE_OBJECT);
 
-#define NAME_PREFIX_MATCH_WEIGHT 100
-#define NAME_SUBSTRING_MATCH_WEIGHT 90
-#define ADDR_PREFIX_MATCH_WEIGHT 10
-#define ADDR_SUBSTRING_MATCH_WEIGHT 5
-
 
 /* Callbacks */
 
@@ -38,15 +36,184 @@ prepare_individual_aggregator_cb (GObject       *obj,
 
 /* Internal stuff */
 
-typedef struct {
-    gchar *key;
-    guint weight;
-} ContactSearchResult;
-
 struct _CinnamonContactSystemPrivate {
     FolksIndividualAggregator *aggregator;
+    CinnamonContactSearchIndex *index;
 };
 
+/* Adds the non-empty values of @addrs to @array */
+static void
+add_addresses (GPtrArray     *array,
+               GeeCollection *addrs)
+{
+  GeeIterator *addrs_iter = gee_iterable_iterator (GEE_ITERABLE (addrs));
+
+  while (gee_iterator_next (addrs_iter))
+    {
+      FolksAbstractFieldDetails *field = gee_iterator_get (addrs_iter);
+      const gchar *addr = folks_abstract_field_details_get_value (field);
+
+      if (addr != NULL && *addr != '\0')
+        g_ptr_array_add (array, cinnamon_util_normalize_and_casefold (addr));
+
+      g_object_unref (field);
+    }
+
+  g_object_unref (addrs_iter);
+}
+
+static void
+add_name (GPtrArray  *array,
+          const char *name)
+{
+  if (name != NULL && *name != '\0')
+    g_ptr_array_add (array, cinnamon_util_normalize_and_casefold (name));
+}
+
+/* Normalizes what @individual is searched by, once. Only properties are
+ * used, so that test-contact-search can feed fake individuals. */
+static void
+index_individual (CinnamonContactSearchIndex *index,
+                  GObject                    *individual)
+{
+  GPtrArray *names, *addresses;
+  GeeMultiMap *im_addr_map;
+  GeeSet *email_addrs;
+  GeeCollection *im_addrs;
+  char *id, *alias, *full_name, *nickname;
+
+  g_object_get (individual,
+                "id", &id,
+                "alias", &alias,
+                "full-name", &full_name,
+                "nickname", &nickname,
+                "im-addresses", &im_addr_map,
+                "email-addresses", &email_addrs,
+                NULL);
+
+  names = g_ptr_array_new ();
+  add_name (names, alias);
+  add_name (names, full_name);
+  add_name (names, nickname);
+  g_ptr_array_add (names, NULL);
+
+  addresses = g_ptr_array_new ();
+  if (im_addr_map != NULL)
+    {
+      im_addrs = gee_multi_map_get_values (im_addr_map);
+      add_addresses (addresses, im_addrs);
+      g_object_unref (im_addrs);
+      g_object_unref (im_addr_map);
+    }
+  if (email_addrs != NULL)
+    {
+      add_addresses (addresses, GEE_COLLECTION (email_addrs));
+      g_object_unref (email_addrs);
+    }
+  g_ptr_array_add (addresses, NULL);
+
+  _cinnamon_contact_search_index_add (index, id,
+                                      (const char * const *) names->pdata,
+                                      (const char * const *) addresses->pdata);
+
+  g_strfreev ((char **) g_ptr_array_free (names, FALSE));
+  g_strfreev ((char **) g_ptr_array_free (addresses, FALSE));
+
+  g_free (id);
+  g_free (alias);
+  g_free (full_name);
+  g_free (nickname);
+}
+
+/**
+ * _cinnamon_contact_system_individual_notify:
+ * @individual: a #FolksIndividual
+ * @pspec: the property that changed
+ * @index: the index @individual is in
+ *
+ * Handler of "notify" on the individuals in @index, connected by
+ * _cinnamon_contact_system_individuals_changed().
+ */
+void
+_cinnamon_contact_system_individual_notify (GObject                    *individual,
+                                            GParamSpec                 *pspec,
+                                            CinnamonContactSearchIndex *index)
+{
+  /* Presence changes all the time and isn't searched */
+  if (strcmp (pspec->name, "alias") == 0 ||
+      strcmp (pspec->name, "full-name") == 0 ||
+      strcmp (pspec->name, "nickname") == 0 ||
+      strcmp (pspec->name, "im-addresses") == 0 ||
+      strcmp (pspec->name, "email-addresses") == 0)
+    index_individual (index, individual);
+}
+
+/**
+ * _cinnamon_contact_system_individuals_changed:
+ * @index: a #CinnamonContactSearchIndex
+ * @added: (allow-none) (element-type FolksIndividual): new individuals
+ * @removed: (allow-none) (element-type FolksIndividual): individuals gone
+ *
+ * Keeps @index up to date with "individuals-changed", and with the
+ * changes of the individuals added.
+ */
+void
+_cinnamon_contact_system_individuals_changed (CinnamonContactSearchIndex *index,
+                                              GeeSet                     *added,
+                                              GeeSet                     *removed)
+{
+  GeeIterator *iter;
+
+  if (removed != NULL)
+    {
+      iter = gee_iterable_iterator (GEE_ITERABLE (removed));
+      while (gee_iterator_next (iter))
+        {
+          GObject *individual = gee_iterator_get (iter);
+          char *id;
+
+          g_signal_handlers_disconnect_by_func (individual,
+                                                _cinnamon_contact_system_individual_notify,
+                                                index);
+
+          g_object_get (individual, "id", &id, NULL);
+          _cinnamon_contact_search_index_remove (index, id);
+          g_free (id);
+
+          g_object_unref (individual);
+        }
+      g_object_unref (iter);
+    }
+
+  if (added != NULL)
+    {
+      iter = gee_iterable_iterator (GEE_ITERABLE (added));
+      while (gee_iterator_next (iter))
+        {
+          GObject *individual = gee_iterator_get (iter);
+
+          index_individual (index, individual);
+          g_signal_connect (individual, "notify",
+                            G_CALLBACK (_cinnamon_contact_system_individual_notify), index);
+
+          g_object_unref (individual);
+        }
+      g_object_unref (iter);
+    }
+}
+
+static void
+on_individuals_changed (FolksIndividualAggregator    *aggregator,
+                        GeeSet                       *added,
+                        GeeSet                       *removed,
+                        const gchar                  *message,
+                        FolksPersona                 *actor,
+                        FolksGroupDetailsChangeReason reason,
+                        CinnamonContactSystem        *self)
+{
+  _cinnamon_contact_system_individuals_changed (self->priv->index, added, removed);
+}
+
 static void
 cinnamon_contact_system_constructed (GObject *obj)
 {
@@ -54,12 +221,14 @@ cinnamon_contact_system_constructed (GObject *obj)
 
   G_OBJECT_CLASS (cinnamon_contact_system_parent_class)->constructed (obj);
 
-  /* We intentionally do not care about the "individuals-changed" signal, as
-   * we don't intend to update searches after they've been performed.
-   * Therefore, we will simply retrieve the "individuals" property which
-   * represents a snapshot of the individuals in the aggregator.
+  /* Searches don't get updated after they've been performed, but the
+   * index they use follows the "individuals-changed" signal, so that
+   * searching never has to go through all the individuals.
    */
+  self->priv->index = _cinnamon_contact_search_index_new ();
   self->priv->aggregator = folks_individual_aggregator_new ();
+  g_signal_connect (self->priv->aggregator, "individuals-changed",
+                    G_CALLBACK (on_individuals_changed), self);
   folks_individual_aggregator_prepare (self->priv->aggregator, prepare_individual_aggregator_cb, NULL);
 }
 
@@ -67,8 +236,23 @@ static void
 cinnamon_contact_system_finalize (GObject *obj)
 {
   CinnamonContactSystem *self = CINNAMON_CONTACT_SYSTEM (obj);
+  GeeMapIterator *iter;
 
+  iter = gee_map_map_iterator (folks_individual_aggregator_get_individuals (self->priv->aggregator));
+  while (gee_map_iterator_next (iter))
+    {
+      FolksIndividual *individual = gee_map_iterator_get_value (iter);
+
+      g_signal_handlers_disconnect_by_func (individual,
+                                            _cinnamon_contact_system_individual_notify,
+                                            self->priv->index);
+      g_object_unref (individual);
+    }
+  g_object_unref (iter);
+
+  g_signal_handlers_disconnect_by_func (self->priv->aggregator, on_individuals_changed, self);
   g_object_unref (self->priv->aggregator);
+  _cinnamon_contact_search_index_free (self->priv->index);
 
   G_OBJECT_CLASS (cinnamon_contact_system_parent_class)->finalize (obj);
 }
@@ -109,199 +293,6 @@ normalize_terms (GSList *terms)
   return normalized_terms;
 }
 
-static guint
-do_match (CinnamonContactSystem  *self,
-          FolksIndividual     *individual,
-          GSList              *terms)
-{
-  GSList *term_iter;
-  guint weight = 0;
-
-  char *alias = cinnamon_util_normalize_and_casefold (folks_alias_details_get_alias (FOLKS_ALIAS_DETAILS (individual)));
-  char *name = cinnamon_util_normalize_and_casefold (folks_name_details_get_full_name (FOLKS_NAME_DETAILS (individual)));
-  char *nick = cinnamon_util_normalize_and_casefold (folks_name_details_get_nickname (FOLKS_NAME_DETAILS (individual)));
-
-  GeeMultiMap *im_addr_map = folks_im_details_get_im_addresses (FOLKS_IM_DETAILS (individual));
-  GeeCollection *im_addrs = gee_multi_map_get_values (im_addr_map);
-  GeeSet *email_addrs = folks_email_details_get_email_addresses (FOLKS_EMAIL_DETAILS (individual));
-  GeeIterator *addrs_iter;
-
-  gboolean have_name_prefix = FALSE;
-  gboolean have_name_substring = FALSE;
-  
-  gboolean have_addr_prefix = FALSE;
-  gboolean have_addr_substring = FALSE;
-
-  for (term_iter = terms; term_iter; term_iter = term_iter->next)
-    {
-      const char *term = term_iter->data;
-      const char *p;
-      gboolean matched;
-
-      matched = FALSE;
-
-      /* Match on alias, name, nickname */
-      if (alias != NULL)
-	{
-	  p = strstr (alias, term);
-	  if (p == alias)
-            {
-	      have_name_prefix = TRUE;
-              matched = TRUE;
-            }
-	  else if (p != NULL)
-            {
-	      have_name_substring = TRUE;
-              matched = TRUE;
-            }
-	}
-      if (name != NULL)
-	{
-	  p = strstr (name, term);
-	  if (p == name)
-            {
-	      have_name_prefix = TRUE;
-              matched = TRUE;
-            }
-	  else if (p != NULL)
-            {
-	      have_name_substring = TRUE;
-              matched = TRUE;
-            }
-	}
-      if (nick != NULL)
-	{
-	  p = strstr (nick, term);
-	  if (p == nick)
-            {
-	      have_name_prefix = TRUE;
-              matched = TRUE;
-            }
-	  else if (p != NULL)
-            {
-	      have_name_substring = TRUE;
-              matched = TRUE;
-            }
-	}
-
-      /* Match on one or more IM or email addresses */
-      addrs_iter = gee_iterable_iterator (GEE_ITERABLE (im_addrs));
-
-      while (gee_iterator_next (addrs_iter))
-        {
-          FolksImFieldDetails *field = gee_iterator_get (addrs_iter);
-          const gchar *addr = folks_abstract_field_details_get_value ((FolksAbstractFieldDetails*)field);
-
-          p = strstr (addr, term);
-          if (p == addr)
-            {
-              have_addr_prefix = TRUE;
-              matched = TRUE;
-            }
-          else if (p != NULL)
-            {
-              have_addr_substring = TRUE;
-              matched = TRUE;
-            }
-
-          g_object_unref (field);
-        }
-
-      g_object_unref (addrs_iter);
-      addrs_iter = gee_iterable_iterator (GEE_ITERABLE (email_addrs));
-      while (gee_iterator_next (addrs_iter))
-        {
-          FolksEmailFieldDetails *field = gee_iterator_get (addrs_iter);
-          const gchar *addr = folks_abstract_field_details_get_value ((FolksAbstractFieldDetails*)field);
-
-          p = strstr (addr, term);
-          if (p == addr)
-            {
-              have_addr_prefix = TRUE;
-              matched = TRUE;
-            }
-          else if (p != NULL)
-            {
-              have_addr_substring = TRUE;
-              matched = TRUE;
-            }
-
-          g_object_unref (field);
-        }
-
-      g_object_unref (addrs_iter);
-
-      if (!matched)
-        {
-          have_name_prefix = FALSE;
-          have_name_substring = FALSE;
-          have_addr_prefix = FALSE;
-          have_addr_substring = FALSE;
-          break;
-        }
-    }
-
-    if (have_name_prefix)
-      weight += NAME_PREFIX_MATCH_WEIGHT;
-    else if (have_name_substring)
-      weight += NAME_SUBSTRING_MATCH_WEIGHT;
-
-    if (have_addr_prefix)
-      weight += ADDR_PREFIX_MATCH_WEIGHT;
-    else if (have_addr_substring)
-      weight += ADDR_SUBSTRING_MATCH_WEIGHT;
-
-  g_free (alias);
-  g_free (name);
-  g_free (nick);
-  g_object_unref (im_addrs);
-
-  return weight;
-}
-
-static gint
-compare_results (gconstpointer a,
-                 gconstpointer b)
-{
-  ContactSearchResult *first = (ContactSearchResult *) a;
-  ContactSearchResult *second = (ContactSearchResult *) b;
-
-  if (first->weight > second->weight)
-      return 1;
-  else if (first->weight < second->weight)
-      return -1;
-  else
-      return 0;
-}
-
-static void
-free_result (gpointer data,
-             gpointer user_data)
-{
-  g_slice_free (ContactSearchResult, data);
-}
-
-/* modifies and frees @results */
-static GSList *
-sort_and_prepare_results (GSList *results)
-{
-  GSList *iter;
-  GSList *sorted_results = NULL;
-
-  results = g_slist_sort (results, compare_results);
-
-  for (iter = results; iter; iter = iter->next)
-    {
-      ContactSearchResult *result = iter->data;
-      gchar *id = result->key;
-      sorted_results = g_slist_prepend (sorted_results, id);
-    }
-
-  g_slist_foreach (results, (GFunc) free_result, NULL);
-
-  return sorted_results;
-}
-
 
 /* Methods */
 
@@ -429,41 +420,18 @@ GSList *
 cinnamon_contact_system_initial_search (CinnamonContactSystem *self,
                                      GSList             *terms)
 {
-  FolksIndividual *individual;
-  GSList *results = NULL;
-  GeeMap *individuals = NULL;
-  ContactSearchResult *result;
-  GeeMapIterator *iter;
-  gpointer key;
-  guint weight;
-  GSList *normalized_terms = normalize_terms (terms);
+  GSList *normalized_terms;
+  GSList *results;
 
   g_return_val_if_fail (CINNAMON_IS_CONTACT_SYSTEM (self), NULL);
 
-  individuals = folks_individual_aggregator_get_individuals (self->priv->aggregator);
+  normalized_terms = normalize_terms (terms);
+  results = _cinnamon_contact_search_index_search (self->priv->index, normalized_terms);
 
-  iter = gee_map_map_iterator (individuals);
+  g_slist_foreach (normalized_terms, (GFunc) g_free, NULL);
+  g_slist_free (normalized_terms);
 
-  while (gee_map_iterator_next (iter))
-    {
-      individual = gee_map_iterator_get_value (iter);
-      weight = do_match (self, individual, normalized_terms);
-
-      if (weight != 0)
-        {
-          key = gee_map_iterator_get_key (iter);
-
-          result = g_slice_new (ContactSearchResult);
-          result->key = (gchar *) key;
-          result->weight = weight;
-
-          results = g_slist_append (results, result);
-        }
-
-      g_object_unref (individual);
-    }
-
-  return sort_and_prepare_results (results);
+  return results;
 }
 
 /**
@@ -483,5 +451,18 @@ cinnamon_contact_system_subsearch (CinnamonContactSystem  *self,
                                 GSList              *previous_results,
                                 GSList              *terms)
 {
-  return cinnamon_contact_system_initial_search (self, terms);
+  GSList *normalized_terms;
+  GSList *results;
+
+  g_return_val_if_fail (CINNAMON_IS_CONTACT_SYSTEM (self), NULL);
+
+  normalized_terms = normalize_terms (terms);
+  results = _cinnamon_contact_search_index_subsearch (self->priv->index,
+                                                      previous_results,
+                                                      normalized_terms);
+
+  g_slist_foreach (normalized_terms, (GFunc) g_free, NULL);
+  g_slist_free (normalized_terms);
+
+  return results;
 }
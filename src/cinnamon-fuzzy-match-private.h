@@ -0,0 +1,25 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+#ifndef __CINNAMON_FUZZY_MATCH_PRIVATE_H__
+#define __CINNAMON_FUZZY_MATCH_PRIVATE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Score ranges, from best to worst kind of match */
+#define CINNAMON_FUZZY_SCORE_PREFIX      900  /* at a word start, 1000 at the start */
+#define CINNAMON_FUZZY_SCORE_SUBSTRING   700
+#define CINNAMON_FUZZY_SCORE_SUBSEQUENCE 300  /* up to 699 */
+#define CINNAMON_FUZZY_SCORE_TYPO        100  /* up to 299 */
+
+typedef struct _CinnamonFuzzyPattern CinnamonFuzzyPattern;
+
+CinnamonFuzzyPattern *_cinnamon_fuzzy_pattern_new   (const char           *term);
+void                  _cinnamon_fuzzy_pattern_free  (CinnamonFuzzyPattern *pattern);
+
+guint                 _cinnamon_fuzzy_pattern_score (CinnamonFuzzyPattern *pattern,
+                                                     const char           *text);
+
+G_END_DECLS
+
+#endif /* __CINNAMON_FUZZY_MATCH_PRIVATE_H__ */
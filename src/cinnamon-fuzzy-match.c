@@ -0,0 +1,279 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Scores how well a search term matches a string, tolerating typos, so
+ * that searches still find something when the exact term is nowhere.
+ *
+ * From best to worst, a term can be:
+ *
+ *  - a prefix of a word of the string, or any substring;
+ *  - a subsequence of the string starting at a word, like "gte" for
+ *    "gnome terminal", scored higher when the letters fall on word
+ *    starts or follow each other;
+ *  - within a few edits of a substring of the string, found with Myers'
+ *    bit-parallel algorithm, which handles a whole term of up to 64 bytes
+ *    per character of the string.
+ *
+ * Both the term and the strings are expected to be normalized and
+ * casefolded. Work is done on bytes, so a typo in a non-ASCII character
+ * counts for as many edits as its UTF-8 encoding has bytes.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "cinnamon-fuzzy-match-private.h"
+
+/* Myers' algorithm keeps one bit per byte of the term */
+#define MAX_TYPO_TERM_LENGTH 64
+
+struct _CinnamonFuzzyPattern {
+  char    *term;
+  gsize    length;
+  guint    max_typos;
+  guint64  peq[256];   /* bit i is set for the bytes equal to term[i] */
+};
+
+/* Longer terms tolerate more typos; short ones would match anything */
+static guint
+max_typos_for_length (gsize length)
+{
+  if (length < 4)
+    return 0;
+  else if (length < 7)
+    return 1;
+  else
+    return 2;
+}
+
+/**
+ * _cinnamon_fuzzy_pattern_new:
+ * @term: a normalized and casefolded search term
+ *
+ * Return value: a pattern to score strings against @term
+ */
+CinnamonFuzzyPattern *
+_cinnamon_fuzzy_pattern_new (const char *term)
+{
+  CinnamonFuzzyPattern *pattern;
+  gsize i;
+
+  pattern = g_slice_new0 (CinnamonFuzzyPattern);
+  pattern->term = g_strdup (term);
+  pattern->length = strlen (term);
+
+  if (pattern->length <= MAX_TYPO_TERM_LENGTH)
+    {
+      pattern->max_typos = max_typos_for_length (pattern->length);
+
+      for (i = 0; i < pattern->length; i++)
+        pattern->peq[(guchar) term[i]] |= G_GUINT64_CONSTANT (1) << i;
+    }
+
+  return pattern;
+}
+
+void
+_cinnamon_fuzzy_pattern_free (CinnamonFuzzyPattern *pattern)
+{
+  g_free (pattern->term);
+  g_slice_free (CinnamonFuzzyPattern, pattern);
+}
+
+static gboolean
+is_word_start (const char *text,
+               const char *p)
+{
+  if (p == text)
+    return TRUE;
+
+  switch (p[-1])
+    {
+    case ' ':
+    case '-':
+    case '_':
+    case '.':
+    case '/':
+      return TRUE;
+    default:
+      return FALSE;
+    }
+}
+
+static guint
+score_substring (CinnamonFuzzyPattern *pattern,
+                 const char           *text)
+{
+  const char *p;
+  guint score = 0;
+
+  for (p = strstr (text, pattern->term); p; p = strstr (p + 1, pattern->term))
+    {
+      if (p == text)
+        return CINNAMON_FUZZY_SCORE_PREFIX + 100;
+      else if (is_word_start (text, p))
+        score = CINNAMON_FUZZY_SCORE_PREFIX;
+      else if (score == 0)
+        score = CINNAMON_FUZZY_SCORE_SUBSTRING;
+    }
+
+  return score;
+}
+
+static gboolean
+is_subsequence (const char *term,
+                const char *text)
+{
+  for (; *text && *term; text++)
+    if (*text == *term)
+      term++;
+
+  return *term == '\0';
+}
+
+/* Matches the term as a subsequence starting at @start, which matches
+ * its first byte, and rates how natural the match is */
+static guint
+score_subsequence_from (CinnamonFuzzyPattern *pattern,
+                        const char           *text,
+                        const char           *start)
+{
+  const char *p;
+  const char *previous = start;
+  guint bonus = 0;
+  gsize i;
+
+  for (i = 1; i < pattern->length; i++)
+    {
+      const char *q;
+
+      /* The first occurrence of each letter finds a match whenever there
+       * is one */
+      p = strchr (previous + 1, pattern->term[i]);
+      if (p == NULL)
+        return 0;
+
+      /* Following the previous letter is best, then starting a word;
+       * skip ahead to a word start if the rest still matches after it */
+      if (p == previous + 1)
+        {
+          bonus += 3;
+        }
+      else
+        {
+          for (q = p; q; q = strchr (q + 1, pattern->term[i]))
+            if (is_word_start (text, q))
+              {
+                if (is_subsequence (pattern->term + i + 1, q + 1))
+                  {
+                    p = q;
+                    bonus += 2;
+                  }
+                break;
+              }
+        }
+
+      previous = p;
+    }
+
+  return CINNAMON_FUZZY_SCORE_SUBSEQUENCE + (399 * bonus) / (3 * (pattern->length - 1));
+}
+
+static guint
+score_subsequence (CinnamonFuzzyPattern *pattern,
+                   const char           *text)
+{
+  const char *p;
+  guint best = 0;
+
+  if (pattern->length < 2)
+    return 0;
+
+  /* Only start at word starts, a subsequence starting in the middle of
+   * a word is rarely what was meant */
+  for (p = strchr (text, pattern->term[0]); p; p = strchr (p + 1, pattern->term[0]))
+    if (is_word_start (text, p))
+      best = MAX (best, score_subsequence_from (pattern, text, p));
+
+  return best;
+}
+
+/* Myers' bit-vector algorithm, in its search variant: the lowest edit
+ * distance between the term and any substring of @text */
+static guint
+typo_distance (CinnamonFuzzyPattern *pattern,
+               const char           *text)
+{
+  guint64 pv, mv, high;
+  guint distance, best;
+  const guchar *p;
+
+  high = G_GUINT64_CONSTANT (1) << (pattern->length - 1);
+  pv = ~G_GUINT64_CONSTANT (0);
+  mv = 0;
+  distance = best = pattern->length;
+
+  for (p = (const guchar *) text; *p; p++)
+    {
+      guint64 eq = pattern->peq[*p];
+      guint64 xv = eq | mv;
+      guint64 xh = (((eq & pv) + pv) ^ pv) | eq;
+      guint64 ph = mv | ~(xh | pv);
+      guint64 mh = pv & xh;
+
+      if (ph & high)
+        distance++;
+      else if (mh & high)
+        distance--;
+
+      /* Not shifting a 1 in lets a match start anywhere in the text */
+      ph <<= 1;
+      mh <<= 1;
+      pv = mh | ~(xv | ph);
+      mv = ph & xv;
+
+      if (distance < best)
+        best = distance;
+    }
+
+  return best;
+}
+
+/**
+ * _cinnamon_fuzzy_pattern_score:
+ * @pattern: a #CinnamonFuzzyPattern
+ * @text: (allow-none): a normalized and casefolded string
+ *
+ * Return value: how well @pattern matches @text, see the
+ *   CINNAMON_FUZZY_SCORE_* ranges; 0 if it doesn't
+ */
+guint
+_cinnamon_fuzzy_pattern_score (CinnamonFuzzyPattern *pattern,
+                               const char           *text)
+{
+  guint score;
+  guint distance;
+
+  if (text == NULL)
+    return 0;
+
+  if (pattern->length == 0)
+    return CINNAMON_FUZZY_SCORE_PREFIX + 100;
+
+  score = score_substring (pattern, text);
+  if (score != 0)
+    return score;
+
+  score = score_subsequence (pattern, text);
+  if (score != 0)
+    return score;
+
+  if (pattern->max_typos == 0)
+    return 0;
+
+  distance = typo_distance (pattern, text);
+  if (distance > pattern->max_typos)
+    return 0;
+
+  return CINNAMON_FUZZY_SCORE_TYPO + 100 * (3 - distance) - 1;
+}
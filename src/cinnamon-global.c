@@ -45,6 +45,31 @@ static void grab_notify (GtkWidget *widget, gboolean is_grab, gpointer user_data
 static void cinnamon_global_on_gc (GjsContext   *context,
                                 CinnamonGlobal  *global);
 
+/* Frame durations and intervals are kept in HDR-style histograms: each
+ * power of two range of microseconds is split in FRAME_HISTOGRAM_SUB_BUCKETS
+ * linear buckets, so values are known to about 6% whatever their size,
+ * in constant space.
+ */
+#define FRAME_HISTOGRAM_SUB_BUCKETS 16
+#define FRAME_HISTOGRAM_SUB_BUCKET_BITS 4
+/* Up to 2^24 microseconds, about 16 seconds */
+#define FRAME_HISTOGRAM_MAX_BITS 24
+#define FRAME_HISTOGRAM_N_BUCKETS \
+  ((FRAME_HISTOGRAM_MAX_BITS - FRAME_HISTOGRAM_SUB_BUCKET_BITS + 1) * FRAME_HISTOGRAM_SUB_BUCKETS)
+
+/* We don't know the refresh rate; assume the usual 60Hz */
+#define FRAME_PERIOD_US 16667
+
+/* Frames further apart than this don't belong to the same animation;
+ * the stage just had nothing to redraw in between */
+#define FRAME_IDLE_INTERVAL_US (100 * 1000)
+
+typedef struct {
+  guint counts[FRAME_HISTOGRAM_N_BUCKETS];
+  guint total;
+  gint64 max;
+} FrameHistogram;
+
 struct _CinnamonGlobal {
   GObject parent;
 
@@ -91,6 +116,15 @@ struct _CinnamonGlobal {
   guint32 xdnd_timestamp;
 
   gint64 last_gc_end_time;
+
+  /* Frame statistics */
+  gint64 paint_start_time;
+  gint64 last_frame_time;
+  gboolean last_frame_animating;
+  guint n_frames;
+  guint n_missed_frames;
+  FrameHistogram paint_times;
+  FrameHistogram frame_intervals;
 };
 
 enum {
@@ -787,12 +821,101 @@ global_stage_notify_height (GObject    *gobject,
   g_object_notify (G_OBJECT (global), "screen-height");
 }
 
+static guint
+frame_histogram_bucket (gint64 value)
+{
+  guint shift;
+
+  value = CLAMP (value, 0, (G_GINT64_CONSTANT (1) << FRAME_HISTOGRAM_MAX_BITS) - 1);
+
+  if (value < FRAME_HISTOGRAM_SUB_BUCKETS)
+    return value;
+
+  shift = g_bit_storage (value) - 1 - FRAME_HISTOGRAM_SUB_BUCKET_BITS;
+
+  return (shift + 1) * FRAME_HISTOGRAM_SUB_BUCKETS +
+         (value >> shift) - FRAME_HISTOGRAM_SUB_BUCKETS;
+}
+
+/* Highest value falling in @bucket */
+static gint64
+frame_histogram_bucket_value (guint bucket)
+{
+  guint shift;
+  gint64 top;
+
+  if (bucket < 2 * FRAME_HISTOGRAM_SUB_BUCKETS)
+    return bucket;
+
+  shift = bucket / FRAME_HISTOGRAM_SUB_BUCKETS - 1;
+  top = FRAME_HISTOGRAM_SUB_BUCKETS + bucket % FRAME_HISTOGRAM_SUB_BUCKETS;
+
+  return ((top + 1) << shift) - 1;
+}
+
+static void
+frame_histogram_add (FrameHistogram *histogram,
+                     gint64          value)
+{
+  histogram->counts[frame_histogram_bucket (value)]++;
+  histogram->total++;
+  histogram->max = MAX (histogram->max, value);
+}
+
+static gint64
+frame_histogram_percentile (FrameHistogram *histogram,
+                            guint           percentile)
+{
+  guint64 rank, seen = 0;
+  guint i;
+
+  if (histogram->total == 0)
+    return 0;
+
+  /* Number of values at or below the percentile, rounded up */
+  rank = ((guint64) histogram->total * percentile + 99) / 100;
+
+  for (i = 0; i < FRAME_HISTOGRAM_N_BUCKETS; i++)
+    {
+      seen += histogram->counts[i];
+      if (seen >= rank)
+        return MIN (frame_histogram_bucket_value (i), histogram->max);
+    }
+
+  return histogram->max;
+}
+
 static void
 global_stage_before_paint (ClutterStage *stage,
                            CinnamonGlobal  *global)
 {
+  gint64 now = g_get_monotonic_time ();
+  /* Tweener timelines hold a work count while they run */
+  gboolean animating = global->work_count > 0;
+
   cinnamon_perf_log_event (cinnamon_perf_log_get_default (),
                         "clutter.stagePaintStart");
+
+  if (global->last_frame_time != 0)
+    {
+      gint64 interval = now - global->last_frame_time;
+
+      if (interval < FRAME_IDLE_INTERVAL_US)
+        {
+          gint64 n_periods = (interval + FRAME_PERIOD_US / 2) / FRAME_PERIOD_US;
+
+          frame_histogram_add (&global->frame_intervals, interval);
+
+          /* Redraws are on demand, so a gap only means frames were missed
+           * when an animation wanted one at each vblank in between */
+          if (animating && global->last_frame_animating && n_periods > 1)
+            global->n_missed_frames += n_periods - 1;
+        }
+    }
+
+  global->last_frame_time = now;
+  global->last_frame_animating = animating;
+  global->paint_start_time = now;
 }
 
 static void
@@ -801,6 +924,10 @@ global_stage_after_paint (ClutterStage *stage,
 {
   cinnamon_perf_log_event (cinnamon_perf_log_get_default (),
                         "clutter.stagePaintDone");
+
+  frame_histogram_add (&global->paint_times,
+                       g_get_monotonic_time () - global->paint_start_time);
+  global->n_frames++;
 }
 
 void
@@ -1966,3 +2093,86 @@ cinnamon_global_get_session_type (CinnamonGlobal  *global)
 
   return global->session_type;
 }
+
+static CinnamonFrameStats *
+frame_stats_copy (CinnamonFrameStats *stats)
+{
+  return g_slice_dup (CinnamonFrameStats, stats);
+}
+
+/**
+ * cinnamon_frame_stats_free:
+ * @stats: a #CinnamonFrameStats
+ *
+ * Frees frame statistics returned by cinnamon_global_get_frame_stats().
+ */
+void
+cinnamon_frame_stats_free (CinnamonFrameStats *stats)
+{
+  g_slice_free (CinnamonFrameStats, stats);
+}
+
+G_DEFINE_BOXED_TYPE (CinnamonFrameStats, cinnamon_frame_stats, frame_stats_copy, cinnamon_frame_stats_free)
+
+/**
+ * cinnamon_global_get_frame_stats:
+ * @global: the #CinnamonGlobal
+ *
+ * Summarizes the stage frames painted since Cinnamon started, or since
+ * the last call to cinnamon_global_reset_frame_stats(). Durations are
+ * in microseconds and percentiles are accurate to about 6%.
+ *
+ * Frame intervals only count frames drawn in a row, as during an
+ * animation; a frame coming long after the previous one is the stage
+ * becoming busy again, not a stutter. Missed frames are only counted
+ * while a Tweener animation is running, since otherwise the stage is
+ * only redrawn when something changes: a frame interval within an
+ * animation spanning several refresh periods counts as that many missed
+ * frames, assuming a 60Hz display.
+ *
+ * Return value: (transfer full): the frame statistics
+ */
+CinnamonFrameStats *
+cinnamon_global_get_frame_stats (CinnamonGlobal *global)
+{
+  CinnamonFrameStats *stats;
+
+  g_return_val_if_fail (CINNAMON_IS_GLOBAL (global), NULL);
+
+  stats = g_slice_new0 (CinnamonFrameStats);
+
+  stats->n_frames = global->n_frames;
+  stats->n_missed_frames = global->n_missed_frames;
+
+  stats->paint_time_p50 = frame_histogram_percentile (&global->paint_times, 50);
+  stats->paint_time_p95 = frame_histogram_percentile (&global->paint_times, 95);
+  stats->paint_time_p99 = frame_histogram_percentile (&global->paint_times, 99);
+  stats->paint_time_max = global->paint_times.max;
+
+  stats->frame_interval_p50 = frame_histogram_percentile (&global->frame_intervals, 50);
+  stats->frame_interval_p95 = frame_histogram_percentile (&global->frame_intervals, 95);
+  stats->frame_interval_p99 = frame_histogram_percentile (&global->frame_intervals, 99);
+  stats->frame_interval_max = global->frame_intervals.max;
+
+  return stats;
+}
+
+/**
+ * cinnamon_global_reset_frame_stats:
+ * @global: the #CinnamonGlobal
+ *
+ * Starts collecting frame statistics afresh, for instance to look at a
+ * particular time span.
+ */
+void
+cinnamon_global_reset_frame_stats (CinnamonGlobal *global)
+{
+  g_return_if_fail (CINNAMON_IS_GLOBAL (global));
+
+  global->last_frame_time = 0;
+  global->last_frame_animating = FALSE;
+  global->n_frames = 0;
+  global->n_missed_frames = 0;
+  memset (&global->paint_times, 0, sizeof (FrameHistogram));
+  memset (&global->frame_intervals, 0, sizeof (FrameHistogram));
+}
@@ -169,6 +169,42 @@ typedef enum {
 
 CinnamonSessionType cinnamon_global_get_session_type  (CinnamonGlobal  *global);
 
+/**
+ * CinnamonFrameStats:
+ * @n_frames: number of frames painted
+ * @n_missed_frames: number of refresh periods during animations in which
+ *   a frame should have been painted but wasn't
+ * @paint_time_p50: median time to paint a frame
+ * @paint_time_p95: 95th percentile of the time to paint a frame
+ * @paint_time_p99: 99th percentile of the time to paint a frame
+ * @paint_time_max: longest time to paint a frame
+ * @frame_interval_p50: median time between consecutive frames
+ * @frame_interval_p95: 95th percentile of the time between consecutive frames
+ * @frame_interval_p99: 99th percentile of the time between consecutive frames
+ * @frame_interval_max: longest time between consecutive frames
+ *
+ * Summary of how smoothly the stage was painted; times are in
+ * microseconds.
+ */
+typedef struct {
+  guint  n_frames;
+  guint  n_missed_frames;
+  gint64 paint_time_p50;
+  gint64 paint_time_p95;
+  gint64 paint_time_p99;
+  gint64 paint_time_max;
+  gint64 frame_interval_p50;
+  gint64 frame_interval_p95;
+  gint64 frame_interval_p99;
+  gint64 frame_interval_max;
+} CinnamonFrameStats;
+
+GType               cinnamon_frame_stats_get_type     (void);
+void                cinnamon_frame_stats_free         (CinnamonFrameStats *stats);
+
+CinnamonFrameStats *cinnamon_global_get_frame_stats   (CinnamonGlobal  *global);
+void                cinnamon_global_reset_frame_stats (CinnamonGlobal  *global);
+
 G_END_DECLS
 
 #endif /* __CINNAMON_GLOBAL_H__ */
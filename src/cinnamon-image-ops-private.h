@@ -0,0 +1,21 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+#ifndef __CINNAMON_IMAGE_OPS_PRIVATE_H__
+#define __CINNAMON_IMAGE_OPS_PRIVATE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void _cinnamon_image_fade_horizontal (guchar *pixels,
+                                      gint    width,
+                                      gint    height,
+                                      gint    rowstride,
+                                      gint    n_channels,
+                                      gint    fade_start);
+
+/* Only for testing: force the portable code path */
+void _cinnamon_image_ops_set_use_simd (gboolean use_simd);
+
+G_END_DECLS
+
+#endif /* __CINNAMON_IMAGE_OPS_PRIVATE_H__ */
@@ -0,0 +1,209 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* The fade applied to the icons of applications. Images are processed a
+ * row at a time, in place, and all the arithmetic is done in 8.8 fixed
+ * point: a factor in [0, 1] is a multiplier in [0, 256], and
+ * (value * multiplier + 128) >> 8 is the scaled value, rounded.
+ *
+ * A row of multipliers, one per byte, is computed once for the whole
+ * image; fading all the channels of a pixel by the same amount is correct
+ * for both premultiplied and unpremultiplied data.
+ *
+ * As with the blur in St, the portable and the SIMD code paths use the
+ * same arithmetic and produce identical results.
+ */
+
+#include "config.h"
+
+#include "cinnamon-image-ops-private.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+typedef enum {
+  SIMD_UNKNOWN,
+  SIMD_NONE,
+  SIMD_SSE2,
+  SIMD_AVX2
+} SimdLevel;
+
+static SimdLevel simd_level = SIMD_UNKNOWN;
+static gboolean simd_enabled = TRUE;
+
+typedef void (*ScaleRowFunc) (guchar        *row,
+                              const guint16 *mul,
+                              gint           n);
+
+static void
+scale_row_generic (guchar        *row,
+                   const guint16 *mul,
+                   gint           n)
+{
+  gint x;
+
+  for (x = 0; x < n; x++)
+    row[x] = (row[x] * mul[x] + 128) >> 8;
+}
+
+#ifdef HAVE_X86_SIMD
+
+/* Products of a byte and a multiplier of at most 256, plus rounding, fit
+ * in unsigned 16 bit lanes, so plain 16 bit multiplies and logical shifts
+ * do the whole computation */
+
+__attribute__((target ("sse2")))
+static void
+scale_row_sse2 (guchar        *row,
+                const guint16 *mul,
+                gint           n)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i round = _mm_set1_epi16 (128);
+  gint x;
+
+  for (x = 0; x + 16 <= n; x += 16)
+    {
+      __m128i p = _mm_loadu_si128 ((const __m128i *) (row + x));
+      __m128i m_lo = _mm_loadu_si128 ((const __m128i *) (mul + x));
+      __m128i m_hi = _mm_loadu_si128 ((const __m128i *) (mul + x + 8));
+      __m128i lo = _mm_mullo_epi16 (_mm_unpacklo_epi8 (p, zero), m_lo);
+      __m128i hi = _mm_mullo_epi16 (_mm_unpackhi_epi8 (p, zero), m_hi);
+
+      lo = _mm_srli_epi16 (_mm_add_epi16 (lo, round), 8);
+      hi = _mm_srli_epi16 (_mm_add_epi16 (hi, round), 8);
+      _mm_storeu_si128 ((__m128i *) (row + x), _mm_packus_epi16 (lo, hi));
+    }
+
+  scale_row_generic (row + x, mul + x, n - x);
+}
+
+__attribute__((target ("avx2")))
+static void
+scale_row_avx2 (guchar        *row,
+                const guint16 *mul,
+                gint           n)
+{
+  const __m256i round = _mm256_set1_epi16 (128);
+  gint x;
+
+  for (x = 0; x + 16 <= n; x += 16)
+    {
+      __m256i p = _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i *) (row + x)));
+      __m256i m = _mm256_loadu_si256 ((const __m256i *) (mul + x));
+
+      p = _mm256_srli_epi16 (_mm256_add_epi16 (_mm256_mullo_epi16 (p, m), round), 8);
+      _mm_storeu_si128 ((__m128i *) (row + x),
+                        _mm_packus_epi16 (_mm256_castsi256_si128 (p),
+                                          _mm256_extracti128_si256 (p, 1)));
+    }
+
+  scale_row_generic (row + x, mul + x, n - x);
+}
+
+#endif /* HAVE_X86_SIMD */
+
+static SimdLevel
+get_simd_level (void)
+{
+  if (simd_level == SIMD_UNKNOWN)
+    {
+      simd_level = SIMD_NONE;
+#ifdef HAVE_X86_SIMD
+      __builtin_cpu_init ();
+      if (__builtin_cpu_supports ("avx2"))
+        simd_level = SIMD_AVX2;
+      else if (__builtin_cpu_supports ("sse2"))
+        simd_level = SIMD_SSE2;
+#endif
+    }
+
+  return simd_enabled ? simd_level : SIMD_NONE;
+}
+
+static ScaleRowFunc
+get_scale_row_func (void)
+{
+  switch (get_simd_level ())
+    {
+#ifdef HAVE_X86_SIMD
+    case SIMD_AVX2:
+      return scale_row_avx2;
+    case SIMD_SSE2:
+      return scale_row_sse2;
+#endif
+    default:
+      return scale_row_generic;
+    }
+}
+
+/**
+ * _cinnamon_image_ops_set_use_simd:
+ * @use_simd: whether to use SIMD instructions, when the CPU has them
+ *
+ * Lets tests and benchmarks compare the portable and the SIMD code paths.
+ */
+void
+_cinnamon_image_ops_set_use_simd (gboolean use_simd)
+{
+  simd_enabled = use_simd;
+}
+
+static void
+scale_rows (guchar        *pixels,
+            gint           height,
+            gint           rowstride,
+            const guint16 *mul,
+            gint           n)
+{
+  ScaleRowFunc scale_row = get_scale_row_func ();
+  gint y;
+
+  for (y = 0; y < height; y++)
+    scale_row (pixels + y * rowstride, mul, n);
+}
+
+/**
+ * _cinnamon_image_fade_horizontal:
+ * @pixels: 8 bit per channel pixel data, modified in place
+ * @width: width of @pixels
+ * @height: height of @pixels
+ * @rowstride: rowstride of @pixels
+ * @n_channels: number of channels of @pixels, all of which are faded
+ * @fade_start: the column where the fade starts
+ *
+ * Fades out the columns from @fade_start to the right edge linearly, from
+ * full intensity at @fade_start to almost nothing in the last column.
+ */
+void
+_cinnamon_image_fade_horizontal (guchar *pixels,
+                                 gint    width,
+                                 gint    height,
+                                 gint    rowstride,
+                                 gint    n_channels,
+                                 gint    fade_start)
+{
+  guint16 *mul;
+  gint fade_range = width - fade_start;
+  gint x, c, n;
+
+  if (fade_range <= 0 || height <= 0)
+    return;
+
+  n = fade_range * n_channels;
+  mul = g_new (guint16, n);
+
+  /* The intensity at column x is (width - x) / fade_range */
+  for (x = 0; x < fade_range; x++)
+    {
+      guint16 m = (256 * (fade_range - x) + fade_range / 2) / fade_range;
+
+      for (c = 0; c < n_channels; c++)
+        mul[x * n_channels + c] = m;
+    }
+
+  scale_rows (pixels + fade_start * n_channels, height, rowstride, mul, n);
+
+  g_free (mul);
+}
@@ -28,6 +28,7 @@
 #include <stdlib.h>
 
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 
 #include "cinnamon-mobile-providers.h"
 
@@ -614,17 +615,8 @@ static const GMarkupParser mobile_parser = {
     NULL /* error */
 };
 
-/**
- * cinnamon_mobile_providers_parse:
- * @out_ccs: (out) (allow-none): (element-type utf8 utf8): a #GHashTable containing
- *   country codes
- *
- * Returns: (element-type utf8 GList<Cinnamon.MobileProvider>) (transfer container): a
- *   hash table where keys are country names 'char *', values are a 'GSList *'
- *   of 'CinnamonMobileProvider *'. Everything is destroyed with g_hash_table_destroy ().
-*/
-GHashTable *
-cinnamon_mobile_providers_parse (GHashTable **out_ccs)
+static GHashTable *
+parse_xml (GHashTable **out_ccs)
 {
     GMarkupParseContext *ctx;
     GIOChannel *channel;
@@ -707,6 +699,577 @@ cinnamon_mobile_providers_parse (GHashTable **out_ccs)
     return parser.table;
 }
 
+/* Compiled database
+ *
+ * Parsing the XML takes long enough, and allocates enough, to be worth
+ * doing once per version of the file rather than every time the
+ * providers are needed. The parsed table is compiled into a GVariant,
+ * written to the user's cache directory and mapped back in on later
+ * runs. It holds the providers of each country, and two sorted indexes
+ * mapping MCC/MNC pairs and CDMA SIDs to provider names, which lookups
+ * binary search in place without building the table at all.
+ *
+ * The database is recompiled when the modification time of the XML or
+ * of the country codes changes, or the language does, since country and
+ * access method names may be translated.
+ */
+
+#define DATABASE_VERSION 1
+
+#define METHOD_TYPE "(msmsmsmsasmsu)"
+#define PROVIDER_TYPE "(msa(ss)aua" METHOD_TYPE ")"
+#define COUNTRY_TYPE "(sa" PROVIDER_TYPE ")"
+
+/* version, XML mtime, country codes mtime, language, country codes,
+ * countries, (mcc, mnc, name) sorted by MCC/MNC, (sid, name) sorted by SID */
+#define DATABASE_TYPE "(uxxsa{ss}a" COUNTRY_TYPE "a(sss)a(us))"
+
+enum {
+    DATABASE_VERSION_FIELD = 0,
+    DATABASE_XML_MTIME_FIELD,
+    DATABASE_CCS_MTIME_FIELD,
+    DATABASE_LANGUAGE_FIELD,
+    DATABASE_CCS_FIELD,
+    DATABASE_COUNTRIES_FIELD,
+    DATABASE_GSM_INDEX_FIELD,
+    DATABASE_CDMA_INDEX_FIELD
+};
+
+typedef struct {
+    const char *mcc;
+    const char *mnc;
+    const char *name;
+    guint order;
+} GsmIndexEntry;
+
+typedef struct {
+    guint32 sid;
+    const char *name;
+    guint order;
+} CdmaIndexEntry;
+
+static GVariant *database;
+
+static int
+compare_gsm_index_entries (gconstpointer a, gconstpointer b)
+{
+    const GsmIndexEntry *ea = a, *eb = b;
+    int cmp;
+
+    cmp = strcmp (ea->mcc, eb->mcc);
+    if (cmp == 0)
+        cmp = strcmp (ea->mnc, eb->mnc);
+    if (cmp == 0)
+        cmp = (int) ea->order - (int) eb->order;
+    return cmp;
+}
+
+static int
+compare_cdma_index_entries (gconstpointer a, gconstpointer b)
+{
+    const CdmaIndexEntry *ea = a, *eb = b;
+
+    if (ea->sid != eb->sid)
+        return ea->sid < eb->sid ? -1 : 1;
+    return (int) ea->order - (int) eb->order;
+}
+
+static GVariant *
+method_to_variant (CinnamonMobileAccessMethod *method)
+{
+    GVariantBuilder dns;
+    GSList *iter;
+
+    g_variant_builder_init (&dns, G_VARIANT_TYPE_STRING_ARRAY);
+    for (iter = method->dns; iter; iter = g_slist_next (iter)) {
+        if (iter->data)
+            g_variant_builder_add (&dns, "s", iter->data);
+    }
+
+    return g_variant_new ("(msmsmsms@asmsu)",
+                          method->name, method->username, method->password,
+                          method->gateway, g_variant_builder_end (&dns),
+                          method->gsm_apn, (guint32) method->type);
+}
+
+static GVariant *
+provider_to_variant (CinnamonMobileProvider *provider,
+                     GArray *gsm_index,
+                     GArray *cdma_index)
+{
+    GVariantBuilder networks, sids, methods;
+    GSList *iter;
+
+    g_variant_builder_init (&networks, G_VARIANT_TYPE ("a(ss)"));
+    for (iter = provider->gsm_mcc_mnc; iter; iter = g_slist_next (iter)) {
+        CinnamonGsmMccMnc *m = iter->data;
+
+        g_variant_builder_add (&networks, "(ss)", m->mcc, m->mnc);
+
+        if (provider->name) {
+            GsmIndexEntry entry = { m->mcc, m->mnc, provider->name, gsm_index->len };
+            g_array_append_val (gsm_index, entry);
+        }
+    }
+
+    g_variant_builder_init (&sids, G_VARIANT_TYPE ("au"));
+    for (iter = provider->cdma_sid; iter; iter = g_slist_next (iter)) {
+        guint32 sid = GPOINTER_TO_UINT (iter->data);
+
+        g_variant_builder_add (&sids, "u", sid);
+
+        if (provider->name) {
+            CdmaIndexEntry entry = { sid, provider->name, cdma_index->len };
+            g_array_append_val (cdma_index, entry);
+        }
+    }
+
+    g_variant_builder_init (&methods, G_VARIANT_TYPE ("a" METHOD_TYPE));
+    for (iter = provider->methods; iter; iter = g_slist_next (iter))
+        g_variant_builder_add_value (&methods, method_to_variant (iter->data));
+
+    return g_variant_new ("(ms@a(ss)@au@a" METHOD_TYPE ")",
+                          provider->name,
+                          g_variant_builder_end (&networks),
+                          g_variant_builder_end (&sids),
+                          g_variant_builder_end (&methods));
+}
+
+static GVariant *
+compile_database (GHashTable *table,
+                  GHashTable *country_codes,
+                  gint64 xml_mtime,
+                  gint64 ccs_mtime,
+                  const char *language)
+{
+    GVariantBuilder ccs, countries, gsm, cdma;
+    GArray *gsm_index, *cdma_index;
+    GHashTableIter hash_iter;
+    gpointer key, value;
+    guint i;
+
+    g_variant_builder_init (&ccs, G_VARIANT_TYPE ("a{ss}"));
+    g_hash_table_iter_init (&hash_iter, country_codes);
+    while (g_hash_table_iter_next (&hash_iter, &key, &value)) {
+        if (value)
+            g_variant_builder_add (&ccs, "{ss}", key, value);
+    }
+
+    gsm_index = g_array_new (FALSE, FALSE, sizeof (GsmIndexEntry));
+    cdma_index = g_array_new (FALSE, FALSE, sizeof (CdmaIndexEntry));
+
+    g_variant_builder_init (&countries, G_VARIANT_TYPE ("a" COUNTRY_TYPE));
+    g_hash_table_iter_init (&hash_iter, table);
+    while (g_hash_table_iter_next (&hash_iter, &key, &value)) {
+        GVariantBuilder providers;
+        GSList *iter;
+
+        g_variant_builder_init (&providers, G_VARIANT_TYPE ("a" PROVIDER_TYPE));
+        for (iter = value; iter; iter = g_slist_next (iter))
+            g_variant_builder_add_value (&providers,
+                                         provider_to_variant (iter->data, gsm_index, cdma_index));
+
+        g_variant_builder_add (&countries, "(s@a" PROVIDER_TYPE ")",
+                               key, g_variant_builder_end (&providers));
+    }
+
+    g_array_sort (gsm_index, compare_gsm_index_entries);
+    g_variant_builder_init (&gsm, G_VARIANT_TYPE ("a(sss)"));
+    for (i = 0; i < gsm_index->len; i++) {
+        GsmIndexEntry *entry = &g_array_index (gsm_index, GsmIndexEntry, i);
+        g_variant_builder_add (&gsm, "(sss)", entry->mcc, entry->mnc, entry->name);
+    }
+
+    g_array_sort (cdma_index, compare_cdma_index_entries);
+    g_variant_builder_init (&cdma, G_VARIANT_TYPE ("a(us)"));
+    for (i = 0; i < cdma_index->len; i++) {
+        CdmaIndexEntry *entry = &g_array_index (cdma_index, CdmaIndexEntry, i);
+        g_variant_builder_add (&cdma, "(us)", entry->sid, entry->name);
+    }
+
+    g_array_free (gsm_index, TRUE);
+    g_array_free (cdma_index, TRUE);
+
+    return g_variant_ref_sink (g_variant_new ("(uxxs@a{ss}@a" COUNTRY_TYPE "@a(sss)@a(us))",
+                                              DATABASE_VERSION, xml_mtime, ccs_mtime, language,
+                                              g_variant_builder_end (&ccs),
+                                              g_variant_builder_end (&countries),
+                                              g_variant_builder_end (&gsm),
+                                              g_variant_builder_end (&cdma)));
+}
+
+static gboolean
+get_mtime (const char *path, gint64 *mtime)
+{
+    struct stat buf;
+
+    if (g_stat (path, &buf) < 0)
+        return FALSE;
+
+    *mtime = buf.st_mtime;
+    return TRUE;
+}
+
+static gboolean
+database_is_current (GVariant *data,
+                     gint64 xml_mtime,
+                     gint64 ccs_mtime,
+                     const char *language)
+{
+    guint32 version;
+    gint64 data_xml_mtime, data_ccs_mtime;
+    const char *data_language;
+
+    g_variant_get_child (data, DATABASE_VERSION_FIELD, "u", &version);
+    g_variant_get_child (data, DATABASE_XML_MTIME_FIELD, "x", &data_xml_mtime);
+    g_variant_get_child (data, DATABASE_CCS_MTIME_FIELD, "x", &data_ccs_mtime);
+    g_variant_get_child (data, DATABASE_LANGUAGE_FIELD, "&s", &data_language);
+
+    return version == DATABASE_VERSION &&
+           data_xml_mtime == xml_mtime &&
+           data_ccs_mtime == ccs_mtime &&
+           strcmp (data_language, language) == 0;
+}
+
+static GVariant *
+load_database (const char *path)
+{
+    GMappedFile *mapped;
+
+    mapped = g_mapped_file_new (path, FALSE, NULL);
+    if (!mapped)
+        return NULL;
+
+    /* GVariant copes with any contents, at worst it reads defaults
+     * which fail the version check */
+    return g_variant_ref_sink (g_variant_new_from_data (G_VARIANT_TYPE (DATABASE_TYPE),
+                                                        g_mapped_file_get_contents (mapped),
+                                                        g_mapped_file_get_length (mapped),
+                                                        FALSE,
+                                                        (GDestroyNotify) g_mapped_file_unref,
+                                                        mapped));
+}
+
+static void
+save_database (const char *path, GVariant *data)
+{
+    GError *error = NULL;
+    char *dir;
+
+    dir = g_path_get_dirname (path);
+    g_mkdir_with_parents (dir, 0700);
+    g_free (dir);
+
+    if (!g_file_set_contents (path,
+                              g_variant_get_data (data),
+                              g_variant_get_size (data),
+                              &error)) {
+        g_debug ("Could not save the mobile providers database: %s", error->message);
+        g_error_free (error);
+    }
+}
+
+/* Returns the current database, without a reference, or NULL if the
+ * provider information can't be read */
+static GVariant *
+get_database (void)
+{
+    const char *language = g_get_language_names ()[0];
+    gint64 xml_mtime = -1, ccs_mtime = -1;
+    GHashTable *table, *country_codes = NULL;
+    char *path;
+
+    get_mtime (MOBILE_BROADBAND_PROVIDER_INFO, &xml_mtime);
+    get_mtime (ISO_3166_COUNTRY_CODES, &ccs_mtime);
+
+    if (database && database_is_current (database, xml_mtime, ccs_mtime, language))
+        return database;
+
+    if (database) {
+        g_variant_unref (database);
+        database = NULL;
+    }
+
+    path = g_build_filename (g_get_user_cache_dir (), "cinnamon", "mobile-providers.cache", NULL);
+
+    database = load_database (path);
+    if (database && !database_is_current (database, xml_mtime, ccs_mtime, language)) {
+        g_variant_unref (database);
+        database = NULL;
+    }
+
+    if (!database) {
+        table = parse_xml (&country_codes);
+        if (table) {
+            database = compile_database (table, country_codes, xml_mtime, ccs_mtime, language);
+            save_database (path, database);
+            g_hash_table_destroy (table);
+        }
+        if (country_codes)
+            g_hash_table_destroy (country_codes);
+    }
+
+    g_free (path);
+
+    return database;
+}
+
+static CinnamonMobileAccessMethod *
+method_from_variant (GVariant *value)
+{
+    CinnamonMobileAccessMethod *method;
+    GVariantIter *dns;
+    const char *server;
+    guint32 type;
+
+    method = access_method_new ();
+    g_variant_get (value, "(msmsmsmsasmsu)",
+                   &method->name, &method->username, &method->password,
+                   &method->gateway, &dns, &method->gsm_apn, &type);
+    method->type = type;
+
+    while (g_variant_iter_next (dns, "&s", &server))
+        method->dns = g_slist_prepend (method->dns, g_strdup (server));
+    method->dns = g_slist_reverse (method->dns);
+    g_variant_iter_free (dns);
+
+    return method;
+}
+
+static CinnamonMobileProvider *
+provider_from_variant (GVariant *value)
+{
+    CinnamonMobileProvider *provider;
+    GVariantIter *networks, *sids, *methods;
+    const char *mcc, *mnc;
+    GVariant *method;
+    guint32 sid;
+
+    provider = provider_new ();
+    g_variant_get (value, "(msa(ss)aua" METHOD_TYPE ")",
+                   &provider->name, &networks, &sids, &methods);
+
+    while (g_variant_iter_next (networks, "(&s&s)", &mcc, &mnc))
+        provider->gsm_mcc_mnc = g_slist_prepend (provider->gsm_mcc_mnc, mcc_mnc_new (mcc, mnc));
+    provider->gsm_mcc_mnc = g_slist_reverse (provider->gsm_mcc_mnc);
+    g_variant_iter_free (networks);
+
+    while (g_variant_iter_next (sids, "u", &sid))
+        provider->cdma_sid = g_slist_prepend (provider->cdma_sid, GUINT_TO_POINTER (sid));
+    provider->cdma_sid = g_slist_reverse (provider->cdma_sid);
+    g_variant_iter_free (sids);
+
+    while ((method = g_variant_iter_next_value (methods))) {
+        provider->methods = g_slist_prepend (provider->methods, method_from_variant (method));
+        g_variant_unref (method);
+    }
+    provider->methods = g_slist_reverse (provider->methods);
+    g_variant_iter_free (methods);
+
+    return provider;
+}
+
+/**
+ * cinnamon_mobile_providers_parse:
+ * @out_ccs: (out) (allow-none): (element-type utf8 utf8): a #GHashTable containing
+ *   country codes
+ *
+ * Returns: (element-type utf8 GList<Cinnamon.MobileProvider>) (transfer container): a
+ *   hash table where keys are country names 'char *', values are a 'GSList *'
+ *   of 'CinnamonMobileProvider *'. Everything is destroyed with g_hash_table_destroy ().
+*/
+GHashTable *
+cinnamon_mobile_providers_parse (GHashTable **out_ccs)
+{
+    GVariant *data, *children, *value;
+    GVariantIter iter;
+    GHashTable *table;
+    const char *key, *name;
+
+    data = get_database ();
+    if (!data)
+        return NULL;
+
+    if (out_ccs) {
+        *out_ccs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+        children = g_variant_get_child_value (data, DATABASE_CCS_FIELD);
+        g_variant_iter_init (&iter, children);
+        while (g_variant_iter_next (&iter, "{&s&s}", &key, &name))
+            g_hash_table_insert (*out_ccs, g_strdup (key), g_strdup (name));
+        g_variant_unref (children);
+    }
+
+    table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, provider_list_free);
+
+    children = g_variant_get_child_value (data, DATABASE_COUNTRIES_FIELD);
+    g_variant_iter_init (&iter, children);
+    while ((value = g_variant_iter_next_value (&iter))) {
+        GVariantIter *providers;
+        GVariant *provider;
+        GSList *list = NULL;
+
+        g_variant_get (value, "(&sa" PROVIDER_TYPE ")", &key, &providers);
+        while ((provider = g_variant_iter_next_value (providers))) {
+            list = g_slist_prepend (list, provider_from_variant (provider));
+            g_variant_unref (provider);
+        }
+        g_variant_iter_free (providers);
+
+        g_hash_table_insert (table, g_strdup (key), g_slist_reverse (list));
+        g_variant_unref (value);
+    }
+    g_variant_unref (children);
+
+    return table;
+}
+
+/* Index of the first entry of the sorted @index whose first @n_keys
+ * string fields are not less than @keys */
+static gsize
+index_lower_bound (GVariant *index,
+                   const char **keys,
+                   guint n_keys)
+{
+    gsize low = 0, high = g_variant_n_children (index);
+
+    while (low < high) {
+        gsize mid = low + (high - low) / 2;
+        GVariant *entry = g_variant_get_child_value (index, mid);
+        int cmp = 0;
+        guint i;
+
+        for (i = 0; i < n_keys && cmp == 0; i++) {
+            const char *field;
+
+            g_variant_get_child (entry, i, "&s", &field);
+            cmp = strcmp (field, keys[i]);
+        }
+        g_variant_unref (entry);
+
+        if (cmp < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+/**
+ * cinnamon_mobile_providers_find_for_mcc_mnc:
+ * @mcc: a mobile country code
+ * @mnc: a two or three digit mobile network code
+ *
+ * Looks up which provider operates the GSM network @mcc/@mnc, preferring
+ * a provider with a network code equal to @mnc, and otherwise one with
+ * a network code that starts with the first two digits of @mnc.
+ *
+ * Returns: (transfer full): the name of the provider, or %NULL
+ */
+char *
+cinnamon_mobile_providers_find_for_mcc_mnc (const char *mcc,
+                                            const char *mnc)
+{
+    GVariant *data, *index, *entry;
+    const char *keys[2], *entry_mcc, *entry_mnc, *name;
+    char *result = NULL;
+    char prefix[3];
+    gsize i;
+
+    g_return_val_if_fail (mcc != NULL, NULL);
+    g_return_val_if_fail (mnc != NULL, NULL);
+
+    data = get_database ();
+    if (!data)
+        return NULL;
+
+    index = g_variant_get_child_value (data, DATABASE_GSM_INDEX_FIELD);
+
+    keys[0] = mcc;
+    keys[1] = mnc;
+    i = index_lower_bound (index, keys, 2);
+    if (i < g_variant_n_children (index)) {
+        entry = g_variant_get_child_value (index, i);
+        g_variant_get (entry, "(&s&s&s)", &entry_mcc, &entry_mnc, &name);
+        if (strcmp (entry_mcc, mcc) == 0 && strcmp (entry_mnc, mnc) == 0)
+            result = g_strdup (name);
+        g_variant_unref (entry);
+    }
+
+    /* Network codes sharing their first two digits sort together, from
+     * the two digit prefix on */
+    if (!result && strlen (mnc) >= 2) {
+        g_strlcpy (prefix, mnc, sizeof (prefix));
+        keys[1] = prefix;
+        i = index_lower_bound (index, keys, 2);
+        if (i < g_variant_n_children (index)) {
+            entry = g_variant_get_child_value (index, i);
+            g_variant_get (entry, "(&s&s&s)", &entry_mcc, &entry_mnc, &name);
+            if (strcmp (entry_mcc, mcc) == 0 && strncmp (entry_mnc, prefix, 2) == 0)
+                result = g_strdup (name);
+            g_variant_unref (entry);
+        }
+    }
+
+    g_variant_unref (index);
+
+    return result;
+}
+
+/**
+ * cinnamon_mobile_providers_find_for_sid:
+ * @sid: a CDMA system identifier
+ *
+ * Looks up which provider operates the CDMA network @sid.
+ *
+ * Returns: (transfer full): the name of the provider, or %NULL
+ */
+char *
+cinnamon_mobile_providers_find_for_sid (guint32 sid)
+{
+    GVariant *data, *index, *entry;
+    gsize low, high;
+    char *result = NULL;
+
+    data = get_database ();
+    if (!data)
+        return NULL;
+
+    index = g_variant_get_child_value (data, DATABASE_CDMA_INDEX_FIELD);
+
+    low = 0;
+    high = g_variant_n_children (index);
+    while (low < high) {
+        gsize mid = low + (high - low) / 2;
+        guint32 entry_sid;
+
+        entry = g_variant_get_child_value (index, mid);
+        g_variant_get_child (entry, 0, "u", &entry_sid);
+        g_variant_unref (entry);
+
+        if (entry_sid < sid)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    if (low < g_variant_n_children (index)) {
+        guint32 entry_sid;
+        const char *name;
+
+        entry = g_variant_get_child_value (index, low);
+        g_variant_get (entry, "(u&s)", &entry_sid, &name);
+        if (entry_sid == sid)
+            result = g_strdup (name);
+        g_variant_unref (entry);
+    }
+
+    g_variant_unref (index);
+
+    return result;
+}
+
 static void
 dump_generic (CinnamonMobileAccessMethod *method)
 {
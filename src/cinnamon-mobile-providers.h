@@ -91,6 +91,10 @@ void                     cinnamon_mobile_access_method_unref (CinnamonMobileAcce
 
 GHashTable *cinnamon_mobile_providers_parse (GHashTable **out_ccs);
 
+char *cinnamon_mobile_providers_find_for_mcc_mnc (const char *mcc,
+                                                  const char *mnc);
+char *cinnamon_mobile_providers_find_for_sid     (guint32 sid);
+
 void cinnamon_mobile_providers_dump (GHashTable *providers);
 
 #endif /* CINNAMON_MOBILE_PROVIDERS_H */
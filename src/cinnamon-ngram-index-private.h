@@ -0,0 +1,28 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+#ifndef __CINNAMON_NGRAM_INDEX_PRIVATE_H__
+#define __CINNAMON_NGRAM_INDEX_PRIVATE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _CinnamonNgramIndex CinnamonNgramIndex;
+
+CinnamonNgramIndex *_cinnamon_ngram_index_new             (void);
+void                _cinnamon_ngram_index_free            (CinnamonNgramIndex *index);
+void                _cinnamon_ngram_index_clear           (CinnamonNgramIndex *index);
+
+void                _cinnamon_ngram_index_add_string      (CinnamonNgramIndex *index,
+                                                           const char         *str,
+                                                           guint32             doc);
+
+GArray             *_cinnamon_ngram_index_find_candidates (CinnamonNgramIndex *index,
+                                                           GSList             *terms,
+                                                           const GArray       *restrict_to,
+                                                           guint32             n_docs);
+
+void                _cinnamon_ngram_docs_sort_unique      (GArray             *docs);
+
+G_END_DECLS
+
+#endif /* __CINNAMON_NGRAM_INDEX_PRIVATE_H__ */
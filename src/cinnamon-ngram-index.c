@@ -0,0 +1,272 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* The inverted index behind application and contact search.
+ *
+ * Documents are numbered from 0 by the caller, which knows what they are.
+ * Every substring of up to NGRAM_MAX_LENGTH bytes of the strings of a
+ * document is an n-gram, and each n-gram has the sorted list of the
+ * documents containing it. A term can only match the documents having
+ * all of its trigrams (or, for shorter terms, the term itself), so
+ * intersecting those lists gives a few candidates, which the caller then
+ * matches properly. Working on UTF-8 bytes is fine, since matching is
+ * done with strstr() anyway.
+ *
+ * Documents have to be added in increasing order, which keeps the lists
+ * sorted by appending.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "cinnamon-ngram-index-private.h"
+
+#define NGRAM_MAX_LENGTH 3
+
+struct _CinnamonNgramIndex {
+  GHashTable *postings;     /* n-gram => GArray of document numbers */
+};
+
+/* Packs an n-gram of @len bytes, with its length so that shorter n-grams
+ * don't collide with longer ones */
+static guint
+ngram_key (const char *str,
+           gint        len)
+{
+  guint key = len << 24;
+  gint i;
+
+  for (i = 0; i < len; i++)
+    key |= (guchar) str[i] << (8 * (NGRAM_MAX_LENGTH - 1 - i));
+
+  return key;
+}
+
+static void
+free_posting_list (gpointer data)
+{
+  g_array_free (data, TRUE);
+}
+
+CinnamonNgramIndex *
+_cinnamon_ngram_index_new (void)
+{
+  CinnamonNgramIndex *index;
+
+  index = g_slice_new0 (CinnamonNgramIndex);
+  index->postings = g_hash_table_new_full (NULL, NULL, NULL, free_posting_list);
+
+  return index;
+}
+
+void
+_cinnamon_ngram_index_free (CinnamonNgramIndex *index)
+{
+  g_hash_table_destroy (index->postings);
+  g_slice_free (CinnamonNgramIndex, index);
+}
+
+/**
+ * _cinnamon_ngram_index_clear:
+ * @index: a #CinnamonNgramIndex
+ *
+ * Forgets all documents, so that numbering can start over.
+ */
+void
+_cinnamon_ngram_index_clear (CinnamonNgramIndex *index)
+{
+  g_hash_table_remove_all (index->postings);
+}
+
+static void
+add_posting (CinnamonNgramIndex *index,
+             guint               key,
+             guint32             doc)
+{
+  GArray *list;
+
+  list = g_hash_table_lookup (index->postings, GUINT_TO_POINTER (key));
+  if (list == NULL)
+    {
+      list = g_array_new (FALSE, FALSE, sizeof (guint32));
+      g_hash_table_insert (index->postings, GUINT_TO_POINTER (key), list);
+    }
+
+  /* Documents are indexed in order, so the lists stay sorted */
+  if (list->len == 0 || g_array_index (list, guint32, list->len - 1) != doc)
+    g_array_append_val (list, doc);
+}
+
+/**
+ * _cinnamon_ngram_index_add_string:
+ * @index: a #CinnamonNgramIndex
+ * @str: (allow-none): a normalized and casefolded string of @doc
+ * @doc: a document number, no lower than any added before
+ *
+ * Makes @doc a candidate for the terms found in @str.
+ */
+void
+_cinnamon_ngram_index_add_string (CinnamonNgramIndex *index,
+                                  const char         *str,
+                                  guint32             doc)
+{
+  gsize len, i;
+  gint n;
+
+  if (str == NULL)
+    return;
+
+  len = strlen (str);
+  for (i = 0; i < len; i++)
+    for (n = 1; n <= NGRAM_MAX_LENGTH && i + n <= len; n++)
+      add_posting (index, ngram_key (str + i, n), doc);
+}
+
+static gint
+compare_posting_lists_by_length (gconstpointer a,
+                                 gconstpointer b)
+{
+  const GArray *list_a = *(const GArray **)a;
+  const GArray *list_b = *(const GArray **)b;
+
+  return (gint)list_a->len - (gint)list_b->len;
+}
+
+/* Keeps the documents of @docs that are also in @list, both sorted */
+static void
+intersect_posting_list (GArray       *docs,
+                        const GArray *list)
+{
+  guint i = 0, j = 0, n = 0;
+
+  while (i < docs->len && j < list->len)
+    {
+      guint32 a = g_array_index (docs, guint32, i);
+      guint32 b = g_array_index (list, guint32, j);
+
+      if (a < b)
+        i++;
+      else if (a > b)
+        j++;
+      else
+        {
+          g_array_index (docs, guint32, n++) = a;
+          i++;
+          j++;
+        }
+    }
+
+  g_array_set_size (docs, n);
+}
+
+/**
+ * _cinnamon_ngram_index_find_candidates:
+ * @index: a #CinnamonNgramIndex
+ * @terms: (element-type utf8): normalized and casefolded terms, logical AND
+ * @restrict_to: (allow-none): sorted documents to look among, without
+ *   duplicates, or %NULL for all
+ * @n_docs: the number of documents, for terms without any n-gram
+ *
+ * Return value: the sorted documents that may match all of @terms, or
+ *   %NULL if none can
+ */
+GArray *
+_cinnamon_ngram_index_find_candidates (CinnamonNgramIndex *index,
+                                       GSList             *terms,
+                                       const GArray       *restrict_to,
+                                       guint32             n_docs)
+{
+  GPtrArray *lists;
+  GArray *docs;
+  GArray *list;
+  GSList *l;
+  guint32 doc;
+  guint i;
+
+  lists = g_ptr_array_new ();
+
+  if (restrict_to != NULL)
+    g_ptr_array_add (lists, (GArray *) restrict_to);
+
+  for (l = terms; l; l = l->next)
+    {
+      const char *term = l->data;
+      gsize len = strlen (term);
+      gsize n_ngrams, start;
+
+      /* An empty term matches everything */
+      if (len == 0)
+        continue;
+
+      n_ngrams = len < NGRAM_MAX_LENGTH ? 1 : len - NGRAM_MAX_LENGTH + 1;
+
+      for (start = 0; start < n_ngrams; start++)
+        {
+          list = g_hash_table_lookup (index->postings,
+                                      GUINT_TO_POINTER (ngram_key (term + start,
+                                                                   MIN (len, NGRAM_MAX_LENGTH))));
+          if (list == NULL)
+            {
+              g_ptr_array_free (lists, TRUE);
+              return NULL;
+            }
+
+          g_ptr_array_add (lists, list);
+        }
+    }
+
+  if (lists->len == 0)
+    {
+      g_ptr_array_free (lists, TRUE);
+
+      docs = g_array_sized_new (FALSE, FALSE, sizeof (guint32), n_docs);
+      for (doc = 0; doc < n_docs; doc++)
+        g_array_append_val (docs, doc);
+
+      return docs;
+    }
+
+  /* Start from the shortest list, the result can't be any longer */
+  g_ptr_array_sort (lists, compare_posting_lists_by_length);
+
+  list = g_ptr_array_index (lists, 0);
+  docs = g_array_sized_new (FALSE, FALSE, sizeof (guint32), list->len);
+  g_array_append_vals (docs, list->data, list->len);
+
+  for (i = 1; i < lists->len && docs->len > 0; i++)
+    intersect_posting_list (docs, g_ptr_array_index (lists, i));
+
+  g_ptr_array_free (lists, TRUE);
+
+  return docs;
+}
+
+static gint
+compare_docs (gconstpointer a,
+              gconstpointer b)
+{
+  guint32 doc_a = *(const guint32 *)a;
+  guint32 doc_b = *(const guint32 *)b;
+
+  return doc_a < doc_b ? -1 : (doc_a > doc_b);
+}
+
+/**
+ * _cinnamon_ngram_docs_sort_unique:
+ * @docs: document numbers
+ *
+ * Sorts @docs and removes duplicates, as
+ * _cinnamon_ngram_index_find_candidates() wants @restrict_to.
+ */
+void
+_cinnamon_ngram_docs_sort_unique (GArray *docs)
+{
+  guint i, n;
+
+  g_array_sort (docs, compare_docs);
+
+  for (i = 0, n = 0; i < docs->len; i++)
+    if (n == 0 || g_array_index (docs, guint32, i) != g_array_index (docs, guint32, n - 1))
+      g_array_index (docs, guint32, n++) = g_array_index (docs, guint32, i);
+  g_array_set_size (docs, n);
+}
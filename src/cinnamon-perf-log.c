@@ -3,6 +3,7 @@
 #include "config.h"
 
 #include <string.h>
+#include <sys/mman.h>
 
 #include "cinnamon-perf-log.h"
 
@@ -10,7 +11,7 @@ typedef struct _CinnamonPerfEvent CinnamonPerfEvent;
 typedef struct _CinnamonPerfStatistic CinnamonPerfStatistic;
 typedef struct _CinnamonPerfStatisticsClosure CinnamonPerfStatisticsClosure;
 typedef union  _CinnamonPerfStatisticValue CinnamonPerfStatisticValue;
-typedef struct _CinnamonPerfBlock CinnamonPerfBlock;
+typedef struct _CinnamonPerfRing CinnamonPerfRing;
 
 /**
  * SECTION:cinnamon-perf-log
@@ -31,6 +32,12 @@ typedef struct _CinnamonPerfBlock CinnamonPerfBlock;
  * Arguments are identified by a D-Bus style signature; at the moment
  * only a limited number of event signatures are supported to
  * simplify the code.
+ *
+ * Events can be recorded from any thread, once they have been defined.
+ * By default the log keeps every event until it fills up; in flight
+ * recorder mode, see cinnamon_perf_log_set_flight_recorder(), it keeps
+ * the most recent events instead, so that logging can be left enabled
+ * and the log dumped after the fact.
  */
 struct _CinnamonPerfLog
 {
@@ -43,14 +50,15 @@ struct _CinnamonPerfLog
 
   GPtrArray *statistics_closures;
 
-  GQueue *blocks;
-
-  gint64 start_time;
-  gint64 last_time;
+  /* All the rings ever created; protected by the rings lock */
+  GSList *rings;
+  GSList *free_rings;
 
   guint statistics_timeout_id;
 
-  guint enabled : 1;
+  /* Read by every thread recording events; use g_atomic_int */
+  gint enabled;
+  gint flight_recorder;
 };
 
 struct _CinnamonPerfLogClass
@@ -90,25 +98,48 @@ struct _CinnamonPerfStatisticsClosure
   GDestroyNotify notify;
 };
 
-/* The events in the log are stored in a linked list of fixed size
- * blocks.
+/* The events in the log are stored in one ring buffer per recording
+ * thread, so that recording needs no locking: only the owning thread
+ * writes to a ring, and readers copy it out and check afterwards
+ * whether what they copied was overwritten meanwhile.
+ *
+ * Rings are mmapped directly, to avoid polluting malloc statistics;
+ * the memory is only committed as the ring fills up. When a thread
+ * exits its ring is kept, events included, and handed to the next
+ * new thread.
+ *
+ * 'head' and 'tail' count bytes written and bytes dropped since the
+ * ring was created; they wrap around, but their difference never
+ * exceeds RING_SIZE. Each event is stored as:
+ *
+ *   guint16 size, guint16 id, gint64 time, arguments
  *
- * Note that the power-of-two nature of BLOCK_SIZE here is superficial
- * since the allocated block has the 'bytes' field and malloc
- * overhead. The current value is well below the size that will
- * typically be independently mmapped by the malloc implementation so
- * it doesn't matter. If we switched to mmapping blocks manually
- * (perhaps to avoid polluting malloc statistics), we'd want to use a
- * different value of BLOCK_SIZE.
+ * padded to a multiple of 4 bytes. Events don't wrap around the end of
+ * the buffer; the space left at the end is filled with a padding event
+ * instead, which only has the size and id fields.
  */
-#define BLOCK_SIZE 8192
+#define RING_SIZE (4 * 1024 * 1024)
+#define RING_MASK (RING_SIZE - 1)
 
-struct _CinnamonPerfBlock
+#define EVENT_HEADER_SIZE (sizeof (guint16) + sizeof (guint16) + sizeof (gint64))
+#define MAX_EVENT_SIZE 8192
+#define EVENT_ID_PADDING 0xffff
+
+#define ALIGN_EVENT_SIZE(size) (((size) + 3) & ~3)
+
+struct _CinnamonPerfRing
 {
-  guint32 bytes;
-  guchar buffer[BLOCK_SIZE];
+  guchar *buffer;
+  volatile guint32 head;
+  volatile guint32 tail;
+
+  guint full_warned : 1;
 };
 
+G_LOCK_DEFINE_STATIC (events);
+G_LOCK_DEFINE_STATIC (rings);
+static GStaticPrivate thread_ring = G_STATIC_PRIVATE_INIT;
+
 /* Number of milliseconds between periodic statistics collection when
  * events are enabled. Statistics collection can also be explicitly
  * triggered.
@@ -117,7 +148,6 @@ struct _CinnamonPerfBlock
 
 /* Builtin events */
 enum {
-  EVENT_SET_TIME,
   EVENT_STATISTICS_COLLECTED
 };
 
@@ -141,14 +171,6 @@ cinnamon_perf_log_init (CinnamonPerfLog *perf_log)
   perf_log->statistics = g_ptr_array_new ();
   perf_log->statistics_by_name = g_hash_table_new (g_str_hash, g_str_equal);
   perf_log->statistics_closures = g_ptr_array_new ();
-  perf_log->blocks = g_queue_new ();
-
-  /* This event is used when timestamp deltas are greater than
-   * fits in a gint32. 0xffffffff microseconds is about 70 minutes, so this
-   * is not going to happen in normal usage. It might happen if performance
-   * logging is enabled some time after starting Cinnamon */
-  cinnamon_perf_log_define_event (perf_log, "perf.setTime", "", "x");
-  g_assert (perf_log->events->len == EVENT_SET_TIME + 1);
 
   /* The purpose of this event is to allow us to optimize out storing
    * statistics that haven't changed. We want to mark every time we
@@ -163,8 +185,6 @@ cinnamon_perf_log_init (CinnamonPerfLog *perf_log)
                                "Finished collecting statistics",
                                "x");
   g_assert (perf_log->events->len == EVENT_STATISTICS_COLLECTED + 1);
-
-  perf_log->start_time = perf_log->last_time = get_time();
 }
 
 static void
@@ -214,9 +234,9 @@ cinnamon_perf_log_set_enabled (CinnamonPerfLog *perf_log,
 {
   enabled = enabled != FALSE;
 
-  if (enabled != perf_log->enabled)
+  if (enabled != g_atomic_int_get (&perf_log->enabled))
     {
-      perf_log->enabled = enabled;
+      g_atomic_int_set (&perf_log->enabled, enabled);
 
       if (enabled)
         {
@@ -232,6 +252,25 @@ cinnamon_perf_log_set_enabled (CinnamonPerfLog *perf_log,
     }
 }
 
+/**
+ * cinnamon_perf_log_set_flight_recorder:
+ * @perf_log: a #CinnamonPerfLog
+ * @flight_recorder: whether to overwrite the oldest events
+ *
+ * Sets what happens when the space for the events of a thread is
+ * exhausted. Normally new events are discarded, so that the log
+ * holds the start of a performance run. In flight recorder mode
+ * the oldest events are overwritten instead, so the log always
+ * holds the last few minutes of events and can be left enabled
+ * permanently, to be dumped when something went wrong.
+ */
+void
+cinnamon_perf_log_set_flight_recorder (CinnamonPerfLog *perf_log,
+                                    gboolean      flight_recorder)
+{
+  g_atomic_int_set (&perf_log->flight_recorder, flight_recorder != FALSE);
+}
+
 static CinnamonPerfEvent *
 define_event (CinnamonPerfLog *perf_log,
               const char   *name,
@@ -249,21 +288,25 @@ define_event (CinnamonPerfLog *perf_log,
       return NULL;
     }
 
-  if (perf_log->events->len == 65536)
+  /* We could do stricter validation, but this will break our JSON dumps */
+  if (strchr (name, '"') != NULL)
     {
-      g_warning ("Maximum number of events defined\n");
+      g_warning ("Event names can't include '\"'");
       return NULL;
     }
 
-  /* We could do stricter validation, but this will break our JSON dumps */
-  if (strchr (name, '"') != NULL)
+  G_LOCK (events);
+
+  if (perf_log->events->len == EVENT_ID_PADDING)
     {
-      g_warning ("Event names can't include '\"'");
+      G_UNLOCK (events);
+      g_warning ("Maximum number of events defined\n");
       return NULL;
     }
 
   if (g_hash_table_lookup (perf_log->events_by_name, name) != NULL)
     {
+      G_UNLOCK (events);
       g_warning ("Duplicate event event for '%s'\n", name);
       return NULL;
     }
@@ -278,6 +321,8 @@ define_event (CinnamonPerfLog *perf_log,
   g_ptr_array_add (perf_log->events, event);
   g_hash_table_insert (perf_log->events_by_name, event->name, event);
 
+  G_UNLOCK (events);
+
   return event;
 }
 
@@ -311,7 +356,11 @@ lookup_event (CinnamonPerfLog *perf_log,
               const char   *name,
               const char   *signature)
 {
-  CinnamonPerfEvent *event = g_hash_table_lookup (perf_log->events_by_name, name);
+  CinnamonPerfEvent *event;
+
+  G_LOCK (events);
+  event = g_hash_table_lookup (perf_log->events_by_name, name);
+  G_UNLOCK (events);
 
   if (G_UNLIKELY (event == NULL))
     {
@@ -329,6 +378,58 @@ lookup_event (CinnamonPerfLog *perf_log,
   return event;
 }
 
+static void
+release_thread_ring (gpointer data)
+{
+  CinnamonPerfLog *perf_log = cinnamon_perf_log_get_default ();
+  CinnamonPerfRing *ring = data;
+
+  G_LOCK (rings);
+  perf_log->free_rings = g_slist_prepend (perf_log->free_rings, ring);
+  G_UNLOCK (rings);
+}
+
+static CinnamonPerfRing *
+get_thread_ring (CinnamonPerfLog *perf_log)
+{
+  CinnamonPerfRing *ring = g_static_private_get (&thread_ring);
+
+  if (G_LIKELY (ring != NULL))
+    return ring;
+
+  G_LOCK (rings);
+
+  if (perf_log->free_rings != NULL)
+    {
+      ring = perf_log->free_rings->data;
+      perf_log->free_rings = g_slist_delete_link (perf_log->free_rings,
+                                                  perf_log->free_rings);
+    }
+  else
+    {
+      gpointer buffer = mmap (NULL, RING_SIZE,
+                              PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                              -1, 0);
+
+      if (buffer != MAP_FAILED)
+        {
+          ring = g_slice_new0 (CinnamonPerfRing);
+          ring->buffer = buffer;
+          perf_log->rings = g_slist_prepend (perf_log->rings, ring);
+        }
+    }
+
+  G_UNLOCK (rings);
+
+  if (ring == NULL)
+    return NULL;
+
+  g_static_private_set (&thread_ring, ring, release_thread_ring);
+
+  return ring;
+}
+
 static void
 record_event (CinnamonPerfLog   *perf_log,
               gint64          event_time,
@@ -336,58 +437,74 @@ record_event (CinnamonPerfLog   *perf_log,
               const guchar   *bytes,
               size_t          bytes_len)
 {
-  CinnamonPerfBlock *block;
-  size_t total_bytes;
-  guint32 time_delta;
-  guint32 pos;
+  CinnamonPerfRing *ring;
+  guint32 head, tail, offset;
+  guint32 event_size, padding;
+  guint16 size16;
 
-  if (!perf_log->enabled)
+  if (!g_atomic_int_get (&perf_log->enabled))
     return;
 
-  total_bytes = sizeof (gint32) + sizeof (gint16) + bytes_len;
-  if (G_UNLIKELY (bytes_len > BLOCK_SIZE || total_bytes > BLOCK_SIZE))
+  if (G_UNLIKELY (bytes_len > MAX_EVENT_SIZE))
     {
       g_warning ("Discarding oversize event '%s'\n", event->name);
       return;
     }
 
-  if (event_time > perf_log->last_time + G_GINT64_CONSTANT(0xffffffff))
-    {
-      perf_log->last_time = event_time;
-      record_event (perf_log, event_time,
-                    lookup_event (perf_log, "perf.setTime", "x"),
-                    (const guchar *)&event_time, sizeof(gint64));
-      time_delta = 0;
-    }
-  else if (event_time < perf_log->last_time)
-    time_delta = 0;
-  else
-    time_delta = (guint32)(event_time - perf_log->last_time);
+  ring = get_thread_ring (perf_log);
+  if (G_UNLIKELY (ring == NULL))
+    return;
 
-  perf_log->last_time = event_time;
+  /* Only this thread writes head and tail */
+  head = ring->head;
+  tail = ring->tail;
 
-  if (perf_log->blocks->tail == NULL ||
-      total_bytes + ((CinnamonPerfBlock *)perf_log->blocks->tail->data)->bytes > BLOCK_SIZE)
-    {
-      block = g_new (CinnamonPerfBlock, 1);
-      block->bytes = 0;
-      g_queue_push_tail (perf_log->blocks, block);
-    }
-  else
+  event_size = ALIGN_EVENT_SIZE (EVENT_HEADER_SIZE + bytes_len);
+  offset = head & RING_MASK;
+  padding = offset + event_size > RING_SIZE ? RING_SIZE - offset : 0;
+
+  if (head + padding + event_size - tail > RING_SIZE)
     {
-      block = (CinnamonPerfBlock *)perf_log->blocks->tail->data;
+      if (!g_atomic_int_get (&perf_log->flight_recorder))
+        {
+          if (!ring->full_warned)
+            g_warning ("Performance log is full, discarding events\n");
+          ring->full_warned = TRUE;
+          return;
+        }
+
+      /* Drop the oldest events; readers have to know before they get
+       * overwritten */
+      while (head + padding + event_size - tail > RING_SIZE)
+        {
+          memcpy (&size16, ring->buffer + (tail & RING_MASK), sizeof (guint16));
+          tail += size16;
+        }
+
+      g_atomic_int_set ((volatile gint *) &ring->tail, tail);
     }
 
-  pos = block->bytes;
+  if (padding > 0)
+    {
+      guint16 id = EVENT_ID_PADDING;
 
-  memcpy (block->buffer + pos, &time_delta, sizeof (guint32));
-  pos += sizeof (guint32);
-  memcpy (block->buffer + pos, &event->id, sizeof (guint16));
-  pos += sizeof (guint16);
-  memcpy (block->buffer + pos, bytes, bytes_len);
-  pos += bytes_len;
+      size16 = padding;
+      memcpy (ring->buffer + offset, &size16, sizeof (guint16));
+      memcpy (ring->buffer + offset + sizeof (guint16), &id, sizeof (guint16));
+      offset = 0;
+    }
 
-  block->bytes = pos;
+  size16 = event_size;
+  memcpy (ring->buffer + offset, &size16, sizeof (guint16));
+  offset += sizeof (guint16);
+  memcpy (ring->buffer + offset, &event->id, sizeof (guint16));
+  offset += sizeof (guint16);
+  memcpy (ring->buffer + offset, &event_time, sizeof (gint64));
+  offset += sizeof (gint64);
+  memcpy (ring->buffer + offset, bytes, bytes_len);
+
+  /* Publish the event only once it is completely written */
+  g_atomic_int_set ((volatile gint *) &ring->head, head + padding + event_size);
 }
 
 /**
@@ -631,7 +748,7 @@ cinnamon_perf_log_collect_statistics (CinnamonPerfLog *perf_log)
   gint64 collection_time;
   int i;
 
-  if (!perf_log->enabled)
+  if (!g_atomic_int_get (&perf_log->enabled))
     return;
 
   for (i = 0; i < perf_log->statistics_closures->len; i++)
@@ -683,6 +800,78 @@ cinnamon_perf_log_collect_statistics (CinnamonPerfLog *perf_log)
                 (const guchar *)&collection_time, sizeof (gint64));
 }
 
+typedef struct {
+  guchar *data;
+  guint32 length;
+  guint32 pos;
+} RingSnapshot;
+
+/* Copies the events currently in @ring; see the comment on
+ * CinnamonPerfRing for why this works without locking */
+static void
+snapshot_ring (CinnamonPerfRing *ring,
+               RingSnapshot     *snapshot)
+{
+  guint32 head, tail, new_tail, offset, length;
+
+  head = g_atomic_int_get ((volatile gint *) &ring->head);
+  tail = g_atomic_int_get ((volatile gint *) &ring->tail);
+
+  length = head - tail;
+  offset = tail & RING_MASK;
+
+  snapshot->data = g_malloc (MAX (length, 1));
+
+  if (offset + length <= RING_SIZE)
+    {
+      memcpy (snapshot->data, ring->buffer + offset, length);
+    }
+  else
+    {
+      memcpy (snapshot->data, ring->buffer + offset, RING_SIZE - offset);
+      memcpy (snapshot->data + RING_SIZE - offset, ring->buffer,
+              length - (RING_SIZE - offset));
+    }
+
+  /* The writer moves the tail before overwriting anything, so whatever
+   * is before the current tail may have been overwritten while copying,
+   * and the rest is intact */
+  new_tail = g_atomic_int_get ((volatile gint *) &ring->tail);
+  if (new_tail - tail > length)
+    {
+      snapshot->pos = snapshot->length = 0;
+      return;
+    }
+
+  snapshot->pos = new_tail - tail;
+  snapshot->length = length;
+}
+
+/* Skips padding; returns %FALSE when @snapshot has no event left */
+static gboolean
+snapshot_peek (RingSnapshot *snapshot,
+               guint16      *id,
+               gint64       *time)
+{
+  while (snapshot->pos < snapshot->length)
+    {
+      guint16 size;
+
+      memcpy (&size, snapshot->data + snapshot->pos, sizeof (guint16));
+      memcpy (id, snapshot->data + snapshot->pos + sizeof (guint16), sizeof (guint16));
+
+      if (*id != EVENT_ID_PADDING)
+        {
+          memcpy (time, snapshot->data + snapshot->pos + 2 * sizeof (guint16), sizeof (gint64));
+          return TRUE;
+        }
+
+      snapshot->pos += size;
+    }
+
+  return FALSE;
+}
+
 /**
  * cinnamon_perf_log_replay:
  * @perf_log: a #CinnamonPerfLog
@@ -690,83 +879,103 @@ cinnamon_perf_log_collect_statistics (CinnamonPerfLog *perf_log)
  * @user_data: data to pass to @replay_function
  *
  * Replays the log by calling the given function for each event
- * in the log.
+ * in the log. Events recorded by different threads are merged
+ * in the order of their timestamps.
  */
 void
 cinnamon_perf_log_replay (CinnamonPerfLog            *perf_log,
                        CinnamonPerfReplayFunction  replay_function,
                        gpointer                 user_data)
 {
-  gint64 event_time = perf_log->start_time;
-  GList *iter;
+  RingSnapshot *snapshots;
+  guint n_snapshots, i;
+  GSList *l;
 
-  for (iter = perf_log->blocks->head; iter; iter = iter->next)
-    {
-      CinnamonPerfBlock *block = iter->data;
-      guint32 pos = 0;
+  /* Copy everything out first, the replay function may well record
+   * events itself */
+  G_LOCK (rings);
+
+  n_snapshots = g_slist_length (perf_log->rings);
+  snapshots = g_new0 (RingSnapshot, MAX (n_snapshots, 1));
 
-      while (pos < block->bytes)
+  for (l = perf_log->rings, i = 0; l; l = l->next, i++)
+    snapshot_ring (l->data, &snapshots[i]);
+
+  G_UNLOCK (rings);
+
+  while (TRUE)
+    {
+      RingSnapshot *snapshot = NULL;
+      CinnamonPerfEvent *event;
+      guint16 size, id = 0;
+      gint64 event_time = 0;
+      const guchar *args;
+      GValue arg = { 0, };
+
+      /* There are only a few threads, a linear search is fine */
+      for (i = 0; i < n_snapshots; i++)
         {
-          CinnamonPerfEvent *event;
-          guint16 id;
-          guint32 time_delta;
-          GValue arg = { 0, };
+          guint16 candidate_id;
+          gint64 candidate_time;
 
-          memcpy (&time_delta, block->buffer + pos, sizeof (guint32));
-          pos += sizeof (guint32);
-          memcpy (&id, block->buffer + pos, sizeof (guint16));
-          pos += sizeof (guint16);
+          if (!snapshot_peek (&snapshots[i], &candidate_id, &candidate_time))
+            continue;
 
-          if (id == EVENT_SET_TIME)
-            {
-              /* Internal, we don't include in the replay */
-              memcpy (&event_time, block->buffer + pos, sizeof (gint64));
-              pos += sizeof (gint64);
-              continue;
-            }
-          else
+          if (snapshot == NULL || candidate_time < event_time)
             {
-              event_time += time_delta;
+              snapshot = &snapshots[i];
+              id = candidate_id;
+              event_time = candidate_time;
             }
+        }
 
-          event = g_ptr_array_index (perf_log->events, id);
+      if (snapshot == NULL)
+        break;
 
-          if (strcmp (event->signature, "") == 0)
-            {
-              /* We need to pass something, so pass an empty string */
-              g_value_init (&arg, G_TYPE_STRING);
-            }
-          else if (strcmp (event->signature, "i") == 0)
-            {
-              gint32 l;
+      memcpy (&size, snapshot->data + snapshot->pos, sizeof (guint16));
+      args = snapshot->data + snapshot->pos + EVENT_HEADER_SIZE;
+      snapshot->pos += size;
 
-              memcpy (&l, block->buffer + pos, sizeof (gint32));
-              pos += sizeof (gint32);
+      G_LOCK (events);
+      event = g_ptr_array_index (perf_log->events, id);
+      G_UNLOCK (events);
 
-              g_value_init (&arg, G_TYPE_INT);
-              g_value_set_int (&arg, l);
-            }
-          else if (strcmp (event->signature, "x") == 0)
-            {
-              gint64 l;
+      if (strcmp (event->signature, "") == 0)
+        {
+          /* We need to pass something, so pass an empty string */
+          g_value_init (&arg, G_TYPE_STRING);
+        }
+      else if (strcmp (event->signature, "i") == 0)
+        {
+          gint32 l;
 
-              memcpy (&l, block->buffer + pos, sizeof (gint64));
-              pos += sizeof (gint64);
+          memcpy (&l, args, sizeof (gint32));
 
-              g_value_init (&arg, G_TYPE_INT64);
-              g_value_set_int64 (&arg, l);
-            }
-          else if (strcmp (event->signature, "s") == 0)
-            {
-              g_value_init (&arg, G_TYPE_STRING);
-              g_value_set_string (&arg, (char *)block->buffer + pos);
-              pos += strlen ((char *)(block->buffer + pos)) + 1;
-            }
+          g_value_init (&arg, G_TYPE_INT);
+          g_value_set_int (&arg, l);
+        }
+      else if (strcmp (event->signature, "x") == 0)
+        {
+          gint64 l;
+
+          memcpy (&l, args, sizeof (gint64));
 
-          replay_function (event_time, event->name, event->signature, &arg, user_data);
-          g_value_unset (&arg);
+          g_value_init (&arg, G_TYPE_INT64);
+          g_value_set_int64 (&arg, l);
         }
+      else if (strcmp (event->signature, "s") == 0)
+        {
+          g_value_init (&arg, G_TYPE_STRING);
+          g_value_set_string (&arg, (const char *)args);
+        }
+
+      replay_function (event_time, event->name, event->signature, &arg, user_data);
+      g_value_unset (&arg);
     }
+
+  for (i = 0; i < n_snapshots; i++)
+    g_free (snapshots[i].data);
+  g_free (snapshots);
 }
 
 static char *
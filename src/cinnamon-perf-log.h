@@ -23,6 +23,8 @@ CinnamonPerfLog *cinnamon_perf_log_get_default (void);
 
 void cinnamon_perf_log_set_enabled (CinnamonPerfLog *perf_log,
 				 gboolean      enabled);
+void cinnamon_perf_log_set_flight_recorder (CinnamonPerfLog *perf_log,
+                                         gboolean      flight_recorder);
 
 void cinnamon_perf_log_define_event (CinnamonPerfLog *perf_log,
 				  const char   *name,
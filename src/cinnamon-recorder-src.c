@@ -76,6 +76,14 @@ cinnamon_recorder_src_update_memory_used (CinnamonRecorderSrc *src,
   g_mutex_unlock (src->mutex);
 }
 
+/* Sub-buffers share the memory of their parent, which was already
+ * counted when the parent was added */
+static guint
+buffer_memory_size (GstBuffer *buffer)
+{
+  return GST_BUFFER_MALLOCDATA(buffer) != NULL ? GST_BUFFER_SIZE(buffer) : 0;
+}
+
 /* The create() virtual function is responsible for returning the next buffer.
  * We just pop buffers off of the queue and block if necessary.
  */
@@ -98,7 +106,7 @@ cinnamon_recorder_src_create (GstPushSrc  *push_src,
     }
 
   cinnamon_recorder_src_update_memory_used (src,
-					 - (int)(GST_BUFFER_SIZE(buffer) / 1024));
+					 - (int)(buffer_memory_size (buffer) / 1024));
 
   *buffer_out = buffer;
 
@@ -248,7 +256,7 @@ cinnamon_recorder_src_add_buffer (CinnamonRecorderSrc *src,
 
   gst_buffer_set_caps (buffer, src->caps);
   cinnamon_recorder_src_update_memory_used (src,
-					 (int) (GST_BUFFER_SIZE(buffer) / 1024));
+					 (int) (buffer_memory_size (buffer) / 1024));
 
   g_async_queue_push (src->queue, gst_buffer_ref (buffer));
 }
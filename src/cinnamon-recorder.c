@@ -16,6 +16,9 @@
 #include <clutter/x11/clutter-x11.h>
 #include <X11/extensions/Xfixes.h>
 
+#include <GL/gl.h>
+#include <GL/glext.h>
+
 typedef enum {
   RECORDER_STATE_CLOSED,
   RECORDER_STATE_PAUSED,
@@ -24,6 +27,22 @@ typedef enum {
 
 typedef struct _RecorderPipeline RecorderPipeline;
 
+/* Number of frames that can be in flight between the GPU and us */
+#define N_READBACK_BUFFERS 3
+
+/* A frame being copied from the stage into a pixel buffer object; the
+ * copy happens asynchronously, so we only look at the result a couple
+ * of frames later, when the GPU is long done with it.
+ */
+typedef struct {
+  GLuint pbo;
+  gboolean pending;
+  cairo_rectangle_int_t rect; /* part of the stage read back */
+  GstClockTime timestamp;
+  int pointer_x;
+  int pointer_y;
+} RecorderReadback;
+
 struct _CinnamonRecorderClass
 {
   GObjectClass parent_class;
@@ -62,6 +81,21 @@ struct _CinnamonRecorder {
 
   gboolean only_paint; /* Used to temporarily suppress recording */
 
+  /* Frames being read back, used round-robin. Allocated on the first
+   * frame recorded with the current stage size, when PBOs are available */
+  RecorderReadback readbacks[N_READBACK_BUFFERS];
+  gboolean have_readbacks;
+  guint next_readback;
+
+  /* In incremental mode, only the parts of the stage that were redrawn
+   * are read back, and patched into a copy of the stage we keep */
+  gboolean incremental;
+  guint8 *stage_pixels; /* without the cursor */
+  cairo_region_t *stale; /* parts of stage_pixels not read back yet */
+  GstBuffer *last_frame; /* last frame sent, to share when nothing changes */
+  int last_pointer_x;
+  int last_pointer_y;
+
   int framerate;
   char *pipeline_description;
   char *filename;
@@ -101,15 +135,23 @@ static void recorder_set_pipeline (CinnamonRecorder *recorder,
 static void recorder_set_filename (CinnamonRecorder *recorder,
                                    const char    *filename);
 
+static void recorder_set_incremental (CinnamonRecorder *recorder,
+                                      gboolean          incremental);
+
 static void recorder_pipeline_set_caps (RecorderPipeline *pipeline);
 static void recorder_pipeline_closed   (RecorderPipeline *pipeline);
 
+static void     recorder_record_unchanged_frame (CinnamonRecorder *recorder);
+static void     recorder_queue_redraw           (CinnamonRecorder *recorder);
+static gboolean recorder_have_stage             (CinnamonRecorder *recorder);
+
 enum {
   PROP_0,
   PROP_STAGE,
   PROP_FRAMERATE,
   PROP_PIPELINE,
-  PROP_FILENAME
+  PROP_FILENAME,
+  PROP_INCREMENTAL
 };
 
 G_DEFINE_TYPE(CinnamonRecorder, cinnamon_recorder, G_TYPE_OBJECT);
@@ -355,7 +397,11 @@ recorder_redraw_timeout (gpointer data)
   CinnamonRecorder *recorder = data;
 
   recorder->redraw_timeout = 0;
-  clutter_actor_queue_redraw (CLUTTER_ACTOR (recorder->stage));
+
+  if (recorder->incremental && recorder_have_stage (recorder))
+    recorder_record_unchanged_frame (recorder);
+  else
+    clutter_actor_queue_redraw (CLUTTER_ACTOR (recorder->stage));
 
   return FALSE;
 }
@@ -426,7 +472,9 @@ recorder_fetch_cursor_image (CinnamonRecorder *recorder)
  */
 static void
 recorder_draw_cursor (CinnamonRecorder *recorder,
-                      GstBuffer     *buffer)
+                      GstBuffer     *buffer,
+                      int            pointer_x,
+                      int            pointer_y)
 {
   cairo_surface_t *surface;
   cairo_t *cr;
@@ -434,10 +482,10 @@ recorder_draw_cursor (CinnamonRecorder *recorder,
   /* We don't show a cursor unless the hot spot is in the frame; this
    * means that sometimes we aren't going to draw a cursor even when
    * there is a little bit overlapping within the stage */
-  if (recorder->pointer_x < 0 ||
-      recorder->pointer_y < 0 ||
-      recorder->pointer_x >= recorder->stage_width ||
-      recorder->pointer_y >= recorder->stage_height)
+  if (pointer_x < 0 ||
+      pointer_y < 0 ||
+      pointer_x >= recorder->stage_width ||
+      pointer_y >= recorder->stage_height)
     return;
 
   if (!recorder->cursor_image)
@@ -455,8 +503,8 @@ recorder_draw_cursor (CinnamonRecorder *recorder,
   cr = cairo_create (surface);
   cairo_set_source_surface (cr,
                             recorder->cursor_image,
-                            recorder->pointer_x - recorder->cursor_hot_x,
-                            recorder->pointer_y - recorder->cursor_hot_y);
+                            pointer_x - recorder->cursor_hot_x,
+                            pointer_y - recorder->cursor_hot_y);
   cairo_paint (cr);
 
   cairo_destroy (cr);
@@ -510,40 +558,506 @@ get_wall_time (void)
   return tv.tv_sec * 1000000000LL + tv.tv_usec * 1000LL;
 }
 
-/* Retrieve a frame and feed it into the pipeline
+/* Frames are big and we allocate one at the frame rate, so the memory
+ * handed to GStreamer is recycled rather than given back to malloc. The
+ * free function of a GstBuffer gets no user data, so the size of each
+ * block is stored in front of the frame data. Buffers are freed in the
+ * streaming thread, hence the lock.
  */
+#define FRAME_HEADER_SIZE 16
+
+/* How many unused frames to keep around; frames waiting to be encoded
+ * can be many more, but there is no point in keeping that many */
+#define MAX_POOLED_FRAMES 4
+
+G_LOCK_DEFINE_STATIC (frame_pool);
+static GSList *frame_pool = NULL;
+static gsize frame_pool_size = 0;
+
+static guint8 *
+frame_data_alloc (gsize size)
+{
+  guint8 *block = NULL;
+
+  G_LOCK (frame_pool);
+
+  if (size != frame_pool_size)
+    {
+      g_slist_foreach (frame_pool, (GFunc) g_free, NULL);
+      g_slist_free (frame_pool);
+      frame_pool = NULL;
+      frame_pool_size = size;
+    }
+
+  if (frame_pool)
+    {
+      block = frame_pool->data;
+      frame_pool = g_slist_delete_link (frame_pool, frame_pool);
+    }
+
+  G_UNLOCK (frame_pool);
+
+  if (block == NULL)
+    {
+      block = g_malloc (FRAME_HEADER_SIZE + size);
+      *(gsize *) block = size;
+    }
+
+  return block + FRAME_HEADER_SIZE;
+}
+
 static void
-recorder_record_frame (CinnamonRecorder *recorder)
+frame_data_free (gpointer data)
+{
+  guint8 *block = (guint8 *) data - FRAME_HEADER_SIZE;
+
+  G_LOCK (frame_pool);
+
+  if (*(gsize *) block == frame_pool_size &&
+      g_slist_length (frame_pool) < MAX_POOLED_FRAMES)
+    {
+      frame_pool = g_slist_prepend (frame_pool, block);
+      block = NULL;
+    }
+
+  G_UNLOCK (frame_pool);
+
+  g_free (block);
+}
+
+static GstBuffer *
+recorder_new_frame (CinnamonRecorder *recorder,
+                    GstClockTime      timestamp)
 {
   GstBuffer *buffer;
-  guint8 *data;
   guint size;
 
   size = recorder->stage_width * recorder->stage_height * 4;
-  data = g_malloc (size);
 
   buffer = gst_buffer_new();
   GST_BUFFER_SIZE(buffer) = size;
-  GST_BUFFER_MALLOCDATA(buffer) = GST_BUFFER_DATA(buffer) = data;
+  GST_BUFFER_MALLOCDATA(buffer) = GST_BUFFER_DATA(buffer) = frame_data_alloc (size);
+  GST_BUFFER_FREE_FUNC(buffer) = frame_data_free;
 
-  GST_BUFFER_TIMESTAMP(buffer) = get_wall_time() - recorder->start_time;
+  GST_BUFFER_TIMESTAMP(buffer) = timestamp;
 
-  cogl_read_pixels (0, 0,
-                    recorder->stage_width, recorder->stage_height,
-                    COGL_READ_PIXELS_COLOR_BUFFER,
-                    CLUTTER_CAIRO_FORMAT_ARGB32,
-                    data);
+  return buffer;
+}
 
-  recorder_draw_cursor (recorder, buffer);
+static void
+recorder_push_frame (CinnamonRecorder *recorder,
+                     GstBuffer        *buffer,
+                     int               pointer_x,
+                     int               pointer_y)
+{
+  recorder_draw_cursor (recorder, buffer, pointer_x, pointer_y);
 
   cinnamon_recorder_src_add_buffer (CINNAMON_RECORDER_SRC (recorder->current_pipeline->src), buffer);
   gst_buffer_unref (buffer);
+}
+
+/* Copies @pixels, the contents of @rect of the stage packed without
+ * padding, into @dest, a whole stage sized frame */
+static void
+recorder_copy_region (CinnamonRecorder            *recorder,
+                      guint8                      *dest,
+                      const cairo_rectangle_int_t *rect,
+                      const guint8                *pixels,
+                      gboolean                     bottom_up)
+{
+  int dest_rowstride = recorder->stage_width * 4;
+  int rowstride = rect->width * 4;
+  int i;
+
+  for (i = 0; i < rect->height; i++)
+    {
+      const guint8 *row;
+
+      if (bottom_up)
+        row = pixels + (rect->height - 1 - i) * rowstride;
+      else
+        row = pixels + i * rowstride;
+
+      memcpy (dest + (rect->y + i) * dest_rowstride + rect->x * 4, row, rowstride);
+    }
+}
+
+/* Feeds a frame into the pipeline, given the part of the stage that
+ * changed since the last one. Outside of incremental mode, that's always
+ * the whole stage.
+ */
+static void
+recorder_add_frame (CinnamonRecorder            *recorder,
+                    const cairo_rectangle_int_t *rect,
+                    const guint8                *pixels,
+                    gboolean                     bottom_up,
+                    GstClockTime                 timestamp,
+                    int                          pointer_x,
+                    int                          pointer_y)
+{
+  GstBuffer *buffer;
+  guint size = recorder->stage_width * recorder->stage_height * 4;
+
+  if (recorder->current_pipeline == NULL)
+    return;
+
+  if (!recorder->incremental)
+    {
+      buffer = recorder_new_frame (recorder, timestamp);
+      recorder_copy_region (recorder, GST_BUFFER_DATA(buffer), rect, pixels, bottom_up);
+      recorder_push_frame (recorder, buffer, pointer_x, pointer_y);
+      return;
+    }
+
+  /* We lost track of the stage; it's read back again, starting with
+   * the next frame painted */
+  if (recorder->stage_pixels == NULL)
+    return;
+
+  if (rect->width > 0 && rect->height > 0)
+    {
+      recorder_copy_region (recorder, recorder->stage_pixels, rect, pixels, bottom_up);
+      cairo_region_subtract_rectangle (recorder->stale, rect);
+    }
+
+  /* Don't send frames with parts of the stage missing */
+  if (!cairo_region_is_empty (recorder->stale))
+    return;
+
+  /* Nothing changed at all: share the memory of the previous frame */
+  if (rect->width == 0 && recorder->last_frame != NULL &&
+      pointer_x == recorder->last_pointer_x &&
+      pointer_y == recorder->last_pointer_y &&
+      GST_BUFFER_SIZE(recorder->last_frame) == size)
+    {
+      buffer = gst_buffer_create_sub (recorder->last_frame, 0, size);
+      GST_BUFFER_TIMESTAMP(buffer) = timestamp;
+
+      cinnamon_recorder_src_add_buffer (CINNAMON_RECORDER_SRC (recorder->current_pipeline->src), buffer);
+      gst_buffer_unref (buffer);
+      return;
+    }
+
+  buffer = recorder_new_frame (recorder, timestamp);
+  memcpy (GST_BUFFER_DATA(buffer), recorder->stage_pixels, size);
+
+  if (recorder->last_frame != NULL)
+    gst_buffer_unref (recorder->last_frame);
+  recorder->last_frame = gst_buffer_ref (buffer);
+  recorder->last_pointer_x = pointer_x;
+  recorder->last_pointer_y = pointer_y;
+
+  recorder_push_frame (recorder, buffer, pointer_x, pointer_y);
+}
+
+/* Forgets what the stage looked like, so that all of it is read back
+ * again, as it gets painted */
+static void
+recorder_reset_damage (CinnamonRecorder *recorder)
+{
+  g_free (recorder->stage_pixels);
+  recorder->stage_pixels = NULL;
+
+  if (recorder->stale != NULL)
+    {
+      cairo_region_destroy (recorder->stale);
+      recorder->stale = NULL;
+    }
+
+  if (recorder->last_frame != NULL)
+    {
+      gst_buffer_unref (recorder->last_frame);
+      recorder->last_frame = NULL;
+    }
+}
+
+/* Whether we know what all of the stage looks like, so that frames can
+ * be made up without painting */
+static gboolean
+recorder_have_stage (CinnamonRecorder *recorder)
+{
+  return recorder->stage_pixels != NULL && cairo_region_is_empty (recorder->stale);
+}
+
+/* Figures out which part of the stage to read back for the frame being
+ * painted */
+static void
+recorder_get_damage (CinnamonRecorder      *recorder,
+                     cairo_rectangle_int_t *rect)
+{
+  rect->x = 0;
+  rect->y = 0;
+  rect->width = recorder->stage_width;
+  rect->height = recorder->stage_height;
+
+  if (!recorder->incremental)
+    return;
+
+  if (recorder->stage_pixels == NULL)
+    {
+      recorder->stage_pixels = g_malloc0 (recorder->stage_width * recorder->stage_height * 4);
+      recorder->stale = cairo_region_create_rectangle (rect);
+    }
+
+  /* With clipped redraws, only the clip was painted; the rest of the back
+   * buffer is stale, and either we already have it or it is still in
+   * recorder->stale, to be read back when it gets painted */
+  clutter_stage_get_redraw_clip_bounds (recorder->stage, rect);
+
+  rect->width = MIN (rect->x + rect->width, recorder->stage_width);
+  rect->height = MIN (rect->y + rect->height, recorder->stage_height);
+  rect->x = MAX (rect->x, 0);
+  rect->y = MAX (rect->y, 0);
+  rect->width = MAX (rect->width - rect->x, 0);
+  rect->height = MAX (rect->height - rect->y, 0);
+
+  /* Get the rest of the stage painted, rather than reading back what the
+   * back buffer happens to hold there */
+  if (!cairo_region_is_empty (recorder->stale))
+    {
+      cairo_region_t *rest = cairo_region_copy (recorder->stale);
+
+      cairo_region_subtract_rectangle (rest, rect);
+      if (!cairo_region_is_empty (rest))
+        recorder_queue_redraw (recorder);
+      cairo_region_destroy (rest);
+    }
+}
+
+/* Cogl doesn't let us read the framebuffer into a buffer object, so
+ * the readbacks are done with GL directly */
+static struct {
+  gboolean initialized;
+  gboolean available;
+  PFNGLGENBUFFERSARBPROC gen_buffers;
+  PFNGLDELETEBUFFERSARBPROC delete_buffers;
+  PFNGLBINDBUFFERARBPROC bind_buffer;
+  PFNGLBUFFERDATAARBPROC buffer_data;
+  PFNGLMAPBUFFERARBPROC map_buffer;
+  PFNGLUNMAPBUFFERARBPROC unmap_buffer;
+} gl;
+
+static gboolean
+recorder_check_readback_support (void)
+{
+  if (gl.initialized)
+    return gl.available;
+
+  gl.initialized = TRUE;
+
+  if (!cogl_features_available (COGL_FEATURE_PBOS))
+    return FALSE;
+
+  gl.gen_buffers = (PFNGLGENBUFFERSARBPROC) cogl_get_proc_address ("glGenBuffersARB");
+  gl.delete_buffers = (PFNGLDELETEBUFFERSARBPROC) cogl_get_proc_address ("glDeleteBuffersARB");
+  gl.bind_buffer = (PFNGLBINDBUFFERARBPROC) cogl_get_proc_address ("glBindBufferARB");
+  gl.buffer_data = (PFNGLBUFFERDATAARBPROC) cogl_get_proc_address ("glBufferDataARB");
+  gl.map_buffer = (PFNGLMAPBUFFERARBPROC) cogl_get_proc_address ("glMapBufferARB");
+  gl.unmap_buffer = (PFNGLUNMAPBUFFERARBPROC) cogl_get_proc_address ("glUnmapBufferARB");
+
+  gl.available = (gl.gen_buffers && gl.delete_buffers && gl.bind_buffer &&
+                  gl.buffer_data && gl.map_buffer && gl.unmap_buffer);
+
+  return gl.available;
+}
+
+static void
+recorder_free_readbacks (CinnamonRecorder *recorder)
+{
+  int i;
+
+  if (!recorder->have_readbacks)
+    return;
+
+  for (i = 0; i < N_READBACK_BUFFERS; i++)
+    {
+      gl.delete_buffers (1, &recorder->readbacks[i].pbo);
+      recorder->readbacks[i].pbo = 0;
+      recorder->readbacks[i].pending = FALSE;
+    }
+
+  recorder->have_readbacks = FALSE;
+  recorder->next_readback = 0;
+}
+
+static gboolean
+recorder_ensure_readbacks (CinnamonRecorder *recorder)
+{
+  int i;
+
+  if (recorder->have_readbacks)
+    return TRUE;
+
+  if (!recorder_check_readback_support ())
+    return FALSE;
+
+  for (i = 0; i < N_READBACK_BUFFERS; i++)
+    {
+      gl.gen_buffers (1, &recorder->readbacks[i].pbo);
+      gl.bind_buffer (GL_PIXEL_PACK_BUFFER_ARB, recorder->readbacks[i].pbo);
+      gl.buffer_data (GL_PIXEL_PACK_BUFFER_ARB,
+                      recorder->stage_width * recorder->stage_height * 4,
+                      NULL, GL_STREAM_READ_ARB);
+      recorder->readbacks[i].pending = FALSE;
+    }
+
+  gl.bind_buffer (GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+  recorder->have_readbacks = TRUE;
+  recorder->next_readback = 0;
+
+  return TRUE;
+}
+
+/* Start copying @rect of the stage into @readback, without waiting for it */
+static void
+recorder_start_readback (CinnamonRecorder            *recorder,
+                         RecorderReadback            *readback,
+                         const cairo_rectangle_int_t *rect)
+{
+  readback->rect = *rect;
+  readback->timestamp = get_wall_time() - recorder->start_time;
+  readback->pointer_x = recorder->pointer_x;
+  readback->pointer_y = recorder->pointer_y;
+  readback->pending = TRUE;
+
+  if (rect->width == 0 || rect->height == 0)
+    return;
+
+  /* Get whatever Cogl has batched up drawn first */
+  cogl_flush ();
+
+  gl.bind_buffer (GL_PIXEL_PACK_BUFFER_ARB, readback->pbo);
+
+  glPixelStorei (GL_PACK_ALIGNMENT, 4);
+  glPixelStorei (GL_PACK_ROW_LENGTH, 0);
+  glPixelStorei (GL_PACK_SKIP_PIXELS, 0);
+  glPixelStorei (GL_PACK_SKIP_ROWS, 0);
+
+  /* Cairo's native-endian ARGB32; GL counts rows from the bottom */
+  glReadPixels (rect->x, recorder->stage_height - rect->y - rect->height,
+                rect->width, rect->height,
+                GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV,
+                NULL);
+
+  gl.bind_buffer (GL_PIXEL_PACK_BUFFER_ARB, 0);
+}
+
+/* Collect the result of @readback and feed it into the pipeline */
+static void
+recorder_finish_readback (CinnamonRecorder *recorder,
+                          RecorderReadback *readback)
+{
+  const guint8 *pixels = NULL;
+  gboolean mapped = FALSE;
+
+  readback->pending = FALSE;
+
+  if (readback->rect.width > 0 && readback->rect.height > 0)
+    {
+      gl.bind_buffer (GL_PIXEL_PACK_BUFFER_ARB, readback->pbo);
+      pixels = gl.map_buffer (GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+      mapped = TRUE;
+
+      /* The stage we keep is now missing this part, start over */
+      if (pixels == NULL)
+        recorder_reset_damage (recorder);
+    }
+
+  if (!mapped || pixels != NULL)
+    recorder_add_frame (recorder, &readback->rect, pixels, TRUE,
+                        readback->timestamp,
+                        readback->pointer_x, readback->pointer_y);
+
+  if (mapped)
+    {
+      if (pixels != NULL)
+        gl.unmap_buffer (GL_PIXEL_PACK_BUFFER_ARB);
+      gl.bind_buffer (GL_PIXEL_PACK_BUFFER_ARB, 0);
+    }
+}
+
+/* Send the frames still being read back to the pipeline, oldest first */
+static void
+recorder_flush_readbacks (CinnamonRecorder *recorder)
+{
+  int i;
+
+  if (!recorder->have_readbacks)
+    return;
+
+  for (i = 0; i < N_READBACK_BUFFERS; i++)
+    {
+      RecorderReadback *readback;
+
+      readback = &recorder->readbacks[(recorder->next_readback + i) % N_READBACK_BUFFERS];
+      if (readback->pending)
+        recorder_finish_readback (recorder, readback);
+    }
+}
+
+/* Retrieve a frame, or just the part of it in @rect, and feed it into
+ * the pipeline
+ */
+static void
+recorder_record_frame (CinnamonRecorder            *recorder,
+                       const cairo_rectangle_int_t *rect)
+{
+  if (recorder_ensure_readbacks (recorder))
+    {
+      RecorderReadback *readback;
+      RecorderReadback *oldest;
+
+      readback = &recorder->readbacks[recorder->next_readback];
+      recorder->next_readback = (recorder->next_readback + 1) % N_READBACK_BUFFERS;
+
+      /* Only happens if the ring wrapped around without being flushed */
+      if (readback->pending)
+        recorder_finish_readback (recorder, readback);
+
+      recorder_start_readback (recorder, readback, rect);
+
+      /* The oldest frame in flight had a couple of frames to finish */
+      oldest = &recorder->readbacks[recorder->next_readback];
+      if (oldest->pending)
+        recorder_finish_readback (recorder, oldest);
+    }
+  else
+    {
+      guint8 *pixels = NULL;
+
+      if (rect->width > 0 && rect->height > 0)
+        {
+          pixels = g_malloc (rect->width * rect->height * 4);
+          cogl_read_pixels (rect->x, rect->y,
+                            rect->width, rect->height,
+                            COGL_READ_PIXELS_COLOR_BUFFER,
+                            CLUTTER_CAIRO_FORMAT_ARGB32,
+                            pixels);
+        }
+
+      recorder_add_frame (recorder, rect, pixels, FALSE,
+                          get_wall_time() - recorder->start_time,
+                          recorder->pointer_x, recorder->pointer_y);
+
+      g_free (pixels);
+    }
 
   /* Reset the timeout that we used to avoid an overlong pause in the stream */
   recorder_remove_redraw_timeout (recorder);
   recorder_add_redraw_timeout (recorder);
 }
 
+/* In incremental mode, frames where only the cursor moved don't need the
+ * stage to be painted: they are made up from what we already have */
+static void
+recorder_record_unchanged_frame (CinnamonRecorder *recorder)
+{
+  cairo_rectangle_int_t rect = { 0, 0, 0, 0 };
+
+  recorder_record_frame (recorder, &rect);
+}
+
 /* We hook in by recording each frame right after the stage is painted
  * by clutter before glSwapBuffers() makes it visible to the user.
  */
@@ -554,7 +1068,18 @@ recorder_on_stage_paint (ClutterActor  *actor,
   if (recorder->state == RECORDER_STATE_RECORDING)
     {
       if (!recorder->only_paint)
-        recorder_record_frame (recorder);
+        {
+          cairo_rectangle_int_t damage;
+
+          recorder_get_damage (recorder, &damage);
+          recorder_record_frame (recorder, &damage);
+        }
+      else
+        {
+          /* Whatever was painted is lost to us */
+          recorder_flush_readbacks (recorder);
+          recorder_reset_damage (recorder);
+        }
 
       cogl_set_source_texture (recorder->recording_icon);
       cogl_rectangle (recorder->stage_width - 32, recorder->stage_height - 42,
@@ -580,6 +1105,11 @@ recorder_on_stage_notify_size (GObject          *object,
                                GParamSpec       *pspec,
                                CinnamonRecorder    *recorder)
 {
+  /* Frames in flight have the old size */
+  recorder_flush_readbacks (recorder);
+  recorder_free_readbacks (recorder);
+  recorder_reset_damage (recorder);
+
   recorder_update_size (recorder);
 
   /* This breaks the recording but tweaking the GStreamer pipeline a bit
@@ -596,7 +1126,11 @@ recorder_idle_redraw (gpointer data)
   CinnamonRecorder *recorder = data;
 
   recorder->redraw_idle = 0;
-  clutter_actor_queue_redraw (CLUTTER_ACTOR (recorder->stage));
+
+  if (recorder->incremental && recorder_have_stage (recorder))
+    recorder_record_unchanged_frame (recorder);
+  else
+    clutter_actor_queue_redraw (CLUTTER_ACTOR (recorder->stage));
 
   return FALSE;
 }
@@ -641,6 +1175,13 @@ recorder_event_filter (XEvent        *xev,
               recorder->cursor_image = NULL;
             }
 
+          /* The last frame has the old cursor, it can't be reused */
+          if (recorder->last_frame)
+            {
+              gst_buffer_unref (recorder->last_frame);
+              recorder->last_frame = NULL;
+            }
+
           recorder_queue_redraw (recorder);
         }
     }
@@ -804,6 +1345,9 @@ recorder_set_stage (CinnamonRecorder *recorder,
   if (recorder->current_pipeline)
     cinnamon_recorder_close (recorder);
 
+  recorder_free_readbacks (recorder);
+  recorder_reset_damage (recorder);
+
   if (recorder->stage)
     {
       g_signal_handlers_disconnect_by_func (recorder->stage,
@@ -917,6 +1461,23 @@ recorder_set_filename (CinnamonRecorder *recorder,
   g_object_notify (G_OBJECT (recorder), "filename");
 }
 
+static void
+recorder_set_incremental (CinnamonRecorder *recorder,
+                          gboolean          incremental)
+{
+  incremental = incremental != FALSE;
+
+  if (incremental == recorder->incremental)
+    return;
+
+  if (recorder->current_pipeline)
+    cinnamon_recorder_close (recorder);
+
+  recorder->incremental = incremental;
+
+  g_object_notify (G_OBJECT (recorder), "incremental");
+}
+
 static void
 cinnamon_recorder_set_property (GObject      *object,
                              guint         prop_id,
@@ -939,6 +1500,9 @@ cinnamon_recorder_set_property (GObject      *object,
     case PROP_FILENAME:
       recorder_set_filename (recorder, g_value_get_string (value));
       break;
+    case PROP_INCREMENTAL:
+      recorder_set_incremental (recorder, g_value_get_boolean (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -967,6 +1531,9 @@ cinnamon_recorder_get_property (GObject         *object,
     case PROP_FILENAME:
       g_value_set_string (value, recorder->filename);
       break;
+    case PROP_INCREMENTAL:
+      g_value_set_boolean (value, recorder->incremental);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1015,6 +1582,14 @@ cinnamon_recorder_class_init (CinnamonRecorderClass *klass)
                                                         "The filename template to use for output files",
                                                         NULL,
                                                         G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class,
+                                   PROP_INCREMENTAL,
+                                   g_param_spec_boolean ("incremental",
+                                                         "Incremental",
+                                                         "Only read back the parts of the stage that were redrawn",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE));
 }
 
 /* Sets the GstCaps (video format, in this case) on the stream
@@ -1630,6 +2205,29 @@ cinnamon_recorder_set_pipeline (CinnamonRecorder *recorder,
   recorder_set_pipeline (recorder, pipeline);
 }
 
+/**
+ * cinnamon_recorder_set_incremental:
+ * @recorder: the #CinnamonRecorder
+ * @incremental: whether to only capture what changed
+ *
+ * Sets whether frames are captured incrementally. By default the whole
+ * stage is redrawn and read back for every frame. In incremental mode,
+ * the stage is redrawn as usual, only where something changed, and only
+ * those parts are read back and patched into the previous frame; when
+ * nothing but the pointer moved, the stage isn't even painted. Frames
+ * that are identical to the previous one share its memory.
+ *
+ * This makes recording mostly static screens much cheaper.
+ */
+void
+cinnamon_recorder_set_incremental (CinnamonRecorder *recorder,
+                                   gboolean          incremental)
+{
+  g_return_if_fail (CINNAMON_IS_RECORDER (recorder));
+
+  recorder_set_incremental (recorder, incremental);
+}
+
 /**
  * cinnamon_recorder_record:
  * @recorder: the #CinnamonRecorder
@@ -1674,8 +2272,13 @@ cinnamon_recorder_record (CinnamonRecorder *recorder)
   recorder->state = RECORDER_STATE_RECORDING;
   recorder_add_update_pointer_timeout (recorder);
 
-  /* Set up repaint hook */
-  recorder->repaint_hook_id = clutter_threads_add_repaint_func(recorder_repaint_hook, recorder->stage, NULL);
+  /* The stage may have changed while we weren't looking */
+  recorder_reset_damage (recorder);
+
+  /* Set up repaint hook; in incremental mode, we rather want clipped
+   * redraws, to know what changed */
+  if (!recorder->incremental)
+    recorder->repaint_hook_id = clutter_threads_add_repaint_func(recorder_repaint_hook, recorder->stage, NULL);
 
   /* Record an initial frame and also redraw with the indicator */
   clutter_actor_queue_redraw (CLUTTER_ACTOR (recorder->stage));
@@ -1709,6 +2312,7 @@ cinnamon_recorder_pause (CinnamonRecorder *recorder)
    * elapsed since the last frame
    */
   clutter_actor_paint (CLUTTER_ACTOR (recorder->stage));
+  recorder_flush_readbacks (recorder);
 
   if (recorder->filename_has_count)
     recorder_close_pipeline (recorder);
@@ -1747,6 +2351,8 @@ cinnamon_recorder_close (CinnamonRecorder *recorder)
   recorder_remove_update_pointer_timeout (recorder);
   recorder_remove_redraw_timeout (recorder);
   recorder_close_pipeline (recorder);
+  recorder_free_readbacks (recorder);
+  recorder_reset_damage (recorder);
 
   recorder->state = RECORDER_STATE_CLOSED;
   recorder->count = 0;
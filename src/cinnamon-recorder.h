@@ -36,6 +36,8 @@ void               cinnamon_recorder_set_filename (CinnamonRecorder *recorder,
 						const char    *filename);
 void               cinnamon_recorder_set_pipeline (CinnamonRecorder *recorder,
 						const char    *pipeline);
+void               cinnamon_recorder_set_incremental (CinnamonRecorder *recorder,
+                                                   gboolean       incremental);
 gboolean           cinnamon_recorder_record       (CinnamonRecorder *recorder);
 void               cinnamon_recorder_close        (CinnamonRecorder *recorder);
 void               cinnamon_recorder_pause        (CinnamonRecorder *recorder);
@@ -8,4 +8,8 @@ void _cinnamon_window_tracker_add_child_process_app (CinnamonWindowTracker *trac
                                                   GPid                pid,
                                                   CinnamonApp           *app);
 
+void _cinnamon_window_tracker_get_wm_class_statistics (CinnamonWindowTracker *tracker,
+                                                       guint                 *hits,
+                                                       guint                 *misses);
+
 #endif
@@ -51,6 +51,11 @@ struct _CinnamonWindowTracker
 
   /* <int, CinnamonApp *app> */
   GHashTable *launched_pid_to_app;
+
+  /* <char *wm_class, CinnamonApp *app>, app is NULL if there is none */
+  GHashTable *wm_class_to_app;
+  guint wm_class_hits;
+  guint wm_class_misses;
 };
 
 G_DEFINE_TYPE (CinnamonWindowTracker, cinnamon_window_tracker, G_TYPE_OBJECT);
@@ -211,30 +216,48 @@ cinnamon_window_tracker_is_window_interesting (MetaWindow *window)
  * an application based on WM_CLASS.  If one can't be determined,
  * return %NULL.
  *
+ * The result only depends on WM_CLASS and on the installed applications,
+ * so it is remembered for each WM_CLASS until the applications change.
+ *
  * Return value: (transfer full): A newly-referenced #CinnamonApp, or %NULL
  */
 static CinnamonApp *
-get_app_from_window_wmclass (MetaWindow  *window)
+get_app_from_window_wmclass (CinnamonWindowTracker *tracker,
+                             MetaWindow            *window)
 {
   CinnamonApp *app;
   CinnamonAppSystem *appsys;
-  char *wmclass;
+  const char *wm_class;
+  char *appid;
   char *with_desktop;
+  gpointer cached;
 
-  appsys = cinnamon_app_system_get_default ();
-  wmclass = get_appid_from_window (window);
-
-  if (!wmclass)
+  wm_class = meta_window_get_wm_class (window);
+  if (!wm_class)
     return NULL;
 
-  with_desktop = g_strjoin (NULL, wmclass, ".desktop", NULL);
-  g_free (wmclass);
+  if (g_hash_table_lookup_extended (tracker->wm_class_to_app, wm_class, NULL, &cached))
+    {
+      tracker->wm_class_hits++;
+      return cached ? g_object_ref (cached) : NULL;
+    }
+
+  tracker->wm_class_misses++;
+
+  appsys = cinnamon_app_system_get_default ();
+  appid = get_appid_from_window (window);
+
+  with_desktop = g_strjoin (NULL, appid, ".desktop", NULL);
+  g_free (appid);
 
   app = cinnamon_app_system_lookup_heuristic_basename (appsys, with_desktop);
   if (app != NULL)
     g_object_ref (app);
   g_free (with_desktop);
 
+  g_hash_table_insert (tracker->wm_class_to_app, g_strdup (wm_class),
+                       app ? g_object_ref (app) : NULL);
+
   return app;
 }
 
@@ -354,7 +377,7 @@ get_app_for_window (CinnamonWindowTracker    *tracker,
   /* Check if the app's WM_CLASS specifies an app; this is
    * canonical if it does.
    */
-  result = get_app_from_window_wmclass (window);
+  result = get_app_from_window_wmclass (tracker, window);
   if (result != NULL)
     return result;
 
@@ -581,6 +604,20 @@ on_startup_sequence_changed (MetaScreen            *screen,
   g_signal_emit (G_OBJECT (self), signals[STARTUP_SEQUENCE_CHANGED], 0, sequence);
 }
 
+static void
+unref_app_if_any (gpointer data)
+{
+  if (data != NULL)
+    g_object_unref (data);
+}
+
+static void
+on_installed_changed (CinnamonAppSystem     *app_system,
+                      CinnamonWindowTracker *self)
+{
+  g_hash_table_remove_all (self->wm_class_to_app);
+}
+
 static void
 cinnamon_window_tracker_init (CinnamonWindowTracker *self)
 {
@@ -591,6 +628,11 @@ cinnamon_window_tracker_init (CinnamonWindowTracker *self)
 
   self->launched_pid_to_app = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) g_object_unref);
 
+  self->wm_class_to_app = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                 g_free, unref_app_if_any);
+  g_signal_connect (cinnamon_app_system_get_default (), "installed-changed",
+                    G_CALLBACK (on_installed_changed), self);
+
   screen = cinnamon_global_get_screen (cinnamon_global_get ());
 
   g_signal_connect (G_OBJECT (screen), "startup-sequence-changed",
@@ -608,6 +650,10 @@ cinnamon_window_tracker_finalize (GObject *object)
   g_hash_table_destroy (self->window_to_app);
   g_hash_table_destroy (self->launched_pid_to_app);
 
+  g_signal_handlers_disconnect_by_func (cinnamon_app_system_get_default (),
+                                        G_CALLBACK (on_installed_changed), self);
+  g_hash_table_destroy (self->wm_class_to_app);
+
   G_OBJECT_CLASS (cinnamon_window_tracker_parent_class)->finalize(object);
 }
 
@@ -861,3 +907,20 @@ cinnamon_window_tracker_get_default ()
 
   return instance;
 }
+
+/**
+ * _cinnamon_window_tracker_get_wm_class_statistics:
+ * @tracker: a #CinnamonWindowTracker
+ * @hits: (out): location for the number of WM_CLASS lookups answered from
+ *   memory
+ * @misses: (out): location for the number of WM_CLASS lookups that had to
+ *   look for an application
+ */
+void
+_cinnamon_window_tracker_get_wm_class_statistics (CinnamonWindowTracker *tracker,
+                                                  guint                 *hits,
+                                                  guint                 *misses)
+{
+  *hits = tracker->wm_class_hits;
+  *misses = tracker->wm_class_misses;
+}
@@ -26,6 +26,7 @@
 #include "cinnamon-global.h"
 #include "cinnamon-global-private.h"
 #include "cinnamon-perf-log.h"
+#include "cinnamon-window-tracker-private.h"
 #include "st.h"
 
 extern GType gnome_cinnamon_plugin_get_type (void);
@@ -408,6 +409,249 @@ malloc_statistics_callback (CinnamonPerfLog *perf_log,
 #endif
 }
 
+static void
+texture_cache_statistics_callback (CinnamonPerfLog *perf_log,
+                                   gpointer      data)
+{
+  guint hits, misses, evictions;
+  gsize resident_bytes;
+
+  st_texture_cache_get_statistics (st_texture_cache_get_default (),
+                                   &hits, &misses, &evictions,
+                                   &resident_bytes);
+
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "textureCache.hits",
+                                     hits);
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "textureCache.misses",
+                                     misses);
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "textureCache.evictions",
+                                     evictions);
+  cinnamon_perf_log_update_statistic_x (perf_log,
+                                     "textureCache.residentBytes",
+                                     resident_bytes);
+}
+
+static void
+texture_decode_statistics_callback (CinnamonPerfLog *perf_log,
+                                    gpointer      data)
+{
+  guint queued, running, cancelled;
+  gint64 visible_latency, mean_latency, max_latency;
+
+  st_texture_cache_get_decode_statistics (st_texture_cache_get_default (),
+                                          &queued, &running, &cancelled,
+                                          &visible_latency, &mean_latency,
+                                          &max_latency);
+
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "textureDecode.queued",
+                                     queued);
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "textureDecode.running",
+                                     running);
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "textureDecode.cancelled",
+                                     cancelled);
+  cinnamon_perf_log_update_statistic_x (perf_log,
+                                     "textureDecode.visibleLatency",
+                                     visible_latency);
+  cinnamon_perf_log_update_statistic_x (perf_log,
+                                     "textureDecode.meanLatency",
+                                     mean_latency);
+  cinnamon_perf_log_update_statistic_x (perf_log,
+                                     "textureDecode.maxLatency",
+                                     max_latency);
+}
+
+static void
+texture_upload_statistics_callback (CinnamonPerfLog *perf_log,
+                                    gpointer      data)
+{
+  guint pending, frames, frames_over_budget;
+
+  st_texture_cache_get_upload_statistics (st_texture_cache_get_default (),
+                                          &pending, &frames,
+                                          &frames_over_budget);
+
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "textureUpload.pending",
+                                     pending);
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "textureUpload.frames",
+                                     frames);
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "textureUpload.framesOverBudget",
+                                     frames_over_budget);
+}
+
+static void
+icon_cache_statistics_callback (CinnamonPerfLog *perf_log,
+                                gpointer      data)
+{
+  guint hits, misses, stores;
+  gint64 startup_load_time;
+
+  st_texture_cache_get_icon_cache_statistics (st_texture_cache_get_default (),
+                                              &hits, &misses, &stores,
+                                              &startup_load_time);
+
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "iconCache.hits",
+                                     hits);
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "iconCache.misses",
+                                     misses);
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "iconCache.stores",
+                                     stores);
+  cinnamon_perf_log_update_statistic_x (perf_log,
+                                     "iconCache.startupLoadTime",
+                                     startup_load_time);
+}
+
+static void
+background_atlas_statistics_callback (CinnamonPerfLog *perf_log,
+                                      gpointer      data)
+{
+  guint n_pages, n_backgrounds;
+  gsize used_pixels, total_pixels;
+
+  st_theme_node_get_background_atlas_statistics (&n_pages, &n_backgrounds,
+                                                 &used_pixels, &total_pixels);
+
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "backgroundAtlas.pages",
+                                     n_pages);
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "backgroundAtlas.backgrounds",
+                                     n_backgrounds);
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "backgroundAtlas.occupancy",
+                                     total_pixels > 0 ? (100 * used_pixels) / total_pixels : 0);
+}
+
+static void
+icon_atlas_statistics_callback (CinnamonPerfLog *perf_log,
+                                gpointer      data)
+{
+  StTextureCache *cache = st_texture_cache_get_default ();
+  guint n_pages, n_icons, n_recycled, n_painted, n_binds;
+  gsize used_pixels, total_pixels;
+
+  st_texture_cache_get_icon_atlas_statistics (cache, &n_pages, &n_icons,
+                                              &used_pixels, &total_pixels,
+                                              &n_recycled);
+  st_texture_cache_get_paint_statistics (cache, &n_painted, &n_binds);
+
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "iconAtlas.pages",
+                                     n_pages);
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "iconAtlas.icons",
+                                     n_icons);
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "iconAtlas.occupancy",
+                                     total_pixels > 0 ? (100 * used_pixels) / total_pixels : 0);
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "iconAtlas.recycled",
+                                     n_recycled);
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "iconPaint.textures",
+                                     n_painted);
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "iconPaint.binds",
+                                     n_binds);
+}
+
+static void
+transition_statistics_callback (CinnamonPerfLog *perf_log,
+                                gpointer      data)
+{
+  guint n_reused, n_allocated;
+  gsize total_bytes, peak_bytes;
+
+  st_theme_node_get_transition_statistics (&n_reused, &n_allocated,
+                                           &total_bytes, &peak_bytes);
+
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "transitions.offscreensReused",
+                                     n_reused);
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "transitions.offscreensAllocated",
+                                     n_allocated);
+  cinnamon_perf_log_update_statistic_x (perf_log,
+                                     "transitions.offscreenBytes",
+                                     total_bytes);
+  cinnamon_perf_log_update_statistic_x (perf_log,
+                                     "transitions.offscreenPeakBytes",
+                                     peak_bytes);
+}
+
+static void
+frame_stats_statistics_callback (CinnamonPerfLog *perf_log,
+                                 gpointer      data)
+{
+  CinnamonGlobal *global = cinnamon_global_get ();
+  CinnamonFrameStats *stats;
+
+  /* Statistics may be collected before the plugin is set up */
+  if (global == NULL)
+    return;
+
+  stats = cinnamon_global_get_frame_stats (global);
+
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "frames.count",
+                                     stats->n_frames);
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "frames.missed",
+                                     stats->n_missed_frames);
+  cinnamon_perf_log_update_statistic_x (perf_log,
+                                     "frames.paintTimeP50",
+                                     stats->paint_time_p50);
+  cinnamon_perf_log_update_statistic_x (perf_log,
+                                     "frames.paintTimeP95",
+                                     stats->paint_time_p95);
+  cinnamon_perf_log_update_statistic_x (perf_log,
+                                     "frames.paintTimeP99",
+                                     stats->paint_time_p99);
+  cinnamon_perf_log_update_statistic_x (perf_log,
+                                     "frames.intervalP50",
+                                     stats->frame_interval_p50);
+  cinnamon_perf_log_update_statistic_x (perf_log,
+                                     "frames.intervalP95",
+                                     stats->frame_interval_p95);
+  cinnamon_perf_log_update_statistic_x (perf_log,
+                                     "frames.intervalP99",
+                                     stats->frame_interval_p99);
+
+  cinnamon_frame_stats_free (stats);
+}
+
+static void
+window_tracker_statistics_callback (CinnamonPerfLog *perf_log,
+                                    gpointer      data)
+{
+  guint hits, misses;
+
+  /* Statistics may be collected before the plugin is set up */
+  if (cinnamon_global_get () == NULL)
+    return;
+
+  _cinnamon_window_tracker_get_wm_class_statistics (cinnamon_window_tracker_get_default (),
+                                                    &hits, &misses);
+
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "windowTracker.wmClassHits",
+                                     hits);
+  cinnamon_perf_log_update_statistic_i (perf_log,
+                                     "windowTracker.wmClassMisses",
+                                     misses);
+}
+
 static void
 cinnamon_perf_log_init (void)
 {
@@ -433,6 +677,227 @@ cinnamon_perf_log_init (void)
   cinnamon_perf_log_add_statistics_callback (perf_log,
                                           malloc_statistics_callback,
                                           NULL, NULL);
+
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "textureCache.hits",
+                                   "Number of texture cache lookups that found a cached texture",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "textureCache.misses",
+                                   "Number of texture cache lookups that had to load the texture",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "textureCache.evictions",
+                                   "Number of textures dropped from the texture cache to stay within budget",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "textureCache.residentBytes",
+                                   "Size of the texture data held by the texture cache, in bytes",
+                                   "x");
+
+  cinnamon_perf_log_add_statistics_callback (perf_log,
+                                          texture_cache_statistics_callback,
+                                          NULL, NULL);
+
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "textureDecode.queued",
+                                   "Number of images waiting for a thread to decode them",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "textureDecode.running",
+                                   "Number of images being decoded",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "textureDecode.cancelled",
+                                   "Number of image loads dropped because their actors were destroyed",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "textureDecode.visibleLatency",
+                                   "Mean time from request to decoded image for icons and images being shown, in microseconds",
+                                   "x");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "textureDecode.meanLatency",
+                                   "Mean time from request to decoded image, in microseconds",
+                                   "x");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "textureDecode.maxLatency",
+                                   "Longest time from request to decoded image, in microseconds",
+                                   "x");
+
+  cinnamon_perf_log_add_statistics_callback (perf_log,
+                                          texture_decode_statistics_callback,
+                                          NULL, NULL);
+
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "textureUpload.pending",
+                                   "Number of decoded images waiting to be uploaded as textures",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "textureUpload.frames",
+                                   "Number of frames that uploaded decoded images",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "textureUpload.framesOverBudget",
+                                   "Number of frames whose texture uploads exceeded the per-frame budget",
+                                   "i");
+
+  cinnamon_perf_log_add_statistics_callback (perf_log,
+                                          texture_upload_statistics_callback,
+                                          NULL, NULL);
+
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "iconCache.hits",
+                                   "Number of icons read already decoded from the disk cache",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "iconCache.misses",
+                                   "Number of icons that were not in the disk cache",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "iconCache.stores",
+                                   "Number of decoded icons written to the disk cache",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "iconCache.startupLoadTime",
+                                   "Time from the first image load until the images requested at startup were loaded (us)",
+                                   "x");
+
+  cinnamon_perf_log_add_statistics_callback (perf_log,
+                                          icon_cache_statistics_callback,
+                                          NULL, NULL);
+
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "backgroundAtlas.pages",
+                                   "Number of atlas textures holding prerendered backgrounds",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "backgroundAtlas.backgrounds",
+                                   "Number of distinct prerendered backgrounds in the atlas",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "backgroundAtlas.occupancy",
+                                   "Percentage of the background atlas area holding backgrounds",
+                                   "i");
+
+  cinnamon_perf_log_add_statistics_callback (perf_log,
+                                          background_atlas_statistics_callback,
+                                          NULL, NULL);
+
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "iconAtlas.pages",
+                                   "Number of atlas textures holding small icons",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "iconAtlas.icons",
+                                   "Number of icons in the icon atlas",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "iconAtlas.occupancy",
+                                   "Percentage of the icon atlas area holding icons",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "iconAtlas.recycled",
+                                   "Number of icons placed into the space of dropped icons",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "iconPaint.textures",
+                                   "Number of cached icons and images painted in the last frame painting any",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "iconPaint.binds",
+                                   "Number of texture switches between those icons and images in that frame",
+                                   "i");
+
+  cinnamon_perf_log_add_statistics_callback (perf_log,
+                                          icon_atlas_statistics_callback,
+                                          NULL, NULL);
+
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "transitions.offscreensReused",
+                                   "Number of offscreen render targets style transitions got back from the pool",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "transitions.offscreensAllocated",
+                                   "Number of offscreen render targets created for style transitions",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "transitions.offscreenBytes",
+                                   "Size of the offscreen render targets of style transitions, in bytes",
+                                   "x");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "transitions.offscreenPeakBytes",
+                                   "Largest size the offscreen render targets of style transitions ever had, in bytes",
+                                   "x");
+
+  cinnamon_perf_log_add_statistics_callback (perf_log,
+                                          transition_statistics_callback,
+                                          NULL, NULL);
+
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "frames.count",
+                                   "Number of frames painted",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "frames.missed",
+                                   "Number of refresh periods during animations in which a frame should have been painted but wasn't",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "frames.paintTimeP50",
+                                   "Median time to paint a frame, in microseconds",
+                                   "x");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "frames.paintTimeP95",
+                                   "95th percentile of the time to paint a frame, in microseconds",
+                                   "x");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "frames.paintTimeP99",
+                                   "99th percentile of the time to paint a frame, in microseconds",
+                                   "x");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "frames.intervalP50",
+                                   "Median time between consecutive frames, in microseconds",
+                                   "x");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "frames.intervalP95",
+                                   "95th percentile of the time between consecutive frames, in microseconds",
+                                   "x");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "frames.intervalP99",
+                                   "99th percentile of the time between consecutive frames, in microseconds",
+                                   "x");
+
+  cinnamon_perf_log_add_statistics_callback (perf_log,
+                                          frame_stats_statistics_callback,
+                                          NULL, NULL);
+
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "windowTracker.wmClassHits",
+                                   "Number of windows whose WM_CLASS was already matched to an application or to none",
+                                   "i");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "windowTracker.wmClassMisses",
+                                   "Number of windows whose WM_CLASS had to be matched against the installed applications",
+                                   "i");
+
+  cinnamon_perf_log_add_statistics_callback (perf_log,
+                                          window_tracker_statistics_callback,
+                                          NULL, NULL);
+
+  /* Set once, when the usage data is loaded */
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "applicationUsage.loadTime",
+                                   "Time to load the application usage data at startup, in microseconds",
+                                   "x");
+
+  /* Set once, when the applications are first loaded */
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "applications.treeLoadTime",
+                                   "Time to load the applications menu tree at startup, in microseconds",
+                                   "x");
+  cinnamon_perf_log_define_statistic (perf_log,
+                                   "applications.indexTime",
+                                   "Time to set up and index the applications at startup, in microseconds",
+                                   "x");
 }
 
 static void
@@ -0,0 +1,298 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-atlas-packer.c: Space allocation within texture atlas pages
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Keeps track of which rectangles of an atlas page are in use, apart
+ * from the textures, so that it can be tested without a GL context.
+ *
+ * A page is filled by shelves, rows of rectangles of similar heights
+ * stacked from the top. Rectangles can't move once handed out, so
+ * instead of compacting the page, the space of released rectangles is
+ * recycled: it becomes a hole in its shelf, merged with adjacent holes,
+ * which later rectangles of a fitting height are put into before the
+ * page grows. Holes at the end of a shelf give the space back to the
+ * shelf, and empty shelves at the bottom of the page are dropped, so a
+ * page that is emptied in any order ends up blank again.
+ */
+
+#include "st-atlas-packer.h"
+
+/* Don't put rectangles on shelves much taller than them */
+#define MAX_SHELF_WASTE 1.5
+
+typedef struct {
+  gint y;
+  gint height;
+  gint x;       /* first free column */
+} Shelf;
+
+/* Free space left by a rectangle in the middle of a shelf */
+typedef struct {
+  gint x;
+  gint y;       /* of the shelf */
+  gint width;
+  gint height;  /* of the shelf */
+} Hole;
+
+struct _StAtlasPacker {
+  gint    width;
+  gint    height;
+  GArray *shelves;
+  GArray *holes;
+  gint    shelves_height;
+};
+
+/**
+ * _st_atlas_packer_new:
+ * @width: width of the page
+ * @height: height of the page
+ *
+ * Return value: a packer for an empty page
+ */
+StAtlasPacker *
+_st_atlas_packer_new (gint width,
+                      gint height)
+{
+  StAtlasPacker *packer;
+
+  packer = g_slice_new0 (StAtlasPacker);
+  packer->width = width;
+  packer->height = height;
+  packer->shelves = g_array_new (FALSE, FALSE, sizeof (Shelf));
+  packer->holes = g_array_new (FALSE, FALSE, sizeof (Hole));
+
+  return packer;
+}
+
+void
+_st_atlas_packer_free (StAtlasPacker *packer)
+{
+  g_array_free (packer->shelves, TRUE);
+  g_array_free (packer->holes, TRUE);
+  g_slice_free (StAtlasPacker, packer);
+}
+
+static gboolean
+shelf_fits (gint shelf_height,
+            gint height)
+{
+  return shelf_height >= height && shelf_height <= height * MAX_SHELF_WASTE;
+}
+
+/* Takes the best fitting hole for a @width x @height rectangle */
+static gboolean
+allocate_hole (StAtlasPacker *packer,
+               gint           width,
+               gint           height,
+               gint          *x,
+               gint          *y)
+{
+  Hole *best = NULL;
+  guint i, best_index = 0;
+
+  for (i = 0; i < packer->holes->len; i++)
+    {
+      Hole *candidate = &g_array_index (packer->holes, Hole, i);
+
+      if (!shelf_fits (candidate->height, height) || candidate->width < width)
+        continue;
+
+      if (best == NULL ||
+          candidate->height < best->height ||
+          (candidate->height == best->height && candidate->width < best->width))
+        {
+          best = candidate;
+          best_index = i;
+        }
+    }
+
+  if (best == NULL)
+    return FALSE;
+
+  *x = best->x;
+  *y = best->y;
+
+  best->x += width;
+  best->width -= width;
+  if (best->width == 0)
+    g_array_remove_index_fast (packer->holes, best_index);
+
+  return TRUE;
+}
+
+/**
+ * _st_atlas_packer_allocate:
+ * @packer: a #StAtlasPacker
+ * @width: width of the rectangle
+ * @height: height of the rectangle
+ * @x: (out): location for the left edge of the rectangle
+ * @y: (out): location for the top edge of the rectangle
+ * @recycled: (out) (allow-none): location to store whether the rectangle
+ *   is in space that was released before
+ *
+ * Finds room for a @width x @height rectangle.
+ *
+ * Return value: %TRUE if there was room
+ */
+gboolean
+_st_atlas_packer_allocate (StAtlasPacker *packer,
+                           gint           width,
+                           gint           height,
+                           gint          *x,
+                           gint          *y,
+                           gboolean      *recycled)
+{
+  Shelf *best = NULL;
+  Shelf shelf;
+  guint i;
+
+  if (allocate_hole (packer, width, height, x, y))
+    {
+      if (recycled)
+        *recycled = TRUE;
+      return TRUE;
+    }
+
+  for (i = 0; i < packer->shelves->len; i++)
+    {
+      Shelf *candidate = &g_array_index (packer->shelves, Shelf, i);
+
+      if (!shelf_fits (candidate->height, height) ||
+          candidate->x + width > packer->width)
+        continue;
+
+      if (best == NULL || candidate->height < best->height)
+        best = candidate;
+    }
+
+  if (best == NULL)
+    {
+      if (packer->shelves_height + height > packer->height ||
+          width > packer->width)
+        return FALSE;
+
+      shelf.y = packer->shelves_height;
+      shelf.height = height;
+      shelf.x = 0;
+      g_array_append_val (packer->shelves, shelf);
+      packer->shelves_height += height;
+
+      best = &g_array_index (packer->shelves, Shelf, packer->shelves->len - 1);
+    }
+
+  *x = best->x;
+  *y = best->y;
+  best->x += width;
+
+  if (recycled)
+    *recycled = FALSE;
+
+  return TRUE;
+}
+
+/**
+ * _st_atlas_packer_release:
+ * @packer: a #StAtlasPacker
+ * @x: left edge of a rectangle from _st_atlas_packer_allocate()
+ * @y: top edge of the rectangle
+ * @width: width of the rectangle
+ *
+ * Gives the space of the rectangle back.
+ */
+void
+_st_atlas_packer_release (StAtlasPacker *packer,
+                          gint           x,
+                          gint           y,
+                          gint           width)
+{
+  Shelf *shelf = NULL;
+  Hole hole;
+  guint i;
+
+  for (i = 0; i < packer->shelves->len; i++)
+    {
+      shelf = &g_array_index (packer->shelves, Shelf, i);
+      if (shelf->y == y)
+        break;
+    }
+
+  g_return_if_fail (i < packer->shelves->len);
+
+  hole.x = x;
+  hole.y = y;
+  hole.width = width;
+  hole.height = shelf->height;
+
+  /* Merge with the holes on either side */
+  i = 0;
+  while (i < packer->holes->len)
+    {
+      Hole *other = &g_array_index (packer->holes, Hole, i);
+
+      if (other->y == y &&
+          (other->x + other->width == hole.x || hole.x + hole.width == other->x))
+        {
+          hole.x = MIN (hole.x, other->x);
+          hole.width += other->width;
+          g_array_remove_index_fast (packer->holes, i);
+        }
+      else
+        i++;
+    }
+
+  if (hole.x + hole.width == shelf->x)
+    shelf->x = hole.x;
+  else
+    g_array_append_val (packer->holes, hole);
+
+  /* Shelves are stacked in order, so the last one is at the bottom */
+  while (packer->shelves->len > 0)
+    {
+      shelf = &g_array_index (packer->shelves, Shelf, packer->shelves->len - 1);
+      if (shelf->x != 0)
+        break;
+
+      packer->shelves_height -= shelf->height;
+      g_array_set_size (packer->shelves, packer->shelves->len - 1);
+    }
+}
+
+/**
+ * _st_atlas_packer_clear:
+ * @packer: a #StAtlasPacker
+ *
+ * Forgets all rectangles, as if they were all released.
+ */
+void
+_st_atlas_packer_clear (StAtlasPacker *packer)
+{
+  g_array_set_size (packer->shelves, 0);
+  g_array_set_size (packer->holes, 0);
+  packer->shelves_height = 0;
+}
+
+/**
+ * _st_atlas_packer_is_empty:
+ * @packer: a #StAtlasPacker
+ *
+ * Return value: %TRUE if no space of the page is in use or in holes
+ */
+gboolean
+_st_atlas_packer_is_empty (StAtlasPacker *packer)
+{
+  return packer->shelves->len == 0 && packer->holes->len == 0 &&
+         packer->shelves_height == 0;
+}
@@ -0,0 +1,47 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-atlas-packer.h: Space allocation within texture atlas pages
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ST_ATLAS_PACKER_H__
+#define __ST_ATLAS_PACKER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _StAtlasPacker StAtlasPacker;
+
+StAtlasPacker *_st_atlas_packer_new      (gint           width,
+                                          gint           height);
+void           _st_atlas_packer_free     (StAtlasPacker *packer);
+
+gboolean       _st_atlas_packer_allocate (StAtlasPacker *packer,
+                                          gint           width,
+                                          gint           height,
+                                          gint          *x,
+                                          gint          *y,
+                                          gboolean      *recycled);
+void           _st_atlas_packer_release  (StAtlasPacker *packer,
+                                          gint           x,
+                                          gint           y,
+                                          gint           width);
+void           _st_atlas_packer_clear    (StAtlasPacker *packer);
+
+gboolean       _st_atlas_packer_is_empty (StAtlasPacker *packer);
+
+G_END_DECLS
+
+#endif /* __ST_ATLAS_PACKER_H__ */
@@ -0,0 +1,545 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-blur.c: Fast approximate gaussian blur of alpha masks
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Shadows are blurred with three successive box blurs, which converge
+ * quickly towards a gaussian of the same standard deviation. A box blur
+ * costs the same whatever its radius, since it only needs a running sum.
+ * Small radii, where a few boxes are a poor approximation and the exact
+ * kernel is cheap anyway, use a direct convolution with the gaussian.
+ *
+ * All passes run down the columns of the image: a row of running sums
+ * is updated from one input row entering the window and one leaving it,
+ * which walks memory linearly and is trivially vectorized across the
+ * row. The horizontal passes are done the same way on the transposed
+ * image.
+ *
+ * Sums are kept in integers and divided with a 16 bit fixed point
+ * reciprocal; the portable and the SIMD code paths use the same
+ * arithmetic and produce identical results.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "st-blur.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#define N_PASSES 3
+#define TRANSPOSE_TILE 32
+
+/* Kernels up to this size are applied directly */
+#define MAX_DIRECT_KERNEL_SIZE 15
+
+/* Running sums of up to this many bytes (plus rounding) fit in 16 bits */
+#define MAX_SIMD_BOX_SIZE 255
+
+typedef enum {
+  SIMD_UNKNOWN,
+  SIMD_NONE,
+  SIMD_SSE2,
+  SIMD_AVX2
+} SimdLevel;
+
+static SimdLevel simd_level = SIMD_UNKNOWN;
+static gboolean simd_enabled = TRUE;
+
+typedef void (*BoxRowFunc) (const guchar *add,
+                            const guchar *sub,
+                            guint16      *acc,
+                            guchar       *out,
+                            gint          n,
+                            guint         mul,
+                            guint         bias);
+
+static void
+box_row_generic16 (const guchar *add,
+                   const guchar *sub,
+                   guint16      *acc,
+                   guchar       *out,
+                   gint          n,
+                   guint         mul,
+                   guint         bias)
+{
+  gint x;
+
+  for (x = 0; x < n; x++)
+    {
+      guint a = acc[x] + add[x];
+
+      /* mul is rounded up, so a full box of 255 can come out as 256;
+       * the SIMD paths saturate when packing */
+      out[x] = MIN (((a + bias) * mul) >> 16, 255);
+      acc[x] = a - sub[x];
+    }
+}
+
+/* For huge radii, where the sums don't fit in 16 bits anymore */
+static void
+box_row_generic32 (const guchar *add,
+                   const guchar *sub,
+                   guint32      *acc,
+                   guchar       *out,
+                   gint          n,
+                   guint         mul,
+                   guint         bias)
+{
+  gint x;
+
+  for (x = 0; x < n; x++)
+    {
+      guint32 a = acc[x] + add[x];
+
+      out[x] = MIN (((guint64) (a + bias) * mul) >> 16, 255);
+      acc[x] = a - sub[x];
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+
+__attribute__((target ("sse2")))
+static void
+box_row_sse2 (const guchar *add,
+              const guchar *sub,
+              guint16      *acc,
+              guchar       *out,
+              gint          n,
+              guint         mul,
+              guint         bias)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i vmul = _mm_set1_epi16 ((short) mul);
+  const __m128i vbias = _mm_set1_epi16 ((short) bias);
+  gint x;
+
+  for (x = 0; x + 16 <= n; x += 16)
+    {
+      __m128i add8 = _mm_loadu_si128 ((const __m128i *) (add + x));
+      __m128i sub8 = _mm_loadu_si128 ((const __m128i *) (sub + x));
+      __m128i acc_lo = _mm_loadu_si128 ((const __m128i *) (acc + x));
+      __m128i acc_hi = _mm_loadu_si128 ((const __m128i *) (acc + x + 8));
+      __m128i out_lo, out_hi;
+
+      acc_lo = _mm_add_epi16 (acc_lo, _mm_unpacklo_epi8 (add8, zero));
+      acc_hi = _mm_add_epi16 (acc_hi, _mm_unpackhi_epi8 (add8, zero));
+
+      out_lo = _mm_mulhi_epu16 (_mm_add_epi16 (acc_lo, vbias), vmul);
+      out_hi = _mm_mulhi_epu16 (_mm_add_epi16 (acc_hi, vbias), vmul);
+      _mm_storeu_si128 ((__m128i *) (out + x), _mm_packus_epi16 (out_lo, out_hi));
+
+      acc_lo = _mm_sub_epi16 (acc_lo, _mm_unpacklo_epi8 (sub8, zero));
+      acc_hi = _mm_sub_epi16 (acc_hi, _mm_unpackhi_epi8 (sub8, zero));
+      _mm_storeu_si128 ((__m128i *) (acc + x), acc_lo);
+      _mm_storeu_si128 ((__m128i *) (acc + x + 8), acc_hi);
+    }
+
+  box_row_generic16 (add + x, sub + x, acc + x, out + x, n - x, mul, bias);
+}
+
+__attribute__((target ("avx2")))
+static void
+box_row_avx2 (const guchar *add,
+              const guchar *sub,
+              guint16      *acc,
+              guchar       *out,
+              gint          n,
+              guint         mul,
+              guint         bias)
+{
+  const __m256i vmul = _mm256_set1_epi16 ((short) mul);
+  const __m256i vbias = _mm256_set1_epi16 ((short) bias);
+  gint x;
+
+  for (x = 0; x + 16 <= n; x += 16)
+    {
+      __m256i add16 = _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i *) (add + x)));
+      __m256i sub16 = _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i *) (sub + x)));
+      __m256i a = _mm256_loadu_si256 ((const __m256i *) (acc + x));
+      __m256i o;
+
+      a = _mm256_add_epi16 (a, add16);
+      o = _mm256_mulhi_epu16 (_mm256_add_epi16 (a, vbias), vmul);
+      _mm_storeu_si128 ((__m128i *) (out + x),
+                        _mm_packus_epi16 (_mm256_castsi256_si128 (o),
+                                          _mm256_extracti128_si256 (o, 1)));
+
+      a = _mm256_sub_epi16 (a, sub16);
+      _mm256_storeu_si256 ((__m256i *) (acc + x), a);
+    }
+
+  box_row_generic16 (add + x, sub + x, acc + x, out + x, n - x, mul, bias);
+}
+
+#endif /* HAVE_X86_SIMD */
+
+static BoxRowFunc
+get_box_row_func (void)
+{
+  if (simd_level == SIMD_UNKNOWN)
+    {
+      simd_level = SIMD_NONE;
+#ifdef HAVE_X86_SIMD
+      __builtin_cpu_init ();
+      if (__builtin_cpu_supports ("avx2"))
+        simd_level = SIMD_AVX2;
+      else if (__builtin_cpu_supports ("sse2"))
+        simd_level = SIMD_SSE2;
+#endif
+    }
+
+  if (!simd_enabled)
+    return box_row_generic16;
+
+  switch (simd_level)
+    {
+#ifdef HAVE_X86_SIMD
+    case SIMD_AVX2:
+      return box_row_avx2;
+    case SIMD_SSE2:
+      return box_row_sse2;
+#endif
+    default:
+      return box_row_generic16;
+    }
+}
+
+/**
+ * _st_blur_set_use_simd:
+ * @use_simd: whether to use SIMD instructions, when the CPU has them
+ *
+ * Lets tests and benchmarks compare the portable and the SIMD code paths.
+ */
+void
+_st_blur_set_use_simd (gboolean use_simd)
+{
+  simd_enabled = use_simd;
+}
+
+/* Sizes of the boxes whose successive application best approximates a
+ * gaussian of deviation @sigma; see "Fast Almost-Gaussian Filtering",
+ * Peter Kovesi, 2010.
+ */
+static void
+compute_box_radii (gdouble sigma,
+                   gint    radii[N_PASSES])
+{
+  gdouble w_ideal;
+  gint wl, wu, m, i;
+
+  w_ideal = sqrt (12 * sigma * sigma / N_PASSES + 1);
+  wl = (gint) floor (w_ideal);
+  if (wl % 2 == 0)
+    wl--;
+  wu = wl + 2;
+
+  m = (gint) floor ((12 * sigma * sigma - N_PASSES * wl * wl - 4 * N_PASSES * wl - 3 * N_PASSES)
+                    / (-4. * wl - 4) + 0.5);
+
+  for (i = 0; i < N_PASSES; i++)
+    radii[i] = ((i < m ? wl : wu) - 1) / 2;
+}
+
+/* One box blur of radius @radius down the columns of @src into @dst */
+static void
+box_blur_columns (const guchar *src,
+                  guchar       *dst,
+                  gint          width,
+                  gint          height,
+                  gint          stride,
+                  gint          radius,
+                  const guchar *zeros,
+                  gpointer      acc)
+{
+  guint size = 2 * radius + 1;
+  guint mul = (65536 + size - 1) / size;
+  guint bias = size / 2;
+  gint x, y;
+
+  if (size <= MAX_SIMD_BOX_SIZE)
+    {
+      BoxRowFunc box_row = get_box_row_func ();
+      guint16 *acc16 = acc;
+
+      memset (acc16, 0, width * sizeof (guint16));
+      for (y = 0; y < radius && y < height; y++)
+        for (x = 0; x < width; x++)
+          acc16[x] += src[y * stride + x];
+
+      for (y = 0; y < height; y++)
+        {
+          const guchar *add = y + radius < height ? src + (y + radius) * stride : zeros;
+          const guchar *sub = y - radius >= 0 ? src + (y - radius) * stride : zeros;
+
+          box_row (add, sub, acc16, dst + y * stride, width, mul, bias);
+        }
+    }
+  else
+    {
+      guint32 *acc32 = acc;
+
+      memset (acc32, 0, width * sizeof (guint32));
+      for (y = 0; y < radius && y < height; y++)
+        for (x = 0; x < width; x++)
+          acc32[x] += src[y * stride + x];
+
+      for (y = 0; y < height; y++)
+        {
+          const guchar *add = y + radius < height ? src + (y + radius) * stride : zeros;
+          const guchar *sub = y - radius >= 0 ? src + (y - radius) * stride : zeros;
+
+          box_row_generic32 (add, sub, acc32, dst + y * stride, width, mul, bias);
+        }
+    }
+}
+
+/* Integer gaussian kernel, normalized to a sum of 65536 */
+static guint32 *
+compute_gaussian_kernel (gdouble sigma,
+                         gint    n_values)
+{
+  gdouble *values;
+  guint32 *kernel;
+  gdouble sum = 0;
+  gint half = n_values / 2;
+  gint i;
+
+  values = g_new (gdouble, n_values);
+  for (i = 0; i < n_values; i++)
+    {
+      values[i] = exp (-(i - half) * (i - half) / (2 * sigma * sigma));
+      sum += values[i];
+    }
+
+  kernel = g_new (guint32, n_values);
+  for (i = 0; i < n_values; i++)
+    kernel[i] = (guint32) floor (values[i] / sum * 65536 + 0.5);
+
+  g_free (values);
+
+  return kernel;
+}
+
+/* Convolution of the columns of @src with @kernel into @dst; the kernel
+ * is centered the same way as in the old exact blur, which matters for
+ * even sizes */
+static void
+gaussian_blur_columns (const guchar  *src,
+                       guchar        *dst,
+                       gint           width,
+                       gint           height,
+                       gint           stride,
+                       const guint32 *kernel,
+                       gint           n_values,
+                       guint32       *acc)
+{
+  gint half = n_values / 2;
+  gint x, y, i;
+
+  for (y = 0; y < height; y++)
+    {
+      const guchar *row;
+      guchar *out = dst + y * stride;
+      gint i0 = MAX (half - y, 0);
+      gint i1 = MIN (height + half - y, n_values);
+
+      memset (acc, 0, width * sizeof (guint32));
+
+      row = src + (y + i0 - half) * stride;
+      for (i = i0; i < i1; i++, row += stride)
+        {
+          guint32 k = kernel[i];
+
+          for (x = 0; x < width; x++)
+            acc[x] += k * row[x];
+        }
+
+      for (x = 0; x < width; x++)
+        out[x] = MIN ((acc[x] + 32768) >> 16, 255);
+    }
+}
+
+/* Runs all the passes, ping-ponging between @a and @b; returns the one
+ * holding the result */
+static guchar *
+blur_columns (guchar        *a,
+              guchar        *b,
+              gint           width,
+              gint           height,
+              gint           stride,
+              const gint     radii[N_PASSES],
+              const guint32 *kernel,
+              gint           n_values,
+              const guchar  *zeros,
+              gpointer       acc)
+{
+  gint i;
+
+  if (kernel != NULL)
+    {
+      gaussian_blur_columns (a, b, width, height, stride, kernel, n_values, acc);
+      return b;
+    }
+
+  for (i = 0; i < N_PASSES; i++)
+    {
+      guchar *tmp;
+
+      if (radii[i] == 0)
+        continue;
+
+      box_blur_columns (a, b, width, height, stride, radii[i], zeros, acc);
+
+      tmp = a;
+      a = b;
+      b = tmp;
+    }
+
+  return a;
+}
+
+static void
+transpose (const guchar *src,
+           gint          src_stride,
+           guchar       *dst,
+           gint          dst_stride,
+           gint          width,
+           gint          height)
+{
+  gint x0, y0, x, y;
+
+  for (y0 = 0; y0 < height; y0 += TRANSPOSE_TILE)
+    for (x0 = 0; x0 < width; x0 += TRANSPOSE_TILE)
+      {
+        gint x1 = MIN (x0 + TRANSPOSE_TILE, width);
+        gint y1 = MIN (y0 + TRANSPOSE_TILE, height);
+
+        for (y = y0; y < y1; y++)
+          for (x = x0; x < x1; x++)
+            dst[x * dst_stride + y] = src[y * src_stride + x];
+      }
+}
+
+/**
+ * _st_blur_alpha:
+ * @pixels_in: 8 bit alpha mask
+ * @width_in: width of @pixels_in
+ * @height_in: height of @pixels_in
+ * @rowstride_in: rowstride of @pixels_in
+ * @blur: blur radius, as in CSS; twice the gaussian standard deviation
+ * @width_out: (out): width of the result
+ * @height_out: (out): height of the result
+ * @rowstride_out: (out): rowstride of the result
+ *
+ * Blurs an alpha mask. The result is padded on all sides so that
+ * nothing gets clipped; the padding is the same as that of an exact
+ * gaussian blur truncated at 2.5 standard deviations.
+ *
+ * Return value: the blurred mask, to be freed with g_free()
+ */
+guchar *
+_st_blur_alpha (const guchar *pixels_in,
+                gint          width_in,
+                gint          height_in,
+                gint          rowstride_in,
+                gdouble       blur,
+                gint         *width_out,
+                gint         *height_out,
+                gint         *rowstride_out)
+{
+  guchar *a, *b, *result;
+  guchar *zeros;
+  gpointer acc;
+  guint32 *kernel = NULL;
+  gdouble sigma;
+  gint radii[N_PASSES];
+  gint n_values, half, width, height, stride, t_stride;
+  gint y;
+
+  /* The CSS specification defines (or will define) the blur radius as twice
+   * the Gaussian standard deviation. See:
+   *
+   * http://lists.w3.org/Archives/Public/www-style/2010Sep/0002.html
+   */
+  sigma = blur / 2.;
+
+  if ((guint) blur == 0)
+    {
+      *width_out  = width_in;
+      *height_out = height_in;
+      *rowstride_out = rowstride_in;
+      return g_memdup (pixels_in, *rowstride_out * *height_out);
+    }
+
+  n_values = (gint) (5 * sigma);
+  half = n_values / 2;
+
+  width = width_in + 2 * half;
+  height = height_in + 2 * half;
+  stride = (width + 3) & ~3;
+  t_stride = (height + 3) & ~3;
+
+  if (n_values <= MAX_DIRECT_KERNEL_SIZE)
+    kernel = compute_gaussian_kernel (sigma, n_values);
+  else
+    compute_box_radii (sigma, radii);
+
+  zeros = g_malloc0 (MAX (width, height));
+  acc = g_malloc (MAX (width, height) * sizeof (guint32));
+
+  /* Vertical passes */
+  a = g_malloc0 (stride * height);
+  b = g_malloc0 (stride * height);
+
+  for (y = 0; y < height_in; y++)
+    memcpy (a + (y + half) * stride + half, pixels_in + y * rowstride_in, width_in);
+
+  result = blur_columns (a, b, width, height, stride, radii, kernel, n_values, zeros, acc);
+
+  /* Horizontal passes, on the transposed image */
+  if (result == a)
+    {
+      a = b;
+      b = result;
+    }
+
+  {
+    guchar *ta = g_malloc (t_stride * width);
+    guchar *tb = g_malloc (t_stride * width);
+    guchar *t_result;
+
+    transpose (b, stride, ta, t_stride, width, height);
+    t_result = blur_columns (ta, tb, height, width, t_stride, radii, kernel, n_values, zeros, acc);
+    transpose (t_result, t_stride, a, stride, height, width);
+
+    g_free (ta);
+    g_free (tb);
+  }
+
+  g_free (b);
+  g_free (kernel);
+  g_free (acc);
+  g_free (zeros);
+
+  *width_out = width;
+  *height_out = height;
+  *rowstride_out = stride;
+
+  return a;
+}
@@ -0,0 +1,39 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-blur.h: Fast approximate gaussian blur of alpha masks
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ST_BLUR_H__
+#define __ST_BLUR_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+guchar *_st_blur_alpha (const guchar *pixels_in,
+                        gint          width_in,
+                        gint          height_in,
+                        gint          rowstride_in,
+                        gdouble       blur,
+                        gint         *width_out,
+                        gint         *height_out,
+                        gint         *rowstride_out);
+
+/* Only for testing: force the portable code path */
+void    _st_blur_set_use_simd (gboolean use_simd);
+
+G_END_DECLS
+
+#endif /* __ST_BLUR_H__ */
@@ -0,0 +1,325 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-content-hash.c: Fast 128 bit hashes of image data
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The texture cache identifies images passed in as pixels or encoded data
+ * by a hash of their contents. That needs to be fast, since it happens on
+ * the main thread for every notification icon, but not cryptographic: a
+ * collision shows the wrong image, it doesn't compromise anything.
+ *
+ * The hash follows the structure of XXH3. The data is read in stripes of
+ * 64 bytes, as eight little endian 64 bit words, each of which is added
+ * to a neighbouring accumulator and, xored with a secret, multiplied as
+ * two 32 bit halves into its own accumulator. The secret slides by a word
+ * from one stripe to the next; after a block of STRIPES_PER_BLOCK stripes
+ * the accumulators are scrambled. At the end they are folded, together
+ * with the length, into two independently seeded 64 bit halves.
+ *
+ * 32x32->64 bit multiplies of adjacent lanes and swaps of 64 bit halves
+ * are exactly what SSE2 and AVX2 provide, so the SIMD code paths process
+ * two or four words at a time and produce identical results.
+ */
+
+#include <string.h>
+
+#include "st-content-hash.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#define STRIPE_LEN        64
+#define N_LANES           8
+#define STRIPES_PER_BLOCK 16
+#define BLOCK_LEN         (STRIPE_LEN * STRIPES_PER_BLOCK)
+
+#define PRIME32_1 G_GUINT64_CONSTANT (0x9e3779b1)
+#define PRIME64_1 G_GUINT64_CONSTANT (0x9e3779b185ebca87)
+#define PRIME64_2 G_GUINT64_CONSTANT (0xc2b2ae3d27d4eb4f)
+#define PRIME64_3 G_GUINT64_CONSTANT (0x165667b19e3779f9)
+
+/* Stripes use words 0 to 22, scrambling words 24 to 31 */
+static const guint64 secret[32] = {
+  G_GUINT64_CONSTANT (0xe220a8397b1dcdaf), G_GUINT64_CONSTANT (0x6e789e6aa1b965f4),
+  G_GUINT64_CONSTANT (0x06c45d188009454f), G_GUINT64_CONSTANT (0xf88bb8a8724c81ec),
+  G_GUINT64_CONSTANT (0x1b39896a51a8749b), G_GUINT64_CONSTANT (0x53cb9f0c747ea2ea),
+  G_GUINT64_CONSTANT (0x2c829abe1f4532e1), G_GUINT64_CONSTANT (0xc584133ac916ab3c),
+  G_GUINT64_CONSTANT (0x3ee5789041c98ac3), G_GUINT64_CONSTANT (0xf3b8488c368cb0a6),
+  G_GUINT64_CONSTANT (0x657eecdd3cb13d09), G_GUINT64_CONSTANT (0xc2d326e0055bdef6),
+  G_GUINT64_CONSTANT (0x8621a03fe0bbdb7b), G_GUINT64_CONSTANT (0x8e1f7555983aa92f),
+  G_GUINT64_CONSTANT (0xb54e0f1600cc4d19), G_GUINT64_CONSTANT (0x84bb3f97971d80ab),
+  G_GUINT64_CONSTANT (0x7d29825c75521255), G_GUINT64_CONSTANT (0xc3cf17102b7f7f86),
+  G_GUINT64_CONSTANT (0x3466e9a083914f64), G_GUINT64_CONSTANT (0xd81a8d2b5a4485ac),
+  G_GUINT64_CONSTANT (0xdb01602b100b9ed7), G_GUINT64_CONSTANT (0xa9038a921825f10d),
+  G_GUINT64_CONSTANT (0xedf5f1d90dca2f6a), G_GUINT64_CONSTANT (0x54496ad67bd2634c),
+  G_GUINT64_CONSTANT (0xdd7c01d4f5407269), G_GUINT64_CONSTANT (0x935e82f1db4c4f7b),
+  G_GUINT64_CONSTANT (0x69b82ebc92233300), G_GUINT64_CONSTANT (0x40d29eb57de1d510),
+  G_GUINT64_CONSTANT (0xa2f09dabb45c6316), G_GUINT64_CONSTANT (0xee521d7a0f4d3872),
+  G_GUINT64_CONSTANT (0xf16952ee72f3454f), G_GUINT64_CONSTANT (0x377d35dea8e40225),
+};
+
+typedef enum {
+  SIMD_UNKNOWN,
+  SIMD_NONE,
+  SIMD_SSE2,
+  SIMD_AVX2
+} SimdLevel;
+
+static SimdLevel simd_level = SIMD_UNKNOWN;
+static gboolean simd_enabled = TRUE;
+
+/* Accumulates @n_stripes stripes of @data, using the secret from word
+ * @first_stripe on */
+typedef void (*AccumulateFunc) (guint64      *acc,
+                                const guchar *data,
+                                gint          first_stripe,
+                                gint          n_stripes);
+
+static inline guint64
+read64 (const guchar *p)
+{
+  guint64 v;
+
+  memcpy (&v, p, sizeof (v));
+  return GUINT64_FROM_LE (v);
+}
+
+static void
+accumulate_generic (guint64      *acc,
+                    const guchar *data,
+                    gint          first_stripe,
+                    gint          n_stripes)
+{
+  gint s, i;
+
+  for (s = 0; s < n_stripes; s++)
+    {
+      const guchar *stripe = data + s * STRIPE_LEN;
+      const guint64 *key = secret + first_stripe + s;
+
+      for (i = 0; i < N_LANES; i++)
+        {
+          guint64 word = read64 (stripe + 8 * i);
+          guint64 keyed = word ^ key[i];
+
+          acc[i ^ 1] += word;
+          acc[i] += (keyed & 0xffffffff) * (keyed >> 32);
+        }
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+
+__attribute__((target ("sse2")))
+static void
+accumulate_sse2 (guint64      *acc,
+                 const guchar *data,
+                 gint          first_stripe,
+                 gint          n_stripes)
+{
+  __m128i vacc[N_LANES / 2];
+  gint s, i;
+
+  for (i = 0; i < N_LANES / 2; i++)
+    vacc[i] = _mm_loadu_si128 ((const __m128i *) (acc + 2 * i));
+
+  for (s = 0; s < n_stripes; s++)
+    {
+      const guchar *stripe = data + s * STRIPE_LEN;
+      const guint64 *key = secret + first_stripe + s;
+
+      for (i = 0; i < N_LANES / 2; i++)
+        {
+          __m128i word = _mm_loadu_si128 ((const __m128i *) (stripe + 16 * i));
+          __m128i keyed = _mm_xor_si128 (word, _mm_loadu_si128 ((const __m128i *) (key + 2 * i)));
+          __m128i product = _mm_mul_epu32 (keyed, _mm_srli_epi64 (keyed, 32));
+          __m128i swapped = _mm_shuffle_epi32 (word, _MM_SHUFFLE (1, 0, 3, 2));
+
+          vacc[i] = _mm_add_epi64 (vacc[i], _mm_add_epi64 (product, swapped));
+        }
+    }
+
+  for (i = 0; i < N_LANES / 2; i++)
+    _mm_storeu_si128 ((__m128i *) (acc + 2 * i), vacc[i]);
+}
+
+__attribute__((target ("avx2")))
+static void
+accumulate_avx2 (guint64      *acc,
+                 const guchar *data,
+                 gint          first_stripe,
+                 gint          n_stripes)
+{
+  __m256i vacc[N_LANES / 4];
+  gint s, i;
+
+  for (i = 0; i < N_LANES / 4; i++)
+    vacc[i] = _mm256_loadu_si256 ((const __m256i *) (acc + 4 * i));
+
+  for (s = 0; s < n_stripes; s++)
+    {
+      const guchar *stripe = data + s * STRIPE_LEN;
+      const guint64 *key = secret + first_stripe + s;
+
+      for (i = 0; i < N_LANES / 4; i++)
+        {
+          __m256i word = _mm256_loadu_si256 ((const __m256i *) (stripe + 32 * i));
+          __m256i keyed = _mm256_xor_si256 (word, _mm256_loadu_si256 ((const __m256i *) (key + 4 * i)));
+          __m256i product = _mm256_mul_epu32 (keyed, _mm256_srli_epi64 (keyed, 32));
+          __m256i swapped = _mm256_shuffle_epi32 (word, _MM_SHUFFLE (1, 0, 3, 2));
+
+          vacc[i] = _mm256_add_epi64 (vacc[i], _mm256_add_epi64 (product, swapped));
+        }
+    }
+
+  for (i = 0; i < N_LANES / 4; i++)
+    _mm256_storeu_si256 ((__m256i *) (acc + 4 * i), vacc[i]);
+}
+
+#endif /* HAVE_X86_SIMD */
+
+static AccumulateFunc
+get_accumulate_func (void)
+{
+  if (simd_level == SIMD_UNKNOWN)
+    {
+      simd_level = SIMD_NONE;
+#ifdef HAVE_X86_SIMD
+      __builtin_cpu_init ();
+      if (__builtin_cpu_supports ("avx2"))
+        simd_level = SIMD_AVX2;
+      else if (__builtin_cpu_supports ("sse2"))
+        simd_level = SIMD_SSE2;
+#endif
+    }
+
+  switch (simd_enabled ? simd_level : SIMD_NONE)
+    {
+#ifdef HAVE_X86_SIMD
+    case SIMD_AVX2:
+      return accumulate_avx2;
+    case SIMD_SSE2:
+      return accumulate_sse2;
+#endif
+    default:
+      return accumulate_generic;
+    }
+}
+
+static void
+scramble (guint64 *acc)
+{
+  gint i;
+
+  for (i = 0; i < N_LANES; i++)
+    {
+      acc[i] ^= acc[i] >> 47;
+      acc[i] ^= secret[24 + i];
+      acc[i] *= PRIME32_1;
+    }
+}
+
+static inline guint64
+rotl64 (guint64 x,
+        gint    r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static guint64
+avalanche (guint64 h)
+{
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+static guint64
+fold (const guint64 *acc,
+      const guint64 *key,
+      guint64        h)
+{
+  gint i;
+
+  for (i = 0; i < N_LANES; i++)
+    h = rotl64 (h ^ avalanche (acc[i] ^ key[i]), 27) * PRIME64_1 + PRIME64_3;
+
+  return avalanche (h);
+}
+
+/**
+ * _st_content_hash_compute:
+ * @data: the data to hash
+ * @len: the length of @data
+ * @hash: (out): location for the hash
+ *
+ * Computes a 128 bit non-cryptographic hash of @data.
+ */
+void
+_st_content_hash_compute (const guchar  *data,
+                          gsize          len,
+                          StContentHash *hash)
+{
+  AccumulateFunc accumulate = get_accumulate_func ();
+  guint64 acc[N_LANES] = {
+    PRIME32_1, PRIME64_1, PRIME64_2, PRIME64_3,
+    ~PRIME32_1, ~PRIME64_1, ~PRIME64_2, ~PRIME64_3
+  };
+  guchar last[STRIPE_LEN];
+  gsize n_blocks, n_stripes, rest, i;
+
+  n_blocks = len / BLOCK_LEN;
+  for (i = 0; i < n_blocks; i++)
+    {
+      accumulate (acc, data + i * BLOCK_LEN, 0, STRIPES_PER_BLOCK);
+      scramble (acc);
+    }
+
+  data += n_blocks * BLOCK_LEN;
+  len -= n_blocks * BLOCK_LEN;
+  n_stripes = len / STRIPE_LEN;
+  accumulate (acc, data, 0, n_stripes);
+
+  /* The partial stripe at the end, padded with zeros; the length tells
+   * it apart from data that ends in zeros */
+  rest = len - n_stripes * STRIPE_LEN;
+  if (rest > 0)
+    {
+      memset (last, 0, sizeof (last));
+      memcpy (last, data + n_stripes * STRIPE_LEN, rest);
+      accumulate (acc, last, n_stripes, 1);
+    }
+
+  len += n_blocks * BLOCK_LEN;
+  hash->low = fold (acc, secret, len * PRIME64_1);
+  hash->high = fold (acc, secret + N_LANES, ~len * PRIME64_2);
+}
+
+/**
+ * _st_content_hash_set_use_simd:
+ * @use_simd: whether to use SIMD instructions, when the CPU has them
+ *
+ * Lets tests and benchmarks compare the portable and the SIMD code paths.
+ */
+void
+_st_content_hash_set_use_simd (gboolean use_simd)
+{
+  simd_enabled = use_simd;
+}
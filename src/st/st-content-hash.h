@@ -0,0 +1,39 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-content-hash.h: Fast 128 bit hashes of image data
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ST_CONTENT_HASH_H__
+#define __ST_CONTENT_HASH_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct {
+  guint64 low;
+  guint64 high;
+} StContentHash;
+
+void _st_content_hash_compute      (const guchar  *data,
+                                    gsize          len,
+                                    StContentHash *hash);
+
+/* Only for testing: force the portable code path */
+void _st_content_hash_set_use_simd (gboolean       use_simd);
+
+G_END_DECLS
+
+#endif /* __ST_CONTENT_HASH_H__ */
@@ -0,0 +1,264 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-decode-pool.c: Prioritized worker threads for image decoding
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* A replacement for g_simple_async_result_run_in_thread() for the texture
+ * cache. GIO runs all such jobs on one shared pool in the order they come
+ * in, so opening a menu with hundreds of thumbnails delays every icon
+ * requested after it. Here jobs wait in a queue sorted by priority class,
+ * then by age, for a bounded number of threads.
+ *
+ * A job whose cancellable is cancelled before it starts is completed with
+ * G_IO_ERROR_CANCELLED without running. Latency is measured from the push
+ * to the end of the job, when the result is sent back to the main loop.
+ */
+
+#include "st-decode-pool.h"
+
+struct _StDecodePool {
+  GThreadPool *threads;
+  guint64      next_sequence;
+
+  /* Protected by the stats lock */
+  guint        n_queued[ST_DECODE_N_PRIORITIES];
+  guint        n_running;
+  guint        n_cancelled;
+  guint        n_completed[ST_DECODE_N_PRIORITIES];
+  gint64       total_latency[ST_DECODE_N_PRIORITIES];
+  gint64       max_latency;
+};
+
+typedef struct {
+  GSimpleAsyncResult     *result;
+  GSimpleAsyncThreadFunc  func;
+  GCancellable           *cancellable;
+  StDecodePriority        priority;
+  guint64                 sequence;
+  gint64                  push_time;
+} StDecodeJob;
+
+G_LOCK_DEFINE_STATIC (stats);
+
+static gint
+compare_jobs (gconstpointer a,
+              gconstpointer b,
+              gpointer      user_data)
+{
+  const StDecodeJob *job_a = a;
+  const StDecodeJob *job_b = b;
+
+  if (job_a->priority != job_b->priority)
+    return job_a->priority < job_b->priority ? -1 : 1;
+
+  return job_a->sequence < job_b->sequence ? -1 : 1;
+}
+
+static void
+run_job (gpointer data,
+         gpointer user_data)
+{
+  StDecodeJob *job = data;
+  StDecodePool *pool = user_data;
+  GError *error = NULL;
+  gboolean cancelled;
+  gint64 latency;
+
+  G_LOCK (stats);
+  pool->n_queued[job->priority]--;
+  pool->n_running++;
+  G_UNLOCK (stats);
+
+  cancelled = g_cancellable_set_error_if_cancelled (job->cancellable, &error);
+  if (cancelled)
+    {
+      g_simple_async_result_set_from_error (job->result, error);
+      g_error_free (error);
+    }
+  else
+    {
+      GObject *object = g_async_result_get_source_object (G_ASYNC_RESULT (job->result));
+
+      job->func (job->result, object, job->cancellable);
+
+      if (object)
+        g_object_unref (object);
+    }
+
+  latency = g_get_monotonic_time () - job->push_time;
+
+  G_LOCK (stats);
+  pool->n_running--;
+  if (cancelled)
+    pool->n_cancelled++;
+  else
+    {
+      pool->n_completed[job->priority]++;
+      pool->total_latency[job->priority] += latency;
+      pool->max_latency = MAX (pool->max_latency, latency);
+    }
+  G_UNLOCK (stats);
+
+  g_simple_async_result_complete_in_idle (job->result);
+
+  g_object_unref (job->result);
+  if (job->cancellable)
+    g_object_unref (job->cancellable);
+  g_slice_free (StDecodeJob, job);
+}
+
+/**
+ * _st_decode_pool_new:
+ * @max_threads: how many jobs may run at the same time
+ *
+ * Return value: a new pool, with no threads until jobs are pushed
+ */
+StDecodePool *
+_st_decode_pool_new (guint max_threads)
+{
+  StDecodePool *pool;
+
+  g_return_val_if_fail (max_threads > 0, NULL);
+
+  pool = g_slice_new0 (StDecodePool);
+
+  /* Not exclusive, so idle threads go back to GLib's shared pool */
+  pool->threads = g_thread_pool_new (run_job, pool, max_threads, FALSE, NULL);
+  g_thread_pool_set_sort_function (pool->threads, compare_jobs, NULL);
+
+  return pool;
+}
+
+/**
+ * _st_decode_pool_free:
+ * @pool: a #StDecodePool
+ *
+ * Runs the jobs still queued in @pool, then frees it. Their results are
+ * completed from idles as usual.
+ */
+void
+_st_decode_pool_free (StDecodePool *pool)
+{
+  g_thread_pool_free (pool->threads, FALSE, TRUE);
+  g_slice_free (StDecodePool, pool);
+}
+
+void
+_st_decode_pool_set_max_threads (StDecodePool *pool,
+                                 guint         max_threads)
+{
+  g_return_if_fail (max_threads > 0);
+
+  g_thread_pool_set_max_threads (pool->threads, max_threads, NULL);
+}
+
+guint
+_st_decode_pool_get_max_threads (StDecodePool *pool)
+{
+  return g_thread_pool_get_max_threads (pool->threads);
+}
+
+/**
+ * _st_decode_pool_push:
+ * @pool: a #StDecodePool
+ * @result: the result to complete
+ * @func: the function run in a thread to set @result
+ * @priority: the class of the job
+ * @cancellable: (allow-none): a #GCancellable
+ *
+ * Like g_simple_async_result_run_in_thread(), except that @func runs on
+ * one of the threads of @pool, after every job pushed before it with
+ * the same or a more urgent @priority has started.
+ */
+void
+_st_decode_pool_push (StDecodePool           *pool,
+                      GSimpleAsyncResult     *result,
+                      GSimpleAsyncThreadFunc  func,
+                      StDecodePriority        priority,
+                      GCancellable           *cancellable)
+{
+  StDecodeJob *job;
+
+  g_return_if_fail (priority < ST_DECODE_N_PRIORITIES);
+
+  job = g_slice_new (StDecodeJob);
+  job->result = g_object_ref (result);
+  job->func = func;
+  job->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+  job->priority = priority;
+  job->sequence = pool->next_sequence++;
+  job->push_time = g_get_monotonic_time ();
+
+  G_LOCK (stats);
+  pool->n_queued[priority]++;
+  G_UNLOCK (stats);
+
+  g_thread_pool_push (pool->threads, job, NULL);
+}
+
+/**
+ * _st_decode_pool_get_statistics:
+ * @pool: a #StDecodePool
+ * @n_queued: (out) (allow-none): number of jobs waiting for a thread
+ * @n_running: (out) (allow-none): number of jobs running
+ * @n_cancelled: (out) (allow-none): number of jobs cancelled before
+ *   they started
+ * @visible_latency: (out) (allow-none): mean latency of the jobs of
+ *   the most urgent class, in microseconds
+ * @mean_latency: (out) (allow-none): mean latency of all jobs, in
+ *   microseconds
+ * @max_latency: (out) (allow-none): highest latency of a job, in
+ *   microseconds
+ */
+void
+_st_decode_pool_get_statistics (StDecodePool *pool,
+                                guint        *n_queued,
+                                guint        *n_running,
+                                guint        *n_cancelled,
+                                gint64       *visible_latency,
+                                gint64       *mean_latency,
+                                gint64       *max_latency)
+{
+  guint queued = 0, completed = 0;
+  gint64 total = 0;
+  int i;
+
+  G_LOCK (stats);
+
+  for (i = 0; i < ST_DECODE_N_PRIORITIES; i++)
+    {
+      queued += pool->n_queued[i];
+      completed += pool->n_completed[i];
+      total += pool->total_latency[i];
+    }
+
+  if (n_queued)
+    *n_queued = queued;
+  if (n_running)
+    *n_running = pool->n_running;
+  if (n_cancelled)
+    *n_cancelled = pool->n_cancelled;
+  if (visible_latency)
+    {
+      guint n = pool->n_completed[ST_DECODE_PRIORITY_VISIBLE];
+      *visible_latency = n ? pool->total_latency[ST_DECODE_PRIORITY_VISIBLE] / n : 0;
+    }
+  if (mean_latency)
+    *mean_latency = completed ? total / completed : 0;
+  if (max_latency)
+    *max_latency = pool->max_latency;
+
+  G_UNLOCK (stats);
+}
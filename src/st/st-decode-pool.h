@@ -0,0 +1,59 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-decode-pool.h: Prioritized worker threads for image decoding
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ST_DECODE_POOL_H__
+#define __ST_DECODE_POOL_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* Jobs of a class only start once no job of a more urgent class waits */
+typedef enum {
+  ST_DECODE_PRIORITY_VISIBLE,
+  ST_DECODE_PRIORITY_PREFETCH,
+  ST_DECODE_PRIORITY_BACKGROUND
+} StDecodePriority;
+
+#define ST_DECODE_N_PRIORITIES (ST_DECODE_PRIORITY_BACKGROUND + 1)
+
+typedef struct _StDecodePool StDecodePool;
+
+StDecodePool *_st_decode_pool_new             (guint                   max_threads);
+void          _st_decode_pool_free            (StDecodePool           *pool);
+
+void          _st_decode_pool_set_max_threads (StDecodePool           *pool,
+                                               guint                   max_threads);
+guint         _st_decode_pool_get_max_threads (StDecodePool           *pool);
+
+void          _st_decode_pool_push            (StDecodePool           *pool,
+                                               GSimpleAsyncResult     *result,
+                                               GSimpleAsyncThreadFunc  func,
+                                               StDecodePriority        priority,
+                                               GCancellable           *cancellable);
+
+void          _st_decode_pool_get_statistics  (StDecodePool           *pool,
+                                               guint                  *n_queued,
+                                               guint                  *n_running,
+                                               guint                  *n_cancelled,
+                                               gint64                 *visible_latency,
+                                               gint64                 *mean_latency,
+                                               gint64                 *max_latency);
+
+G_END_DECLS
+
+#endif /* __ST_DECODE_POOL_H__ */
@@ -0,0 +1,393 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-icon-cache.c: On-disk cache of rasterized icons
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Every session starts by decoding the same icons for the panel, the
+ * menu and the window list, and rasterizing SVGs is expensive. Once an
+ * icon is decoded, its pixels are stored as premultiplied RGBA, exactly
+ * as they are uploaded, in CACHE_DIR/icons/<digest>, where the digest is
+ * of the icon theme, the icon file and the texture cache key, which
+ * includes the size and the colors of symbolic icons. Later loads map
+ * the file and create the texture from it without decoding.
+ *
+ * An entry records the modification times of the icon file and of the
+ * directory holding it, and is ignored once either changed. Editing an
+ * icon changes the former, adding an icon next to it the latter; a
+ * different theme resolves icons to different files in the first place.
+ *
+ * Loads and stores happen in the texture cache's decoding threads.
+ *
+ * Files that are read get their modification time refreshed once a day,
+ * so that it tells when an entry was last used. Icons of removed themes
+ * and applications are never read again: _st_icon_cache_prune(), run at
+ * startup, deletes entries unused for MAX_AGE_DAYS, then the least
+ * recently used ones while the cache is larger than MAX_CACHE_BYTES.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include <glib/gstdio.h>
+
+#include "st-icon-cache.h"
+
+#define ICON_CACHE_MAGIC   0x43495453 /* "STIC" */
+#define ICON_CACHE_VERSION 1
+
+#define MAX_AGE_DAYS     30
+#define MAX_CACHE_BYTES  (32 * 1024 * 1024)
+#define SECONDS_PER_DAY  (24 * 60 * 60)
+
+typedef struct {
+  guint32 magic;
+  guint32 version;
+  gint64  file_mtime;
+  gint64  dir_mtime;
+  guint32 width;
+  guint32 height;
+  guint32 rowstride;
+  guint32 padding;
+} StIconCacheHeader;
+
+static volatile gint n_hits;
+static volatile gint n_misses;
+static volatile gint n_stores;
+
+typedef struct {
+  char   *path;
+  time_t  mtime;
+  gsize   size;
+} CacheFile;
+
+static char *
+get_cache_dir (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), "cinnamon", "icons", NULL);
+}
+
+/**
+ * _st_icon_cache_get_path:
+ * @theme_name: (allow-none): the name of the icon theme
+ * @filename: the file the icon is loaded from
+ * @key: the texture cache key of the icon
+ *
+ * Return value: the path of the cache file for the icon
+ */
+char *
+_st_icon_cache_get_path (const char *theme_name,
+                         const char *filename,
+                         const char *key)
+{
+  char *identity, *digest, *dir, *path;
+
+  identity = g_strconcat (theme_name ? theme_name : "", "\n",
+                          filename, "\n",
+                          key, NULL);
+  digest = g_compute_checksum_for_string (G_CHECKSUM_MD5, identity, -1);
+  dir = get_cache_dir ();
+  path = g_build_filename (dir, digest, NULL);
+
+  g_free (dir);
+  g_free (digest);
+  g_free (identity);
+
+  return path;
+}
+
+static gboolean
+get_mtimes (const char *filename,
+            gint64     *file_mtime,
+            gint64     *dir_mtime)
+{
+  struct stat buf;
+  char *dir;
+  gboolean ok;
+
+  if (g_stat (filename, &buf) < 0)
+    return FALSE;
+  *file_mtime = buf.st_mtime;
+
+  dir = g_path_get_dirname (filename);
+  ok = g_stat (dir, &buf) == 0;
+  g_free (dir);
+
+  *dir_mtime = buf.st_mtime;
+  return ok;
+}
+
+/**
+ * _st_icon_cache_load:
+ * @path: the path of the cache file
+ * @filename: the file the icon is loaded from
+ *
+ * Return value: (transfer full): the cached pixels of the icon, or %NULL
+ *   if there are none or they are out of date
+ */
+StIconCacheImage *
+_st_icon_cache_load (const char *path,
+                     const char *filename)
+{
+  StIconCacheImage *image;
+  StIconCacheHeader header;
+  GMappedFile *file;
+  gint64 file_mtime, dir_mtime;
+  gsize length;
+  struct stat buf;
+
+  file = g_mapped_file_new (path, FALSE, NULL);
+  if (file == NULL)
+    goto miss;
+
+  length = g_mapped_file_get_length (file);
+  if (length < sizeof (header))
+    goto stale;
+
+  memcpy (&header, g_mapped_file_get_contents (file), sizeof (header));
+
+  /* Sizes are checked in gsize, a corrupt header mustn't overflow them */
+  if (header.magic != ICON_CACHE_MAGIC ||
+      header.version != ICON_CACHE_VERSION ||
+      header.width == 0 || header.height == 0 ||
+      (gsize) header.rowstride < (gsize) header.width * 4 ||
+      length - sizeof (header) != (gsize) header.rowstride * header.height ||
+      !get_mtimes (filename, &file_mtime, &dir_mtime) ||
+      header.file_mtime != file_mtime ||
+      header.dir_mtime != dir_mtime)
+    goto stale;
+
+  image = g_slice_new (StIconCacheImage);
+  image->file = file;
+  image->pixels = (const guchar *) g_mapped_file_get_contents (file) + sizeof (header);
+  image->width = header.width;
+  image->height = header.height;
+  image->rowstride = header.rowstride;
+
+  /* Mark the entry as used */
+  if (g_stat (path, &buf) == 0 &&
+      buf.st_mtime < time (NULL) - SECONDS_PER_DAY)
+    g_utime (path, NULL);
+
+  g_atomic_int_inc (&n_hits);
+
+  return image;
+
+ stale:
+  g_mapped_file_unref (file);
+ miss:
+  g_atomic_int_inc (&n_misses);
+  return NULL;
+}
+
+/**
+ * _st_icon_cache_store:
+ * @path: the path of the cache file
+ * @filename: the file @pixbuf was loaded from
+ * @pixbuf: the decoded icon
+ * @add_padding: whether to center the icon in a transparent square
+ *
+ * Saves the pixels of @pixbuf for later _st_icon_cache_load() calls.
+ */
+void
+_st_icon_cache_store (const char *path,
+                      const char *filename,
+                      GdkPixbuf  *pixbuf,
+                      gboolean    add_padding)
+{
+  StIconCacheHeader header;
+  const guchar *src_pixels;
+  guchar *contents, *dst_pixels;
+  int src_width, src_height, src_rowstride, n_channels;
+  int x_offset = 0, y_offset = 0;
+  int x, y;
+  gsize length;
+  char *dir;
+
+  memset (&header, 0, sizeof (header));
+  if (!get_mtimes (filename, &header.file_mtime, &header.dir_mtime))
+    return;
+
+  if (gdk_pixbuf_get_bits_per_sample (pixbuf) != 8)
+    return;
+
+  src_width = gdk_pixbuf_get_width (pixbuf);
+  src_height = gdk_pixbuf_get_height (pixbuf);
+  src_rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  src_pixels = gdk_pixbuf_get_pixels (pixbuf);
+  n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+
+  header.magic = ICON_CACHE_MAGIC;
+  header.version = ICON_CACHE_VERSION;
+  header.width = src_width;
+  header.height = src_height;
+
+  if (add_padding && src_width != src_height)
+    {
+      header.width = header.height = MAX (src_width, src_height);
+      x_offset = (header.width - src_width) / 2;
+      y_offset = (header.height - src_height) / 2;
+    }
+
+  header.rowstride = header.width * 4;
+
+  length = sizeof (header) + (gsize) header.rowstride * header.height;
+  contents = g_malloc0 (length);
+  memcpy (contents, &header, sizeof (header));
+  dst_pixels = contents + sizeof (header);
+
+  for (y = 0; y < src_height; y++)
+    {
+      const guchar *src = src_pixels + y * src_rowstride;
+      guchar *dst = dst_pixels + (y + y_offset) * header.rowstride + x_offset * 4;
+
+      for (x = 0; x < src_width; x++)
+        {
+          guint alpha = n_channels == 4 ? src[3] : 255;
+
+          dst[0] = (src[0] * alpha + 127) / 255;
+          dst[1] = (src[1] * alpha + 127) / 255;
+          dst[2] = (src[2] * alpha + 127) / 255;
+          dst[3] = alpha;
+
+          src += n_channels;
+          dst += 4;
+        }
+    }
+
+  dir = g_path_get_dirname (path);
+  g_mkdir_with_parents (dir, 0700);
+  g_free (dir);
+
+  if (g_file_set_contents (path, (const char *) contents, length, NULL))
+    g_atomic_int_inc (&n_stores);
+
+  g_free (contents);
+}
+
+static gint
+compare_by_mtime (gconstpointer a,
+                  gconstpointer b)
+{
+  const CacheFile *file_a = a;
+  const CacheFile *file_b = b;
+
+  if (file_a->mtime < file_b->mtime)
+    return -1;
+  else if (file_a->mtime > file_b->mtime)
+    return 1;
+  else
+    return 0;
+}
+
+/**
+ * _st_icon_cache_prune:
+ *
+ * Deletes the entries that weren't used for a long time, then the least
+ * recently used ones until the cache is well below its size limit.
+ */
+void
+_st_icon_cache_prune (void)
+{
+  GArray *files;
+  GDir *dir;
+  const char *name;
+  char *dir_path;
+  time_t oldest;
+  gsize total = 0;
+  guint i;
+
+  dir_path = get_cache_dir ();
+  dir = g_dir_open (dir_path, 0, NULL);
+  if (dir == NULL)
+    {
+      g_free (dir_path);
+      return;
+    }
+
+  files = g_array_new (FALSE, FALSE, sizeof (CacheFile));
+  oldest = time (NULL) - MAX_AGE_DAYS * SECONDS_PER_DAY;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      CacheFile file;
+      struct stat buf;
+
+      file.path = g_build_filename (dir_path, name, NULL);
+      if (g_stat (file.path, &buf) < 0 || !S_ISREG (buf.st_mode))
+        {
+          g_free (file.path);
+          continue;
+        }
+
+      if (buf.st_mtime < oldest)
+        {
+          g_unlink (file.path);
+          g_free (file.path);
+          continue;
+        }
+
+      file.mtime = buf.st_mtime;
+      file.size = buf.st_size;
+      total += file.size;
+      g_array_append_val (files, file);
+    }
+
+  g_dir_close (dir);
+  g_free (dir_path);
+
+  /* Make room for a while rather than pruning a bit at every startup */
+  if (total > MAX_CACHE_BYTES)
+    {
+      g_array_sort (files, compare_by_mtime);
+
+      for (i = 0; i < files->len && total > MAX_CACHE_BYTES / 4 * 3; i++)
+        {
+          CacheFile *file = &g_array_index (files, CacheFile, i);
+
+          if (g_unlink (file->path) == 0)
+            total -= file->size;
+        }
+    }
+
+  for (i = 0; i < files->len; i++)
+    g_free (g_array_index (files, CacheFile, i).path);
+  g_array_free (files, TRUE);
+}
+
+void
+_st_icon_cache_image_free (StIconCacheImage *image)
+{
+  g_mapped_file_unref (image->file);
+  g_slice_free (StIconCacheImage, image);
+}
+
+/**
+ * _st_icon_cache_get_statistics:
+ * @hits: (out) (allow-none): number of icons loaded from the cache
+ * @misses: (out) (allow-none): number of icons that had to be decoded
+ * @stores: (out) (allow-none): number of icons written to the cache
+ */
+void
+_st_icon_cache_get_statistics (guint *hits,
+                               guint *misses,
+                               guint *stores)
+{
+  if (hits)
+    *hits = g_atomic_int_get (&n_hits);
+  if (misses)
+    *misses = g_atomic_int_get (&n_misses);
+  if (stores)
+    *stores = g_atomic_int_get (&n_stores);
+}
@@ -0,0 +1,56 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-icon-cache.h: On-disk cache of rasterized icons
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ST_ICON_CACHE_H__
+#define __ST_ICON_CACHE_H__
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+typedef struct {
+  /* Premultiplied RGBA */
+  const guchar *pixels;
+  guint         width;
+  guint         height;
+  guint         rowstride;
+
+  /*< private >*/
+  GMappedFile  *file;
+} StIconCacheImage;
+
+char             *_st_icon_cache_get_path       (const char       *theme_name,
+                                                 const char       *filename,
+                                                 const char       *key);
+
+StIconCacheImage *_st_icon_cache_load           (const char       *path,
+                                                 const char       *filename);
+void              _st_icon_cache_store          (const char       *path,
+                                                 const char       *filename,
+                                                 GdkPixbuf        *pixbuf,
+                                                 gboolean          add_padding);
+void              _st_icon_cache_image_free     (StIconCacheImage *image);
+
+void              _st_icon_cache_prune          (void);
+
+void              _st_icon_cache_get_statistics (guint            *hits,
+                                                 guint            *misses,
+                                                 guint            *stores);
+
+G_END_DECLS
+
+#endif /* __ST_ICON_CACHE_H__ */
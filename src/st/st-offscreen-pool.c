@@ -0,0 +1,181 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-offscreen-pool.c: Offscreen render targets shared between transitions
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Style transitions paint the old and the new look of a widget into two
+ * offscreen textures and crossfade between them. Hovering over a panel or
+ * a menu starts and ends such transitions all the time, usually on
+ * widgets of the same few sizes, so rather than creating textures and
+ * framebuffers for each transition, they are taken from this pool and
+ * given back when the transition is done.
+ *
+ * Sizes are rounded up to buckets, so that widgets of similar sizes share
+ * render targets; users paint into the top left corner of a target and
+ * only sample that part of its texture. Targets given back are kept in
+ * least recently released order, up to MAX_IDLE_BYTES.
+ */
+
+#include "st-offscreen-pool.h"
+
+/* How much texture data to keep for targets that are currently unused */
+#define MAX_IDLE_BYTES (8 * 1024 * 1024)
+
+#define OFFSCREEN_BYTES(offscreen) ((gsize) (offscreen)->width * (offscreen)->height * 4)
+
+static GQueue idle_offscreens = G_QUEUE_INIT;
+static gsize  idle_bytes = 0;
+
+static struct {
+  guint n_reused;
+  guint n_allocated;
+  gsize total_bytes;
+  gsize peak_bytes;
+} stats;
+
+/* Multiples of 32 pixels up to 256, then of 128 */
+static guint
+bucket_size (guint size)
+{
+  if (size <= 256)
+    return (size + 31) & ~31;
+  else
+    return (size + 127) & ~127;
+}
+
+static void
+offscreen_free (StOffscreen *offscreen)
+{
+  stats.total_bytes -= OFFSCREEN_BYTES (offscreen);
+
+  cogl_handle_unref (offscreen->framebuffer);
+  cogl_handle_unref (offscreen->texture);
+  g_slice_free (StOffscreen, offscreen);
+}
+
+static void
+trim_idle_offscreens (void)
+{
+  while (idle_bytes > MAX_IDLE_BYTES)
+    {
+      GList *link = idle_offscreens.head;
+      StOffscreen *offscreen = link->data;
+
+      g_queue_unlink (&idle_offscreens, link);
+      idle_bytes -= OFFSCREEN_BYTES (offscreen);
+      offscreen_free (offscreen);
+    }
+}
+
+/**
+ * _st_offscreen_pool_acquire:
+ * @width: the width to render at
+ * @height: the height to render at
+ *
+ * Finds an unused render target of at least @width by @height pixels,
+ * creating one if needed. Its contents are undefined.
+ *
+ * Return value: a render target, to give back with
+ *   _st_offscreen_pool_release(), or %NULL if it could not be created
+ */
+StOffscreen *
+_st_offscreen_pool_acquire (guint width,
+                            guint height)
+{
+  StOffscreen *offscreen;
+  CoglHandle texture, framebuffer;
+  GList *l;
+
+  width = bucket_size (width);
+  height = bucket_size (height);
+
+  /* The most recently released target is the most likely to be resident */
+  for (l = idle_offscreens.tail; l; l = l->prev)
+    {
+      offscreen = l->data;
+
+      if (offscreen->width == width && offscreen->height == height)
+        {
+          g_queue_unlink (&idle_offscreens, l);
+          idle_bytes -= OFFSCREEN_BYTES (offscreen);
+          stats.n_reused++;
+
+          return offscreen;
+        }
+    }
+
+  texture = cogl_texture_new_with_size (width, height,
+                                        COGL_TEXTURE_NO_SLICING,
+                                        COGL_PIXEL_FORMAT_ANY);
+  if (texture == COGL_INVALID_HANDLE)
+    return NULL;
+
+  framebuffer = cogl_offscreen_new_to_texture (texture);
+  if (framebuffer == COGL_INVALID_HANDLE)
+    {
+      cogl_handle_unref (texture);
+      return NULL;
+    }
+
+  offscreen = g_slice_new0 (StOffscreen);
+  offscreen->texture = texture;
+  offscreen->framebuffer = framebuffer;
+  offscreen->width = width;
+  offscreen->height = height;
+  offscreen->link.data = offscreen;
+
+  stats.n_allocated++;
+  stats.total_bytes += OFFSCREEN_BYTES (offscreen);
+  stats.peak_bytes = MAX (stats.peak_bytes, stats.total_bytes);
+
+  return offscreen;
+}
+
+/**
+ * _st_offscreen_pool_release:
+ * @offscreen: (allow-none): a render target from _st_offscreen_pool_acquire()
+ *
+ * Gives @offscreen back to the pool.
+ */
+void
+_st_offscreen_pool_release (StOffscreen *offscreen)
+{
+  if (offscreen == NULL)
+    return;
+
+  g_queue_push_tail_link (&idle_offscreens, &offscreen->link);
+  idle_bytes += OFFSCREEN_BYTES (offscreen);
+
+  trim_idle_offscreens ();
+}
+
+/**
+ * _st_offscreen_pool_get_statistics:
+ * @n_reused: (out): number of targets handed out again from the pool
+ * @n_allocated: (out): number of targets that had to be created
+ * @total_bytes: (out): size of the textures of all existing targets
+ * @peak_bytes: (out): largest value @total_bytes ever had
+ */
+void
+_st_offscreen_pool_get_statistics (guint *n_reused,
+                                   guint *n_allocated,
+                                   gsize *total_bytes,
+                                   gsize *peak_bytes)
+{
+  *n_reused = stats.n_reused;
+  *n_allocated = stats.n_allocated;
+  *total_bytes = stats.total_bytes;
+  *peak_bytes = stats.peak_bytes;
+}
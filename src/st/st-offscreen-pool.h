@@ -0,0 +1,48 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-offscreen-pool.h: Offscreen render targets shared between transitions
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ST_OFFSCREEN_POOL_H__
+#define __ST_OFFSCREEN_POOL_H__
+
+#include <cogl/cogl.h>
+
+G_BEGIN_DECLS
+
+typedef struct {
+  CoglHandle texture;
+  CoglHandle framebuffer;
+
+  /* Size of the texture, which may be larger than what was asked for */
+  guint      width;
+  guint      height;
+
+  /*< private >*/
+  GList      link;
+} StOffscreen;
+
+StOffscreen *_st_offscreen_pool_acquire        (guint        width,
+                                                guint        height);
+void         _st_offscreen_pool_release        (StOffscreen *offscreen);
+
+void         _st_offscreen_pool_get_statistics (guint       *n_reused,
+                                                guint       *n_allocated,
+                                                gsize       *total_bytes,
+                                                gsize       *peak_bytes);
+
+G_END_DECLS
+
+#endif /* __ST_OFFSCREEN_POOL_H__ */
@@ -19,10 +19,10 @@
  * You should have received a copy of the GNU Lesser General Public License
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
-#include <math.h>
-#include <string.h>
 
+#include "st-blur.h"
 #include "st-private.h"
+#include "st-shadow-cache.h"
 
 /**
  * _st_actor_get_preferred_width:
@@ -391,153 +391,13 @@ _st_create_texture_material (CoglHandle src_texture)
  * Shadows
  *****/
 
-static gdouble *
-calculate_gaussian_kernel (gdouble   sigma,
-                           guint     n_values)
-{
-  gdouble *ret, sum;
-  gdouble exp_divisor;
-  gint half, i;
-
-  g_return_val_if_fail (sigma > 0, NULL);
-
-  half = n_values / 2;
-
-  ret = g_malloc (n_values * sizeof (gdouble));
-  sum = 0.0;
-
-  exp_divisor = 2 * sigma * sigma;
-
-  /* n_values of 1D Gauss function */
-  for (i = 0; i < n_values; i++)
-    {
-      ret[i] = exp (-(i - half) * (i - half) / exp_divisor);
-      sum += ret[i];
-    }
-
-  /* normalize */
-  for (i = 0; i < n_values; i++)
-    ret[i] /= sum;
-
-  return ret;
-}
-
-static guchar *
-blur_pixels (guchar  *pixels_in,
-             gint     width_in,
-             gint     height_in,
-             gint     rowstride_in,
-             gdouble  blur,
-             gint    *width_out,
-             gint    *height_out,
-             gint    *rowstride_out)
-{
-  guchar *pixels_out;
-  float   sigma;
-
-  /* The CSS specification defines (or will define) the blur radius as twice
-   * the Gaussian standard deviation. See:
-   *
-   * http://lists.w3.org/Archives/Public/www-style/2010Sep/0002.html
-   */
-  sigma = blur / 2.;
-
-  if ((guint) blur == 0)
-    {
-      *width_out  = width_in;
-      *height_out = height_in;
-      *rowstride_out = rowstride_in;
-      pixels_out = g_memdup (pixels_in, *rowstride_out * *height_out);
-    }
-  else
-    {
-      gdouble *kernel;
-      guchar  *line;
-      gint     n_values, half;
-      gint     x_in, y_in, x_out, y_out, i;
-
-      n_values = (gint) 5 * sigma;
-      half = n_values / 2;
-
-      *width_out  = width_in  + 2 * half;
-      *height_out = height_in + 2 * half;
-      *rowstride_out = (*width_out + 3) & ~3;
-
-      pixels_out = g_malloc0 (*rowstride_out * *height_out);
-      line       = g_malloc0 (*rowstride_out);
-
-      kernel = calculate_gaussian_kernel (sigma, n_values);
-
-      /* vertical blur */
-      for (x_in = 0; x_in < width_in; x_in++)
-        for (y_out = 0; y_out < *height_out; y_out++)
-          {
-            guchar *pixel_in, *pixel_out;
-            gint i0, i1;
-
-            y_in = y_out - half;
-
-            /* We read from the source at 'y = y_in + i - half'; clamp the
-             * full i range [0, n_values) so that y is in [0, height_in).
-             */
-            i0 = MAX (half - y_in, 0);
-            i1 = MIN (height_in + half - y_in, n_values);
-
-            pixel_in  =  pixels_in + (y_in + i0 - half) * rowstride_in + x_in;
-            pixel_out =  pixels_out + y_out * *rowstride_out + (x_in + half);
-
-            for (i = i0; i < i1; i++)
-              {
-                *pixel_out += *pixel_in * kernel[i];
-                pixel_in += rowstride_in;
-              }
-          }
-
-      /* horizontal blur */
-      for (y_out = 0; y_out < *height_out; y_out++)
-        {
-          memcpy (line, pixels_out + y_out * *rowstride_out, *rowstride_out);
-
-          for (x_out = 0; x_out < *width_out; x_out++)
-            {
-              gint i0, i1;
-              guchar *pixel_out, *pixel_in;
-
-              /* We read from the source at 'x = x_out + i - half'; clamp the
-               * full i range [0, n_values) so that x is in [0, width_out).
-               */
-              i0 = MAX (half - x_out, 0);
-              i1 = MIN (*width_out + half - x_out, n_values);
-
-              pixel_in  = line + x_out + i0 - half;
-              pixel_out = pixels_out + *rowstride_out * y_out + x_out;
-
-              *pixel_out = 0;
-              for (i = i0; i < i1; i++)
-                {
-                  *pixel_out += *pixel_in * kernel[i];
-                  pixel_in++;
-                }
-            }
-        }
-      g_free (kernel);
-      g_free (line);
-    }
-
-  return pixels_out;
-}
-
 CoglHandle
 _st_create_shadow_material (StShadow   *shadow_spec,
                             CoglHandle  src_texture)
 {
-  static CoglHandle shadow_material_template = COGL_INVALID_HANDLE;
-
   CoglHandle  material;
-  CoglHandle  texture;
-  guchar     *pixels_in, *pixels_out;
+  guchar     *pixels_in;
   gint        width_in, height_in, rowstride_in;
-  gint        width_out, height_out, rowstride_out;
 
   g_return_val_if_fail (shadow_spec != NULL, COGL_INVALID_HANDLE);
   g_return_val_if_fail (src_texture != COGL_INVALID_HANDLE,
@@ -552,39 +412,11 @@ _st_create_shadow_material (StShadow   *shadow_spec,
   cogl_texture_get_data (src_texture, COGL_PIXEL_FORMAT_A_8,
                          rowstride_in, pixels_in);
 
-  pixels_out = blur_pixels (pixels_in, width_in, height_in, rowstride_in,
-                            shadow_spec->blur,
-                            &width_out, &height_out, &rowstride_out);
+  /* Identical shadows share a single blurred texture */
+  material = _st_shadow_cache_create_material (shadow_spec, pixels_in,
+                                               width_in, height_in, rowstride_in);
   g_free (pixels_in);
 
-  texture = cogl_texture_new_from_data (width_out,
-                                        height_out,
-                                        COGL_TEXTURE_NONE,
-                                        COGL_PIXEL_FORMAT_A_8,
-                                        COGL_PIXEL_FORMAT_A_8,
-                                        rowstride_out,
-                                        pixels_out);
-
-  g_free (pixels_out);
-
-  if (G_UNLIKELY (shadow_material_template == COGL_INVALID_HANDLE))
-    {
-      shadow_material_template = cogl_material_new ();
-
-      /* We set up the material to blend the shadow texture with the combine
-       * constant, but defer setting the latter until painting, so that we can
-       * take the actor's overall opacity into account. */
-      cogl_material_set_layer_combine (shadow_material_template, 0,
-                                       "RGBA = MODULATE (CONSTANT, TEXTURE[A])",
-                                       NULL);
-    }
-
-  material = cogl_material_copy (shadow_material_template);
-
-  cogl_material_set_layer (material, 0, texture);
-
-  cogl_handle_unref (texture);
-
   return material;
 }
 
@@ -708,9 +540,9 @@ _st_create_shadow_cairo_pattern (StShadow        *shadow_spec,
   pixels_in = cairo_image_surface_get_data (surface_in);
   rowstride_in = cairo_image_surface_get_stride (surface_in);
 
-  pixels_out = blur_pixels (pixels_in, width_in, height_in, rowstride_in,
-                            shadow_spec->blur,
-                            &width_out, &height_out, &rowstride_out);
+  pixels_out = _st_blur_alpha (pixels_in, width_in, height_in, rowstride_in,
+                               shadow_spec->blur,
+                               &width_out, &height_out, &rowstride_out);
   cairo_surface_destroy (surface_in);
 
   /* Invert pixels for inset shadows */
@@ -0,0 +1,258 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-shadow-cache.c: Blurred shadow textures shared between actors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Many actors have identical shadows: all the buttons of a window list,
+ * the items of a menu, the icons of an app grid. The blurred texture of
+ * a shadow only depends on the blur radius and on the alpha mask of what
+ * is being shadowed, so it is blurred once and shared.
+ *
+ * Each material handed out holds a reference on its entry, dropped when
+ * the material is destroyed. Entries nobody uses anymore are kept around
+ * in least recently used order, up to MAX_IDLE_BYTES, since the same
+ * shadow is usually asked for again soon, for instance when a menu is
+ * reopened.
+ */
+
+#include <string.h>
+
+#include "st-blur.h"
+#include "st-shadow-cache.h"
+
+/* How much texture data to keep for shadows that are currently unused */
+#define MAX_IDLE_BYTES (4 * 1024 * 1024)
+
+typedef struct {
+  /* Key */
+  gdouble     blur;
+  gint        width;
+  gint        height;
+  guint       hash;
+  guchar     *mask;    /* width * height, without padding */
+
+  CoglHandle  texture;
+  gsize       bytes;
+  guint       ref_count;
+  GList      *idle_link;
+} ShadowCacheEntry;
+
+static GHashTable *shadow_cache = NULL;
+static GQueue      idle_entries = G_QUEUE_INIT;
+static gsize       idle_bytes = 0;
+static CoglUserDataKey shadow_entry_key;
+
+static guint
+shadow_cache_entry_hash (gconstpointer data)
+{
+  const ShadowCacheEntry *entry = data;
+
+  return entry->hash;
+}
+
+static gboolean
+shadow_cache_entry_equal (gconstpointer a,
+                          gconstpointer b)
+{
+  const ShadowCacheEntry *entry_a = a;
+  const ShadowCacheEntry *entry_b = b;
+
+  return entry_a->hash == entry_b->hash &&
+         entry_a->blur == entry_b->blur &&
+         entry_a->width == entry_b->width &&
+         entry_a->height == entry_b->height &&
+         memcmp (entry_a->mask, entry_b->mask, entry_a->width * entry_a->height) == 0;
+}
+
+static void
+shadow_cache_entry_free (gpointer data)
+{
+  ShadowCacheEntry *entry = data;
+
+  if (entry->texture != COGL_INVALID_HANDLE)
+    cogl_handle_unref (entry->texture);
+  g_free (entry->mask);
+  g_slice_free (ShadowCacheEntry, entry);
+}
+
+/* FNV-1a over the mask and the parameters */
+static guint
+compute_hash (gdouble       blur,
+              const guchar *mask,
+              gint          width,
+              gint          height,
+              gint          rowstride)
+{
+  guint32 hash = 2166136261u;
+  gint x, y;
+
+  hash = (hash ^ (guint32) (blur * 16)) * 16777619u;
+  hash = (hash ^ (guint32) width) * 16777619u;
+  hash = (hash ^ (guint32) height) * 16777619u;
+
+  for (y = 0; y < height; y++)
+    {
+      const guchar *row = mask + y * rowstride;
+
+      for (x = 0; x < width; x++)
+        hash = (hash ^ row[x]) * 16777619u;
+    }
+
+  return hash;
+}
+
+static void
+trim_idle_entries (void)
+{
+  while (idle_bytes > MAX_IDLE_BYTES)
+    {
+      ShadowCacheEntry *entry = g_queue_pop_head (&idle_entries);
+
+      entry->idle_link = NULL;
+      idle_bytes -= entry->bytes;
+      g_hash_table_remove (shadow_cache, entry);
+    }
+}
+
+static void
+shadow_cache_entry_ref (ShadowCacheEntry *entry)
+{
+  if (entry->ref_count++ == 0 && entry->idle_link != NULL)
+    {
+      g_queue_delete_link (&idle_entries, entry->idle_link);
+      entry->idle_link = NULL;
+      idle_bytes -= entry->bytes;
+    }
+}
+
+static void
+shadow_cache_entry_unref (gpointer data)
+{
+  ShadowCacheEntry *entry = data;
+
+  if (--entry->ref_count > 0)
+    return;
+
+  g_queue_push_tail (&idle_entries, entry);
+  entry->idle_link = idle_entries.tail;
+  idle_bytes += entry->bytes;
+
+  trim_idle_entries ();
+}
+
+static CoglHandle
+create_material (ShadowCacheEntry *entry)
+{
+  static CoglHandle shadow_material_template = COGL_INVALID_HANDLE;
+  CoglHandle material;
+
+  if (G_UNLIKELY (shadow_material_template == COGL_INVALID_HANDLE))
+    {
+      shadow_material_template = cogl_material_new ();
+
+      /* We set up the material to blend the shadow texture with the combine
+       * constant, but defer setting the latter until painting, so that we can
+       * take the actor's overall opacity into account. */
+      cogl_material_set_layer_combine (shadow_material_template, 0,
+                                       "RGBA = MODULATE (CONSTANT, TEXTURE[A])",
+                                       NULL);
+    }
+
+  material = cogl_material_copy (shadow_material_template);
+
+  cogl_material_set_layer (material, 0, entry->texture);
+
+  shadow_cache_entry_ref (entry);
+  cogl_object_set_user_data (material, &shadow_entry_key,
+                             entry, shadow_cache_entry_unref);
+
+  return material;
+}
+
+/**
+ * _st_shadow_cache_create_material:
+ * @shadow_spec: the definition of the shadow
+ * @mask: the alpha mask of what is shadowed
+ * @width: width of @mask
+ * @height: height of @mask
+ * @rowstride: rowstride of @mask
+ *
+ * Creates a material painting a blurred version of @mask; the blurred
+ * texture is shared with every other shadow of the same blur radius
+ * over an identical mask.
+ *
+ * Return value: a new material
+ */
+CoglHandle
+_st_shadow_cache_create_material (StShadow     *shadow_spec,
+                                  const guchar *mask,
+                                  gint          width,
+                                  gint          height,
+                                  gint          rowstride)
+{
+  ShadowCacheEntry key, *entry;
+  guchar *pixels_out;
+  gint width_out, height_out, rowstride_out;
+  gint y;
+
+  g_return_val_if_fail (shadow_spec != NULL, COGL_INVALID_HANDLE);
+  g_return_val_if_fail (mask != NULL, COGL_INVALID_HANDLE);
+
+  if (G_UNLIKELY (shadow_cache == NULL))
+    shadow_cache = g_hash_table_new_full (shadow_cache_entry_hash,
+                                          shadow_cache_entry_equal,
+                                          shadow_cache_entry_free,
+                                          NULL);
+
+  /* The key keeps an unpadded copy of the mask, which is handed over to
+   * the new entry on a miss */
+  key.blur = shadow_spec->blur;
+  key.width = width;
+  key.height = height;
+  key.hash = compute_hash (shadow_spec->blur, mask, width, height, rowstride);
+  key.mask = g_malloc (width * height);
+  for (y = 0; y < height; y++)
+    memcpy (key.mask + y * width, mask + y * rowstride, width);
+
+  entry = g_hash_table_lookup (shadow_cache, &key);
+  if (entry != NULL)
+    {
+      g_free (key.mask);
+      return create_material (entry);
+    }
+
+  pixels_out = _st_blur_alpha (mask, width, height, rowstride,
+                               shadow_spec->blur,
+                               &width_out, &height_out, &rowstride_out);
+
+  entry = g_slice_new0 (ShadowCacheEntry);
+  *entry = key;
+  entry->texture = cogl_texture_new_from_data (width_out,
+                                               height_out,
+                                               COGL_TEXTURE_NONE,
+                                               COGL_PIXEL_FORMAT_A_8,
+                                               COGL_PIXEL_FORMAT_A_8,
+                                               rowstride_out,
+                                               pixels_out);
+  entry->bytes = width * height + rowstride_out * height_out;
+  entry->ref_count = 0;
+  entry->idle_link = NULL;
+
+  g_free (pixels_out);
+
+  g_hash_table_insert (shadow_cache, entry, entry);
+
+  return create_material (entry);
+}
@@ -0,0 +1,383 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-texture-atlas.c: Small textures packed into shared atlas pages
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* An atlas packs many small images into a few big textures, the pages,
+ * so that painting them doesn't need a texture bind each, and so that
+ * identical images, found by key, are only uploaded once.
+ *
+ * Each image is handed out as a sub-texture of its page. The atlas
+ * doesn't keep a reference on it: the region is given back when the last
+ * user drops the sub-texture. Where regions go within a page is up to
+ * StAtlasPacker, which recycles the space of freed regions.
+ *
+ * Images too big for a page get a page of their own, so that they can
+ * still be shared by key.
+ */
+
+#include <string.h>
+
+#include "st-atlas-packer.h"
+#include "st-texture-atlas.h"
+
+/* Transparent border around each region, so that filtering at the edges
+ * doesn't pick up the neighbours */
+#define REGION_PADDING 1
+
+typedef struct {
+  StTextureAtlas *atlas;
+  CoglHandle      texture;
+  gint            width;
+  gint            height;
+  StAtlasPacker  *packer;
+  guint           n_regions;
+  gsize           used_pixels;
+  gboolean        dedicated;
+} AtlasPage;
+
+
+typedef struct {
+  AtlasPage  *page;
+  CoglHandle  texture;     /* not owned */
+  char       *key;
+  gint        x;           /* of the padded rectangle */
+  gint        y;
+  gint        width;
+  gint        height;
+} AtlasRegion;
+
+struct _StTextureAtlas {
+  gint        page_width;
+  gint        page_height;
+  GList      *pages;
+  GHashTable *regions;     /* key => AtlasRegion, not owned */
+  guint       n_recycled;
+};
+
+static CoglUserDataKey region_key;
+
+/**
+ * _st_texture_atlas_new:
+ * @page_width: width of the atlas pages
+ * @page_height: height of the atlas pages
+ *
+ * Return value: a new, empty atlas
+ */
+StTextureAtlas *
+_st_texture_atlas_new (gint page_width,
+                       gint page_height)
+{
+  StTextureAtlas *atlas;
+
+  atlas = g_new0 (StTextureAtlas, 1);
+  atlas->page_width = page_width;
+  atlas->page_height = page_height;
+  atlas->regions = g_hash_table_new (g_str_hash, g_str_equal);
+
+  return atlas;
+}
+
+static AtlasPage *
+atlas_page_new (StTextureAtlas *atlas,
+                gint            width,
+                gint            height,
+                gboolean        dedicated)
+{
+  AtlasPage *page;
+
+  page = g_slice_new0 (AtlasPage);
+  page->atlas = atlas;
+  page->width = width;
+  page->height = height;
+  page->dedicated = dedicated;
+  page->texture = cogl_texture_new_with_size (width, height,
+                                              COGL_TEXTURE_NO_SLICING |
+                                              COGL_TEXTURE_NO_ATLAS,
+                                              COGL_PIXEL_FORMAT_RGBA_8888_PRE);
+
+  if (page->texture == COGL_INVALID_HANDLE)
+    {
+      g_slice_free (AtlasPage, page);
+      return NULL;
+    }
+
+  page->packer = _st_atlas_packer_new (width, height);
+  atlas->pages = g_list_prepend (atlas->pages, page);
+
+  return page;
+}
+
+static void
+atlas_page_free (AtlasPage *page)
+{
+  page->atlas->pages = g_list_remove (page->atlas->pages, page);
+
+  cogl_handle_unref (page->texture);
+  _st_atlas_packer_free (page->packer);
+  g_slice_free (AtlasPage, page);
+}
+
+/* Finds room for a @width x @height rectangle, padding included */
+static gboolean
+atlas_page_allocate (AtlasPage *page,
+                     gint       width,
+                     gint       height,
+                     gint      *x,
+                     gint      *y)
+{
+  gboolean recycled;
+
+  if (!_st_atlas_packer_allocate (page->packer, width, height, x, y, &recycled))
+    return FALSE;
+
+  if (recycled)
+    page->atlas->n_recycled++;
+
+  return TRUE;
+}
+
+static void
+atlas_region_free (gpointer data)
+{
+  AtlasRegion *region = data;
+  AtlasPage *page = region->page;
+  StTextureAtlas *atlas = page->atlas;
+
+  if (region->key != NULL)
+    {
+      if (g_hash_table_lookup (atlas->regions, region->key) == region)
+        g_hash_table_remove (atlas->regions, region->key);
+      g_free (region->key);
+    }
+
+  page->n_regions--;
+  page->used_pixels -= region->width * region->height;
+
+  if (!page->dedicated)
+    _st_atlas_packer_release (page->packer, region->x, region->y,
+                              region->width + 2 * REGION_PADDING);
+
+  if (page->n_regions == 0)
+    {
+      /* Keep one shared page around, the next region is never far */
+      if (page->dedicated || g_list_length (atlas->pages) > 1)
+        atlas_page_free (page);
+      else
+        _st_atlas_packer_clear (page->packer);
+    }
+
+  g_slice_free (AtlasRegion, region);
+}
+
+/**
+ * _st_texture_atlas_lookup:
+ * @atlas: a #StTextureAtlas
+ * @key: the key an image was added with
+ *
+ * Return value: a new reference to the sub-texture holding the image
+ *   added with @key, or %COGL_INVALID_HANDLE if it isn't in use anymore
+ */
+CoglHandle
+_st_texture_atlas_lookup (StTextureAtlas *atlas,
+                          const char     *key)
+{
+  AtlasRegion *region;
+
+  region = g_hash_table_lookup (atlas->regions, key);
+  if (region == NULL)
+    return COGL_INVALID_HANDLE;
+
+  return cogl_handle_ref (region->texture);
+}
+
+/**
+ * _st_texture_atlas_add:
+ * @atlas: a #StTextureAtlas
+ * @key: (allow-none): key to find the image again with
+ *   _st_texture_atlas_lookup(), or %NULL
+ * @width: width of the image
+ * @height: height of the image
+ * @format: format of @data, with 4 bytes per pixel
+ * @rowstride: rowstride of @data
+ * @data: the pixels of the image
+ *
+ * Uploads an image into the atlas.
+ *
+ * Return value: a sub-texture of an atlas page holding the image, or
+ *   %COGL_INVALID_HANDLE if no texture could be created
+ */
+CoglHandle
+_st_texture_atlas_add (StTextureAtlas  *atlas,
+                       const char      *key,
+                       gint             width,
+                       gint             height,
+                       CoglPixelFormat  format,
+                       gint             rowstride,
+                       const guchar    *data)
+{
+  AtlasPage *page = NULL;
+  AtlasRegion *region;
+  CoglHandle texture;
+  guchar *padded;
+  gint padded_width, padded_height, padded_rowstride;
+  gint x = 0, y = 0;
+  gint i;
+  GList *l;
+
+  g_return_val_if_fail (width > 0 && height > 0, COGL_INVALID_HANDLE);
+
+  padded_width = width + 2 * REGION_PADDING;
+  padded_height = height + 2 * REGION_PADDING;
+
+  if (padded_width > atlas->page_width || padded_height > atlas->page_height)
+    {
+      page = atlas_page_new (atlas, padded_width, padded_height, TRUE);
+      if (page == NULL)
+        return COGL_INVALID_HANDLE;
+    }
+  else
+    {
+      for (l = atlas->pages; l; l = l->next)
+        {
+          AtlasPage *candidate = l->data;
+
+          if (!candidate->dedicated &&
+              atlas_page_allocate (candidate, padded_width, padded_height, &x, &y))
+            {
+              page = candidate;
+              break;
+            }
+        }
+
+      if (page == NULL)
+        {
+          page = atlas_page_new (atlas, atlas->page_width, atlas->page_height, FALSE);
+          if (page == NULL)
+            return COGL_INVALID_HANDLE;
+
+          atlas_page_allocate (page, padded_width, padded_height, &x, &y);
+        }
+    }
+
+  /* Upload the padding along with the image, the page contents are
+   * undefined */
+  padded_rowstride = padded_width * 4;
+  padded = g_malloc0 (padded_rowstride * padded_height);
+  for (i = 0; i < height; i++)
+    memcpy (padded + (i + REGION_PADDING) * padded_rowstride + REGION_PADDING * 4,
+            data + i * rowstride,
+            width * 4);
+
+  cogl_texture_set_region (page->texture,
+                           0, 0,
+                           x, y,
+                           padded_width, padded_height,
+                           padded_width, padded_height,
+                           format,
+                           padded_rowstride,
+                           padded);
+  g_free (padded);
+
+  texture = cogl_texture_new_from_sub_texture (page->texture,
+                                               x + REGION_PADDING,
+                                               y + REGION_PADDING,
+                                               width, height);
+
+  region = g_slice_new0 (AtlasRegion);
+  region->page = page;
+  region->x = x;
+  region->y = y;
+  region->width = width;
+  region->height = height;
+  region->texture = texture;
+
+  page->n_regions++;
+  page->used_pixels += width * height;
+
+  if (key != NULL)
+    {
+      region->key = g_strdup (key);
+      g_hash_table_replace (atlas->regions, region->key, region);
+    }
+
+  cogl_object_set_user_data (texture, &region_key, region, atlas_region_free);
+
+  return texture;
+}
+
+/**
+ * _st_texture_atlas_get_page:
+ * @texture: a texture
+ *
+ * Return value: (transfer none): the atlas page @texture is a sub-texture
+ *   of, if it came from _st_texture_atlas_add(), or else @texture itself
+ */
+CoglHandle
+_st_texture_atlas_get_page (CoglHandle texture)
+{
+  AtlasRegion *region;
+
+  region = cogl_object_get_user_data (texture, &region_key);
+  if (region == NULL)
+    return texture;
+
+  return region->page->texture;
+}
+
+/**
+ * _st_texture_atlas_get_statistics:
+ * @atlas: a #StTextureAtlas
+ * @n_pages: (out): number of pages
+ * @n_regions: (out): number of images in use
+ * @used_pixels: (out): number of pixels used by the images
+ * @total_pixels: (out): number of pixels of all pages
+ */
+void
+_st_texture_atlas_get_statistics (StTextureAtlas *atlas,
+                                  guint          *n_pages,
+                                  guint          *n_regions,
+                                  gsize          *used_pixels,
+                                  gsize          *total_pixels)
+{
+  GList *l;
+
+  *n_pages = 0;
+  *n_regions = 0;
+  *used_pixels = 0;
+  *total_pixels = 0;
+
+  for (l = atlas->pages; l; l = l->next)
+    {
+      AtlasPage *page = l->data;
+
+      *n_pages += 1;
+      *n_regions += page->n_regions;
+      *used_pixels += page->used_pixels;
+      *total_pixels += (gsize) page->width * page->height;
+    }
+}
+
+/**
+ * _st_texture_atlas_get_n_recycled:
+ * @atlas: a #StTextureAtlas
+ *
+ * Return value: how many images were put into space freed by others
+ */
+guint
+_st_texture_atlas_get_n_recycled (StTextureAtlas *atlas)
+{
+  return atlas->n_recycled;
+}
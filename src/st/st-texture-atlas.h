@@ -0,0 +1,51 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * st-texture-atlas.h: Small textures packed into shared atlas pages
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ST_TEXTURE_ATLAS_H__
+#define __ST_TEXTURE_ATLAS_H__
+
+#include <cogl/cogl.h>
+
+G_BEGIN_DECLS
+
+typedef struct _StTextureAtlas StTextureAtlas;
+
+StTextureAtlas *_st_texture_atlas_new            (gint             page_width,
+                                                  gint             page_height);
+
+CoglHandle      _st_texture_atlas_lookup         (StTextureAtlas  *atlas,
+                                                  const char      *key);
+CoglHandle      _st_texture_atlas_add            (StTextureAtlas  *atlas,
+                                                  const char      *key,
+                                                  gint             width,
+                                                  gint             height,
+                                                  CoglPixelFormat  format,
+                                                  gint             rowstride,
+                                                  const guchar    *data);
+
+CoglHandle      _st_texture_atlas_get_page       (CoglHandle       texture);
+
+void            _st_texture_atlas_get_statistics (StTextureAtlas  *atlas,
+                                                  guint           *n_pages,
+                                                  guint           *n_regions,
+                                                  gsize           *used_pixels,
+                                                  gsize           *total_pixels);
+guint           _st_texture_atlas_get_n_recycled (StTextureAtlas  *atlas);
+
+G_END_DECLS
+
+#endif /* __ST_TEXTURE_ATLAS_H__ */
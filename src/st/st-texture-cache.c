@@ -22,6 +22,10 @@
 #include "config.h"
 
 #include "st-texture-cache.h"
+#include "st-content-hash.h"
+#include "st-decode-pool.h"
+#include "st-icon-cache.h"
+#include "st-texture-atlas.h"
 #include <gtk/gtk.h>
 #define GNOME_DESKTOP_USE_UNSTABLE_API
 #include <libgnome-desktop/gnome-desktop-thumbnail.h>
@@ -32,23 +36,116 @@
 #define CACHE_PREFIX_URI "uri:"
 #define CACHE_PREFIX_URI_FOR_CAIRO "uri-for-cairo:"
 #define CACHE_PREFIX_THUMBNAIL_URI "thumbnail-uri:"
-#define CACHE_PREFIX_RAW_CHECKSUM "raw-checksum:"
-#define CACHE_PREFIX_COMPRESSED_CHECKSUM "compressed-checksum:"
+
+/* Default limits on the texture memory held by the cache itself; textures
+ * still in use by actors stay alive after eviction, they just won't be
+ * shared with later loads anymore. */
+#define DEFAULT_CACHE_BUDGET (128 * 1024 * 1024)
+#define DEFAULT_THUMBNAIL_QUOTA (32 * 1024 * 1024)
+
+/* Threads decoding images at the same time */
+#define DEFAULT_DECODE_THREADS 4
+
+/* How much decoded image data to upload as textures per frame */
+#define DEFAULT_UPLOAD_BYTE_BUDGET (8 * 1024 * 1024)
+#define DEFAULT_UPLOAD_TIME_BUDGET 4000 /* microseconds */
+
+/* Icons up to this size are packed into shared textures */
+#define ICON_ATLAS_MAX_SIZE 48
+#define ICON_ATLAS_PAGE_SIZE 512
+
+/* Set on results of icon loads served from the icon cache */
+#define ICON_CACHE_IMAGE_KEY "st-icon-cache-image"
+
+typedef struct {
+  char *prefix;
+  gsize limit;
+  gsize used;
+} StTextureCacheQuota;
+
+/* Images passed in as data are cached by their contents and the
+ * parameters they are loaded with */
+typedef enum {
+  CONTENT_RAW_RGB,
+  CONTENT_RAW_RGBA,
+  CONTENT_COMPRESSED
+} StTextureCacheContentType;
+
+typedef struct {
+  StContentHash hash;
+  gint32 type;
+  gint32 width;
+  gint32 height;
+  gint32 rowstride;
+  gint32 size;      /* requested when decoding compressed data */
+} StTextureCacheContentKey;
+
+typedef struct {
+  StTextureCache *cache;
+  char *key; /* or NULL, for images cached by content */
+  StTextureCacheContentKey *content_key;
+  gpointer value; /* CoglHandle or cairo_surface_t * */
+  GDestroyNotify destroy;
+  gsize bytes;
+  StTextureCacheQuota *quota;
+  GList *lru_link;
+} StTextureCacheEntry;
 
 struct _StTextureCachePrivate
 {
   GtkIconTheme *icon_theme;
 
   /* Things that were loaded with a cache policy != NONE */
-  GHashTable *keyed_cache; /* char * -> CoglTexture* */
+  GHashTable *keyed_cache; /* char * -> StTextureCacheEntry * */
+  GHashTable *content_cache; /* StTextureCacheContentKey * -> StTextureCacheEntry * */
+  GQueue *lru; /* StTextureCacheEntry *, most recently used first */
+  GSList *quotas; /* StTextureCacheQuota * */
+  gsize budget;
+  gsize resident_bytes;
+  guint hits;
+  guint misses;
+  guint evictions;
+
   /* Presently this is used to de-duplicate requests for GIcons,
    * it could in theory be extended to async URL loading and other
    * cases too.
    */
   GHashTable *outstanding_requests; /* char * -> AsyncTextureLoadData * */
   GnomeDesktopThumbnailFactory *thumbnails;
+
+  StDecodePool *decode_pool;
+
+  /* Decoded loads waiting for their textures to be uploaded */
+  GQueue *pending_uploads; /* AsyncTextureLoadData * */
+  guint upload_repaint_id;
+  gsize upload_byte_budget;
+  gint64 upload_time_budget;
+  guint upload_frames;
+  guint frames_over_budget;
+
+  /* From the first load to the first time none is outstanding once
+   * startup is complete */
+  guint n_loading;
+  gboolean startup_complete;
+  gint64 first_load_time;
+  gint64 startup_load_time;
+
+  /* Small icons share textures; never freed, like the regions handed
+   * out from it, which may outlive the cache */
+  StTextureAtlas *icon_atlas;
+
+  /* What the actors we created painted, per frame */
+  guint paint_repaint_id;
+  CoglHandle last_painted_page;
+  guint frame_icons;
+  guint frame_binds;
+  guint last_frame_icons;
+  guint last_frame_binds;
 };
 
+typedef struct _AsyncTextureLoadData AsyncTextureLoadData;
+
+static void async_load_data_free (AsyncTextureLoadData *data);
 static void st_texture_cache_dispose (GObject *object);
 static void st_texture_cache_finalize (GObject *object);
 
@@ -82,6 +179,226 @@ set_texture_cogl_texture (ClutterTexture *clutter_texture, CoglHandle cogl_textu
   g_object_set (clutter_texture, "opacity", 255, NULL);
 }
 
+static gsize
+texture_byte_size (CoglHandle texture)
+{
+  /* Drivers store pretty much everything as 4 bytes per texel */
+  return (gsize) cogl_texture_get_width (texture) * cogl_texture_get_height (texture) * 4;
+}
+
+static gsize
+surface_byte_size (cairo_surface_t *surface)
+{
+  return (gsize) cairo_image_surface_get_stride (surface) * cairo_image_surface_get_height (surface);
+}
+
+static void
+cache_entry_free (gpointer p)
+{
+  StTextureCacheEntry *entry = p;
+  StTextureCachePrivate *priv = entry->cache->priv;
+
+  g_queue_delete_link (priv->lru, entry->lru_link);
+  priv->resident_bytes -= entry->bytes;
+  if (entry->quota)
+    entry->quota->used -= entry->bytes;
+
+  entry->destroy (entry->value);
+  g_free (entry->key);
+  if (entry->content_key)
+    g_slice_free (StTextureCacheContentKey, entry->content_key);
+  g_slice_free (StTextureCacheEntry, entry);
+}
+
+static guint
+content_key_hash (gconstpointer key)
+{
+  const StTextureCacheContentKey *content_key = key;
+
+  return (guint) content_key->hash.low;
+}
+
+static gboolean
+content_key_equal (gconstpointer a,
+                   gconstpointer b)
+{
+  const StTextureCacheContentKey *key_a = a;
+  const StTextureCacheContentKey *key_b = b;
+
+  /* Not memcmp(), the struct has padding at the end */
+  return key_a->hash.low == key_b->hash.low &&
+         key_a->hash.high == key_b->hash.high &&
+         key_a->type == key_b->type &&
+         key_a->width == key_b->width &&
+         key_a->height == key_b->height &&
+         key_a->rowstride == key_b->rowstride &&
+         key_a->size == key_b->size;
+}
+
+static void
+cache_evict_entry (StTextureCache      *cache,
+                   StTextureCacheEntry *entry)
+{
+  cache->priv->evictions++;
+  if (entry->content_key)
+    g_hash_table_remove (cache->priv->content_cache, entry->content_key);
+  else
+    g_hash_table_remove (cache->priv->keyed_cache, entry->key);
+}
+
+static void
+cache_enforce_limits (StTextureCache      *cache,
+                      StTextureCacheEntry *keep)
+{
+  StTextureCachePrivate *priv = cache->priv;
+  GList *l, *prev;
+
+  /* The entry just inserted is never evicted, callers may still be
+   * using the value without holding their own reference. */
+  if (keep->quota && keep->quota->used > keep->quota->limit)
+    {
+      for (l = priv->lru->tail; l && keep->quota->used > keep->quota->limit; l = prev)
+        {
+          StTextureCacheEntry *entry = l->data;
+
+          prev = l->prev;
+          if (entry != keep && entry->quota == keep->quota)
+            cache_evict_entry (cache, entry);
+        }
+    }
+
+  if (priv->budget == 0)
+    return;
+
+  while (priv->resident_bytes > priv->budget && priv->lru->tail->data != keep)
+    cache_evict_entry (cache, priv->lru->tail->data);
+}
+
+/* Counts a lookup that found @entry, or nothing, and returns its value */
+static gpointer
+cache_use_entry (StTextureCache      *cache,
+                 StTextureCacheEntry *entry)
+{
+  StTextureCachePrivate *priv = cache->priv;
+
+  if (entry == NULL)
+    {
+      priv->misses++;
+      return NULL;
+    }
+
+  priv->hits++;
+
+  g_queue_unlink (priv->lru, entry->lru_link);
+  g_queue_push_head_link (priv->lru, entry->lru_link);
+
+  return entry->value;
+}
+
+/* Returns the cached value for @key, or %NULL, without adding a reference */
+static gpointer
+cache_lookup (StTextureCache *cache,
+              const char     *key)
+{
+  return cache_use_entry (cache, g_hash_table_lookup (cache->priv->keyed_cache, key));
+}
+
+static gpointer
+cache_lookup_content (StTextureCache                 *cache,
+                      const StTextureCacheContentKey *key)
+{
+  return cache_use_entry (cache, g_hash_table_lookup (cache->priv->content_cache, key));
+}
+
+static StTextureCacheEntry *
+cache_entry_new (StTextureCache *cache,
+                 gpointer        value,
+                 gsize           bytes,
+                 GDestroyNotify  destroy)
+{
+  StTextureCacheEntry *entry;
+
+  entry = g_slice_new0 (StTextureCacheEntry);
+  entry->cache = cache;
+  entry->value = value;
+  entry->destroy = destroy;
+  entry->bytes = bytes;
+
+  return entry;
+}
+
+/* Accounts for an entry just added to one of the tables */
+static void
+cache_add_entry (StTextureCache      *cache,
+                 StTextureCacheEntry *entry)
+{
+  StTextureCachePrivate *priv = cache->priv;
+
+  g_queue_push_head (priv->lru, entry);
+  entry->lru_link = priv->lru->head;
+  priv->resident_bytes += entry->bytes;
+  if (entry->quota)
+    entry->quota->used += entry->bytes;
+
+  cache_enforce_limits (cache, entry);
+}
+
+/* Takes ownership of a reference to @value */
+static void
+cache_insert (StTextureCache *cache,
+              const char     *key,
+              gpointer        value,
+              gsize           bytes,
+              GDestroyNotify  destroy)
+{
+  StTextureCachePrivate *priv = cache->priv;
+  StTextureCacheEntry *entry;
+  GSList *iter;
+
+  entry = cache_entry_new (cache, value, bytes, destroy);
+  entry->key = g_strdup (key);
+
+  for (iter = priv->quotas; iter; iter = iter->next)
+    {
+      StTextureCacheQuota *quota = iter->data;
+
+      if (g_str_has_prefix (key, quota->prefix))
+        {
+          entry->quota = quota;
+          break;
+        }
+    }
+
+  /* Replacing an existing entry frees it, which fixes up the accounting */
+  g_hash_table_replace (priv->keyed_cache, entry->key, entry);
+
+  cache_add_entry (cache, entry);
+}
+
+static void
+cache_insert_texture (StTextureCache *cache,
+                      const char     *key,
+                      CoglHandle      texture)
+{
+  cache_insert (cache, key, texture, texture_byte_size (texture), cogl_handle_unref);
+}
+
+/* Takes ownership of a reference to @texture */
+static void
+cache_insert_content_texture (StTextureCache                 *cache,
+                              const StTextureCacheContentKey *key,
+                              CoglHandle                      texture)
+{
+  StTextureCacheEntry *entry;
+
+  entry = cache_entry_new (cache, texture, texture_byte_size (texture), cogl_handle_unref);
+  entry->content_key = g_slice_dup (StTextureCacheContentKey, key);
+
+  g_hash_table_replace (cache->priv->content_cache, entry->content_key, entry);
+
+  cache_add_entry (cache, entry);
+}
+
 static void
 st_texture_cache_class_init (StTextureCacheClass *klass)
 {
@@ -130,6 +447,26 @@ on_icon_theme_changed (GtkIconTheme   *icon_theme,
   g_signal_emit (cache, signals[ICON_THEME_CHANGED], 0);
 }
 
+static void
+prune_icon_cache_thread (GSimpleAsyncResult *result,
+                         GObject            *object,
+                         GCancellable       *cancellable)
+{
+  _st_icon_cache_prune ();
+}
+
+/* Keeps the on-disk icon cache bounded, behind everything else */
+static void
+prune_icon_cache (StTextureCache *cache)
+{
+  GSimpleAsyncResult *result;
+
+  result = g_simple_async_result_new (G_OBJECT (cache), NULL, NULL, prune_icon_cache);
+  _st_decode_pool_push (cache->priv->decode_pool, result, prune_icon_cache_thread,
+                        ST_DECODE_PRIORITY_BACKGROUND, NULL);
+  g_object_unref (result);
+}
+
 static void
 st_texture_cache_init (StTextureCache *self)
 {
@@ -140,10 +477,22 @@ st_texture_cache_init (StTextureCache *self)
                     G_CALLBACK (on_icon_theme_changed), self);
 
   self->priv->keyed_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                                   g_free, cogl_handle_unref);
+                                                   NULL, cache_entry_free);
+  self->priv->content_cache = g_hash_table_new_full (content_key_hash, content_key_equal,
+                                                    NULL, cache_entry_free);
+  self->priv->lru = g_queue_new ();
+  self->priv->budget = DEFAULT_CACHE_BUDGET;
+  st_texture_cache_set_prefix_quota (self, CACHE_PREFIX_THUMBNAIL_URI, DEFAULT_THUMBNAIL_QUOTA);
   self->priv->outstanding_requests = g_hash_table_new_full (g_str_hash, g_str_equal,
                                                             g_free, NULL);
   self->priv->thumbnails = gnome_desktop_thumbnail_factory_new (GNOME_DESKTOP_THUMBNAIL_SIZE_LARGE);
+  self->priv->decode_pool = _st_decode_pool_new (DEFAULT_DECODE_THREADS);
+  self->priv->pending_uploads = g_queue_new ();
+  self->priv->upload_byte_budget = DEFAULT_UPLOAD_BYTE_BUDGET;
+  self->priv->upload_time_budget = DEFAULT_UPLOAD_TIME_BUDGET;
+  self->priv->icon_atlas = _st_texture_atlas_new (ICON_ATLAS_PAGE_SIZE, ICON_ATLAS_PAGE_SIZE);
+
+  prune_icon_cache (self);
 }
 
 static void
@@ -163,6 +512,29 @@ st_texture_cache_dispose (GObject *object)
     g_hash_table_destroy (self->priv->keyed_cache);
   self->priv->keyed_cache = NULL;
 
+  if (self->priv->content_cache)
+    g_hash_table_destroy (self->priv->content_cache);
+  self->priv->content_cache = NULL;
+
+  if (self->priv->lru)
+    g_queue_free (self->priv->lru);
+  self->priv->lru = NULL;
+
+  if (self->priv->upload_repaint_id)
+    clutter_threads_remove_repaint_func (self->priv->upload_repaint_id);
+  self->priv->upload_repaint_id = 0;
+
+  if (self->priv->paint_repaint_id)
+    clutter_threads_remove_repaint_func (self->priv->paint_repaint_id);
+  self->priv->paint_repaint_id = 0;
+
+  if (self->priv->pending_uploads)
+    {
+      g_queue_foreach (self->priv->pending_uploads, (GFunc) async_load_data_free, NULL);
+      g_queue_free (self->priv->pending_uploads);
+    }
+  self->priv->pending_uploads = NULL;
+
   if (self->priv->outstanding_requests)
     g_hash_table_destroy (self->priv->outstanding_requests);
   self->priv->outstanding_requests = NULL;
@@ -174,9 +546,23 @@ st_texture_cache_dispose (GObject *object)
   G_OBJECT_CLASS (st_texture_cache_parent_class)->dispose (object);
 }
 
+static void
+free_quota (gpointer data)
+{
+  StTextureCacheQuota *quota = data;
+
+  g_free (quota->prefix);
+  g_free (quota);
+}
+
 static void
 st_texture_cache_finalize (GObject *object)
 {
+  StTextureCache *self = (StTextureCache*)object;
+
+  g_slist_free_full (self->priv->quotas, free_quota);
+  _st_decode_pool_free (self->priv->decode_pool);
+
   G_OBJECT_CLASS (st_texture_cache_parent_class)->finalize (object);
 }
 
@@ -191,6 +577,8 @@ typedef struct {
   gint width;
   gint height;
   StIconColors *colors;
+  char *icon_file;
+  char *icon_cache_path;
   gpointer user_data;
 } AsyncIconLookupData;
 
@@ -330,6 +718,8 @@ icon_lookup_data_destroy (gpointer p)
     gtk_recent_info_unref (data->recent_info);
   if (data->colors)
     st_icon_colors_unref (data->colors);
+  g_free (data->icon_file);
+  g_free (data->icon_cache_path);
 
   g_free (data);
 }
@@ -627,7 +1017,24 @@ load_pixbuf_thread (GSimpleAsyncResult *result,
   else if (data->uri)
     pixbuf = impl_load_pixbuf_file (data->uri, data->width, data->height, &error);
   else if (data->icon)
-    pixbuf = impl_load_pixbuf_gicon (data->icon, data->icon_info, data->width, data->colors, &error);
+    {
+      if (data->icon_cache_path)
+        {
+          StIconCacheImage *image = _st_icon_cache_load (data->icon_cache_path, data->icon_file);
+
+          if (image)
+            {
+              g_object_set_data_full (G_OBJECT (result), ICON_CACHE_IMAGE_KEY, image,
+                                      (GDestroyNotify) _st_icon_cache_image_free);
+              return;
+            }
+        }
+
+      pixbuf = impl_load_pixbuf_gicon (data->icon, data->icon_info, data->width, data->colors, &error);
+
+      if (pixbuf && data->icon_cache_path)
+        _st_icon_cache_store (data->icon_cache_path, data->icon_file, pixbuf, TRUE);
+    }
   else
     g_assert_not_reached ();
 
@@ -647,6 +1054,9 @@ load_pixbuf_thread (GSimpleAsyncResult *result,
  *
  * Asynchronously load the #GdkPixbuf associated with a #GIcon.  Currently
  * the #GtkIconInfo must have already been provided.
+ *
+ * If @key is not %NULL, the icon is looked up in the icon cache under
+ * it first, and stored there once decoded.
  */
 static void
 load_icon_pixbuf_async (StTextureCache       *cache,
@@ -654,12 +1064,14 @@ load_icon_pixbuf_async (StTextureCache       *cache,
                         GtkIconInfo          *icon_info,
                         gint                  size,
                         StIconColors         *colors,
+                        const char           *key,
                         GCancellable         *cancellable,
                         GAsyncReadyCallback   callback,
                         gpointer              user_data)
 {
   GSimpleAsyncResult *result;
   AsyncIconLookupData *data;
+  const char *filename;
 
   data = g_new0 (AsyncIconLookupData, 1);
   data->cache = cache;
@@ -672,10 +1084,23 @@ load_icon_pixbuf_async (StTextureCache       *cache,
     data->colors = NULL;
   data->user_data = user_data;
 
+  /* Builtin icons have no file */
+  filename = gtk_icon_info_get_filename (icon_info);
+  if (key && filename)
+    {
+      char *theme_name;
+
+      g_object_get (gtk_settings_get_default (), "gtk-icon-theme-name", &theme_name, NULL);
+      data->icon_file = g_strdup (filename);
+      data->icon_cache_path = _st_icon_cache_get_path (theme_name, filename, key);
+      g_free (theme_name);
+    }
+
   result = g_simple_async_result_new (G_OBJECT (cache), callback, user_data, load_icon_pixbuf_async);
 
   g_object_set_data_full (G_OBJECT (result), "load_pixbuf_async", data, icon_lookup_data_destroy);
-  g_simple_async_result_run_in_thread (result, load_pixbuf_thread, G_PRIORITY_DEFAULT, cancellable);
+  _st_decode_pool_push (cache->priv->decode_pool, result, load_pixbuf_thread,
+                        ST_DECODE_PRIORITY_VISIBLE, cancellable);
 
   g_object_unref (result);
 }
@@ -702,11 +1127,14 @@ load_uri_pixbuf_async (StTextureCache     *cache,
   result = g_simple_async_result_new (G_OBJECT (cache), callback, user_data, load_uri_pixbuf_async);
 
   g_object_set_data_full (G_OBJECT (result), "load_pixbuf_async", data, icon_lookup_data_destroy);
-  g_simple_async_result_run_in_thread (result, load_pixbuf_thread, G_PRIORITY_DEFAULT, cancellable);
+  _st_decode_pool_push (cache->priv->decode_pool, result, load_pixbuf_thread,
+                        ST_DECODE_PRIORITY_VISIBLE, cancellable);
 
   g_object_unref (result);
 }
 
+/* Thumbnails are the largest images and come in bulk; they only start
+ * decoding once no icon waits */
 static void
 load_thumbnail_async (StTextureCache     *cache,
                       const char         *uri,
@@ -731,11 +1159,13 @@ load_thumbnail_async (StTextureCache     *cache,
   result = g_simple_async_result_new (G_OBJECT (cache), callback, user_data, load_thumbnail_async);
 
   g_object_set_data_full (G_OBJECT (result), "load_pixbuf_async", data, icon_lookup_data_destroy);
-  g_simple_async_result_run_in_thread (result, load_pixbuf_thread, G_PRIORITY_DEFAULT, cancellable);
+  _st_decode_pool_push (cache->priv->decode_pool, result, load_pixbuf_thread,
+                        ST_DECODE_PRIORITY_PREFETCH, cancellable);
 
   g_object_unref (result);
 }
 
+/* A recent files menu asks for hundreds of these at once */
 static void
 load_recent_thumbnail_async (StTextureCache     *cache,
                              GtkRecentInfo      *info,
@@ -758,7 +1188,8 @@ load_recent_thumbnail_async (StTextureCache     *cache,
   result = g_simple_async_result_new (G_OBJECT (cache), callback, user_data, load_recent_thumbnail_async);
 
   g_object_set_data_full (G_OBJECT (result), "load_pixbuf_async", data, icon_lookup_data_destroy);
-  g_simple_async_result_run_in_thread (result, load_pixbuf_thread, G_PRIORITY_DEFAULT, cancellable);
+  _st_decode_pool_push (cache->priv->decode_pool, result, load_pixbuf_thread,
+                        ST_DECODE_PRIORITY_BACKGROUND, cancellable);
 
   g_object_unref (result);
 }
@@ -772,7 +1203,8 @@ load_pixbuf_async_finish (StTextureCache *cache, GAsyncResult *result, GError **
   return g_simple_async_result_get_op_res_gpointer (simple);
 }
 
-typedef struct {
+struct _AsyncTextureLoadData {
+  StTextureCache *cache;
   StTextureCachePolicy policy;
   char *key;
   char *uri;
@@ -786,7 +1218,66 @@ typedef struct {
   guint width;
   guint height;
   GSList *textures;
-} AsyncTextureLoadData;
+  GCancellable *cancellable;
+  /* Decoded or read from the icon cache, waiting for upload */
+  GdkPixbuf *pixbuf;
+  StIconCacheImage *image;
+};
+
+static void
+on_texture_destroyed (ClutterActor         *texture,
+                      AsyncTextureLoadData *data)
+{
+  GHashTable *outstanding_requests = data->cache->priv->outstanding_requests;
+
+  data->textures = g_slist_remove (data->textures, texture);
+  g_signal_handlers_disconnect_by_func (texture, on_texture_destroyed, data);
+  g_object_unref (texture);
+
+  /* Nothing shows the image anymore: don't decode it if that hasn't
+   * started yet, and don't let new requests wait for it */
+  if (data->textures == NULL)
+    {
+      g_cancellable_cancel (data->cancellable);
+
+      if (outstanding_requests &&
+          g_hash_table_lookup (outstanding_requests, data->key) == data)
+        g_hash_table_remove (outstanding_requests, data->key);
+    }
+}
+
+static void
+async_load_add_texture (StTextureCache       *cache,
+                        AsyncTextureLoadData *data,
+                        ClutterTexture       *texture)
+{
+  if (data->cancellable == NULL)
+    {
+      data->cache = cache;
+      data->cancellable = g_cancellable_new ();
+    }
+
+  data->textures = g_slist_prepend (data->textures, g_object_ref (texture));
+  g_signal_connect (texture, "destroy", G_CALLBACK (on_texture_destroyed), data);
+}
+
+static void
+async_load_release_textures (AsyncTextureLoadData *data)
+{
+  GSList *iter;
+
+  for (iter = data->textures; iter; iter = iter->next)
+    {
+      g_signal_handlers_disconnect_by_func (iter->data, on_texture_destroyed, data);
+      g_object_unref (iter->data);
+    }
+  g_slist_free (data->textures);
+  data->textures = NULL;
+
+  if (data->cancellable)
+    g_object_unref (data->cancellable);
+  data->cancellable = NULL;
+}
 
 static CoglHandle
 pixbuf_to_cogl_handle (GdkPixbuf *pixbuf,
@@ -893,42 +1384,137 @@ load_pixbuf_fallback(AsyncTextureLoadData *data)
 }
 
 static void
-on_pixbuf_loaded (GObject      *source,
-                  GAsyncResult *result,
-                  gpointer      user_data)
+async_load_data_free (AsyncTextureLoadData *data)
 {
-  GSList *iter;
-  StTextureCache *cache;
-  AsyncTextureLoadData *data;
-  GdkPixbuf *pixbuf;
-  GError *error = NULL;
-  CoglHandle texdata = NULL;
+  g_free (data->key);
 
-  data = user_data;
-  cache = ST_TEXTURE_CACHE (source);
+  if (data->icon)
+    {
+      gtk_icon_info_free (data->icon_info);
+      g_object_unref (data->icon);
+    }
+  else if (data->uri)
+    g_free (data->uri);
 
-  g_hash_table_remove (cache->priv->outstanding_requests, data->key);
+  if (data->recent_info)
+    gtk_recent_info_unref (data->recent_info);
+  if (data->mimetype)
+    g_free (data->mimetype);
+  if (data->pixbuf)
+    g_object_unref (data->pixbuf);
+  if (data->image)
+    _st_icon_cache_image_free (data->image);
 
-  pixbuf = load_pixbuf_async_finish (cache, result, &error);
-  if (pixbuf == NULL)
-    pixbuf = load_pixbuf_fallback (data);
-  if (pixbuf == NULL)
-    goto out;
+  async_load_release_textures (data);
 
-  texdata = pixbuf_to_cogl_handle (pixbuf, data->enforced_square);
+  g_free (data);
+}
 
-  g_object_unref (pixbuf);
+static void
+start_texture_load (StTextureCache *cache)
+{
+  if (cache->priv->first_load_time == 0)
+    cache->priv->first_load_time = g_get_monotonic_time ();
 
-  if (data->policy != ST_TEXTURE_CACHE_POLICY_NONE)
+  cache->priv->n_loading++;
+}
+
+static void
+finish_texture_load (StTextureCache       *cache,
+                     AsyncTextureLoadData *data)
+{
+  StTextureCachePrivate *priv = cache->priv;
+
+  if (g_hash_table_lookup (priv->outstanding_requests, data->key) == data)
+    g_hash_table_remove (priv->outstanding_requests, data->key);
+
+  async_load_data_free (data);
+
+  if (--priv->n_loading == 0 && priv->startup_complete && priv->startup_load_time == 0)
+    priv->startup_load_time = g_get_monotonic_time () - priv->first_load_time;
+}
+
+static gsize
+upload_byte_size (AsyncTextureLoadData *data)
+{
+  if (data->image)
+    return (gsize) data->image->rowstride * data->image->height;
+  else
+    return (gsize) gdk_pixbuf_get_width (data->pixbuf) * gdk_pixbuf_get_height (data->pixbuf) * 4;
+}
+
+/* Puts small icons into the atlas, so that painting several of them
+ * doesn't switch textures each time */
+static CoglHandle
+atlas_icon_texture (StTextureCache       *cache,
+                    AsyncTextureLoadData *data)
+{
+  gint width, height;
+
+  if (data->icon == NULL)
+    return COGL_INVALID_HANDLE;
+
+  if (data->image)
     {
-      gpointer orig_key, value;
+      if (data->image->width > ICON_ATLAS_MAX_SIZE || data->image->height > ICON_ATLAS_MAX_SIZE)
+        return COGL_INVALID_HANDLE;
+
+      return _st_texture_atlas_add (cache->priv->icon_atlas, NULL,
+                                    data->image->width, data->image->height,
+                                    COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                    data->image->rowstride,
+                                    data->image->pixels);
+    }
+
+  width = gdk_pixbuf_get_width (data->pixbuf);
+  height = gdk_pixbuf_get_height (data->pixbuf);
+
+  /* Padding to a square is left to pixbuf_to_cogl_handle() */
+  if (width > ICON_ATLAS_MAX_SIZE || height > ICON_ATLAS_MAX_SIZE ||
+      (data->enforced_square && width != height) ||
+      !gdk_pixbuf_get_has_alpha (data->pixbuf) ||
+      gdk_pixbuf_get_bits_per_sample (data->pixbuf) != 8)
+    return COGL_INVALID_HANDLE;
+
+  return _st_texture_atlas_add (cache->priv->icon_atlas, NULL,
+                                width, height,
+                                COGL_PIXEL_FORMAT_RGBA_8888,
+                                gdk_pixbuf_get_rowstride (data->pixbuf),
+                                gdk_pixbuf_get_pixels (data->pixbuf));
+}
 
-      if (!g_hash_table_lookup_extended (cache->priv->keyed_cache, data->key,
-                                         &orig_key, &value))
+static void
+upload_texture (StTextureCache       *cache,
+                AsyncTextureLoadData *data)
+{
+  GSList *iter;
+  CoglHandle texdata;
+
+  texdata = atlas_icon_texture (cache, data);
+  if (texdata == COGL_INVALID_HANDLE)
+    {
+      if (data->image)
+        texdata = cogl_texture_new_from_data (data->image->width,
+                                              data->image->height,
+                                              COGL_TEXTURE_NONE,
+                                              COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                              COGL_PIXEL_FORMAT_ANY,
+                                              data->image->rowstride,
+                                              data->image->pixels);
+      else
+        texdata = pixbuf_to_cogl_handle (data->pixbuf, data->enforced_square);
+    }
+
+  /* Leave the textures empty, as for images that failed to load */
+  if (texdata == COGL_INVALID_HANDLE)
+    return;
+
+  if (data->policy != ST_TEXTURE_CACHE_POLICY_NONE)
+    {
+      if (!g_hash_table_lookup (cache->priv->keyed_cache, data->key))
         {
           cogl_handle_ref (texdata);
-          g_hash_table_insert (cache->priv->keyed_cache, g_strdup (data->key),
-                               texdata);
+          cache_insert_texture (cache, data->key, texdata);
         }
     }
 
@@ -938,34 +1524,142 @@ on_pixbuf_loaded (GObject      *source,
       set_texture_cogl_texture (texture, texdata);
     }
 
-out:
-  if (texdata)
-    cogl_handle_unref (texdata);
-  g_free (data->key);
+  cogl_handle_unref (texdata);
+}
 
-  if (data->icon)
+static gboolean
+async_load_is_visible (AsyncTextureLoadData *data)
+{
+  GSList *iter;
+
+  for (iter = data->textures; iter; iter = iter->next)
+    if (CLUTTER_ACTOR_IS_MAPPED (iter->data))
+      return TRUE;
+
+  return FALSE;
+}
+
+static void
+queue_upload_frame (void)
+{
+  ClutterActor *stage;
+
+  stage = CLUTTER_ACTOR (clutter_stage_manager_get_default_stage (clutter_stage_manager_get_default ()));
+  if (stage)
+    clutter_actor_queue_redraw (stage);
+}
+
+/* Runs before each frame is painted while uploads are pending. Loads
+ * with a texture on screen go first, then the others in the order they
+ * were decoded. Uploads stop once the budget of the frame is used up,
+ * but at least one is done per frame so that the queue always drains.
+ */
+static gboolean
+upload_pending_textures (gpointer user_data)
+{
+  StTextureCache *cache = user_data;
+  StTextureCachePrivate *priv = cache->priv;
+  GQueue hidden = G_QUEUE_INIT;
+  AsyncTextureLoadData *data;
+  guint i, n_pending, n_uploads = 0;
+  gint64 start, elapsed = 0;
+  gsize bytes = 0;
+
+  n_pending = g_queue_get_length (priv->pending_uploads);
+  for (i = 0; i < n_pending; i++)
     {
-      gtk_icon_info_free (data->icon_info);
-      g_object_unref (data->icon);
+      data = g_queue_pop_head (priv->pending_uploads);
+      if (async_load_is_visible (data))
+        g_queue_push_tail (priv->pending_uploads, data);
+      else
+        g_queue_push_tail (&hidden, data);
     }
-  else if (data->uri)
-    g_free (data->uri);
+  while ((data = g_queue_pop_head (&hidden)))
+    g_queue_push_tail (priv->pending_uploads, data);
 
-  if (data->recent_info)
-    gtk_recent_info_unref (data->recent_info);
-  if (data->mimetype)
-    g_free (data->mimetype);
+  start = g_get_monotonic_time ();
 
-  /* Alternatively we could weakref and just do nothing if the texture
-     is destroyed */
-  for (iter = data->textures; iter; iter = iter->next)
+  while ((data = g_queue_peek_head (priv->pending_uploads)))
     {
-      ClutterTexture *texture = iter->data;
-      g_object_unref (texture);
+      gsize size = upload_byte_size (data);
+
+      if (n_uploads > 0 &&
+          (bytes + size > priv->upload_byte_budget ||
+           elapsed >= priv->upload_time_budget))
+        break;
+
+      g_queue_pop_head (priv->pending_uploads);
+
+      /* Nothing shows it and it won't be cached */
+      if (data->textures == NULL && data->policy == ST_TEXTURE_CACHE_POLICY_NONE)
+        {
+          finish_texture_load (cache, data);
+          continue;
+        }
+
+      upload_texture (cache, data);
+      finish_texture_load (cache, data);
+
+      bytes += size;
+      n_uploads++;
+      elapsed = g_get_monotonic_time () - start;
     }
 
-  g_clear_error (&error);
-  g_free (data);
+  if (n_uploads > 0)
+    {
+      priv->upload_frames++;
+      if (bytes > priv->upload_byte_budget || elapsed > priv->upload_time_budget)
+        priv->frames_over_budget++;
+    }
+
+  if (g_queue_is_empty (priv->pending_uploads))
+    {
+      priv->upload_repaint_id = 0;
+      return FALSE;
+    }
+
+  queue_upload_frame ();
+  return TRUE;
+}
+
+static void
+on_pixbuf_loaded (GObject      *source,
+                  GAsyncResult *result,
+                  gpointer      user_data)
+{
+  StTextureCache *cache;
+  AsyncTextureLoadData *data;
+  GdkPixbuf *pixbuf;
+  GError *error = NULL;
+
+  data = user_data;
+  cache = ST_TEXTURE_CACHE (source);
+
+  data->image = g_object_steal_data (G_OBJECT (result), ICON_CACHE_IMAGE_KEY);
+  if (data->image == NULL)
+    {
+      pixbuf = load_pixbuf_async_finish (cache, result, &error);
+      if (pixbuf == NULL && !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        pixbuf = load_pixbuf_fallback (data);
+      g_clear_error (&error);
+
+      if (pixbuf == NULL)
+        {
+          finish_texture_load (cache, data);
+          return;
+        }
+
+      data->pixbuf = pixbuf;
+    }
+
+  /* The request stays outstanding until the upload, so that loads of
+   * the same key still join it rather than decoding it again */
+  g_queue_push_tail (cache->priv->pending_uploads, data);
+
+  if (cache->priv->upload_repaint_id == 0)
+    cache->priv->upload_repaint_id =
+      clutter_threads_add_repaint_func (upload_pending_textures, cache, NULL);
+  queue_upload_frame ();
 }
 
 typedef struct {
@@ -1097,12 +1791,12 @@ st_texture_cache_load (StTextureCache       *cache,
 {
   CoglHandle texture;
 
-  texture = g_hash_table_lookup (cache->priv->keyed_cache, key);
+  texture = cache_lookup (cache, key);
   if (!texture)
     {
       texture = load (cache, key, data, error);
       if (texture)
-        g_hash_table_insert (cache->priv->keyed_cache, g_strdup (key), texture);
+        cache_insert_texture (cache, key, texture);
       else
         return COGL_INVALID_HANDLE;
     }
@@ -1110,6 +1804,50 @@ st_texture_cache_load (StTextureCache       *cache,
   return texture;
 }
 
+/* Runs before each frame: closes the counts of the last one */
+static gboolean
+start_paint_frame (gpointer data)
+{
+  StTextureCachePrivate *priv = ST_TEXTURE_CACHE (data)->priv;
+
+  if (priv->frame_icons > 0)
+    {
+      priv->last_frame_icons = priv->frame_icons;
+      priv->last_frame_binds = priv->frame_binds;
+    }
+
+  priv->frame_icons = 0;
+  priv->frame_binds = 0;
+  priv->last_painted_page = COGL_INVALID_HANDLE;
+
+  return TRUE;
+}
+
+/* Counts how often consecutively painted textures of ours are on
+ * different textures, which each needs a bind at least */
+static void
+on_texture_paint (ClutterTexture *texture,
+                  StTextureCache *cache)
+{
+  StTextureCachePrivate *priv = cache->priv;
+  CoglHandle texdata, page;
+
+  texdata = clutter_texture_get_cogl_texture (texture);
+  if (texdata == COGL_INVALID_HANDLE)
+    return;
+
+  page = _st_texture_atlas_get_page (texdata);
+  if (page != priv->last_painted_page)
+    {
+      priv->frame_binds++;
+      priv->last_painted_page = page;
+    }
+  priv->frame_icons++;
+
+  if (priv->paint_repaint_id == 0)
+    priv->paint_repaint_id = clutter_threads_add_repaint_func (start_paint_frame, cache, NULL);
+}
+
 /**
  * create_texture_and_ensure_request:
  * @cache:
@@ -1139,8 +1877,9 @@ create_texture_and_ensure_request (StTextureCache        *cache,
 
   *texture = (ClutterActor *) create_default_texture (cache);
   clutter_actor_set_size (*texture, size, size);
+  g_signal_connect (*texture, "paint", G_CALLBACK (on_texture_paint), cache);
 
-  texdata = g_hash_table_lookup (cache->priv->keyed_cache, key);
+  texdata = cache_lookup (cache, key);
 
   if (texdata != NULL)
     {
@@ -1163,7 +1902,7 @@ create_texture_and_ensure_request (StTextureCache        *cache,
    *request = pending;
 
   /* Regardless of whether there was a pending request, prepend our texture here. */
-  (*request)->textures = g_slist_prepend ((*request)->textures, g_object_ref (*texture));
+  async_load_add_texture (cache, *request, CLUTTER_TEXTURE (*texture));
 
   return had_pending;
 }
@@ -1226,15 +1965,17 @@ load_gicon_with_colors (StTextureCache    *cache,
       request->width = request->height = size;
       request->enforced_square = TRUE;
 
-      load_icon_pixbuf_async (cache, icon, info, size, colors, NULL, on_pixbuf_loaded, request);
+      start_texture_load (cache);
+      load_icon_pixbuf_async (cache, icon, info, size, colors,
+                              policy != ST_TEXTURE_CACHE_POLICY_NONE ? key : NULL,
+                              request->cancellable, on_pixbuf_loaded, request);
     }
   else
     {
       /* Blah; we failed to find the icon, but we've added our texture to the outstanding
        * requests.  In that case, just undo what create_texture_and_ensure_request() did.
        */
-       g_slist_foreach (request->textures, (GFunc) g_object_unref, NULL);
-       g_slist_free (request->textures);
+       async_load_release_textures (request);
        g_free (request);
        g_hash_table_remove (cache->priv->outstanding_requests, key);
        g_free (key);
@@ -1588,8 +2329,9 @@ st_texture_cache_load_uri_async (StTextureCache *cache,
   data->uri = g_strdup (uri);
   data->width = available_width;
   data->height = available_height;
-  data->textures = g_slist_prepend (data->textures, g_object_ref (texture));
-  load_uri_pixbuf_async (cache, uri, available_width, available_height, NULL, on_pixbuf_loaded, data);
+  async_load_add_texture (cache, data, texture);
+  start_texture_load (cache);
+  load_uri_pixbuf_async (cache, uri, available_width, available_height, data->cancellable, on_pixbuf_loaded, data);
 
   return CLUTTER_ACTOR (texture);
 }
@@ -1608,7 +2350,7 @@ st_texture_cache_load_uri_sync_to_cogl_texture (StTextureCache *cache,
 
   key = g_strconcat (CACHE_PREFIX_URI, uri, NULL);
 
-  texdata = g_hash_table_lookup (cache->priv->keyed_cache, key);
+  texdata = cache_lookup (cache, key);
 
   if (texdata == NULL)
     {
@@ -1622,7 +2364,7 @@ st_texture_cache_load_uri_sync_to_cogl_texture (StTextureCache *cache,
       if (policy == ST_TEXTURE_CACHE_POLICY_FOREVER)
         {
           cogl_handle_ref (texdata);
-          g_hash_table_insert (cache->priv->keyed_cache, g_strdup (key), texdata);
+          cache_insert_texture (cache, key, texdata);
         }
     }
   else
@@ -1647,7 +2389,7 @@ st_texture_cache_load_uri_sync_to_cairo_surface (StTextureCache        *cache,
 
   key = g_strconcat (CACHE_PREFIX_URI_FOR_CAIRO, uri, NULL);
 
-  surface = g_hash_table_lookup (cache->priv->keyed_cache, key);
+  surface = cache_lookup (cache, key);
 
   if (surface == NULL)
     {
@@ -1661,7 +2403,8 @@ st_texture_cache_load_uri_sync_to_cairo_surface (StTextureCache        *cache,
       if (policy == ST_TEXTURE_CACHE_POLICY_FOREVER)
         {
           cairo_surface_reference (surface);
-          g_hash_table_insert (cache->priv->keyed_cache, g_strdup (key), surface);
+          cache_insert (cache, key, surface, surface_byte_size (surface),
+                        (GDestroyNotify) cairo_surface_destroy);
         }
     }
   else
@@ -1846,24 +2589,23 @@ st_texture_cache_load_from_data (StTextureCache    *cache,
   ClutterTexture *texture;
   CoglHandle texdata;
   GdkPixbuf *pixbuf;
-  char *key;
-  char *checksum;
+  StTextureCacheContentKey key;
 
   texture = create_default_texture (cache);
   clutter_actor_set_size (CLUTTER_ACTOR (texture), size, size);
 
-  checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA1, data, len);
-  key = g_strdup_printf (CACHE_PREFIX_COMPRESSED_CHECKSUM "checksum=%s,size=%d", checksum, size);
-  g_free (checksum);
+  memset (&key, 0, sizeof (key));
+  _st_content_hash_compute (data, len, &key.hash);
+  key.type = CONTENT_COMPRESSED;
+  key.size = size;
 
-  texdata = g_hash_table_lookup (cache->priv->keyed_cache, key);
+  texdata = cache_lookup_content (cache, &key);
   if (texdata == NULL)
     {
       pixbuf = impl_load_pixbuf_data (data, len, size, size, error);
       if (!pixbuf)
         {
           g_object_unref (texture);
-          g_free (key);
           return NULL;
         }
 
@@ -1872,11 +2614,9 @@ st_texture_cache_load_from_data (StTextureCache    *cache,
 
       set_texture_cogl_texture (texture, texdata);
 
-      g_hash_table_insert (cache->priv->keyed_cache, g_strdup (key), texdata);
+      cache_insert_content_texture (cache, &key, texdata);
     }
 
-  g_free (key);
-
   set_texture_cogl_texture (texture, texdata);
   return CLUTTER_ACTOR (texture);
 }
@@ -1910,33 +2650,30 @@ st_texture_cache_load_from_raw (StTextureCache    *cache,
 {
   ClutterTexture *texture;
   CoglHandle texdata;
-  char *key;
-  char *checksum;
+  StTextureCacheContentKey key;
 
   texture = create_default_texture (cache);
   clutter_actor_set_size (CLUTTER_ACTOR (texture), size, size);
 
-  /* In theory, two images of with different width and height could have the same
-   * pixel data and thus hash the same. (Say, a 16x16 and a 8x32 blank image.)
-   * We ignore this for now. If anybody hits this problem they should use
-   * GChecksum directly to compute a checksum including the width and height.
-   */
-  checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA1, data, len);
-  key = g_strdup_printf (CACHE_PREFIX_RAW_CHECKSUM "checksum=%s", checksum);
-  g_free (checksum);
+  /* The same pixels at a different width, height, rowstride or format
+   * are a different image (say, a blank 16x16 and a blank 8x32 one) */
+  memset (&key, 0, sizeof (key));
+  _st_content_hash_compute (data, len, &key.hash);
+  key.type = has_alpha ? CONTENT_RAW_RGBA : CONTENT_RAW_RGB;
+  key.width = width;
+  key.height = height;
+  key.rowstride = rowstride;
 
-  texdata = g_hash_table_lookup (cache->priv->keyed_cache, key);
+  texdata = cache_lookup_content (cache, &key);
   if (texdata == NULL)
     {
       texdata = cogl_texture_new_from_data (width, height, COGL_TEXTURE_NONE,
                                             has_alpha ? COGL_PIXEL_FORMAT_RGBA_8888 : COGL_PIXEL_FORMAT_RGB_888,
                                             COGL_PIXEL_FORMAT_ANY,
                                             rowstride, data);
-      g_hash_table_insert (cache->priv->keyed_cache, g_strdup (key), texdata);
+      cache_insert_content_texture (cache, &key, texdata);
     }
 
-  g_free (key);
-
   set_texture_cogl_texture (texture, texdata);
   return CLUTTER_ACTOR (texture);
 }
@@ -1980,7 +2717,7 @@ st_texture_cache_load_thumbnail (StTextureCache    *cache,
 
   key = g_strdup_printf (CACHE_PREFIX_THUMBNAIL_URI "uri=%s,size=%d", uri, size);
 
-  texdata = g_hash_table_lookup (cache->priv->keyed_cache, key);
+  texdata = cache_lookup (cache, key);
   if (!texdata)
     {
       data = g_new0 (AsyncTextureLoadData, 1);
@@ -1992,8 +2729,9 @@ st_texture_cache_load_thumbnail (StTextureCache    *cache,
       data->width = size;
       data->height = size;
       data->enforced_square = TRUE;
-      data->textures = g_slist_prepend (data->textures, g_object_ref (texture));
-      load_thumbnail_async (cache, uri, mimetype, size, NULL, on_pixbuf_loaded, data);
+      async_load_add_texture (cache, data, texture);
+      start_texture_load (cache);
+      load_thumbnail_async (cache, uri, mimetype, size, data->cancellable, on_pixbuf_loaded, data);
     }
   else
     {
@@ -2058,7 +2796,7 @@ st_texture_cache_load_recent_thumbnail (StTextureCache    *cache,
 
   key = g_strdup_printf (CACHE_PREFIX_THUMBNAIL_URI "uri=%s,size=%d", uri, size);
 
-  texdata = g_hash_table_lookup (cache->priv->keyed_cache, key);
+  texdata = cache_lookup (cache, key);
   if (!texdata)
     {
       data = g_new0 (AsyncTextureLoadData, 1);
@@ -2069,8 +2807,9 @@ st_texture_cache_load_recent_thumbnail (StTextureCache    *cache,
       data->width = size;
       data->height = size;
       data->enforced_square = TRUE;
-      data->textures = g_slist_prepend (data->textures, g_object_ref (texture));
-      load_recent_thumbnail_async (cache, info, size, NULL, on_pixbuf_loaded, data);
+      async_load_add_texture (cache, data, texture);
+      start_texture_load (cache);
+      load_recent_thumbnail_async (cache, info, size, data->cancellable, on_pixbuf_loaded, data);
     }
   else
     {
@@ -2115,6 +2854,335 @@ st_texture_cache_evict_recent_thumbnail (StTextureCache *cache,
   st_texture_cache_evict_thumbnail (cache, gtk_recent_info_get_uri (info));
 }
 
+/**
+ * st_texture_cache_set_budget:
+ * @cache: A #StTextureCache
+ * @bytes: maximum number of bytes of texture data to keep cached, or 0
+ *   for no limit
+ *
+ * Sets the total size of the texture data the cache keeps around for
+ * reuse. When the budget is exceeded, the least recently used textures
+ * are dropped from the cache; textures still displayed by actors stay
+ * alive until those actors let go of them.
+ */
+void
+st_texture_cache_set_budget (StTextureCache *cache,
+                             gsize           bytes)
+{
+  StTextureCachePrivate *priv = cache->priv;
+
+  priv->budget = bytes;
+
+  if (priv->budget == 0)
+    return;
+
+  while (priv->resident_bytes > priv->budget && priv->lru->tail != NULL)
+    cache_evict_entry (cache, priv->lru->tail->data);
+}
+
+/**
+ * st_texture_cache_get_budget:
+ * @cache: A #StTextureCache
+ *
+ * Returns: the budget set with st_texture_cache_set_budget()
+ */
+gsize
+st_texture_cache_get_budget (StTextureCache *cache)
+{
+  return cache->priv->budget;
+}
+
+/**
+ * st_texture_cache_set_prefix_quota:
+ * @cache: A #StTextureCache
+ * @prefix: a cache key prefix, like "thumbnail-uri:"
+ * @bytes: maximum number of bytes of texture data to keep cached for
+ *   keys starting with @prefix
+ *
+ * Limits the share of the cache used by one kind of texture, so that
+ * for instance a folder full of thumbnails can't push out all the
+ * icons. Only affects textures cached after the call.
+ */
+void
+st_texture_cache_set_prefix_quota (StTextureCache *cache,
+                                   const char     *prefix,
+                                   gsize           bytes)
+{
+  StTextureCacheQuota *quota;
+  GSList *iter;
+
+  for (iter = cache->priv->quotas; iter; iter = iter->next)
+    {
+      quota = iter->data;
+      if (strcmp (quota->prefix, prefix) == 0)
+        {
+          quota->limit = bytes;
+          return;
+        }
+    }
+
+  quota = g_new0 (StTextureCacheQuota, 1);
+  quota->prefix = g_strdup (prefix);
+  quota->limit = bytes;
+  cache->priv->quotas = g_slist_append (cache->priv->quotas, quota);
+}
+
+/**
+ * st_texture_cache_get_statistics:
+ * @cache: A #StTextureCache
+ * @hits: (out) (allow-none): number of lookups that found a cached texture
+ * @misses: (out) (allow-none): number of lookups that didn't
+ * @evictions: (out) (allow-none): number of textures dropped to stay
+ *   within the budget or a quota
+ * @resident_bytes: (out) (allow-none): size of the texture data
+ *   currently cached
+ *
+ * Gets statistics about the efficiency of the cache.
+ */
+void
+st_texture_cache_get_statistics (StTextureCache *cache,
+                                 guint          *hits,
+                                 guint          *misses,
+                                 guint          *evictions,
+                                 gsize          *resident_bytes)
+{
+  StTextureCachePrivate *priv = cache->priv;
+
+  if (hits)
+    *hits = priv->hits;
+  if (misses)
+    *misses = priv->misses;
+  if (evictions)
+    *evictions = priv->evictions;
+  if (resident_bytes)
+    *resident_bytes = priv->resident_bytes;
+}
+
+/**
+ * st_texture_cache_set_decode_threads:
+ * @cache: A #StTextureCache
+ * @n_threads: how many images may be decoded at the same time
+ *
+ * Sets how many threads asynchronous loads use to decode images.
+ * Icons are always decoded before thumbnails that were requested
+ * earlier, so this only bounds how much of the CPU decoding can take.
+ */
+void
+st_texture_cache_set_decode_threads (StTextureCache *cache,
+                                     guint           n_threads)
+{
+  g_return_if_fail (n_threads > 0);
+
+  _st_decode_pool_set_max_threads (cache->priv->decode_pool, n_threads);
+}
+
+/**
+ * st_texture_cache_get_decode_threads:
+ * @cache: A #StTextureCache
+ *
+ * Return value: how many images may be decoded at the same time
+ */
+guint
+st_texture_cache_get_decode_threads (StTextureCache *cache)
+{
+  return _st_decode_pool_get_max_threads (cache->priv->decode_pool);
+}
+
+/**
+ * st_texture_cache_get_decode_statistics:
+ * @cache: A #StTextureCache
+ * @queued: (out) (allow-none): number of images waiting to be decoded
+ * @running: (out) (allow-none): number of images being decoded
+ * @cancelled: (out) (allow-none): number of loads dropped before
+ *   decoding because their actors were destroyed
+ * @visible_latency: (out) (allow-none): mean time the loads of icons
+ *   and images that are being shown took, in microseconds; prefetches
+ *   and background loads aren't included
+ * @mean_latency: (out) (allow-none): mean time any load took, in
+ *   microseconds
+ * @max_latency: (out) (allow-none): longest time a load took, in
+ *   microseconds
+ *
+ * Gets statistics about asynchronous loads. Times run from the request
+ * to the end of decoding, and don't include the upload of the texture.
+ */
+void
+st_texture_cache_get_decode_statistics (StTextureCache *cache,
+                                        guint          *queued,
+                                        guint          *running,
+                                        guint          *cancelled,
+                                        gint64         *visible_latency,
+                                        gint64         *mean_latency,
+                                        gint64         *max_latency)
+{
+  _st_decode_pool_get_statistics (cache->priv->decode_pool,
+                                  queued, running, cancelled,
+                                  visible_latency, mean_latency, max_latency);
+}
+
+/**
+ * st_texture_cache_set_upload_budget:
+ * @cache: A #StTextureCache
+ * @bytes: how much image data to upload per frame
+ * @usecs: how long to spend uploading per frame, in microseconds
+ *
+ * Images loaded asynchronously are uploaded as textures right before
+ * frames are painted, those shown on screen first, and as many per frame
+ * as fit in @bytes and @usecs. The rest wait for the following frames.
+ * At least one image is uploaded per frame however large it is.
+ */
+void
+st_texture_cache_set_upload_budget (StTextureCache *cache,
+                                    gsize           bytes,
+                                    guint           usecs)
+{
+  cache->priv->upload_byte_budget = bytes;
+  cache->priv->upload_time_budget = usecs;
+}
+
+/**
+ * st_texture_cache_get_upload_statistics:
+ * @cache: A #StTextureCache
+ * @pending: (out) (allow-none): number of images waiting to be uploaded
+ * @frames: (out) (allow-none): number of frames that uploaded images
+ * @frames_over_budget: (out) (allow-none): number of those frames that
+ *   exceeded the upload budget
+ *
+ * Gets statistics about how uploads of asynchronously loaded images
+ * were spread across frames.
+ */
+void
+st_texture_cache_get_upload_statistics (StTextureCache *cache,
+                                        guint          *pending,
+                                        guint          *frames,
+                                        guint          *frames_over_budget)
+{
+  StTextureCachePrivate *priv = cache->priv;
+
+  if (pending)
+    *pending = g_queue_get_length (priv->pending_uploads);
+  if (frames)
+    *frames = priv->upload_frames;
+  if (frames_over_budget)
+    *frames_over_budget = priv->frames_over_budget;
+}
+
+/**
+ * st_texture_cache_get_icon_atlas_statistics:
+ * @cache: A #StTextureCache
+ * @n_pages: (out) (allow-none): number of atlas textures
+ * @n_icons: (out) (allow-none): number of icons in the atlas
+ * @used_pixels: (out) (allow-none): number of atlas pixels holding an icon
+ * @total_pixels: (out) (allow-none): number of pixels of all atlas textures
+ * @n_recycled: (out) (allow-none): number of icons put into the space
+ *   of icons that were dropped
+ *
+ * Reports how well the atlas small icons are packed into is used.
+ */
+void
+st_texture_cache_get_icon_atlas_statistics (StTextureCache *cache,
+                                            guint          *n_pages,
+                                            guint          *n_icons,
+                                            gsize          *used_pixels,
+                                            gsize          *total_pixels,
+                                            guint          *n_recycled)
+{
+  guint pages, icons;
+  gsize used, total;
+
+  _st_texture_atlas_get_statistics (cache->priv->icon_atlas,
+                                    &pages, &icons, &used, &total);
+
+  if (n_pages)
+    *n_pages = pages;
+  if (n_icons)
+    *n_icons = icons;
+  if (used_pixels)
+    *used_pixels = used;
+  if (total_pixels)
+    *total_pixels = total;
+  if (n_recycled)
+    *n_recycled = _st_texture_atlas_get_n_recycled (cache->priv->icon_atlas);
+}
+
+/**
+ * st_texture_cache_get_paint_statistics:
+ * @cache: A #StTextureCache
+ * @n_painted: (out) (allow-none): number of textures loaded through
+ *   the cache that the last frame painting any painted
+ * @n_binds: (out) (allow-none): number of times that frame switched to a
+ *   different texture between them
+ *
+ * Reports how many texture switches painting icons and images loaded
+ * through the cache needs, leaving out whatever was painted in between.
+ */
+void
+st_texture_cache_get_paint_statistics (StTextureCache *cache,
+                                       guint          *n_painted,
+                                       guint          *n_binds)
+{
+  if (n_painted)
+    *n_painted = cache->priv->last_frame_icons;
+  if (n_binds)
+    *n_binds = cache->priv->last_frame_binds;
+}
+
+/**
+ * st_texture_cache_mark_startup_complete:
+ * @cache: A #StTextureCache
+ *
+ * Tells the cache that everything shown at startup has been created, so
+ * that the loads still outstanding are the last ones of the startup; the
+ * startup load time is taken once they are done.
+ */
+void
+st_texture_cache_mark_startup_complete (StTextureCache *cache)
+{
+  StTextureCachePrivate *priv = cache->priv;
+
+  if (priv->startup_complete)
+    return;
+
+  priv->startup_complete = TRUE;
+
+  if (priv->n_loading == 0 && priv->first_load_time != 0)
+    priv->startup_load_time = g_get_monotonic_time () - priv->first_load_time;
+}
+
+/**
+ * st_texture_cache_get_icon_cache_statistics:
+ * @cache: A #StTextureCache
+ * @hits: (out) (allow-none): number of icons read from the icon cache
+ * @misses: (out) (allow-none): number of icons that had to be decoded
+ * @stores: (out) (allow-none): number of icons written to the icon cache
+ * @startup_load_time: (out) (allow-none): time in microseconds from the
+ *   first asynchronous load until the loads outstanding at
+ *   st_texture_cache_mark_startup_complete() were done, or 0 if that has
+ *   not happened yet
+ *
+ * Gets statistics about the on-disk cache of decoded icons.
+ */
+void
+st_texture_cache_get_icon_cache_statistics (StTextureCache *cache,
+                                            guint          *hits,
+                                            guint          *misses,
+                                            guint          *stores,
+                                            gint64         *startup_load_time)
+{
+  guint n_hits, n_misses, n_stores;
+
+  _st_icon_cache_get_statistics (&n_hits, &n_misses, &n_stores);
+
+  if (hits)
+    *hits = n_hits;
+  if (misses)
+    *misses = n_misses;
+  if (stores)
+    *stores = n_stores;
+  if (startup_load_time)
+    *startup_load_time = cache->priv->startup_load_time;
+}
+
 static size_t
 pixbuf_byte_size (GdkPixbuf *pixbuf)
 {
@@ -160,6 +160,55 @@ CoglHandle st_texture_cache_load (StTextureCache       *cache,
                                   void                 *data,
                                   GError              **error);
 
+void  st_texture_cache_set_budget       (StTextureCache *cache,
+                                         gsize           bytes);
+gsize st_texture_cache_get_budget       (StTextureCache *cache);
+void  st_texture_cache_set_prefix_quota (StTextureCache *cache,
+                                         const char     *prefix,
+                                         gsize           bytes);
+
+void st_texture_cache_get_statistics (StTextureCache *cache,
+                                      guint          *hits,
+                                      guint          *misses,
+                                      guint          *evictions,
+                                      gsize          *resident_bytes);
+
+void  st_texture_cache_set_decode_threads    (StTextureCache *cache,
+                                              guint           n_threads);
+guint st_texture_cache_get_decode_threads    (StTextureCache *cache);
+void  st_texture_cache_get_decode_statistics (StTextureCache *cache,
+                                              guint          *queued,
+                                              guint          *running,
+                                              guint          *cancelled,
+                                              gint64         *visible_latency,
+                                              gint64         *mean_latency,
+                                              gint64         *max_latency);
+
+void  st_texture_cache_set_upload_budget     (StTextureCache *cache,
+                                              gsize           bytes,
+                                              guint           usecs);
+void  st_texture_cache_get_upload_statistics (StTextureCache *cache,
+                                              guint          *pending,
+                                              guint          *frames,
+                                              guint          *frames_over_budget);
+
+void  st_texture_cache_get_icon_atlas_statistics (StTextureCache *cache,
+                                                  guint          *n_pages,
+                                                  guint          *n_icons,
+                                                  gsize          *used_pixels,
+                                                  gsize          *total_pixels,
+                                                  guint          *n_recycled);
+void  st_texture_cache_get_paint_statistics      (StTextureCache *cache,
+                                                  guint          *n_painted,
+                                                  guint          *n_binds);
+
+void  st_texture_cache_mark_startup_complete     (StTextureCache *cache);
+void  st_texture_cache_get_icon_cache_statistics (StTextureCache *cache,
+                                                  guint          *hits,
+                                                  guint          *misses,
+                                                  guint          *stores,
+                                                  gint64         *startup_load_time);
+
 gboolean st_texture_cache_pixbuf_equal (StTextureCache *cache, GdkPixbuf *a, GdkPixbuf *b);
 
 #endif /* __ST_TEXTURE_CACHE_H__ */
@@ -24,6 +24,7 @@
 #include "st-texture-cache.h"
 #include "st-theme.h"
 #include "st-theme-context.h"
+#include "st-theme-node-private.h"
 
 struct _StThemeContext {
   GObject parent;
@@ -32,6 +33,11 @@ struct _StThemeContext {
   PangoFontDescription *font;
   StThemeNode *root_node;
   StTheme *theme;
+
+  /* Theme nodes that have computed their style, keyed by the things
+   * that determine it (see st_theme_node_equal()); equal nodes created
+   * later copy their style from these. Doesn't hold references. */
+  GHashTable *nodes;
 };
 
 struct _StThemeContextClass {
@@ -69,6 +75,8 @@ st_theme_context_finalize (GObject *object)
   if (context->theme)
     g_object_unref (context->theme);
 
+  g_hash_table_destroy (context->nodes);
+
   pango_font_description_free (context->font);
 
   G_OBJECT_CLASS (st_theme_context_parent_class)->finalize (object);
@@ -96,6 +104,8 @@ st_theme_context_init (StThemeContext *context)
 {
   context->resolution = DEFAULT_RESOLUTION;
   context->font = pango_font_description_from_string (DEFAULT_FONT);
+  context->nodes = g_hash_table_new ((GHashFunc) st_theme_node_hash,
+                                     (GEqualFunc) st_theme_node_equal);
 
   g_signal_connect (st_texture_cache_get_default (),
                     "icon-theme-changed",
@@ -136,6 +146,10 @@ st_theme_context_changed (StThemeContext *context)
   StThemeNode *old_root = context->root_node;
   context->root_node = NULL;
 
+  /* Resolution and font changes aren't part of the node key, so
+   * nodes computed before this point must not be shared anymore */
+  g_hash_table_remove_all (context->nodes);
+
   g_signal_emit (context, signals[CHANGED], 0);
 
   if (old_root)
@@ -347,3 +361,44 @@ st_theme_context_get_root_node (StThemeContext *context)
 
   return context->root_node;
 }
+
+/**
+ * _st_theme_context_intern_node:
+ * @context: a #StThemeContext
+ * @node: a #StThemeNode created for @context
+ *
+ * Looks for a node equal to @node whose style can be shared with @node,
+ * registering @node as the shared one if there is none yet.
+ *
+ * Return value: (transfer none): the shared node; this may be @node itself
+ */
+StThemeNode *
+_st_theme_context_intern_node (StThemeContext *context,
+                               StThemeNode    *node)
+{
+  StThemeNode *mine;
+
+  mine = g_hash_table_lookup (context->nodes, node);
+  if (mine != NULL && mine->stylesheets_serial == node->stylesheets_serial)
+    return mine;
+
+  /* Equal nodes have the same theme, a different serial means the
+   * stylesheets changed since @mine was matched */
+  g_hash_table_replace (context->nodes, node, node);
+  return node;
+}
+
+/**
+ * _st_theme_context_forget_node:
+ * @context: a #StThemeContext
+ * @node: a #StThemeNode that is being disposed
+ *
+ * Removes @node from the set of shared nodes, if it is in there.
+ */
+void
+_st_theme_context_forget_node (StThemeContext *context,
+                               StThemeNode    *node)
+{
+  if (g_hash_table_lookup (context->nodes, node) == node)
+    g_hash_table_remove (context->nodes, node);
+}
@@ -30,9 +30,11 @@
 #include <math.h>
 
 #include "st-shadow.h"
+#include "st-offscreen-pool.h"
 #include "st-private.h"
 #include "st-theme-private.h"
 #include "st-theme-context.h"
+#include "st-texture-atlas.h"
 #include "st-texture-cache.h"
 #include "st-theme-node-private.h"
 
@@ -907,12 +909,99 @@ paint_inset_box_shadow_to_cairo_context (StThemeNode     *node,
   cairo_pattern_destroy (shadow_pattern);
 }
 
+/****
+ * Prerendered backgrounds
+ ****/
+
+#define BACKGROUND_ATLAS_PAGE_SIZE 1024
+
+static StTextureAtlas *background_atlas = NULL;
+
+static StTextureAtlas *
+get_background_atlas (void)
+{
+  if (G_UNLIKELY (background_atlas == NULL))
+    background_atlas = _st_texture_atlas_new (BACKGROUND_ATLAS_PAGE_SIZE,
+                                              BACKGROUND_ATLAS_PAGE_SIZE);
+
+  return background_atlas;
+}
+
+static void
+append_color (GString            *key,
+              const ClutterColor *color)
+{
+  g_string_append_printf (key, "%02x%02x%02x%02x,",
+                          color->red, color->green, color->blue, color->alpha);
+}
+
+static void
+append_shadow (GString  *key,
+               StShadow *shadow)
+{
+  if (shadow == NULL)
+    {
+      g_string_append (key, "none,");
+      return;
+    }
+
+  append_color (key, &shadow->color);
+  g_string_append_printf (key, "%g,%g,%g,%g,%d,",
+                          shadow->xoffset, shadow->yoffset,
+                          shadow->blur, shadow->spread, shadow->inset);
+}
+
+/* Everything st_theme_node_prerender_background() depends on, so that
+ * nodes painting identical backgrounds share a single texture */
+static char *
+background_to_string (StThemeNode *node)
+{
+  StBorderImage *border_image;
+  GString *key;
+  int i;
+
+  key = g_string_new ("st-theme-node-background:");
+
+  g_string_append_printf (key, "%gx%g,", node->alloc_width, node->alloc_height);
+
+  append_color (key, &node->background_color);
+  g_string_append_printf (key, "%d,", node->background_gradient_type);
+  /* Read even without a gradient, to find out whether there is an outline */
+  append_color (key, &node->background_gradient_end);
+
+  for (i = 0; i < 4; i++)
+    {
+      g_string_append_printf (key, "%d,%d,", node->border_width[i], node->border_radius[i]);
+      append_color (key, &node->border_color[i]);
+    }
+
+  border_image = st_theme_node_get_border_image (node);
+  g_string_append_printf (key, "%d,", border_image != NULL);
+
+  append_shadow (key, st_theme_node_get_box_shadow (node));
+  append_shadow (key, st_theme_node_get_background_image_shadow (node));
+
+  if (node->background_position_set)
+    g_string_append_printf (key, "%d,%d,",
+                            node->background_position_x,
+                            node->background_position_y);
+
+  /* Last, since it is the only free form part */
+  if (node->background_image != NULL)
+    g_string_append (key, node->background_image);
+
+  return g_string_free (key, FALSE);
+}
+
 /* In order for borders to be smoothly blended with non-solid backgrounds,
  * we need to use cairo.  This function is a slow fallback path for those
  * cases (gradients, background images, etc).
+ *
+ * The result is put in a shared atlas under @key.
  */
 static CoglHandle
-st_theme_node_prerender_background (StThemeNode *node)
+st_theme_node_prerender_background (StThemeNode *node,
+                                    const char  *key)
 {
   StBorderImage *border_image;
   CoglHandle texture;
@@ -1233,16 +1322,17 @@ st_theme_node_prerender_background (StThemeNode *node)
   if (interior_path != NULL)
     cairo_path_destroy (interior_path);
 
-  texture = cogl_texture_new_from_data (paint_box.x2 - paint_box.x1,
-                                        paint_box.y2 - paint_box.y1,
-                                        COGL_TEXTURE_NONE,
-                                        CLUTTER_CAIRO_FORMAT_ARGB32,
-                                        COGL_PIXEL_FORMAT_ANY,
-                                        rowstride,
-                                        data);
-
   cairo_destroy (cr);
   cairo_surface_destroy (surface);
+
+  texture = _st_texture_atlas_add (get_background_atlas (),
+                                   key,
+                                   paint_box.x2 - paint_box.x1,
+                                   paint_box.y2 - paint_box.y1,
+                                   CLUTTER_CAIRO_FORMAT_ARGB32,
+                                   rowstride,
+                                   data);
+
   g_free (data);
 
   return texture;
@@ -1401,7 +1491,15 @@ st_theme_node_render_resources (StThemeNode   *node,
       || (has_inset_box_shadow && (has_border || node->background_color.alpha > 0))
       || (background_image && (has_border || has_border_radius))
       || has_large_corners)
-    node->prerendered_texture = st_theme_node_prerender_background (node);
+    {
+      char *key = background_to_string (node);
+
+      node->prerendered_texture = _st_texture_atlas_lookup (get_background_atlas (), key);
+      if (node->prerendered_texture == COGL_INVALID_HANDLE)
+        node->prerendered_texture = st_theme_node_prerender_background (node, key);
+
+      g_free (key);
+    }
 
   if (node->prerendered_texture)
     node->prerendered_material = _st_create_texture_material (node->prerendered_texture);
@@ -2090,3 +2188,44 @@ st_theme_node_copy_cached_paint_state (StThemeNode *node,
     if (other->corner_material[corner_id])
       node->corner_material[corner_id] = cogl_handle_ref (other->corner_material[corner_id]);
 }
+
+/**
+ * st_theme_node_get_background_atlas_statistics:
+ * @n_pages: (out): number of atlas textures
+ * @n_backgrounds: (out): number of distinct prerendered backgrounds
+ * @used_pixels: (out): number of atlas pixels holding a background
+ * @total_pixels: (out): number of pixels of all atlas textures
+ *
+ * Reports how well the atlas that prerendered backgrounds (gradients,
+ * rounded corners over images, ...) are packed into is used.
+ */
+void
+st_theme_node_get_background_atlas_statistics (guint *n_pages,
+                                               guint *n_backgrounds,
+                                               gsize *used_pixels,
+                                               gsize *total_pixels)
+{
+  _st_texture_atlas_get_statistics (get_background_atlas (),
+                                    n_pages, n_backgrounds,
+                                    used_pixels, total_pixels);
+}
+
+/**
+ * st_theme_node_get_transition_statistics:
+ * @n_reused: (out): number of render targets transitions got from the pool
+ * @n_allocated: (out): number of render targets that had to be created
+ * @total_bytes: (out): size of the textures of all render targets
+ * @peak_bytes: (out): largest value @total_bytes ever had
+ *
+ * Reports how well the offscreen render targets that style transitions
+ * paint into are shared.
+ */
+void
+st_theme_node_get_transition_statistics (guint *n_reused,
+                                         guint *n_allocated,
+                                         gsize *total_bytes,
+                                         gsize *peak_bytes)
+{
+  _st_offscreen_pool_get_statistics (n_reused, n_allocated,
+                                     total_bytes, peak_bytes);
+}
@@ -79,6 +79,17 @@ struct _StThemeNode {
   CRDeclaration **properties;
   int n_properties;
 
+  /* Owns the storage of properties; may be shared with equal nodes */
+  GPtrArray *property_array;
+
+  /* An equal node that already computed its style, and that we copy
+   * resolved values from instead of recomputing them */
+  StThemeNode *style_source;
+
+  /* _st_theme_get_stylesheets_serial() of the theme when the style was
+   * computed; nodes computed before a stylesheet change aren't shared */
+  guint stylesheets_serial;
+
   /* We hold onto these separately so we can destroy them on finalize */
   CRDeclaration *inline_properties;
 
@@ -115,6 +126,11 @@ struct _StThemeNodeClass {
 void _st_theme_node_ensure_background (StThemeNode *node);
 void _st_theme_node_ensure_geometry (StThemeNode *node);
 
+StThemeNode *_st_theme_context_intern_node (StThemeContext *context,
+                                            StThemeNode    *node);
+void         _st_theme_context_forget_node (StThemeContext *context,
+                                            StThemeNode    *node);
+
 void _st_theme_node_init_drawing_state (StThemeNode *node);
 void _st_theme_node_free_drawing_state (StThemeNode *node);
 
@@ -19,6 +19,7 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "st-offscreen-pool.h"
 #include "st-theme-node-transition.h"
 
 enum {
@@ -33,11 +34,8 @@ struct _StThemeNodeTransitionPrivate {
   StThemeNode *old_theme_node;
   StThemeNode *new_theme_node;
 
-  CoglHandle old_texture;
-  CoglHandle new_texture;
-
-  CoglHandle old_offscreen;
-  CoglHandle new_offscreen;
+  StOffscreen *old_offscreen;
+  StOffscreen *new_offscreen;
 
   CoglHandle material;
 
@@ -216,12 +214,32 @@ st_theme_node_transition_get_paint_box (StThemeNodeTransition *transition,
   paint_box->y2 = MAX (old_node_box.y2, new_node_box.y2);
 }
 
+/* Paints @node into the top left corner of @offscreen */
+static void
+paint_offscreen (StThemeNodeTransition *transition,
+                 StOffscreen           *offscreen,
+                 StThemeNode           *node,
+                 const ClutterActorBox *allocation)
+{
+  StThemeNodeTransitionPrivate *priv = transition->priv;
+  CoglColor clear_color = { 0, 0, 0, 0 };
+
+  cogl_push_framebuffer (offscreen->framebuffer);
+  cogl_clear (&clear_color, COGL_BUFFER_BIT_COLOR);
+  cogl_ortho (priv->offscreen_box.x1,
+              priv->offscreen_box.x1 + offscreen->width,
+              priv->offscreen_box.y1 + offscreen->height,
+              priv->offscreen_box.y1,
+              0.0, 1.0);
+  st_theme_node_paint (node, allocation, 255);
+  cogl_pop_framebuffer ();
+}
+
 static gboolean
 setup_framebuffers (StThemeNodeTransition *transition,
                     const ClutterActorBox *allocation)
 {
   StThemeNodeTransitionPrivate *priv = transition->priv;
-  CoglColor clear_color = { 0, 0, 0, 0 };
   guint width, height;
 
   /* template material to avoid unnecessary shader compilation */
@@ -233,31 +251,15 @@ setup_framebuffers (StThemeNodeTransition *transition,
   g_return_val_if_fail (width  > 0, FALSE);
   g_return_val_if_fail (height > 0, FALSE);
 
-  if (priv->old_texture)
-    cogl_handle_unref (priv->old_texture);
-  priv->old_texture = cogl_texture_new_with_size (width, height,
-                                                  COGL_TEXTURE_NO_SLICING,
-                                                  COGL_PIXEL_FORMAT_ANY);
-
-  if (priv->new_texture)
-    cogl_handle_unref (priv->new_texture);
-  priv->new_texture = cogl_texture_new_with_size (width, height,
-                                                  COGL_TEXTURE_NO_SLICING,
-                                                  COGL_PIXEL_FORMAT_ANY);
+  /* When the size stays in the same bucket, this gets the same render
+   * targets back */
+  _st_offscreen_pool_release (priv->old_offscreen);
+  _st_offscreen_pool_release (priv->new_offscreen);
+  priv->old_offscreen = _st_offscreen_pool_acquire (width, height);
+  priv->new_offscreen = _st_offscreen_pool_acquire (width, height);
 
-  g_return_val_if_fail (priv->old_texture != COGL_INVALID_HANDLE, FALSE);
-  g_return_val_if_fail (priv->new_texture != COGL_INVALID_HANDLE, FALSE);
-
-  if (priv->old_offscreen)
-    cogl_handle_unref (priv->old_offscreen);
-  priv->old_offscreen = cogl_offscreen_new_to_texture (priv->old_texture);
-
-  if (priv->new_offscreen)
-    cogl_handle_unref (priv->new_offscreen);
-  priv->new_offscreen = cogl_offscreen_new_to_texture (priv->new_texture);
-
-  g_return_val_if_fail (priv->old_offscreen != COGL_INVALID_HANDLE, FALSE);
-  g_return_val_if_fail (priv->new_offscreen != COGL_INVALID_HANDLE, FALSE);
+  g_return_val_if_fail (priv->old_offscreen != NULL, FALSE);
+  g_return_val_if_fail (priv->new_offscreen != NULL, FALSE);
 
   if (priv->material == NULL)
     {
@@ -281,24 +283,11 @@ setup_framebuffers (StThemeNodeTransition *transition,
       priv->material = cogl_material_copy (material_template);
     }
 
-  cogl_material_set_layer (priv->material, 0, priv->new_texture);
-  cogl_material_set_layer (priv->material, 1, priv->old_texture);
-
-  cogl_push_framebuffer (priv->old_offscreen);
-  cogl_clear (&clear_color, COGL_BUFFER_BIT_COLOR);
-  cogl_ortho (priv->offscreen_box.x1, priv->offscreen_box.x2,
-              priv->offscreen_box.y2, priv->offscreen_box.y1,
-              0.0, 1.0);
-  st_theme_node_paint (priv->old_theme_node, allocation, 255);
-  cogl_pop_framebuffer ();
+  cogl_material_set_layer (priv->material, 0, priv->new_offscreen->texture);
+  cogl_material_set_layer (priv->material, 1, priv->old_offscreen->texture);
 
-  cogl_push_framebuffer (priv->new_offscreen);
-  cogl_clear (&clear_color, COGL_BUFFER_BIT_COLOR);
-  cogl_ortho (priv->offscreen_box.x1, priv->offscreen_box.x2,
-              priv->offscreen_box.y2, priv->offscreen_box.y1,
-              0.0, 1.0);
-  st_theme_node_paint (priv->new_theme_node, allocation, 255);
-  cogl_pop_framebuffer ();
+  paint_offscreen (transition, priv->old_offscreen, priv->old_theme_node, allocation);
+  paint_offscreen (transition, priv->new_offscreen, priv->new_theme_node, allocation);
 
   return TRUE;
 }
@@ -311,10 +300,7 @@ st_theme_node_transition_paint (StThemeNodeTransition *transition,
   StThemeNodeTransitionPrivate *priv = transition->priv;
 
   CoglColor constant;
-  float tex_coords[] = {
-    0.0, 0.0, 1.0, 1.0,
-    0.0, 0.0, 1.0, 1.0,
-  };
+  float s, t;
 
   g_return_if_fail (ST_IS_THEME_NODE (priv->old_theme_node));
   g_return_if_fail (ST_IS_THEME_NODE (priv->new_theme_node));
@@ -333,6 +319,10 @@ st_theme_node_transition_paint (StThemeNodeTransition *transition,
         return;
     }
 
+  /* Only the top left corner of the render targets was painted */
+  s = (priv->offscreen_box.x2 - priv->offscreen_box.x1) / priv->new_offscreen->width;
+  t = (priv->offscreen_box.y2 - priv->offscreen_box.y1) / priv->new_offscreen->height;
+
   cogl_color_set_from_4f (&constant, 0., 0., 0.,
                           clutter_alpha_get_alpha (priv->alpha));
   cogl_material_set_layer_combine_constant (priv->material, 1, &constant);
@@ -342,11 +332,18 @@ st_theme_node_transition_paint (StThemeNodeTransition *transition,
                               paint_opacity, paint_opacity);
 
   cogl_set_source (priv->material);
-  cogl_rectangle_with_multitexture_coords (priv->offscreen_box.x1,
-                                           priv->offscreen_box.y1,
-                                           priv->offscreen_box.x2,
-                                           priv->offscreen_box.y2,
-                                           tex_coords, 8);
+  {
+    float tex_coords[] = {
+      0.0, 0.0, s, t,
+      0.0, 0.0, s, t,
+    };
+
+    cogl_rectangle_with_multitexture_coords (priv->offscreen_box.x1,
+                                             priv->offscreen_box.y1,
+                                             priv->offscreen_box.x2,
+                                             priv->offscreen_box.y2,
+                                             tex_coords, 8);
+  }
 }
 
 static void
@@ -366,27 +363,15 @@ st_theme_node_transition_dispose (GObject *object)
       priv->new_theme_node = NULL;
     }
 
-  if (priv->old_texture)
-    {
-      cogl_handle_unref (priv->old_texture);
-      priv->old_texture = NULL;
-    }
-
-  if (priv->new_texture)
-    {
-      cogl_handle_unref (priv->new_texture);
-      priv->new_texture = NULL;
-    }
-
   if (priv->old_offscreen)
     {
-      cogl_handle_unref (priv->old_offscreen);
+      _st_offscreen_pool_release (priv->old_offscreen);
       priv->old_offscreen = NULL;
     }
 
   if (priv->new_offscreen)
     {
-      cogl_handle_unref (priv->new_offscreen);
+      _st_offscreen_pool_release (priv->new_offscreen);
       priv->new_offscreen = NULL;
     }
 
@@ -429,9 +414,6 @@ st_theme_node_transition_init (StThemeNodeTransition *transition)
   transition->priv->old_theme_node = NULL;
   transition->priv->new_theme_node = NULL;
 
-  transition->priv->old_texture = NULL;
-  transition->priv->new_texture = NULL;
-
   transition->priv->old_offscreen = NULL;
   transition->priv->new_offscreen = NULL;
 
@@ -68,6 +68,7 @@ st_theme_node_dispose (GObject *gobject)
 
   if (node->context)
     {
+      _st_theme_context_forget_node (node->context, node);
       g_object_unref (node->context);
       node->context = NULL;
     }
@@ -84,6 +85,12 @@ st_theme_node_dispose (GObject *gobject)
       node->parent_node = NULL;
     }
 
+  if (node->style_source)
+    {
+      g_object_unref (node->style_source);
+      node->style_source = NULL;
+    }
+
   if (node->border_image)
     {
       g_object_unref (node->border_image);
@@ -109,9 +116,10 @@ st_theme_node_finalize (GObject *object)
   g_free (node->pseudo_class);
   g_free (node->inline_style);
 
-  if (node->properties)
+  if (node->property_array)
     {
-      g_free (node->properties);
+      g_ptr_array_unref (node->property_array);
+      node->property_array = NULL;
       node->properties = NULL;
       node->n_properties = 0;
     }
@@ -322,6 +330,39 @@ st_theme_node_equal (StThemeNode *node_a, StThemeNode *node_b)
          !g_strcmp0 (node_a->inline_style, node_b->inline_style);
 }
 
+/**
+ * st_theme_node_hash:
+ * @node: a #StThemeNode
+ *
+ * Computes a hash value for @node, suitable for use together with
+ * st_theme_node_equal() in a #GHashTable.
+ *
+ * Returns: the hash value
+ */
+guint
+st_theme_node_hash (StThemeNode *node)
+{
+  guint hash;
+
+  g_return_val_if_fail (ST_IS_THEME_NODE (node), 0);
+
+  hash = GPOINTER_TO_UINT (node->parent_node);
+  hash = hash * 33 + GPOINTER_TO_UINT (node->context);
+  hash = hash * 33 + GPOINTER_TO_UINT (node->theme);
+  hash = hash * 33 + (guint) node->element_type;
+
+  if (node->element_id != NULL)
+    hash = hash * 33 + g_str_hash (node->element_id);
+  if (node->element_class != NULL)
+    hash = hash * 33 + g_str_hash (node->element_class);
+  if (node->pseudo_class != NULL)
+    hash = hash * 33 + g_str_hash (node->pseudo_class);
+  if (node->inline_style != NULL)
+    hash = hash * 33 + g_str_hash (node->inline_style);
+
+  return hash;
+}
+
 static void
 ensure_properties (StThemeNode *node)
 {
@@ -331,6 +372,34 @@ ensure_properties (StThemeNode *node)
 
       node->properties_computed = TRUE;
 
+      if (node->theme)
+        node->stylesheets_serial = _st_theme_get_stylesheets_serial (node->theme);
+
+      /* Siblings with the same parent, type, id, classes and pseudo-classes
+       * (menu items, app grid icons, ...) all match the same rules, so share
+       * the matched declarations and resolved values of the first one.
+       * Inline declarations are owned by their node, so those don't share.
+       */
+      if (node->context && !node->inline_style)
+        {
+          StThemeNode *source = _st_theme_context_intern_node (node->context, node);
+
+          if (source != node)
+            {
+              ensure_properties (source);
+
+              node->style_source = g_object_ref (source);
+              if (source->property_array)
+                {
+                  node->property_array = g_ptr_array_ref (source->property_array);
+                  node->properties = source->properties;
+                  node->n_properties = source->n_properties;
+                }
+
+              return;
+            }
+        }
+
       if (node->theme)
         properties = _st_theme_get_matched_properties (node->theme, node);
 
@@ -348,8 +417,9 @@ ensure_properties (StThemeNode *node)
 
       if (properties)
         {
+          node->property_array = properties;
           node->n_properties = properties->len;
-          node->properties = (CRDeclaration **)g_ptr_array_free (properties, FALSE);
+          node->properties = (CRDeclaration **)properties->pdata;
         }
     }
 }
@@ -1377,6 +1447,28 @@ _st_theme_node_ensure_geometry (StThemeNode *node)
 
   ensure_properties (node);
 
+  if (node->style_source)
+    {
+      StThemeNode *source = node->style_source;
+
+      _st_theme_node_ensure_geometry (source);
+
+      memcpy (node->border_width, source->border_width, sizeof (node->border_width));
+      memcpy (node->border_color, source->border_color, sizeof (node->border_color));
+      memcpy (node->border_radius, source->border_radius, sizeof (node->border_radius));
+      memcpy (node->padding, source->padding, sizeof (node->padding));
+      node->outline_width = source->outline_width;
+      node->outline_color = source->outline_color;
+      node->width = source->width;
+      node->height = source->height;
+      node->min_width = source->min_width;
+      node->min_height = source->min_height;
+      node->max_width = source->max_width;
+      node->max_height = source->max_height;
+
+      return;
+    }
+
   for (j = 0; j < 4; j++)
     {
       node->border_width[j] = 0;
@@ -1582,6 +1674,23 @@ _st_theme_node_ensure_background (StThemeNode *node)
 
   ensure_properties (node);
 
+  if (node->style_source)
+    {
+      StThemeNode *source = node->style_source;
+
+      _st_theme_node_ensure_background (source);
+
+      node->background_color = source->background_color;
+      node->background_gradient_type = source->background_gradient_type;
+      node->background_gradient_end = source->background_gradient_end;
+      node->background_position_x = source->background_position_x;
+      node->background_position_y = source->background_position_y;
+      node->background_position_set = source->background_position_set;
+      node->background_image = g_strdup (source->background_image);
+
+      return;
+    }
+
   for (i = 0; i < node->n_properties; i++)
     {
       CRDeclaration *decl = node->properties[i];
@@ -1795,6 +1904,12 @@ st_theme_node_get_foreground_color (StThemeNode  *node,
 
       ensure_properties (node);
 
+      if (node->style_source)
+        {
+          st_theme_node_get_foreground_color (node->style_source, &node->foreground_color);
+          goto out;
+        }
+
       for (i = node->n_properties - 1; i >= 0; i--)
         {
           CRDeclaration *decl = node->properties[i];
@@ -2301,6 +2416,14 @@ st_theme_node_get_font (StThemeNode *node)
   if (node->font_desc)
     return node->font_desc;
 
+  ensure_properties (node);
+
+  if (node->style_source)
+    {
+      node->font_desc = pango_font_description_copy (st_theme_node_get_font (node->style_source));
+      return node->font_desc;
+    }
+
   node->font_desc = pango_font_description_copy (get_parent_font (node));
   parent_size = pango_font_description_get_size (node->font_desc);
   if (!pango_font_description_get_size_is_absolute (node->font_desc))
@@ -2887,6 +3010,17 @@ st_theme_node_get_box_shadow (StThemeNode *node)
   node->box_shadow = NULL;
   node->box_shadow_computed = TRUE;
 
+  ensure_properties (node);
+
+  if (node->style_source)
+    {
+      shadow = st_theme_node_get_box_shadow (node->style_source);
+      if (shadow)
+        node->box_shadow = st_shadow_ref (shadow);
+
+      return node->box_shadow;
+    }
+
   if (st_theme_node_lookup_shadow (node,
                                    "box-shadow",
                                    FALSE,
@@ -2960,6 +3094,18 @@ st_theme_node_get_text_shadow (StThemeNode *node)
 
   ensure_properties (node);
 
+  if (node->style_source)
+    {
+      result = st_theme_node_get_text_shadow (node->style_source);
+      if (result)
+        st_shadow_ref (result);
+
+      node->text_shadow = result;
+      node->text_shadow_computed = TRUE;
+
+      return result;
+    }
+
   if (!st_theme_node_lookup_shadow (node,
                                     "text-shadow",
                                     FALSE,
@@ -110,6 +110,7 @@ StThemeNode *st_theme_node_get_parent (StThemeNode *node);
 StTheme *st_theme_node_get_theme (StThemeNode *node);
 
 gboolean    st_theme_node_equal (StThemeNode *node_a, StThemeNode *node_b);
+guint       st_theme_node_hash  (StThemeNode *node);
 
 GType       st_theme_node_get_element_type  (StThemeNode *node);
 const char *st_theme_node_get_element_id    (StThemeNode *node);
@@ -245,6 +246,16 @@ void st_theme_node_paint (StThemeNode            *node,
 void st_theme_node_copy_cached_paint_state (StThemeNode *node,
                                             StThemeNode *other);
 
+void st_theme_node_get_background_atlas_statistics (guint *n_pages,
+                                                    guint *n_backgrounds,
+                                                    gsize *used_pixels,
+                                                    gsize *total_pixels);
+
+void st_theme_node_get_transition_statistics (guint *n_reused,
+                                              guint *n_allocated,
+                                              gsize *total_bytes,
+                                              gsize *peak_bytes);
+
 G_END_DECLS
 
 #endif /* __ST_THEME_NODE_H__ */
@@ -36,6 +36,8 @@ char *_st_theme_resolve_url (StTheme      *theme,
 
 CRDeclaration *_st_theme_parse_declaration_list (const char *str);
 
+guint _st_theme_get_stylesheets_serial (StTheme *theme);
+
 G_END_DECLS
 
 #endif /* __ST_THEME_PRIVATE_H__ */
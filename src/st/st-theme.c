@@ -72,8 +72,33 @@ struct _StTheme
   GHashTable *filenames_by_stylesheet;
 
   CRCascade *cascade;
+
+  /* Index of all selectors in the cascade and the custom stylesheets,
+   * bucketed by the most selective part of their rightmost simple
+   * selector, so that matching a node only tests candidate rules.
+   * Built lazily, and thrown away whenever the set of stylesheets
+   * changes.
+   */
+  gboolean rule_index_valid;
+  GPtrArray *rules;
+  GHashTable *rules_by_id;
+  GHashTable *rules_by_class;
+  GHashTable *rules_by_type;
+  GPtrArray *universal_rules;
+
+  /* Bumped whenever a stylesheet is loaded or unloaded */
+  guint stylesheets_serial;
 };
 
+/* A single selector from a ruleset, in document order */
+typedef struct
+{
+  CRStatement *statement;
+  CRSimpleSel *simple_sel;
+  gulong specificity;
+  guint position;
+} StThemeRule;
+
 struct _StThemeClass
 {
   GObjectClass parent_class;
@@ -89,6 +114,8 @@ enum
 
 G_DEFINE_TYPE (StTheme, st_theme, G_TYPE_OBJECT)
 
+static void invalidate_rule_index (StTheme *theme);
+
 /* Quick strcmp.  Test only for == 0 or != 0, not < 0 or > 0.  */
 #define strqcmp(str,lit,lit_len) \
   (strlen (str) != (lit_len) || memcmp (str, lit, lit_len))
@@ -99,6 +126,15 @@ st_theme_init (StTheme *theme)
   theme->stylesheets_by_filename = g_hash_table_new_full (g_str_hash, g_str_equal,
                                                           (GDestroyNotify)g_free, (GDestroyNotify)cr_stylesheet_unref);
   theme->filenames_by_stylesheet = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  theme->rules = g_ptr_array_new_with_free_func (g_free);
+  theme->rules_by_id = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                              (GDestroyNotify)g_free, (GDestroyNotify)g_ptr_array_unref);
+  theme->rules_by_class = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                 (GDestroyNotify)g_free, (GDestroyNotify)g_ptr_array_unref);
+  theme->rules_by_type = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                (GDestroyNotify)g_free, (GDestroyNotify)g_ptr_array_unref);
+  theme->universal_rules = g_ptr_array_new ();
 }
 
 static void
@@ -234,6 +270,9 @@ st_theme_load_stylesheet (StTheme    *theme,
   cr_stylesheet_ref (stylesheet);
   theme->custom_stylesheets = g_slist_prepend (theme->custom_stylesheets, stylesheet);
 
+  invalidate_rule_index (theme);
+  theme->stylesheets_serial++;
+
   return TRUE;
 }
 
@@ -250,12 +289,29 @@ st_theme_unload_stylesheet (StTheme    *theme,
   if (!g_slist_find (theme->custom_stylesheets, stylesheet))
     return;
 
+  invalidate_rule_index (theme);
+  theme->stylesheets_serial++;
+
   theme->custom_stylesheets = g_slist_remove (theme->custom_stylesheets, stylesheet);
   g_hash_table_remove (theme->stylesheets_by_filename, path);
   g_hash_table_remove (theme->filenames_by_stylesheet, stylesheet);
   cr_stylesheet_unref (stylesheet);
 }
 
+/**
+ * _st_theme_get_stylesheets_serial:
+ * @theme: an #StTheme
+ *
+ * Return value: a number that changes whenever stylesheets are loaded
+ *   into or unloaded from @theme, so that style matched before can be
+ *   told apart
+ */
+guint
+_st_theme_get_stylesheets_serial (StTheme *theme)
+{
+  return theme->stylesheets_serial;
+}
+
 /**
  * st_theme_get_custom_stylesheets:
  * @theme: an #StTheme
@@ -323,6 +379,12 @@ st_theme_finalize (GObject * object)
   g_slist_free (theme->custom_stylesheets);
   theme->custom_stylesheets = NULL;
 
+  g_ptr_array_free (theme->rules, TRUE);
+  g_hash_table_destroy (theme->rules_by_id);
+  g_hash_table_destroy (theme->rules_by_class);
+  g_hash_table_destroy (theme->rules_by_type);
+  g_ptr_array_free (theme->universal_rules, TRUE);
+
   g_hash_table_destroy (theme->stylesheets_by_filename);
   g_hash_table_destroy (theme->filenames_by_stylesheet);
 
@@ -796,22 +858,94 @@ done:
 }
 
 static void
-add_matched_properties (StTheme      *a_this,
-                        CRStyleSheet *a_nodesheet,
-                        StThemeNode  *a_node,
-                        GPtrArray    *props)
+add_rule_to_bucket (GHashTable  *buckets,
+                    const char  *key,
+                    StThemeRule *rule)
+{
+  GPtrArray *bucket;
+
+  bucket = g_hash_table_lookup (buckets, key);
+  if (bucket == NULL)
+    {
+      bucket = g_ptr_array_new ();
+      g_hash_table_insert (buckets, g_strdup (key), bucket);
+    }
+
+  g_ptr_array_add (bucket, rule);
+}
+
+static void
+index_selector (StTheme     *theme,
+                CRStatement *stmt,
+                CRSimpleSel *simple_sel)
+{
+  StThemeRule *rule;
+  CRSimpleSel *last_sel;
+  CRAdditionalSel *add_sel;
+  const char *class_name = NULL;
+
+  /* Selectors are matched right to left, so bucket them by the
+   * rightmost simple selector: an id is the most selective key,
+   * then a class, then the element type.
+   */
+  for (last_sel = simple_sel; last_sel->next; last_sel = last_sel->next)
+    ;
+
+  if (!(last_sel->type_mask & (TYPE_SELECTOR | UNIVERSAL_SELECTOR)) &&
+      !last_sel->add_sel)
+    return; /* Can never match anything */
+
+  cr_simple_sel_compute_specificity (simple_sel);
+
+  rule = g_new0 (StThemeRule, 1);
+  rule->statement = stmt;
+  rule->simple_sel = simple_sel;
+  rule->specificity = simple_sel->specificity;
+  rule->position = theme->rules->len;
+  g_ptr_array_add (theme->rules, rule);
+
+  for (add_sel = last_sel->add_sel; add_sel; add_sel = add_sel->next)
+    {
+      if (add_sel->type == ID_ADD_SELECTOR &&
+          add_sel->content.id_name &&
+          add_sel->content.id_name->stryng &&
+          add_sel->content.id_name->stryng->str)
+        {
+          add_rule_to_bucket (theme->rules_by_id,
+                              add_sel->content.id_name->stryng->str, rule);
+          return;
+        }
+
+      if (class_name == NULL &&
+          add_sel->type == CLASS_ADD_SELECTOR &&
+          add_sel->content.class_name &&
+          add_sel->content.class_name->stryng &&
+          add_sel->content.class_name->stryng->str)
+        class_name = add_sel->content.class_name->stryng->str;
+    }
+
+  if (class_name != NULL)
+    add_rule_to_bucket (theme->rules_by_class, class_name, rule);
+  else if ((last_sel->type_mask & TYPE_SELECTOR) &&
+           !(last_sel->type_mask & UNIVERSAL_SELECTOR) &&
+           last_sel->name && last_sel->name->stryng && last_sel->name->stryng->str)
+    add_rule_to_bucket (theme->rules_by_type, last_sel->name->stryng->str, rule);
+  else
+    g_ptr_array_add (theme->universal_rules, rule);
+}
+
+static void
+index_stylesheet (StTheme      *a_this,
+                  CRStyleSheet *a_nodesheet)
 {
   CRStatement *cur_stmt = NULL;
   CRSelector *sel_list = NULL;
   CRSelector *cur_sel = NULL;
-  gboolean matches = FALSE;
-  enum CRStatus status = CR_OK;
 
   /*
    *walk through the list of statements and,
    *get the selectors list inside the statements that
-   *contain some, and try to match our style node in these
-   *selectors lists.
+   *contain some, and add them to the rule index.
    */
   for (cur_stmt = a_nodesheet->statements; cur_stmt; cur_stmt = cur_stmt->next)
     {
@@ -878,10 +1012,7 @@ add_matched_properties (StTheme      *a_this,
               }
 
             if (import_rule->sheet != (CRStyleSheet *) - 1)
-              {
-                add_matched_properties (a_this, import_rule->sheet,
-                                        a_node, props);
-              }
+              index_stylesheet (a_this, import_rule->sheet);
           }
           break;
         default:
@@ -891,41 +1022,204 @@ add_matched_properties (StTheme      *a_this,
       if (!sel_list)
         continue;
 
-      /*
-       *now, we have a comma separated selector list to look in.
-       *let's walk it and try to match the style node
-       *on each item of the list.
-       */
       for (cur_sel = sel_list; cur_sel; cur_sel = cur_sel->next)
         {
           if (!cur_sel->simple_sel)
             continue;
 
-          status = sel_matches_style_real (a_this, cur_sel->simple_sel, a_node, &matches, TRUE, TRUE);
+          index_selector (a_this, cur_stmt, cur_sel->simple_sel);
+        }
+    }
+}
+
+static void
+invalidate_rule_index (StTheme *theme)
+{
+  if (!theme->rule_index_valid)
+    return;
+
+  g_hash_table_remove_all (theme->rules_by_id);
+  g_hash_table_remove_all (theme->rules_by_class);
+  g_hash_table_remove_all (theme->rules_by_type);
+  g_ptr_array_set_size (theme->universal_rules, 0);
+  g_ptr_array_set_size (theme->rules, 0);
 
-          if (status == CR_OK && matches)
-            {
-              CRDeclaration *cur_decl = NULL;
-
-              /* In order to sort the matching properties, we need to compute the
-               * specificity of the selector that actually matched this
-               * element. In a non-thread-safe fashion, we store it in the
-               * ruleset. (Fixing this would mean cut-and-pasting
-               * cr_simple_sel_compute_specificity(), and have no need for
-               * thread-safety anyways.)
-               *
-               * Once we've sorted the properties, the specificity no longer
-               * matters and it can be safely overriden.
-               */
-              cr_simple_sel_compute_specificity (cur_sel->simple_sel);
-
-              cur_stmt->specificity = cur_sel->simple_sel->specificity;
-
-              for (cur_decl = cur_stmt->kind.ruleset->decl_list; cur_decl; cur_decl = cur_decl->next)
-                g_ptr_array_add (props, cur_decl);
-            }
+  theme->rule_index_valid = FALSE;
+}
+
+static void
+ensure_rule_index (StTheme *theme)
+{
+  enum CRStyleOrigin origin = 0;
+  CRStyleSheet *sheet = NULL;
+  GSList *iter;
+
+  if (theme->rule_index_valid)
+    return;
+
+  /* The order here determines rule positions, and must match the
+   * order in which declarations of equal priority are applied.
+   */
+  for (origin = ORIGIN_UA; origin < NB_ORIGINS; origin++)
+    {
+      sheet = cr_cascade_get_sheet (theme->cascade, origin);
+      if (!sheet)
+        continue;
+
+      index_stylesheet (theme, sheet);
+    }
+
+  for (iter = theme->custom_stylesheets; iter; iter = iter->next)
+    index_stylesheet (theme, iter->data);
+
+  theme->rule_index_valid = TRUE;
+}
+
+static void
+add_bucket_candidates (GHashTable *buckets,
+                       const char *key,
+                       GPtrArray  *candidates)
+{
+  GPtrArray *bucket;
+  guint i;
+
+  bucket = g_hash_table_lookup (buckets, key);
+  if (bucket == NULL)
+    return;
+
+  for (i = 0; i < bucket->len; i++)
+    g_ptr_array_add (candidates, g_ptr_array_index (bucket, i));
+}
+
+static void
+add_type_candidates (StTheme   *theme,
+                     GType      element_type,
+                     GPtrArray *candidates)
+{
+  GType *interfaces;
+  guint n_interfaces, i;
+  GType type;
+
+  if (g_hash_table_size (theme->rules_by_type) == 0)
+    return;
+
+  if (element_type == G_TYPE_NONE)
+    {
+      add_bucket_candidates (theme->rules_by_type, "stage", candidates);
+      return;
+    }
+
+  /* Mirror element_name_matches_type(): a type selector matches the
+   * element type, any of its ancestors, and any interface it implements.
+   */
+  for (type = element_type; type != 0; type = g_type_parent (type))
+    add_bucket_candidates (theme->rules_by_type, g_type_name (type), candidates);
+
+  interfaces = g_type_interfaces (element_type, &n_interfaces);
+  for (i = 0; i < n_interfaces; i++)
+    add_bucket_candidates (theme->rules_by_type, g_type_name (interfaces[i]), candidates);
+  g_free (interfaces);
+}
+
+static void
+add_class_candidates (StTheme    *theme,
+                      const char *element_class,
+                      GPtrArray  *candidates)
+{
+  const char *cur = element_class;
+  GString *class_name;
+
+  if (element_class == NULL || g_hash_table_size (theme->rules_by_class) == 0)
+    return;
+
+  class_name = g_string_new (NULL);
+
+  while (*cur)
+    {
+      while (*cur && cr_utils_is_white_space (*cur))
+        cur++;
+
+      g_string_truncate (class_name, 0);
+      while (*cur && !cr_utils_is_white_space (*cur))
+        g_string_append_c (class_name, *cur++);
+
+      if (class_name->len > 0)
+        add_bucket_candidates (theme->rules_by_class, class_name->str, candidates);
+    }
+
+  g_string_free (class_name, TRUE);
+}
+
+static int
+compare_rule_positions (gconstpointer a,
+                        gconstpointer b)
+{
+  StThemeRule *rule_a = *(StThemeRule **) a;
+  StThemeRule *rule_b = *(StThemeRule **) b;
+
+  return (int) rule_a->position - (int) rule_b->position;
+}
+
+static void
+add_matched_properties (StTheme      *a_this,
+                        StThemeNode  *a_node,
+                        GPtrArray    *props)
+{
+  GPtrArray *candidates;
+  StThemeRule *prev_rule = NULL;
+  const char *element_id;
+  gboolean matches = FALSE;
+  enum CRStatus status = CR_OK;
+  guint i;
+
+  candidates = g_ptr_array_new ();
+
+  element_id = st_theme_node_get_element_id (a_node);
+  if (element_id != NULL)
+    add_bucket_candidates (a_this->rules_by_id, element_id, candidates);
+
+  add_class_candidates (a_this, st_theme_node_get_element_class (a_node), candidates);
+  add_type_candidates (a_this, st_theme_node_get_element_type (a_node), candidates);
+
+  for (i = 0; i < a_this->universal_rules->len; i++)
+    g_ptr_array_add (candidates, g_ptr_array_index (a_this->universal_rules, i));
+
+  /* Put candidates back in document order, since the stable sort of the
+   * declarations relies on it; duplicates (from a class listed twice,
+   * or an interface shared by several ancestors) end up adjacent.
+   */
+  g_ptr_array_sort (candidates, compare_rule_positions);
+
+  for (i = 0; i < candidates->len; i++)
+    {
+      StThemeRule *rule = g_ptr_array_index (candidates, i);
+
+      if (rule == prev_rule)
+        continue;
+      prev_rule = rule;
+
+      status = sel_matches_style_real (a_this, rule->simple_sel, a_node, &matches, TRUE, TRUE);
+
+      if (status == CR_OK && matches)
+        {
+          CRDeclaration *cur_decl = NULL;
+
+          /* In order to sort the matching properties, we need the
+           * specificity of the selector that actually matched this
+           * element. In a non-thread-safe fashion, we store it in the
+           * ruleset.
+           *
+           * Once we've sorted the properties, the specificity no longer
+           * matters and it can be safely overriden.
+           */
+          rule->statement->specificity = rule->specificity;
+
+          for (cur_decl = rule->statement->kind.ruleset->decl_list; cur_decl; cur_decl = cur_decl->next)
+            g_ptr_array_add (props, cur_decl);
         }
     }
+
+  g_ptr_array_free (candidates, TRUE);
 }
 
 #define ORIGIN_AUTHOR_IMPORTANT (ORIGIN_AUTHOR + 1)
@@ -973,25 +1267,13 @@ GPtrArray *
 _st_theme_get_matched_properties (StTheme        *theme,
                                   StThemeNode    *node)
 {
-  enum CRStyleOrigin origin = 0;
-  CRStyleSheet *sheet = NULL;
   GPtrArray *props = g_ptr_array_new ();
-  GSList *iter;
 
   g_return_val_if_fail (ST_IS_THEME (theme), NULL);
   g_return_val_if_fail (ST_IS_THEME_NODE (node), NULL);
 
-  for (origin = ORIGIN_UA; origin < NB_ORIGINS; origin++)
-    {
-      sheet = cr_cascade_get_sheet (theme->cascade, origin);
-      if (!sheet)
-        continue;
-
-      add_matched_properties (theme, sheet, node, props);
-    }
-
-  for (iter = theme->custom_stylesheets; iter; iter = iter->next)
-    add_matched_properties (theme, iter->data, node, props);
+  ensure_rule_index (theme);
+  add_matched_properties (theme, node, props);
 
   /* We count on a stable sort here so that later declarations come
    * after earlier declarations */
@@ -0,0 +1,294 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * test-atlas-packer.c: test program for the atlas page packer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "st-atlas-packer.h"
+
+/* What StTextureCache puts into its icon atlas: common icon sizes,
+ * with the 1 pixel padding on each side */
+#define PAGE_SIZE 512
+#define PADDING 2
+
+/* Least fraction of the pages the icons must fill under churn */
+#define MIN_OCCUPANCY 0.4
+
+typedef struct {
+  gint page;
+  gint x;
+  gint y;
+  gint width;
+  gint height;
+} Rect;
+
+static gboolean fail;
+
+static gint
+random_icon_size (GRand *rand)
+{
+  static const gint sizes[] = { 16, 22, 24, 32, 48 };
+
+  return sizes[g_rand_int_range (rand, 0, G_N_ELEMENTS (sizes))] + PADDING;
+}
+
+/* Marks the pixels of @rect on @pages, checking they were free */
+static gboolean
+mark_rect (guchar     **pages,
+           const Rect  *rect,
+           guchar       value)
+{
+  gint i, j;
+
+  if (rect->x < 0 || rect->y < 0 ||
+      rect->x + rect->width > PAGE_SIZE || rect->y + rect->height > PAGE_SIZE)
+    {
+      g_print ("%dx%d at %d,%d: out of the page\n",
+               rect->width, rect->height, rect->x, rect->y);
+      return FALSE;
+    }
+
+  for (j = rect->y; j < rect->y + rect->height; j++)
+    for (i = rect->x; i < rect->x + rect->width; i++)
+      {
+        guchar *pixel = &pages[rect->page][j * PAGE_SIZE + i];
+
+        if (*pixel == value)
+          {
+            g_print ("%dx%d at %d,%d: overlaps another rectangle\n",
+                     rect->width, rect->height, rect->x, rect->y);
+            return FALSE;
+          }
+        *pixel = value;
+      }
+
+  return TRUE;
+}
+
+static void
+shuffle (GRand  *rand,
+         GArray *rects)
+{
+  guint i;
+
+  for (i = rects->len; i > 1; i--)
+    {
+      guint j = g_rand_int_range (rand, 0, i);
+      Rect tmp = g_array_index (rects, Rect, i - 1);
+
+      g_array_index (rects, Rect, i - 1) = g_array_index (rects, Rect, j);
+      g_array_index (rects, Rect, j) = tmp;
+    }
+}
+
+/* Fills a page with random icons, then frees them in random order, with
+ * some refills half way, and checks that the page ends up blank */
+static void
+test_fill_and_empty (GRand *rand)
+{
+  StAtlasPacker *packer = _st_atlas_packer_new (PAGE_SIZE, PAGE_SIZE);
+  GArray *rects = g_array_new (FALSE, FALSE, sizeof (Rect));
+  guchar *page = g_malloc0 (PAGE_SIZE * PAGE_SIZE);
+  gint round;
+  Rect rect;
+
+  for (round = 0; round < 3 && !fail; round++)
+    {
+      guint n_failed = 0;
+
+      /* Fill until several sizes in a row don't fit anymore */
+      while (n_failed < 20 && !fail)
+        {
+          rect.page = 0;
+          rect.width = random_icon_size (rand);
+          rect.height = rect.width;
+
+          if (!_st_atlas_packer_allocate (packer, rect.width, rect.height,
+                                          &rect.x, &rect.y, NULL))
+            {
+              n_failed++;
+              continue;
+            }
+
+          n_failed = 0;
+          if (!mark_rect (&page, &rect, 1))
+            fail = TRUE;
+          g_array_append_val (rects, rect);
+        }
+
+      /* Free all but a quarter, then all in the last round */
+      shuffle (rand, rects);
+      while (rects->len > (round < 2 ? rects->len / 4 : 0) && !fail)
+        {
+          rect = g_array_index (rects, Rect, rects->len - 1);
+          g_array_set_size (rects, rects->len - 1);
+
+          if (!mark_rect (&page, &rect, 0))
+            fail = TRUE;
+          _st_atlas_packer_release (packer, rect.x, rect.y, rect.width);
+        }
+    }
+
+  if (!fail && !_st_atlas_packer_is_empty (packer))
+    {
+      g_print ("page isn't blank after freeing all rectangles\n");
+      fail = TRUE;
+    }
+
+  g_free (page);
+  g_array_free (rects, TRUE);
+  _st_atlas_packer_free (packer);
+}
+
+/* Keeps adding and dropping random icons on a growing set of pages, the
+ * way StTextureAtlas does, and returns how full the pages are at the end.
+ * Without @recycle, freed space is only reused once its page is empty,
+ * as before holes were kept. */
+static double
+run_churn (guint32  seed,
+           gboolean recycle)
+{
+  GRand *rand = g_rand_new_with_seed (seed);
+  GPtrArray *packers = g_ptr_array_new ();
+  GArray *rects = g_array_new (FALSE, FALSE, sizeof (Rect));
+  guchar *pages[64];
+  guint n_rects[64];
+  gsize used_pixels = 0;
+  double occupancy;
+  gint step;
+  guint i;
+  Rect rect;
+
+  for (step = 0; step < 50000 && !fail; step++)
+    {
+      /* Hover around 500 icons, a few pages worth */
+      if (g_rand_int_range (rand, 0, 1000) >= (gint) rects->len)
+        {
+          rect.width = random_icon_size (rand);
+          rect.height = rect.width;
+
+          for (i = 0; i < packers->len; i++)
+            if (_st_atlas_packer_allocate (packers->pdata[i], rect.width, rect.height,
+                                           &rect.x, &rect.y, NULL))
+              break;
+
+          if (i == packers->len)
+            {
+              g_assert (i < G_N_ELEMENTS (pages));
+              g_ptr_array_add (packers, _st_atlas_packer_new (PAGE_SIZE, PAGE_SIZE));
+              pages[i] = g_malloc0 (PAGE_SIZE * PAGE_SIZE);
+              n_rects[i] = 0;
+              _st_atlas_packer_allocate (packers->pdata[i], rect.width, rect.height,
+                                         &rect.x, &rect.y, NULL);
+            }
+
+          rect.page = i;
+          if (!mark_rect (pages, &rect, 1))
+            fail = TRUE;
+          g_array_append_val (rects, rect);
+          n_rects[i]++;
+          used_pixels += rect.width * rect.height;
+        }
+      else
+        {
+          guint index = g_rand_int_range (rand, 0, rects->len);
+
+          rect = g_array_index (rects, Rect, index);
+          g_array_remove_index_fast (rects, index);
+
+          if (!mark_rect (pages, &rect, 0))
+            fail = TRUE;
+          n_rects[rect.page]--;
+          used_pixels -= rect.width * rect.height;
+
+          if (recycle)
+            _st_atlas_packer_release (packers->pdata[rect.page], rect.x, rect.y, rect.width);
+          else if (n_rects[rect.page] == 0)
+            _st_atlas_packer_clear (packers->pdata[rect.page]);
+
+          /* Drop the last page once it's empty */
+          while (packers->len > 1 && n_rects[packers->len - 1] == 0)
+            {
+              if (recycle && !_st_atlas_packer_is_empty (packers->pdata[packers->len - 1]))
+                {
+                  g_print ("churn: page isn't blank after freeing all rectangles\n");
+                  fail = TRUE;
+                }
+
+              _st_atlas_packer_free (packers->pdata[packers->len - 1]);
+              g_free (pages[packers->len - 1]);
+              g_ptr_array_set_size (packers, packers->len - 1);
+            }
+        }
+    }
+
+  occupancy = (double) used_pixels / ((gsize) packers->len * PAGE_SIZE * PAGE_SIZE);
+  g_print ("churn%s: %u icons on %u pages, %.0f%% used\n",
+           recycle ? "" : " without recycling",
+           rects->len, packers->len, occupancy * 100);
+
+  for (i = 0; i < packers->len; i++)
+    {
+      _st_atlas_packer_free (packers->pdata[i]);
+      g_free (pages[i]);
+    }
+  g_ptr_array_free (packers, TRUE);
+  g_array_free (rects, TRUE);
+  g_rand_free (rand);
+
+  return occupancy;
+}
+
+static void
+test_churn (void)
+{
+  double occupancy, baseline;
+
+  occupancy = run_churn (42, TRUE);
+  baseline = run_churn (42, FALSE);
+
+  if (!fail && occupancy < MIN_OCCUPANCY)
+    {
+      g_print ("churn: pages are less than %.0f%% used\n", MIN_OCCUPANCY * 100);
+      fail = TRUE;
+    }
+
+  if (!fail && occupancy <= baseline)
+    {
+      g_print ("churn: recycling doesn't use the pages better\n");
+      fail = TRUE;
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  GRand *rand;
+  gint i;
+
+  rand = g_rand_new_with_seed (42);
+
+  for (i = 0; i < 20 && !fail; i++)
+    test_fill_and_empty (rand);
+
+  g_rand_free (rand);
+
+  if (!fail)
+    test_churn ();
+
+  return fail ? 1 : 0;
+}
@@ -0,0 +1,313 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * test-blur.c: test program and benchmark for the shadow blur
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "st-blur.h"
+
+/* How far the box blur approximation may stray from the exact gaussian */
+#define MAX_PIXEL_ERROR 8
+#define MAX_MEAN_ERROR 2.0
+
+static gboolean fail;
+
+/* The exact gaussian blur that was used for shadows before, except that
+ * the old code truncated the output after every tap, which made wide
+ * shadows noticeably fainter than they should be; here the sums are kept
+ * in floating point and only rounded at the end. */
+static guchar *
+reference_blur (const guchar *pixels_in,
+                gint          width_in,
+                gint          height_in,
+                gint          rowstride_in,
+                gdouble       blur,
+                gint         *width_out,
+                gint         *height_out,
+                gint         *rowstride_out)
+{
+  guchar  *pixels_out;
+  gdouble *kernel;
+  gdouble *tmp;
+  gdouble  sigma, sum;
+  gint     n_values, half;
+  gint     x_in, y_in, x_out, y_out, i;
+
+  sigma = blur / 2.;
+  n_values = (gint) (5 * sigma);
+  half = n_values / 2;
+
+  *width_out  = width_in  + 2 * half;
+  *height_out = height_in + 2 * half;
+  *rowstride_out = (*width_out + 3) & ~3;
+
+  pixels_out = g_malloc0 (*rowstride_out * *height_out);
+  tmp        = g_new0 (gdouble, *width_out * *height_out);
+
+  if (n_values == 0)
+    {
+      for (y_in = 0; y_in < height_in; y_in++)
+        memcpy (pixels_out + y_in * *rowstride_out,
+                pixels_in + y_in * rowstride_in, width_in);
+      g_free (tmp);
+      return pixels_out;
+    }
+
+  kernel = g_malloc (n_values * sizeof (gdouble));
+  sum = 0.0;
+  for (i = 0; i < n_values; i++)
+    {
+      kernel[i] = exp (-(i - half) * (i - half) / (2 * sigma * sigma));
+      sum += kernel[i];
+    }
+  for (i = 0; i < n_values; i++)
+    kernel[i] /= sum;
+
+  for (x_in = 0; x_in < width_in; x_in++)
+    for (y_out = 0; y_out < *height_out; y_out++)
+      {
+        gint i0, i1;
+
+        y_in = y_out - half;
+        i0 = MAX (half - y_in, 0);
+        i1 = MIN (height_in + half - y_in, n_values);
+
+        for (i = i0; i < i1; i++)
+          tmp[y_out * *width_out + x_in + half] +=
+            pixels_in[(y_in + i - half) * rowstride_in + x_in] * kernel[i];
+      }
+
+  for (y_out = 0; y_out < *height_out; y_out++)
+    for (x_out = 0; x_out < *width_out; x_out++)
+      {
+        gdouble value = 0;
+        gint i0, i1;
+
+        i0 = MAX (half - x_out, 0);
+        i1 = MIN (*width_out + half - x_out, n_values);
+
+        for (i = i0; i < i1; i++)
+          value += tmp[y_out * *width_out + x_out + i - half] * kernel[i];
+
+        pixels_out[y_out * *rowstride_out + x_out] = (guchar) MIN (floor (value + 0.5), 255);
+      }
+
+  g_free (kernel);
+  g_free (tmp);
+
+  return pixels_out;
+}
+
+/* A rounded rectangle, like most shadowed things are */
+static guchar *
+make_mask (gint width,
+           gint height,
+           gint rowstride)
+{
+  guchar *mask = g_malloc0 (rowstride * height);
+  gint radius = MIN (width, height) / 4;
+  gint x, y;
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      {
+        gint dx = MAX (MAX (radius - x, x - (width - 1 - radius)), 0);
+        gint dy = MAX (MAX (radius - y, y - (height - 1 - radius)), 0);
+
+        if (dx * dx + dy * dy <= radius * radius)
+          mask[y * rowstride + x] = 255;
+      }
+
+  return mask;
+}
+
+static void
+test_blur (gint    width,
+           gint    height,
+           gdouble blur)
+{
+  gint rowstride = (width + 3) & ~3;
+  guchar *mask = make_mask (width, height, rowstride);
+  guchar *expected, *fast, *portable;
+  gint expected_width, expected_height, expected_rowstride;
+  gint fast_width, fast_height, fast_rowstride;
+  gint portable_width, portable_height, portable_rowstride;
+  gint x, y, max_error = 0;
+  gdouble total_error = 0;
+
+  expected = reference_blur (mask, width, height, rowstride, blur,
+                             &expected_width, &expected_height, &expected_rowstride);
+
+  _st_blur_set_use_simd (TRUE);
+  fast = _st_blur_alpha (mask, width, height, rowstride, blur,
+                         &fast_width, &fast_height, &fast_rowstride);
+
+  _st_blur_set_use_simd (FALSE);
+  portable = _st_blur_alpha (mask, width, height, rowstride, blur,
+                             &portable_width, &portable_height, &portable_rowstride);
+
+  if (fast_width != expected_width || fast_height != expected_height ||
+      fast_rowstride != expected_rowstride)
+    {
+      g_print ("%dx%d blur %g: expected size %dx%d (%d), got %dx%d (%d)\n",
+               width, height, blur,
+               expected_width, expected_height, expected_rowstride,
+               fast_width, fast_height, fast_rowstride);
+      fail = TRUE;
+      goto out;
+    }
+
+  if (memcmp (fast, portable, fast_rowstride * fast_height) != 0)
+    {
+      g_print ("%dx%d blur %g: SIMD and portable results differ\n",
+               width, height, blur);
+      fail = TRUE;
+    }
+
+  for (y = 0; y < fast_height; y++)
+    for (x = 0; x < fast_width; x++)
+      {
+        gint error = abs (fast[y * fast_rowstride + x] - expected[y * expected_rowstride + x]);
+
+        max_error = MAX (max_error, error);
+        total_error += error;
+      }
+
+  if (max_error > MAX_PIXEL_ERROR ||
+      total_error / (fast_width * fast_height) > MAX_MEAN_ERROR)
+    {
+      g_print ("%dx%d blur %g: max error %d, mean error %g\n",
+               width, height, blur, max_error,
+               total_error / (fast_width * fast_height));
+      fail = TRUE;
+    }
+
+ out:
+  g_free (mask);
+  g_free (expected);
+  g_free (fast);
+  g_free (portable);
+}
+
+/* Wide blurs of a solid block: where the boxes only cover opaque
+ * pixels, the sums are at their maximum and the result must be opaque
+ * rather than wrap around */
+static void
+test_opaque_blur (gint    size,
+                  gdouble blur)
+{
+  gint rowstride = (size + 3) & ~3;
+  guchar *block = g_malloc (rowstride * size);
+  guchar *fast, *portable;
+  gint width, height, out_rowstride;
+
+  memset (block, 255, rowstride * size);
+
+  _st_blur_set_use_simd (TRUE);
+  fast = _st_blur_alpha (block, size, size, rowstride, blur,
+                         &width, &height, &out_rowstride);
+
+  _st_blur_set_use_simd (FALSE);
+  portable = _st_blur_alpha (block, size, size, rowstride, blur,
+                             &width, &height, &out_rowstride);
+
+  if (memcmp (fast, portable, out_rowstride * height) != 0)
+    {
+      g_print ("opaque %dx%d blur %g: SIMD and portable results differ\n",
+               size, size, blur);
+      fail = TRUE;
+    }
+
+  if (portable[(height / 2) * out_rowstride + width / 2] != 255)
+    {
+      g_print ("opaque %dx%d blur %g: center is %d rather than opaque\n",
+               size, size, blur, portable[(height / 2) * out_rowstride + width / 2]);
+      fail = TRUE;
+    }
+
+  g_free (block);
+  g_free (fast);
+  g_free (portable);
+}
+
+static void
+benchmark_blur (gint    width,
+                gint    height,
+                gdouble blur)
+{
+  gint rowstride = (width + 3) & ~3;
+  guchar *mask = make_mask (width, height, rowstride);
+  gint width_out, height_out, rowstride_out;
+  gint64 start, reference_time, portable_time, fast_time;
+  const int iterations = 10;
+  int i;
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < iterations; i++)
+    g_free (reference_blur (mask, width, height, rowstride, blur,
+                            &width_out, &height_out, &rowstride_out));
+  reference_time = (g_get_monotonic_time () - start) / iterations;
+
+  _st_blur_set_use_simd (FALSE);
+  start = g_get_monotonic_time ();
+  for (i = 0; i < iterations; i++)
+    g_free (_st_blur_alpha (mask, width, height, rowstride, blur,
+                            &width_out, &height_out, &rowstride_out));
+  portable_time = (g_get_monotonic_time () - start) / iterations;
+
+  _st_blur_set_use_simd (TRUE);
+  start = g_get_monotonic_time ();
+  for (i = 0; i < iterations; i++)
+    g_free (_st_blur_alpha (mask, width, height, rowstride, blur,
+                            &width_out, &height_out, &rowstride_out));
+  fast_time = (g_get_monotonic_time () - start) / iterations;
+
+  g_print ("%4dx%-4d blur %3g: gaussian %7" G_GINT64_FORMAT "us, "
+           "box %6" G_GINT64_FORMAT "us, box+simd %6" G_GINT64_FORMAT "us\n",
+           width, height, blur, reference_time, portable_time, fast_time);
+
+  g_free (mask);
+}
+
+int
+main (int argc, char **argv)
+{
+  static const gdouble blurs[] = { 1, 2, 3, 5, 8, 12, 20, 35, 60, 160, 300 };
+  guint i;
+
+  if (argc > 1 && strcmp (argv[1], "--benchmark") == 0)
+    {
+      benchmark_blur (48, 48, 4);
+      benchmark_blur (200, 30, 8);
+      benchmark_blur (400, 300, 20);
+      benchmark_blur (1024, 768, 40);
+      return 0;
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (blurs); i++)
+    {
+      test_blur (1, 1, blurs[i]);
+      test_blur (16, 16, blurs[i]);
+      test_blur (33, 7, blurs[i]);
+      test_blur (120, 48, blurs[i]);
+      test_opaque_blur (4 * blurs[i], blurs[i]);
+    }
+
+  return fail ? 1 : 0;
+}
@@ -0,0 +1,166 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * test-content-hash.c: test program and benchmark for the content hash
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "st-content-hash.h"
+
+static gboolean fail;
+
+static guchar *
+make_data (GRand *rand,
+           gsize  len)
+{
+  guchar *data = g_malloc (len + 1);
+  gsize i;
+
+  for (i = 0; i < len; i++)
+    data[i] = g_rand_int_range (rand, 0, 256);
+
+  return data;
+}
+
+static gboolean
+hash_equal (const StContentHash *a,
+            const StContentHash *b)
+{
+  return a->low == b->low && a->high == b->high;
+}
+
+static void
+test_hash (GRand *rand,
+           gsize  len)
+{
+  guchar *data = make_data (rand, len);
+  StContentHash fast, portable, changed;
+  gsize i;
+
+  _st_content_hash_set_use_simd (TRUE);
+  _st_content_hash_compute (data, len, &fast);
+
+  _st_content_hash_set_use_simd (FALSE);
+  _st_content_hash_compute (data, len, &portable);
+
+  if (!hash_equal (&fast, &portable))
+    {
+      g_print ("%" G_GSIZE_FORMAT " bytes: SIMD and portable results differ\n", len);
+      fail = TRUE;
+    }
+
+  /* Every bit of the input, and its length, matters; check a few */
+  for (i = 0; i < MIN (len, 100); i++)
+    {
+      gsize byte = g_rand_int_range (rand, 0, len);
+      guchar bit = 1 << g_rand_int_range (rand, 0, 8);
+
+      data[byte] ^= bit;
+      _st_content_hash_compute (data, len, &changed);
+      data[byte] ^= bit;
+
+      if (changed.low == portable.low || changed.high == portable.high)
+        {
+          g_print ("%" G_GSIZE_FORMAT " bytes: flipping a bit of byte %" G_GSIZE_FORMAT
+                   " did not change the hash\n", len, byte);
+          fail = TRUE;
+          break;
+        }
+    }
+
+  data[len] = 0;
+  _st_content_hash_compute (data, len + 1, &changed);
+  if (hash_equal (&changed, &portable))
+    {
+      g_print ("%" G_GSIZE_FORMAT " bytes: appending a zero did not change the hash\n", len);
+      fail = TRUE;
+    }
+
+  g_free (data);
+}
+
+static void
+benchmark_hash (gint size)
+{
+  GRand *rand = g_rand_new_with_seed (42);
+  gsize len = (gsize) size * size * 4;
+  guchar *data = make_data (rand, len);
+  StContentHash hash;
+  gint64 start, sha1_time, portable_time, fast_time;
+  const int iterations = 2000;
+  int i;
+
+  /* What st_texture_cache_load_from_raw() used to do to build its key */
+  start = g_get_monotonic_time ();
+  for (i = 0; i < iterations; i++)
+    {
+      char *checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA1, data, len);
+      char *key = g_strdup_printf ("raw-checksum:checksum=%s", checksum);
+
+      g_free (checksum);
+      g_free (key);
+    }
+  sha1_time = g_get_monotonic_time () - start;
+
+  _st_content_hash_set_use_simd (FALSE);
+  start = g_get_monotonic_time ();
+  for (i = 0; i < iterations; i++)
+    _st_content_hash_compute (data, len, &hash);
+  portable_time = g_get_monotonic_time () - start;
+
+  _st_content_hash_set_use_simd (TRUE);
+  start = g_get_monotonic_time ();
+  for (i = 0; i < iterations; i++)
+    _st_content_hash_compute (data, len, &hash);
+  fast_time = g_get_monotonic_time () - start;
+
+  g_print ("hash %3dx%-3d: sha1 key %8.2fus, hash %6.2fus, hash+simd %6.2fus\n",
+           size, size,
+           (double) sha1_time / iterations,
+           (double) portable_time / iterations,
+           (double) fast_time / iterations);
+
+  g_free (data);
+  g_rand_free (rand);
+}
+
+int
+main (int argc, char **argv)
+{
+  static const gint sizes[] = { 16, 22, 24, 48, 64, 96, 128, 256 };
+  GRand *rand;
+  gsize len;
+  guint i;
+
+  if (argc > 1 && strcmp (argv[1], "--benchmark") == 0)
+    {
+      for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+        benchmark_hash (sizes[i]);
+      return 0;
+    }
+
+  rand = g_rand_new_with_seed (42);
+
+  /* All the ways data can end within a stripe and a block */
+  for (len = 0; len <= 2100; len++)
+    test_hash (rand, len);
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    test_hash (rand, (gsize) sizes[i] * sizes[i] * 4);
+
+  g_rand_free (rand);
+
+  return fail ? 1 : 0;
+}
@@ -21,11 +21,14 @@
 #include <clutter/clutter.h>
 #include "st-theme.h"
 #include "st-theme-context.h"
+#include "st-theme-node-private.h"
 #include "st-label.h"
 #include <math.h>
 #include <string.h>
 
 static ClutterActor *stage;
+static StTheme *theme;
+static StThemeContext *context;
 static StThemeNode *root;
 static StThemeNode *group1;
 static StThemeNode *text1;
@@ -420,12 +423,232 @@ test_inline_style (void)
                  st_theme_node_get_padding (text3, ST_SIDE_BOTTOM));
 }
 
+static void
+test_rule_index (void)
+{
+  StThemeNode *group, *indexed, *other;
+
+  test = "rule_index";
+  group = st_theme_node_new (context, root, NULL,
+                             CLUTTER_TYPE_GROUP, "indexedGroup", NULL, NULL, NULL);
+  indexed = st_theme_node_new (context, group, NULL,
+                               CLUTTER_TYPE_RECTANGLE, "indexed", "first indexed", NULL, NULL);
+  other = st_theme_node_new (context, root, NULL,
+                             CLUTTER_TYPE_RECTANGLE, "other", NULL, NULL, NULL);
+
+  assert_length ("indexed", "-test-id", 1.,
+                 st_theme_node_get_length (indexed, "-test-id"));
+  assert_length ("indexed", "-test-class", 2.,
+                 st_theme_node_get_length (indexed, "-test-class"));
+  assert_length ("indexed", "-test-element", 3.,
+                 st_theme_node_get_length (indexed, "-test-element"));
+  assert_length ("indexed", "-test-universal", 4.,
+                 st_theme_node_get_length (indexed, "-test-universal"));
+  assert_length ("indexed", "-test-unmatched", 0.,
+                 st_theme_node_get_length (indexed, "-test-unmatched"));
+
+  /* Only the element rule applies to a node without the id or class */
+  assert_length ("other", "-test-id", 0.,
+                 st_theme_node_get_length (other, "-test-id"));
+  assert_length ("other", "-test-class", 0.,
+                 st_theme_node_get_length (other, "-test-class"));
+  assert_length ("other", "-test-element", 3.,
+                 st_theme_node_get_length (other, "-test-element"));
+  assert_length ("other", "-test-universal", 0.,
+                 st_theme_node_get_length (other, "-test-universal"));
+
+  g_object_unref (other);
+  g_object_unref (indexed);
+  g_object_unref (group);
+}
+
+/* Loading and unloading a stylesheet rebuilds the rule index, which new
+ * nodes are matched against */
+static StThemeNode *
+new_indexed_node (void)
+{
+  StThemeNode *group, *node;
+
+  group = st_theme_node_new (context, root, NULL,
+                             CLUTTER_TYPE_GROUP, NULL, NULL, NULL, NULL);
+  node = st_theme_node_new (context, group, NULL,
+                            CLUTTER_TYPE_RECTANGLE, "indexed", "indexed", NULL, NULL);
+  g_object_unref (group);
+
+  return node;
+}
+
+static void
+test_unload_stylesheet (void)
+{
+  StThemeNode *node;
+  GError *error = NULL;
+
+  test = "unload_stylesheet";
+
+  node = new_indexed_node ();
+  assert_length ("node", "-test-custom", 0.,
+                 st_theme_node_get_length (node, "-test-custom"));
+  g_object_unref (node);
+
+  if (!st_theme_load_stylesheet (theme, "st/test-theme-custom.css", &error))
+    {
+      g_print ("%s: %s\n", test, error->message);
+      g_error_free (error);
+      fail = TRUE;
+      return;
+    }
+
+  node = new_indexed_node ();
+  assert_length ("node", "-test-custom", 6.,
+                 st_theme_node_get_length (node, "-test-custom"));
+  assert_length ("node", "-test-id", 1.,
+                 st_theme_node_get_length (node, "-test-id"));
+  g_object_unref (node);
+
+  st_theme_unload_stylesheet (theme, "st/test-theme-custom.css");
+
+  node = new_indexed_node ();
+  assert_length ("node", "-test-custom", 0.,
+                 st_theme_node_get_length (node, "-test-custom"));
+  assert_length ("node", "-test-class", 2.,
+                 st_theme_node_get_length (node, "-test-class"));
+  g_object_unref (node);
+}
+
+static void
+assert_shared (StThemeNode *node_a,
+               StThemeNode *node_b,
+               const char  *description,
+               gboolean     expected)
+{
+  gboolean shared;
+
+  /* Sharing means using the very same matched declarations */
+  shared = node_a->properties != NULL && node_a->properties == node_b->properties;
+  if (shared != expected)
+    {
+      g_print ("%s: %s: expected style %sshared\n",
+               test, description, expected ? "" : "not ");
+      fail = TRUE;
+    }
+}
+
+static void
+test_shared_style (void)
+{
+  StThemeNode *group, *first, *second, *inline_node, *other_class, *hovered, *plain;
+
+  test = "shared_style";
+  group = st_theme_node_new (context, root, NULL,
+                             CLUTTER_TYPE_GROUP, "indexedGroup", NULL, NULL, NULL);
+
+  first = st_theme_node_new (context, group, NULL,
+                             CLUTTER_TYPE_RECTANGLE, "indexed", "indexed", NULL, NULL);
+  second = st_theme_node_new (context, group, NULL,
+                              CLUTTER_TYPE_RECTANGLE, "indexed", "indexed", NULL, NULL);
+  assert_length ("first", "-test-universal", 4.,
+                 st_theme_node_get_length (first, "-test-universal"));
+  assert_length ("second", "-test-universal", 4.,
+                 st_theme_node_get_length (second, "-test-universal"));
+  assert_shared (first, second, "equal nodes", TRUE);
+
+  inline_node = st_theme_node_new (context, group, NULL,
+                                   CLUTTER_TYPE_RECTANGLE, "indexed", "indexed", NULL,
+                                   "padding: 3px;");
+  assert_length ("inline", "padding-top", 3.,
+                 st_theme_node_get_padding (inline_node, ST_SIDE_TOP));
+  assert_shared (first, inline_node, "inline style", FALSE);
+
+  /* What a widget gets when its class or pseudo-class changes: a node
+   * that only differs by that, created after the first one is computed */
+  other_class = st_theme_node_new (context, group, NULL,
+                                   CLUTTER_TYPE_RECTANGLE, "indexed", "indexed other", NULL, NULL);
+  assert_length ("other_class", "-test-unmatched", 5.,
+                 st_theme_node_get_length (other_class, "-test-unmatched"));
+  assert_length ("first", "-test-unmatched", 0.,
+                 st_theme_node_get_length (first, "-test-unmatched"));
+  assert_shared (first, other_class, "different classes", FALSE);
+
+  hovered = st_theme_node_new (context, group, NULL,
+                               CLUTTER_TYPE_TEXT, NULL, NULL, "hover", NULL);
+  plain = st_theme_node_new (context, group, NULL,
+                             CLUTTER_TYPE_TEXT, NULL, NULL, NULL, NULL);
+  assert_text_decoration (hovered, "hovered", ST_TEXT_DECORATION_UNDERLINE);
+  assert_text_decoration (plain, "plain", 0);
+  assert_shared (hovered, plain, "different pseudo-classes", FALSE);
+
+  g_object_unref (plain);
+  g_object_unref (hovered);
+  g_object_unref (other_class);
+  g_object_unref (inline_node);
+  g_object_unref (second);
+  g_object_unref (first);
+  g_object_unref (group);
+}
+
+static void
+test_shared_style_reload (void)
+{
+  StThemeNode *group, *before, *loaded, *unloaded, *reloaded;
+  StTheme *new_theme;
+  GError *error = NULL;
+
+  test = "shared_style_reload";
+  group = st_theme_node_new (context, root, NULL,
+                             CLUTTER_TYPE_GROUP, "indexedGroup", NULL, NULL, NULL);
+
+  /* Kept alive across the stylesheet changes, so equal nodes created
+   * later could find it */
+  before = st_theme_node_new (context, group, NULL,
+                              CLUTTER_TYPE_RECTANGLE, "indexed", "indexed", NULL, NULL);
+  assert_length ("before", "-test-custom", 0.,
+                 st_theme_node_get_length (before, "-test-custom"));
+
+  if (!st_theme_load_stylesheet (theme, "st/test-theme-custom.css", &error))
+    {
+      g_print ("%s: %s\n", test, error->message);
+      g_error_free (error);
+      fail = TRUE;
+      return;
+    }
+
+  loaded = st_theme_node_new (context, group, NULL,
+                              CLUTTER_TYPE_RECTANGLE, "indexed", "indexed", NULL, NULL);
+  assert_length ("loaded", "-test-custom", 6.,
+                 st_theme_node_get_length (loaded, "-test-custom"));
+  assert_shared (before, loaded, "after loading a stylesheet", FALSE);
+
+  st_theme_unload_stylesheet (theme, "st/test-theme-custom.css");
+
+  unloaded = st_theme_node_new (context, group, NULL,
+                                CLUTTER_TYPE_RECTANGLE, "indexed", "indexed", NULL, NULL);
+  assert_length ("unloaded", "-test-custom", 0.,
+                 st_theme_node_get_length (unloaded, "-test-custom"));
+  assert_shared (loaded, unloaded, "after unloading a stylesheet", FALSE);
+
+  g_object_unref (unloaded);
+  g_object_unref (loaded);
+  g_object_unref (before);
+  g_object_unref (group);
+
+  /* Replacing the theme, as reloading it from the settings does */
+  new_theme = st_theme_new ("st/test-theme.css", "st/test-theme-custom.css", NULL);
+  st_theme_context_set_theme (context, new_theme);
+
+  reloaded = st_theme_node_new (context, st_theme_context_get_root_node (context), NULL,
+                                CLUTTER_TYPE_RECTANGLE, "indexed", "indexed", NULL, NULL);
+  assert_length ("reloaded", "-test-custom", 6.,
+                 st_theme_node_get_length (reloaded, "-test-custom"));
+  g_object_unref (reloaded);
+
+  st_theme_context_set_theme (context, theme);
+  g_object_unref (new_theme);
+}
+
 int
 main (int argc, char **argv)
 {
-  StTheme *theme;
-  StThemeContext *context;
-
   if (clutter_init (&argc, &argv) != CLUTTER_INIT_SUCCESS)
     return 1;
 
@@ -469,6 +692,10 @@ main (int argc, char **argv)
   test_font ();
   test_pseudo_class ();
   test_inline_style ();
+  test_rule_index ();
+  test_unload_stylesheet ();
+  test_shared_style ();
+  test_shared_style_reload ();
 
   return fail ? 1 : 0;
 }
@@ -0,0 +1,726 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* Test program and benchmark for the contact search index, fed through
+ * the handlers CinnamonContactSystem connects to libfolks, by a fake
+ * aggregator */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <folks/folks.h>
+
+#include "cinnamon-contact-system-private.h"
+#include "cinnamon-fuzzy-match-private.h"
+
+#define N_TEST_CONTACTS 2000
+#define N_TEST_CHANGES 3000
+#define N_BENCHMARK_CONTACTS 20000
+
+static gboolean fail;
+
+/* Has the properties of FolksIndividual that are searched, and one that
+ * isn't, and keeps what they contain as plain strings to check against */
+typedef struct {
+  GObject parent;
+
+  char        *id;
+  char        *alias;
+  char        *full_name;
+  char        *nickname;
+  char        *presence_message;
+  GeeMultiMap *im_addresses;
+  GeeSet      *email_addresses;
+
+  char       **names;
+  char       **addresses;
+} FakeIndividual;
+
+typedef struct {
+  GObjectClass parent_class;
+} FakeIndividualClass;
+
+enum {
+  PROP_0,
+  PROP_ID,
+  PROP_ALIAS,
+  PROP_FULL_NAME,
+  PROP_NICKNAME,
+  PROP_PRESENCE_MESSAGE,
+  PROP_IM_ADDRESSES,
+  PROP_EMAIL_ADDRESSES
+};
+
+static GType fake_individual_get_type (void);
+
+G_DEFINE_TYPE (FakeIndividual, fake_individual, G_TYPE_OBJECT);
+
+static void
+fake_individual_set_property (GObject      *object,
+                              guint         prop_id,
+                              const GValue *value,
+                              GParamSpec   *pspec)
+{
+  FakeIndividual *individual = (FakeIndividual *) object;
+
+  switch (prop_id)
+    {
+    case PROP_ID:
+      g_free (individual->id);
+      individual->id = g_value_dup_string (value);
+      break;
+    case PROP_ALIAS:
+      g_free (individual->alias);
+      individual->alias = g_value_dup_string (value);
+      break;
+    case PROP_FULL_NAME:
+      g_free (individual->full_name);
+      individual->full_name = g_value_dup_string (value);
+      break;
+    case PROP_NICKNAME:
+      g_free (individual->nickname);
+      individual->nickname = g_value_dup_string (value);
+      break;
+    case PROP_PRESENCE_MESSAGE:
+      g_free (individual->presence_message);
+      individual->presence_message = g_value_dup_string (value);
+      break;
+    case PROP_IM_ADDRESSES:
+      if (individual->im_addresses)
+        g_object_unref (individual->im_addresses);
+      individual->im_addresses = g_value_dup_object (value);
+      break;
+    case PROP_EMAIL_ADDRESSES:
+      if (individual->email_addresses)
+        g_object_unref (individual->email_addresses);
+      individual->email_addresses = g_value_dup_object (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+fake_individual_get_property (GObject    *object,
+                              guint       prop_id,
+                              GValue     *value,
+                              GParamSpec *pspec)
+{
+  FakeIndividual *individual = (FakeIndividual *) object;
+
+  switch (prop_id)
+    {
+    case PROP_ID:
+      g_value_set_string (value, individual->id);
+      break;
+    case PROP_ALIAS:
+      g_value_set_string (value, individual->alias);
+      break;
+    case PROP_FULL_NAME:
+      g_value_set_string (value, individual->full_name);
+      break;
+    case PROP_NICKNAME:
+      g_value_set_string (value, individual->nickname);
+      break;
+    case PROP_PRESENCE_MESSAGE:
+      g_value_set_string (value, individual->presence_message);
+      break;
+    case PROP_IM_ADDRESSES:
+      g_value_set_object (value, individual->im_addresses);
+      break;
+    case PROP_EMAIL_ADDRESSES:
+      g_value_set_object (value, individual->email_addresses);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+fake_individual_finalize (GObject *object)
+{
+  FakeIndividual *individual = (FakeIndividual *) object;
+
+  g_free (individual->id);
+  g_free (individual->alias);
+  g_free (individual->full_name);
+  g_free (individual->nickname);
+  g_free (individual->presence_message);
+  if (individual->im_addresses)
+    g_object_unref (individual->im_addresses);
+  if (individual->email_addresses)
+    g_object_unref (individual->email_addresses);
+  g_strfreev (individual->names);
+  g_strfreev (individual->addresses);
+
+  G_OBJECT_CLASS (fake_individual_parent_class)->finalize (object);
+}
+
+static void
+fake_individual_init (FakeIndividual *individual)
+{
+}
+
+static void
+fake_individual_class_init (FakeIndividualClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  const char *strings[] = { NULL, "id", "alias", "full-name", "nickname", "presence-message" };
+  guint i;
+
+  object_class->set_property = fake_individual_set_property;
+  object_class->get_property = fake_individual_get_property;
+  object_class->finalize = fake_individual_finalize;
+
+  for (i = PROP_ID; i <= PROP_PRESENCE_MESSAGE; i++)
+    g_object_class_install_property (object_class, i,
+                                     g_param_spec_string (strings[i], NULL, NULL, NULL,
+                                                          G_PARAM_READWRITE));
+
+  g_object_class_install_property (object_class, PROP_IM_ADDRESSES,
+                                   g_param_spec_object ("im-addresses", NULL, NULL,
+                                                        GEE_TYPE_MULTI_MAP,
+                                                        G_PARAM_READWRITE));
+  g_object_class_install_property (object_class, PROP_EMAIL_ADDRESSES,
+                                   g_param_spec_object ("email-addresses", NULL, NULL,
+                                                        GEE_TYPE_SET,
+                                                        G_PARAM_READWRITE));
+}
+
+/* Stands in for FolksIndividualAggregator: the individuals in the order
+ * they were last indexed, and the index CinnamonContactSystem keeps,
+ * following the changes through its handlers */
+typedef struct {
+  GPtrArray                  *individuals;
+  CinnamonContactSearchIndex *index;
+  guint                       next_id;
+} FakeAggregator;
+
+static const char *first_names[] = { "John", "Maria", "José", "Anna", "Peter", "Jonas",
+                                     "Élodie", "Mohammed", "Wei", "Olga", "Joanna", "Mario" };
+static const char *last_names[] = { "Smith", "García", "Müller", "Johnson", "Rossi", "Novák",
+                                    "Dubois", "Kowalski", "Nakamura", "Silva", "Marino" };
+static const char *domains[] = { "example.com", "mail.org", "work.net", "university.edu" };
+
+static char *
+normalize (const char *str)
+{
+  char *normalized = g_utf8_normalize (str, -1, G_NORMALIZE_ALL);
+  char *result = g_utf8_casefold (normalized, -1);
+
+  g_free (normalized);
+  return result;
+}
+
+/* Gives @individual new names and addresses, notifying them like libfolks */
+static void
+fake_individual_randomize (FakeIndividual *individual,
+                           GRand          *rand)
+{
+  const char *first = first_names[g_rand_int_range (rand, 0, G_N_ELEMENTS (first_names))];
+  const char *last = last_names[g_rand_int_range (rand, 0, G_N_ELEMENTS (last_names))];
+  guint n = g_rand_int_range (rand, 0, 1000);
+  GeeMultiMap *im_addresses;
+  GeeSet *email_addresses;
+  char *name, *nickname = NULL;
+  char *email, *im = NULL;
+  gpointer field;
+
+  name = g_strdup_printf ("%s %s", first, last);
+  if (n % 3 == 0)
+    nickname = g_strdup_printf ("%.3s%u", first, n);
+
+  email = g_strdup_printf ("%s.%s%u@%s", first, last, n, domains[n % G_N_ELEMENTS (domains)]);
+  if (n % 2 == 0)
+    im = g_strdup_printf ("%s%u@jabber.org", last, n);
+
+  g_strfreev (individual->names);
+  g_strfreev (individual->addresses);
+  individual->names = g_new0 (char *, 4);
+  individual->names[0] = g_strdup (name);
+  individual->names[1] = g_strdup (name);
+  individual->names[2] = g_strdup (nickname);
+  individual->addresses = g_new0 (char *, 3);
+  individual->addresses[0] = g_strdup (email);
+  individual->addresses[1] = g_strdup (im);
+
+  email_addresses = GEE_SET (gee_hash_set_new (FOLKS_TYPE_EMAIL_FIELD_DETAILS,
+                                               (GBoxedCopyFunc) g_object_ref, g_object_unref,
+                                               NULL, NULL));
+  field = folks_email_field_details_new (email, NULL);
+  gee_collection_add (GEE_COLLECTION (email_addresses), field);
+  g_object_unref (field);
+
+  im_addresses = GEE_MULTI_MAP (gee_hash_multi_map_new (G_TYPE_STRING,
+                                                        (GBoxedCopyFunc) g_strdup, g_free,
+                                                        FOLKS_TYPE_IM_FIELD_DETAILS,
+                                                        (GBoxedCopyFunc) g_object_ref, g_object_unref,
+                                                        NULL, NULL, NULL, NULL));
+  if (im != NULL)
+    {
+      field = folks_im_field_details_new (im, NULL);
+      gee_multi_map_set (im_addresses, "jabber", field);
+      g_object_unref (field);
+    }
+
+  g_object_set (individual,
+                "alias", name,
+                "full-name", name,
+                "nickname", nickname,
+                "im-addresses", im_addresses,
+                "email-addresses", email_addresses,
+                NULL);
+
+  g_object_unref (im_addresses);
+  g_object_unref (email_addresses);
+  g_free (name);
+  g_free (nickname);
+  g_free (email);
+  g_free (im);
+}
+
+/* Emits "individuals-changed", as far as the index is concerned */
+static void
+fake_aggregator_individuals_changed (FakeAggregator *aggregator,
+                                     FakeIndividual *added,
+                                     FakeIndividual *removed)
+{
+  GeeSet *added_set, *removed_set;
+
+  added_set = GEE_SET (gee_hash_set_new (G_TYPE_OBJECT,
+                                         (GBoxedCopyFunc) g_object_ref, g_object_unref,
+                                         NULL, NULL));
+  removed_set = GEE_SET (gee_hash_set_new (G_TYPE_OBJECT,
+                                           (GBoxedCopyFunc) g_object_ref, g_object_unref,
+                                           NULL, NULL));
+  if (added != NULL)
+    gee_collection_add (GEE_COLLECTION (added_set), added);
+  if (removed != NULL)
+    gee_collection_add (GEE_COLLECTION (removed_set), removed);
+
+  _cinnamon_contact_system_individuals_changed (aggregator->index, added_set, removed_set);
+
+  g_object_unref (added_set);
+  g_object_unref (removed_set);
+}
+
+static FakeAggregator *
+fake_aggregator_new (void)
+{
+  FakeAggregator *aggregator = g_slice_new0 (FakeAggregator);
+
+  aggregator->individuals = g_ptr_array_new ();
+  aggregator->index = _cinnamon_contact_search_index_new ();
+
+  return aggregator;
+}
+
+static void
+fake_aggregator_free (FakeAggregator *aggregator)
+{
+  guint i;
+
+  for (i = 0; i < aggregator->individuals->len; i++)
+    {
+      FakeIndividual *individual = g_ptr_array_index (aggregator->individuals, i);
+
+      g_signal_handlers_disconnect_by_func (individual,
+                                            _cinnamon_contact_system_individual_notify,
+                                            aggregator->index);
+      g_object_unref (individual);
+    }
+
+  g_ptr_array_free (aggregator->individuals, TRUE);
+  _cinnamon_contact_search_index_free (aggregator->index);
+  g_slice_free (FakeAggregator, aggregator);
+}
+
+static void
+fake_aggregator_add (FakeAggregator *aggregator,
+                     GRand          *rand)
+{
+  FakeIndividual *individual;
+  char *id;
+
+  id = g_strdup_printf ("individual-%u", aggregator->next_id++);
+  individual = g_object_new (fake_individual_get_type (), "id", id, NULL);
+  g_free (id);
+
+  fake_individual_randomize (individual, rand);
+  g_ptr_array_add (aggregator->individuals, individual);
+
+  fake_aggregator_individuals_changed (aggregator, individual, NULL);
+}
+
+/* A changed individual is indexed again, after all the others */
+static void
+fake_aggregator_change (FakeAggregator *aggregator,
+                        guint           i,
+                        GRand          *rand)
+{
+  FakeIndividual *individual = g_ptr_array_index (aggregator->individuals, i);
+
+  g_ptr_array_remove_index (aggregator->individuals, i);
+  g_ptr_array_add (aggregator->individuals, individual);
+
+  fake_individual_randomize (individual, rand);
+}
+
+/* Changes that aren't searched must leave the index alone, or the
+ * individual would move after all the others */
+static void
+fake_aggregator_change_presence (FakeAggregator *aggregator,
+                                 guint           i,
+                                 GRand          *rand)
+{
+  FakeIndividual *individual = g_ptr_array_index (aggregator->individuals, i);
+  char *message;
+
+  message = g_strdup_printf ("away %d", g_rand_int (rand));
+  g_object_set (individual, "presence-message", message, NULL);
+  g_free (message);
+}
+
+static void
+fake_aggregator_remove (FakeAggregator *aggregator,
+                        guint           i)
+{
+  FakeIndividual *individual = g_ptr_array_index (aggregator->individuals, i);
+
+  g_ptr_array_remove_index (aggregator->individuals, i);
+  fake_aggregator_individuals_changed (aggregator, NULL, individual);
+
+  /* Notifications after removal must not bring it back */
+  g_object_set (individual, "alias", "Removed", NULL);
+  g_object_unref (individual);
+}
+
+typedef struct {
+  guint position;
+  guint weight;
+} ReferenceResult;
+
+/* What searching used to do: normalize the strings of every individual
+ * and match them, typos allowed in names if nothing matches exactly */
+static guint
+reference_match (FakeIndividual *individual,
+                 char          **terms,
+                 gboolean        fuzzy)
+{
+  gboolean name_prefix = FALSE, name_substring = FALSE, name_fuzzy = FALSE;
+  gboolean addr_prefix = FALSE, addr_substring = FALSE;
+  guint weight = 0;
+  guint i, j;
+
+  for (i = 0; terms[i]; i++)
+    {
+      CinnamonFuzzyPattern *pattern;
+      gboolean matched = FALSE;
+
+      for (j = 0; individual->names[j]; j++)
+        {
+          char *name = normalize (individual->names[j]);
+          const char *p = strstr (name, terms[i]);
+
+          if (p == name)
+            name_prefix = matched = TRUE;
+          else if (p != NULL)
+            name_substring = matched = TRUE;
+          g_free (name);
+        }
+
+      for (j = 0; individual->addresses[j]; j++)
+        {
+          char *addr = normalize (individual->addresses[j]);
+          const char *p = strstr (addr, terms[i]);
+
+          if (p == addr)
+            addr_prefix = matched = TRUE;
+          else if (p != NULL)
+            addr_substring = matched = TRUE;
+          g_free (addr);
+        }
+
+      if (!matched && fuzzy)
+        {
+          pattern = _cinnamon_fuzzy_pattern_new (terms[i]);
+          for (j = 0; individual->names[j] && !matched; j++)
+            {
+              char *name = normalize (individual->names[j]);
+
+              if (_cinnamon_fuzzy_pattern_score (pattern, name) != 0)
+                name_fuzzy = matched = TRUE;
+              g_free (name);
+            }
+          _cinnamon_fuzzy_pattern_free (pattern);
+        }
+
+      if (!matched)
+        return 0;
+    }
+
+  if (name_prefix)
+    weight += CINNAMON_CONTACT_NAME_PREFIX_WEIGHT;
+  else if (name_substring)
+    weight += CINNAMON_CONTACT_NAME_SUBSTRING_WEIGHT;
+  else if (name_fuzzy)
+    weight += CINNAMON_CONTACT_NAME_FUZZY_WEIGHT;
+
+  if (addr_prefix)
+    weight += CINNAMON_CONTACT_ADDR_PREFIX_WEIGHT;
+  else if (addr_substring)
+    weight += CINNAMON_CONTACT_ADDR_SUBSTRING_WEIGHT;
+
+  return weight;
+}
+
+static gint
+compare_reference_results (gconstpointer a,
+                           gconstpointer b)
+{
+  const ReferenceResult *result_a = a;
+  const ReferenceResult *result_b = b;
+
+  if (result_a->weight != result_b->weight)
+    return result_a->weight > result_b->weight ? -1 : 1;
+
+  return (gint) result_a->position - (gint) result_b->position;
+}
+
+static GSList *
+reference_search (FakeAggregator  *aggregator,
+                  char           **terms)
+{
+  GArray *results = g_array_new (FALSE, FALSE, sizeof (ReferenceResult));
+  GSList *ids = NULL;
+  gboolean fuzzy;
+  gint i;
+
+  for (fuzzy = FALSE; fuzzy <= TRUE && results->len == 0 && terms[0] != NULL; fuzzy++)
+    for (i = 0; i < (gint) aggregator->individuals->len; i++)
+      {
+        ReferenceResult result;
+
+        result.position = i;
+        result.weight = reference_match (g_ptr_array_index (aggregator->individuals, i),
+                                         terms, fuzzy);
+        if (result.weight != 0)
+          g_array_append_val (results, result);
+      }
+
+  g_array_sort (results, compare_reference_results);
+
+  for (i = results->len - 1; i >= 0; i--)
+    {
+      guint position = g_array_index (results, ReferenceResult, i).position;
+      FakeIndividual *individual = g_ptr_array_index (aggregator->individuals, position);
+
+      ids = g_slist_prepend (ids, individual->id);
+    }
+
+  g_array_free (results, TRUE);
+
+  return ids;
+}
+
+static GSList *
+strv_to_slist (char **strv)
+{
+  GSList *list = NULL;
+  gint i;
+
+  for (i = (gint) g_strv_length (strv) - 1; i >= 0; i--)
+    list = g_slist_prepend (list, strv[i]);
+
+  return list;
+}
+
+static gboolean
+same_ids (GSList *a,
+          GSList *b)
+{
+  for (; a && b; a = a->next, b = b->next)
+    if (strcmp (a->data, b->data) != 0)
+      return FALSE;
+
+  return a == NULL && b == NULL;
+}
+
+static void
+check_search (FakeAggregator *aggregator,
+              const char     *query)
+{
+  char **terms = g_strsplit (query, " ", -1);
+  GSList *term_list = strv_to_slist (terms);
+  GSList *expected, *results;
+
+  expected = reference_search (aggregator, terms);
+  results = _cinnamon_contact_search_index_search (aggregator->index, term_list);
+
+  if (!same_ids (expected, results))
+    {
+      g_print ("\"%s\": expected %u results, got %u, or in another order\n",
+               query, g_slist_length (expected), g_slist_length (results));
+      fail = TRUE;
+    }
+
+  g_slist_free (expected);
+  g_slist_free (results);
+  g_slist_free (term_list);
+  g_strfreev (terms);
+}
+
+/* Narrowing a search with exact matches gives the same results as
+ * searching again */
+static void
+check_subsearch (FakeAggregator *aggregator,
+                 const char     *term,
+                 const char     *longer_term)
+{
+  GSList *terms = g_slist_prepend (NULL, (char *) term);
+  GSList *longer_terms = g_slist_prepend (NULL, (char *) longer_term);
+  GSList *previous, *expected, *results;
+
+  previous = _cinnamon_contact_search_index_search (aggregator->index, terms);
+  expected = _cinnamon_contact_search_index_search (aggregator->index, longer_terms);
+  results = _cinnamon_contact_search_index_subsearch (aggregator->index, previous, longer_terms);
+
+  if (!same_ids (expected, results))
+    {
+      g_print ("\"%s\" after \"%s\": subsearch differs from search\n",
+               longer_term, term);
+      fail = TRUE;
+    }
+
+  g_slist_free (previous);
+  g_slist_free (expected);
+  g_slist_free (results);
+  g_slist_free (terms);
+  g_slist_free (longer_terms);
+}
+
+static const char *queries[] = { "j", "jo", "joh", "john", "smi", "john smith", "müller",
+                                 "mueller", "jose", "josé", "example", "jabber", "maria mail",
+                                 "jonh", "nakamrua", "garcia", "zzz", "", "ann 2" };
+
+static void
+check_searches (FakeAggregator *aggregator)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (queries); i++)
+    check_search (aggregator, queries[i]);
+
+  check_subsearch (aggregator, "jo", "joh");
+  check_subsearch (aggregator, "ma", "mar");
+}
+
+static void
+test_index (void)
+{
+  FakeAggregator *aggregator = fake_aggregator_new ();
+  GRand *rand = g_rand_new_with_seed (42);
+  guint i;
+
+  for (i = 0; i < N_TEST_CONTACTS; i++)
+    fake_aggregator_add (aggregator, rand);
+
+  check_searches (aggregator);
+
+  /* Enough removals to get the index compacted */
+  for (i = 0; i < N_TEST_CHANGES; i++)
+    {
+      guint n = aggregator->individuals->len;
+
+      switch (g_rand_int_range (rand, 0, 5))
+        {
+        case 0:
+          fake_aggregator_add (aggregator, rand);
+          break;
+        case 1:
+          fake_aggregator_change (aggregator, g_rand_int_range (rand, 0, n), rand);
+          break;
+        case 2:
+          fake_aggregator_change_presence (aggregator, g_rand_int_range (rand, 0, n), rand);
+          break;
+        default:
+          if (n > 1)
+            fake_aggregator_remove (aggregator, g_rand_int_range (rand, 0, n));
+          break;
+        }
+    }
+
+  if (_cinnamon_contact_search_index_get_size (aggregator->index) != aggregator->individuals->len)
+    {
+      g_print ("Index has %u contacts, expected %u\n",
+               _cinnamon_contact_search_index_get_size (aggregator->index),
+               aggregator->individuals->len);
+      fail = TRUE;
+    }
+
+  check_searches (aggregator);
+
+  g_rand_free (rand);
+  fake_aggregator_free (aggregator);
+}
+
+static void
+benchmark (void)
+{
+  static const char *keystrokes[] = { "m", "ma", "mar", "mari", "maria", "maria s", "maria si",
+                                      "n", "na", "nak", "naka", "nakma", "nakmaur" };
+  FakeAggregator *aggregator = fake_aggregator_new ();
+  GRand *rand = g_rand_new_with_seed (42);
+  gint64 start, scan_time, index_time;
+  guint i;
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < N_BENCHMARK_CONTACTS; i++)
+    fake_aggregator_add (aggregator, rand);
+  g_print ("Indexing %d contacts: %" G_GINT64_FORMAT "us\n",
+           N_BENCHMARK_CONTACTS, g_get_monotonic_time () - start);
+
+  for (i = 0; i < G_N_ELEMENTS (keystrokes); i++)
+    {
+      char **terms = g_strsplit (keystrokes[i], " ", -1);
+      GSList *term_list = strv_to_slist (terms);
+      GSList *results;
+      guint n_results;
+
+      start = g_get_monotonic_time ();
+      results = reference_search (aggregator, terms);
+      scan_time = g_get_monotonic_time () - start;
+      g_slist_free (results);
+
+      start = g_get_monotonic_time ();
+      results = _cinnamon_contact_search_index_search (aggregator->index, term_list);
+      index_time = g_get_monotonic_time () - start;
+      n_results = g_slist_length (results);
+      g_slist_free (results);
+
+      g_print ("%-10s %5u results: scan %7" G_GINT64_FORMAT "us, index %6" G_GINT64_FORMAT "us\n",
+               keystrokes[i], n_results, scan_time, index_time);
+
+      g_slist_free (term_list);
+      g_strfreev (terms);
+    }
+
+  g_rand_free (rand);
+  fake_aggregator_free (aggregator);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_type_init ();
+
+  if (argc > 1 && strcmp (argv[1], "--benchmark") == 0)
+    {
+      benchmark ();
+      return 0;
+    }
+
+  test_index ();
+
+  return fail ? 1 : 0;
+}
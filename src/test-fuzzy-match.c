@@ -0,0 +1,250 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* Test program and benchmark for the typo-tolerant search scoring */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cinnamon-fuzzy-match-private.h"
+
+/* How long scoring all the applications of a big install may take for
+ * one keystroke */
+#define N_BENCHMARK_STRINGS 2000
+#define MAX_KEYSTROKE_TIME 1000 /* microseconds */
+
+static gboolean fail;
+
+typedef struct {
+  const char *term;
+  const char *text;
+  guint       min_score;
+  guint       max_score;
+} Case;
+
+static const Case cases[] = {
+  { "fire", "firefox web browser", CINNAMON_FUZZY_SCORE_PREFIX + 100, CINNAMON_FUZZY_SCORE_PREFIX + 100 },
+  { "web", "firefox web browser", CINNAMON_FUZZY_SCORE_PREFIX, CINNAMON_FUZZY_SCORE_PREFIX },
+  { "fox", "firefox web browser", CINNAMON_FUZZY_SCORE_SUBSTRING, CINNAMON_FUZZY_SCORE_SUBSTRING },
+  { "gte", "gnome terminal", CINNAMON_FUZZY_SCORE_SUBSEQUENCE + 200, CINNAMON_FUZZY_SCORE_SUBSTRING - 1 },
+  { "fwb", "firefox web browser", CINNAMON_FUZZY_SCORE_SUBSEQUENCE + 200, CINNAMON_FUZZY_SCORE_SUBSTRING - 1 },
+  { "fx", "firefox", CINNAMON_FUZZY_SCORE_SUBSEQUENCE, CINNAMON_FUZZY_SCORE_SUBSEQUENCE + 199 },
+  { "firefxo", "firefox", CINNAMON_FUZZY_SCORE_TYPO, CINNAMON_FUZZY_SCORE_SUBSEQUENCE - 1 },
+  { "termnial", "gnome terminal", CINNAMON_FUZZY_SCORE_TYPO, CINNAMON_FUZZY_SCORE_SUBSEQUENCE - 1 },
+  { "thunderbrid", "thunderbird mail", CINNAMON_FUZZY_SCORE_TYPO, CINNAMON_FUZZY_SCORE_SUBSEQUENCE - 1 },
+  { "gimo", "gimp", CINNAMON_FUZZY_SCORE_TYPO, CINNAMON_FUZZY_SCORE_SUBSEQUENCE - 1 },
+  { "xyz", "firefox web browser", 0, 0 },
+  { "qwerty", "firefox web browser", 0, 0 },
+  { "ifrefox", "thunderbird", 0, 0 },
+  { "", "anything", CINNAMON_FUZZY_SCORE_PREFIX + 100, CINNAMON_FUZZY_SCORE_PREFIX + 100 },
+};
+
+static void
+test_cases (void)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (cases); i++)
+    {
+      CinnamonFuzzyPattern *pattern = _cinnamon_fuzzy_pattern_new (cases[i].term);
+      guint score = _cinnamon_fuzzy_pattern_score (pattern, cases[i].text);
+
+      if (score < cases[i].min_score || score > cases[i].max_score)
+        {
+          g_print ("\"%s\" in \"%s\": expected a score between %u and %u, got %u\n",
+                   cases[i].term, cases[i].text,
+                   cases[i].min_score, cases[i].max_score, score);
+          fail = TRUE;
+        }
+
+      _cinnamon_fuzzy_pattern_free (pattern);
+    }
+}
+
+/* The lowest edit distance between @term and a substring of @text, the
+ * slow way */
+static guint
+reference_distance (const char *term,
+                    const char *text)
+{
+  gsize m = strlen (term), n = strlen (text);
+  guint *column, *previous;
+  guint best;
+  gsize i, j;
+
+  column = g_new (guint, m + 1);
+  previous = g_new (guint, m + 1);
+
+  for (i = 0; i <= m; i++)
+    previous[i] = i;
+  best = previous[m];
+
+  for (j = 1; j <= n; j++)
+    {
+      column[0] = 0;
+      for (i = 1; i <= m; i++)
+        {
+          guint cost = previous[i - 1] + (term[i - 1] != text[j - 1]);
+
+          cost = MIN (cost, previous[i] + 1);
+          cost = MIN (cost, column[i - 1] + 1);
+          column[i] = cost;
+        }
+
+      best = MIN (best, column[m]);
+      memcpy (previous, column, (m + 1) * sizeof (guint));
+    }
+
+  g_free (column);
+  g_free (previous);
+
+  return best;
+}
+
+static gboolean
+is_subsequence (const char *term,
+                const char *text)
+{
+  for (; *text && *term; text++)
+    if (*text == *term)
+      term++;
+
+  return *term == '\0';
+}
+
+static char *
+random_string (GRand *rand,
+               gint   min_length,
+               gint   max_length)
+{
+  static const char alphabet[] = "abcde fgh";
+  gint length = g_rand_int_range (rand, min_length, max_length + 1);
+  char *str = g_malloc (length + 1);
+  gint i;
+
+  for (i = 0; i < length; i++)
+    str[i] = alphabet[g_rand_int_range (rand, 0, sizeof (alphabet) - 1)];
+  str[length] = '\0';
+
+  return str;
+}
+
+/* Checks the bit-parallel edit distance against the dynamic programming
+ * one, on strings that aren't substrings or subsequences of each other */
+static void
+test_typos (void)
+{
+  GRand *rand = g_rand_new_with_seed (42);
+  gint i;
+
+  for (i = 0; i < 20000; i++)
+    {
+      char *term = random_string (rand, 4, i % 10 == 0 ? 64 : 12);
+      char *text = random_string (rand, 0, 40);
+      CinnamonFuzzyPattern *pattern;
+      guint score, distance, expected;
+
+      if (is_subsequence (term, text))
+        goto next;
+
+      pattern = _cinnamon_fuzzy_pattern_new (term);
+      score = _cinnamon_fuzzy_pattern_score (pattern, text);
+      _cinnamon_fuzzy_pattern_free (pattern);
+
+      distance = reference_distance (term, text);
+      if (distance > (strlen (term) < 7 ? 1 : 2))
+        expected = 0;
+      else
+        expected = CINNAMON_FUZZY_SCORE_TYPO + 100 * (3 - distance) - 1;
+
+      if (score != expected)
+        {
+          g_print ("\"%s\" in \"%s\": distance %u, expected score %u, got %u\n",
+                   term, text, distance, expected, score);
+          fail = TRUE;
+        }
+
+    next:
+      g_free (term);
+      g_free (text);
+    }
+
+  g_rand_free (rand);
+}
+
+static void
+benchmark (void)
+{
+  static const char *words[] = { "web", "browser", "terminal", "editor", "mail",
+                                 "image", "office", "document", "viewer", "player",
+                                 "music", "video", "settings", "manager", "system",
+                                 "monitor", "network", "file", "archive", "calendar" };
+  static const char *terms[] = { "t", "te", "ter", "term", "termn", "termni", "termnia", "termnial" };
+  GRand *rand = g_rand_new_with_seed (42);
+  char **strings;
+  gint64 start, elapsed, worst = 0;
+  guint n_matches;
+  guint i, j;
+
+  strings = g_new (char *, N_BENCHMARK_STRINGS);
+  for (i = 0; i < N_BENCHMARK_STRINGS; i++)
+    {
+      GString *str = g_string_new (NULL);
+      guint n_words = g_rand_int_range (rand, 2, 8);
+
+      for (j = 0; j < n_words; j++)
+        {
+          if (j > 0)
+            g_string_append_c (str, ' ');
+          g_string_append (str, words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))]);
+        }
+
+      strings[i] = g_string_free (str, FALSE);
+    }
+
+  /* Typing a misspelled term a letter at a time */
+  for (i = 0; i < G_N_ELEMENTS (terms); i++)
+    {
+      CinnamonFuzzyPattern *pattern;
+
+      start = g_get_monotonic_time ();
+
+      pattern = _cinnamon_fuzzy_pattern_new (terms[i]);
+      n_matches = 0;
+      for (j = 0; j < N_BENCHMARK_STRINGS; j++)
+        if (_cinnamon_fuzzy_pattern_score (pattern, strings[j]) != 0)
+          n_matches++;
+      _cinnamon_fuzzy_pattern_free (pattern);
+
+      elapsed = g_get_monotonic_time () - start;
+      worst = MAX (worst, elapsed);
+
+      g_print ("%-10s %4u matches in %5" G_GINT64_FORMAT "us\n",
+               terms[i], n_matches, elapsed);
+    }
+
+  if (worst > MAX_KEYSTROKE_TIME)
+    {
+      g_print ("Scoring %d strings took %" G_GINT64_FORMAT "us, more than %dus\n",
+               N_BENCHMARK_STRINGS, worst, MAX_KEYSTROKE_TIME);
+      fail = TRUE;
+    }
+
+  for (i = 0; i < N_BENCHMARK_STRINGS; i++)
+    g_free (strings[i]);
+  g_free (strings);
+  g_rand_free (rand);
+}
+
+int
+main (int argc, char **argv)
+{
+  if (argc > 1 && strcmp (argv[1], "--benchmark") == 0)
+    {
+      benchmark ();
+      return fail ? 1 : 0;
+    }
+
+  test_cases ();
+  test_typos ();
+
+  return fail ? 1 : 0;
+}
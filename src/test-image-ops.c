@@ -0,0 +1,197 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* Test program and benchmark for the fade of application icons */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cinnamon-image-ops-private.h"
+
+/* Fixed point multipliers may round differently from floats by one */
+#define MAX_FADE_ERROR 1
+
+static gboolean fail;
+
+/* How cinnamon_app_create_faded_icon_cpu() used to fade icons: down the
+ * columns of the right half, in floating point */
+static void
+reference_fade (guchar *pixels,
+                gint    width,
+                gint    height,
+                gint    rowstride,
+                gint    n_channels)
+{
+  gint fade_start = width / 2;
+  gint fade_range = width - fade_start;
+  gint i, j, c;
+
+  for (i = fade_start; i < width; i++)
+    {
+      for (j = 0; j < height; j++)
+        {
+          guchar *pixel = &pixels[j * rowstride + i * n_channels];
+          float fade = 1.0 - ((float) i - fade_start) / fade_range;
+
+          for (c = 0; c < n_channels; c++)
+            pixel[c] = 0.5 + pixel[c] * fade;
+        }
+    }
+}
+
+/* Random premultiplied pixels; the padding at the end of rows too, to
+ * check it is left alone */
+static guchar *
+make_image (GRand *rand,
+            gint   rowstride,
+            gint   height,
+            gint   n_channels)
+{
+  guchar *pixels = g_malloc (rowstride * height);
+  gint i;
+
+  for (i = 0; i < rowstride * height; i++)
+    pixels[i] = g_rand_int_range (rand, 0, 256);
+
+  if (n_channels == 4)
+    for (i = 0; i + 3 < rowstride * height; i += 4)
+      {
+        pixels[i] = MIN (pixels[i], pixels[i + 3]);
+        pixels[i + 1] = MIN (pixels[i + 1], pixels[i + 3]);
+        pixels[i + 2] = MIN (pixels[i + 2], pixels[i + 3]);
+      }
+
+  return pixels;
+}
+
+static void
+test_fade (GRand *rand,
+           gint   width,
+           gint   height,
+           gint   n_channels)
+{
+  gint rowstride = (width * n_channels + 3) & ~3;
+  guchar *original = make_image (rand, rowstride, height, n_channels);
+  guchar *expected = g_memdup (original, rowstride * height);
+  guchar *fast = g_memdup (original, rowstride * height);
+  guchar *portable = g_memdup (original, rowstride * height);
+  gint x, y, max_error = 0;
+
+  reference_fade (expected, width, height, rowstride, n_channels);
+
+  _cinnamon_image_ops_set_use_simd (TRUE);
+  _cinnamon_image_fade_horizontal (fast, width, height, rowstride, n_channels, width / 2);
+
+  _cinnamon_image_ops_set_use_simd (FALSE);
+  _cinnamon_image_fade_horizontal (portable, width, height, rowstride, n_channels, width / 2);
+
+  if (memcmp (fast, portable, rowstride * height) != 0)
+    {
+      g_print ("fade %dx%d (%d channels): SIMD and portable results differ\n",
+               width, height, n_channels);
+      fail = TRUE;
+    }
+
+  for (y = 0; y < height; y++)
+    {
+      for (x = 0; x < width * n_channels; x++)
+        max_error = MAX (max_error, abs (fast[y * rowstride + x] - expected[y * rowstride + x]));
+
+      if (memcmp (fast + y * rowstride + width * n_channels,
+                  original + y * rowstride + width * n_channels,
+                  rowstride - width * n_channels) != 0)
+        {
+          g_print ("fade %dx%d (%d channels): row padding was modified\n",
+                   width, height, n_channels);
+          fail = TRUE;
+        }
+    }
+
+  if (max_error > MAX_FADE_ERROR)
+    {
+      g_print ("fade %dx%d (%d channels): max error %d\n",
+               width, height, n_channels, max_error);
+      fail = TRUE;
+    }
+
+  g_free (original);
+  g_free (expected);
+  g_free (fast);
+  g_free (portable);
+}
+
+static void
+benchmark_fade (gint size)
+{
+  GRand *rand = g_rand_new_with_seed (42);
+  gint rowstride = size * 4;
+  guchar *original = make_image (rand, rowstride, size, 4);
+  guchar *pixels = g_malloc (rowstride * size);
+  gint64 start, reference_time, portable_time, fast_time;
+  const int iterations = 2000;
+  int i;
+
+  /* Each iteration copies the icon, like the callers do */
+  start = g_get_monotonic_time ();
+  for (i = 0; i < iterations; i++)
+    {
+      memcpy (pixels, original, rowstride * size);
+      reference_fade (pixels, size, size, rowstride, 4);
+    }
+  reference_time = g_get_monotonic_time () - start;
+
+  _cinnamon_image_ops_set_use_simd (FALSE);
+  start = g_get_monotonic_time ();
+  for (i = 0; i < iterations; i++)
+    {
+      memcpy (pixels, original, rowstride * size);
+      _cinnamon_image_fade_horizontal (pixels, size, size, rowstride, 4, size / 2);
+    }
+  portable_time = g_get_monotonic_time () - start;
+
+  _cinnamon_image_ops_set_use_simd (TRUE);
+  start = g_get_monotonic_time ();
+  for (i = 0; i < iterations; i++)
+    {
+      memcpy (pixels, original, rowstride * size);
+      _cinnamon_image_fade_horizontal (pixels, size, size, rowstride, 4, size / 2);
+    }
+  fast_time = g_get_monotonic_time () - start;
+
+  g_print ("fade %3dx%-3d: columns %6.2fus, rows %6.2fus, rows+simd %6.2fus\n",
+           size, size,
+           (double) reference_time / iterations,
+           (double) portable_time / iterations,
+           (double) fast_time / iterations);
+
+  g_free (original);
+  g_free (pixels);
+  g_rand_free (rand);
+}
+
+int
+main (int argc, char **argv)
+{
+  static const gint sizes[] = { 1, 2, 7, 16, 22, 24, 33, 48, 64, 96, 128 };
+  GRand *rand;
+  guint i;
+
+  if (argc > 1 && strcmp (argv[1], "--benchmark") == 0)
+    {
+      for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+        if (sizes[i] >= 16)
+          benchmark_fade (sizes[i]);
+      return 0;
+    }
+
+  rand = g_rand_new_with_seed (42);
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    {
+      test_fade (rand, sizes[i], sizes[i], 4);
+      test_fade (rand, sizes[i], sizes[i], 3);
+      test_fade (rand, sizes[i], 5, 3);
+    }
+
+  g_rand_free (rand);
+
+  return fail ? 1 : 0;
+}